@@ -53,11 +53,29 @@ namespace netstack
     std::mutex kWaitArpReplyMutex; // 用于上面的锁
     using WaitArpReply = std::map<WaitArpRelpyKey, WaitArpReplyVal*>;
 
+    // key: 正在解析的ip,   value: 上一次发送arp请求的时间. 用来限制非阻塞查询发送请求的频率
+    static std::map<uint32_t, std::chrono::steady_clock::time_point> kArpSolicitMap;
+    #define ARP_SOLICIT_INTERVAL_MS     (1000)
+
 
 
 
 
 ////////////////////////////////////////////////////////////////// 函数
+    // 获取arp缓存表的自旋锁
+    static void ArpCacheLock()
+    {
+        pthread_t self = pthread_self();
+        pthread_t old = 0;
+        while (!kArpAtomicFlag.compare_exchange_weak(old, self, std::memory_order_acquire))
+            old = 0;
+    }
+
+    static void ArpCacheUnlock()
+    {
+        kArpAtomicFlag.store(0, std::memory_order_release);
+    }
+
     bool IsFreeArp(Arp* arp)
     {
         for (int i = 0; i < 6; i++)
@@ -247,15 +265,13 @@ namespace netstack
         
         ArpCache cache;
         {
-            pthread_t old = 0;
-            pthread_t self = pthread_self();
-            while (!kArpAtomicFlag.compare_exchange_strong(old, self, std::memory_order_acquire));
+            ArpCacheLock();
 
             auto ret = kArpCaches.find(*(uint32_t*)in_need_ip);
             if (ret != kArpCaches.end())
                 cache = ret->second;
 
-            kArpAtomicFlag.store(0, std::memory_order_release); // 释放自旋锁
+            ArpCacheUnlock();
         }
 
         if (cache.is_invalid)    // 找不到这个ip的mac地址
@@ -293,6 +309,51 @@ namespace netstack
 
 
 
+    /**
+     * @brief 非阻塞地查询ip对应的mac地址,给转发路径使用.
+     *        缓存中没有时发送一个arp请求(限制频率),不等待响应直接返回
+     * 
+     * @param iface 发送arp请求的网卡
+     * @param ip 需要查询的ip(网络字节序)
+     * @param out_mac 
+     * @return NetErr_t NET_ERR_OK: 获取成功; NET_ERR_EMPTY: 缓存中没有,已经发送请求
+     */
+    NetErr_t ArpLookup(NetInterface* iface, uint32_t ip, uint8_t out_mac[6])
+    {
+        using namespace std::chrono;
+        bool solicit = false;
+        ArpCacheLock();
+        auto it = kArpCaches.find(ip);
+        if (it != kArpCaches.end() && !it->second.is_invalid)
+        {
+            memcpy(out_mac, it->second.mac, 6);
+            ArpCacheUnlock();
+            return NET_ERR_OK;
+        }
+
+        auto now = steady_clock::now();
+        auto solicit_it = kArpSolicitMap.find(ip);
+        if (solicit_it == kArpSolicitMap.end() || 
+            now - solicit_it->second >= milliseconds(ARP_SOLICIT_INTERVAL_MS))
+        {
+            kArpSolicitMap[ip] = now;
+            solicit = true;
+        }
+        ArpCacheUnlock();
+
+        if (solicit)
+        {
+            std::shared_ptr<PacketBuffer> pkt = std::make_shared<PacketBuffer>(sizeof(Arp));
+            Arp* arp = pkt->GetObjectPtr<Arp>();
+            NetInfo* info = iface->GetNetInfo();
+            MakeRequstArp(arp, info->ip, info->mac, (uint8_t*)&ip);
+            ArpHost2Network(arp);
+            EtherPush(pkt, TYPE_ARP, iface, nullptr);
+        }
+        return NET_ERR_EMPTY;
+    }
+
+
     void HandleFreeArp(Arp* arp)
     {
 
@@ -328,26 +389,24 @@ namespace netstack
                 });
                 
                 if (it != kWaitArpReplyMap.end())   // 表示有线程正在等待这个arp响应包
+                {
                     memcpy(it->second->mac, arp->src_hwaddr, 6);
-                WaitArpReplyVal* val = it->second;
-                kWaitArpReplyMap.erase(it->first);
-                lock.unlock();
+                    WaitArpReplyVal* val = it->second;
+                    kWaitArpReplyMap.erase(it);
+                    lock.unlock();
 
-                val->flag.store(true, std::memory_order_release);
+                    val->flag.store(true, std::memory_order_release);
+                }
             }
         }
         
-        pthread_t old = 0;
-        pthread_t self = pthread_self();
-    // 获取自旋锁
-        while (!kArpAtomicFlag.compare_exchange_strong(old, self));
-    
     // 设置arp缓存表
         ArpCache cache;
         cache.SetMac(arp->src_hwaddr);
+        ArpCacheLock();
         kArpCaches[*(uint32_t*)arp->src_ipaddr] = cache;
-    // 释放锁
-        kArpAtomicFlag.store(0, std::memory_order_release);
+        kArpSolicitMap.erase(*(uint32_t*)arp->src_ipaddr);
+        ArpCacheUnlock();
     }
     
     /**
@@ -0,0 +1,167 @@
+#include "checksum.h"
+#include "net_err.h"
+#include "packet_buffer.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+
+namespace netstack
+{
+    uint32_t ChecksumPartial(const void* data, size_t size, uint32_t sum)
+    {
+        const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+        uint64_t acc = sum;
+
+        // 按16位字累加,使用64位累加器避免频繁处理进位
+        while (size >= 2)
+        {
+            uint16_t word;
+            memcpy(&word, ptr, sizeof(word));
+            acc += word;
+            ptr += 2;
+            size -= 2;
+        }
+        // 奇数长度,最后一个字节补0
+        if (size)
+        {
+            uint16_t word = 0;
+            memcpy(&word, ptr, 1);
+            acc += word;
+        }
+
+        while (acc >> 32)
+            acc = (acc & 0xffffffff) + (acc >> 32);
+        return static_cast<uint32_t>(acc);
+    }
+
+    uint16_t ChecksumFold(uint32_t sum)
+    {
+        while (sum >> 16)
+            // 低16位与溢出部分重新累加
+            sum = (sum & 0xffff) + (sum >> 16);
+        return static_cast<uint16_t>(sum);
+    }
+
+    uint16_t Checksum16(const void* data, size_t size)
+    {
+        return static_cast<uint16_t>(~ChecksumFold(ChecksumPartial(data, size)));
+    }
+
+    uint32_t ChecksumPseudoHdr(uint32_t src_ip, uint32_t dst_ip, uint8_t proto, uint16_t len)
+    {
+        uint64_t sum = 0;
+        sum += (src_ip & 0xffff) + (src_ip >> 16);
+        sum += (dst_ip & 0xffff) + (dst_ip >> 16);
+        sum += htons(static_cast<uint16_t>(proto));
+        sum += htons(len);
+        while (sum >> 32)
+            sum = (sum & 0xffffffff) + (sum >> 32);
+        return static_cast<uint32_t>(sum);
+    }
+
+    uint32_t ChecksumPacket(PacketBuffer& pkt, size_t offset, size_t size, uint32_t sum)
+    {
+        bool odd = false;   // 之前累加的字节数是否为奇数
+        for (PacketBlock* block : pkt.GetBlocks())
+        {
+            if (size == 0)
+                break;
+            size_t block_size = block->DataSize();
+            if (offset >= block_size)
+            {
+                offset -= block_size;
+                continue;
+            }
+
+            size_t len = std::min(block_size - offset, size);
+            const uint8_t* data = (const uint8_t*)block->GetDataPtr() + offset;
+            uint16_t part = ChecksumFold(ChecksumPartial(data, len));
+            // 从奇数位置开始的一段,高低字节的位置正好互换了(RFC 1071)
+            if (odd)
+                part = static_cast<uint16_t>((part << 8) | (part >> 8));
+            sum = ChecksumFold(sum) + part;
+
+            odd ^= (len & 1);
+            size -= len;
+            offset = 0;
+        }
+
+        return sum;
+    }
+
+    uint16_t ChecksumIncUpdate(uint16_t csum, uint16_t old_val, uint16_t new_val)
+    {
+        // HC' = ~(~HC + ~m + m')
+        uint32_t sum = static_cast<uint16_t>(~csum);
+        sum += static_cast<uint16_t>(~old_val);
+        sum += new_val;
+        return static_cast<uint16_t>(~ChecksumFold(sum));
+    }
+
+    uint16_t ChecksumIncUpdate32(uint16_t csum, uint32_t old_val, uint32_t new_val)
+    {
+        csum = ChecksumIncUpdate(csum, old_val & 0xffff, new_val & 0xffff);
+        return ChecksumIncUpdate(csum, old_val >> 16, new_val >> 16);
+    }
+
+    NetErr_t CsumFinalize(PacketBuffer& pkt)
+    {
+        if (pkt.GetCsumState() != CSUM_PARTIAL)
+            return NET_ERR_OK;
+
+        size_t start = pkt.CsumStart();
+        size_t field = start + pkt.CsumOffset();
+        size_t data_size = pkt.DataSize();
+        if (start >= data_size || field + sizeof(uint16_t) > data_size)
+            return NET_ERR_PARAM;
+
+        // 校验和字段中已经预先填好了伪首部的部分和,直接参与累加即可
+        uint16_t csum = static_cast<uint16_t>(
+            ~ChecksumFold(ChecksumPacket(pkt, start, data_size - start)));
+        if (csum == 0)  // 0表示没有校验和(UDP),使用等价的0xffff
+            csum = 0xffff;
+
+        pkt.WriteAt(field, (const unsigned char*)&csum, sizeof(csum));
+        pkt.ClearCsum();
+        return NET_ERR_OK;
+    }
+
+    void CsumToVnetHdr(PacketBuffer& pkt, VnetHdr* vnet_hdr)
+    {
+        memset(vnet_hdr, 0, sizeof(*vnet_hdr));
+        vnet_hdr->gso_type = VNET_HDR_GSO_NONE;
+        if (pkt.GetCsumState() == CSUM_PARTIAL)
+        {
+            vnet_hdr->flags = VNET_HDR_F_NEEDS_CSUM;
+            vnet_hdr->csum_start = static_cast<uint16_t>(pkt.CsumStart());
+            vnet_hdr->csum_offset = static_cast<uint16_t>(pkt.CsumOffset());
+        }
+
+        // 分段卸载交给后端(内核)切分. 传输层头部长度: UDP固定8字节,TCP读取数据偏移
+        if (pkt.GetGsoType() != GSO_NONE && pkt.GetCsumState() == CSUM_PARTIAL)
+        {
+            size_t l4_hdr_len = 8;
+            if (pkt.GetGsoType() == GSO_TCPV4)
+            {
+                uint8_t data_offset = 0;
+                pkt.ReadAt(pkt.CsumStart() + 12, &data_offset, 1);
+                l4_hdr_len = (data_offset >> 4) * 4;
+            }
+            vnet_hdr->gso_type = pkt.GetGsoType() == GSO_UDP_L4 ? 
+                VNET_HDR_GSO_UDP_L4 : VNET_HDR_GSO_TCPV4;
+            vnet_hdr->gso_size = static_cast<uint16_t>(pkt.GsoSize());
+            vnet_hdr->hdr_len = static_cast<uint16_t>(pkt.CsumStart() + l4_hdr_len);
+        }
+    }
+
+    void CsumFromVnetHdr(const VnetHdr* vnet_hdr, PacketBuffer& pkt)
+    {
+        // NEEDS_CSUM 说明是本机发出来的数据包,还没有计算校验和,内容本身是可信的
+        if (vnet_hdr->flags & (VNET_HDR_F_DATA_VALID | VNET_HDR_F_NEEDS_CSUM))
+            pkt.SetCsumVerified();
+        else
+            pkt.ClearCsum();
+    }
+}
@@ -20,6 +20,27 @@ namespace netstack
      * @param pkt 
      * @return NetErr_t 
      */
+    /**
+     * @brief 根据目的mac地址判断数据包的类型. 网卡工作在混杂模式下,
+     *        会抓到局域网内发给其他主机的帧
+     * 
+     * @param dst_mac 
+     * @return PktType 
+     */
+    static PktType EtherPktType(const uint8_t dst_mac[6])
+    {
+        static const uint8_t kBroadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+        if (dst_mac[0] & 0x01)
+            return memcmp(dst_mac, kBroadcast, 6) == 0 ? PKT_BROADCAST : PKT_MULTICAST;
+
+        for (auto& netif : kNetifacesMap)
+        {
+            if (memcmp(dst_mac, netif.second->GetNetInfo()->mac, 6) == 0)
+                return PKT_HOST;
+        }
+        return PKT_OTHERHOST;
+    }
+
     NetErr_t CheckEtherFrame(std::shared_ptr<PacketBuffer>& pkt)
     {
     // 1. 判断数据大小满足帧的大小,以太网帧最小64字节
@@ -88,6 +109,62 @@ namespace netstack
 
 
 
+    NetErr_t EtherPushBatch(std::vector<std::shared_ptr<PacketBuffer>>& pkts, PROTO_TYPE type, 
+        NetInterface* src_iface, NetInfo* dst_iface_info)
+    {
+        uint8_t dst_mac[6];
+        if (type == TYPE_IPV4)
+            memcpy(dst_mac, dst_iface_info->mac, sizeof(dst_mac));
+        else
+            memset(dst_mac, 0xff, sizeof(dst_mac));
+        return EtherPushBatch(pkts, type, src_iface, dst_mac);
+    }
+
+    NetErr_t EtherPushBatch(std::vector<std::shared_ptr<PacketBuffer>>& pkts, PROTO_TYPE type, 
+        NetInterface* src_iface, const uint8_t dst_mac[6])
+    {
+        // 同一批数据包的以太网头部都相同,只构建一次
+        EtherHdr ether_hdr;
+        memcpy(ether_hdr.src_addr, src_iface->GetNetInfo()->mac, sizeof(ether_hdr.src_addr));
+        memcpy(ether_hdr.dst_addr, dst_mac, sizeof(ether_hdr.dst_addr));
+        ether_hdr.protocol = htons(type);
+
+        for (auto& pkt : pkts)
+        {
+            if (pkt->DataSize() < 46)
+                pkt->FillTail(46 - pkt->DataSize());
+            pkt->AddHeader(sizeof(EtherHdr), (const unsigned char*)&ether_hdr);
+        }
+
+        return src_iface->NetTxBatch(pkts);
+    }
+
+
+    /**
+     * @brief 转发数据包: 重新写入以太网头部后直接从出口网卡发送.
+     *        接收时去掉的以太网头部空间还在,这里会原地覆盖,不用分配内存
+     * 
+     * @param pkt 
+     * @param send_iface 出口网卡
+     * @param dst_mac 下一跳的mac地址
+     * @return NetErr_t 
+     */
+    NetErr_t EtherForward(std::shared_ptr<PacketBuffer> pkt, NetInterface* send_iface, 
+        const uint8_t dst_mac[6])
+    {
+        EtherHdr ether_hdr;
+        memcpy(ether_hdr.dst_addr, dst_mac, sizeof(ether_hdr.dst_addr));
+        memcpy(ether_hdr.src_addr, send_iface->GetNetInfo()->mac, sizeof(ether_hdr.src_addr));
+        ether_hdr.protocol = htons(TYPE_IPV4);
+
+        if (pkt->DataSize() < 46)
+            pkt->FillTail(46 - pkt->DataSize());
+        pkt->AddHeader(sizeof(EtherHdr), (const unsigned char*)&ether_hdr);
+
+        return send_iface->NetTx(pkt);
+    }
+
+
     /**
      * @brief 提供给下层的接口,也就是解封装数据包,如果合法则传递给上层
      * 
@@ -104,13 +181,9 @@ namespace netstack
         }
 
         EtherHdr* hdr = pkt->GetObjectPtr<EtherHdr>();
-        uint16_t p = hdr->protocol;
-        if (p == TYPE_ARP)
-        {
-            printf("是Arp响应包\n");
-        }
         hdr->protocol = ntohs(hdr->protocol);
         uint16_t protocol = hdr->protocol;
+        pkt->SetPktType(EtherPktType(hdr->dst_addr));
 
     // 去掉以太网的头和尾部
         pkt->RemoveHeader(sizeof(EtherHdr));
@@ -1,7 +1,9 @@
 #include "event_loop.h"
 #include "net_interface.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <ctime>
 #include <sys/epoll.h>
 #include <vector>
 #include <unistd.h>
@@ -11,8 +13,18 @@ namespace netstack
 {
     extern std::map<uint32_t, NetInterface*> kNetifacesMap;
 
+    static uint64_t EventLoopNowNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
     RecvEventLoop::RecvEventLoop(ThreadPool& pool)
-        : epollfd_(-1), start_(false), pool_(pool)
+        : epollfd_(-1), start_(false), pool_(pool), busy_poll_(false),
+        budget_us_(BUSY_POLL_DEFAULT_BUDGET_US), adaptive_(true), avg_gap_ns_(0),
+        poll_ns_(0), sleep_ns_(0), polls_(0), poll_hits_(0), wakeups_(0),
+        poll_enters_(0), poll_skips_(0)
     {
         
     }
@@ -26,7 +38,10 @@ namespace netstack
         if (epollfd_ != -1)
         {
             for (auto& netif : kNetifacesMap)
-                epoll_ctl(epollfd_, EPOLL_CTL_DEL, netif.second->GetFd(), nullptr);
+            {
+                if (netif.second->GetFd() != -1)
+                    epoll_ctl(epollfd_, EPOLL_CTL_DEL, netif.second->GetFd(), nullptr);
+            }
             close(epollfd_);
         }
     }
@@ -59,34 +74,141 @@ namespace netstack
         event.events = EPOLLIN; // 可读事件
         for (auto& netif : kNetifacesMap)
         {
+            if (netif.second->GetFd() == -1)    // 没有可以等待的设备(比如回放网卡)
+                continue;
             event.data.ptr = netif.second;
             if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, netif.second->GetFd(), &event) == -1)
             {
                 perror("epoll_ctl ADD failed: ");
                 return false;
             }
+            ifaces_.push_back(netif.second);
         }
         
         return true;
     }
     
 
+    void RecvEventLoop::SetBusyPoll(const BusyPollOptions& opts)
+    {
+        budget_us_ = opts.budget_us;
+        adaptive_ = opts.adaptive;
+        busy_poll_ = opts.enable;
+    }
+
+    BusyPollOptions RecvEventLoop::GetBusyPoll() const
+    {
+        BusyPollOptions opts;
+        opts.enable = busy_poll_;
+        opts.budget_us = budget_us_;
+        opts.adaptive = adaptive_;
+        return opts;
+    }
+
+    BusyPollStats RecvEventLoop::GetBusyPollStats() const
+    {
+        BusyPollStats stats;
+        stats.poll_ns = poll_ns_;
+        stats.sleep_ns = sleep_ns_;
+        stats.polls = polls_;
+        stats.poll_hits = poll_hits_;
+        stats.wakeups = wakeups_;
+        stats.poll_enters = poll_enters_;
+        stats.poll_skips = poll_skips_;
+        stats.avg_gap_ns = avg_gap_ns_;
+        return stats;
+    }
+
+    /**
+     * @brief 从网卡读取一批并存入到接收队列中. 网卡已经有处理任务时不再提交,
+     *        同一个网卡的数据包只在一个线程上按顺序处理(GRO 依赖这一点)
+     *
+     * @param iface
+     * @return int 读取到的个数
+     */
+    int RecvEventLoop::ReadInterface(NetInterface* iface)
+    {
+        int cnt = iface->NetRx();
+        if (cnt == 0)   // 没有数据或者队列满了,但是这种情况很小
+            return 0;
+        if (iface->RxScheduleTask())
+            pool_.SubmitTask(HandleRecvPktCallback, iface);
+        return cnt;
+    }
+
+    void RecvEventLoop::RecordArrival(uint64_t now)
+    {
+        if (last_arrival_ns_ != 0)
+        {
+            uint64_t gap = now - last_arrival_ns_;
+            uint64_t avg = avg_gap_ns_.load(std::memory_order_relaxed);
+            avg = avg - (avg >> BUSY_POLL_GAP_SHIFT) + (gap >> BUSY_POLL_GAP_SHIFT);
+            avg_gap_ns_.store(avg, std::memory_order_relaxed);
+        }
+        last_arrival_ns_ = now;
+    }
+
+    /**
+     * @brief 不停地读取所有网卡,直到超过 budget_us 没有读取到数据包
+     *
+     */
+    void RecvEventLoop::BusyPoll()
+    {
+        uint64_t budget_ns = budget_us_ * 1000ULL;
+        uint64_t start = EventLoopNowNs();
+        uint64_t last = start;
+        uint64_t now = start;
+        uint64_t polls = 0;
+        uint64_t hits = 0;
+        while (start_ && busy_poll_ && now - last <= budget_ns)
+        {
+            int cnt = 0;
+            for (NetInterface* iface : ifaces_)
+                cnt += ReadInterface(iface);
+            polls++;
+            now = EventLoopNowNs();
+            if (cnt > 0)
+            {
+                hits++;
+                RecordArrival(now);
+                last = now;
+            }
+        }
+        polls_ += polls;
+        poll_hits_ += hits;
+        poll_ns_ += now - start;
+    }
+
     void RecvEventLoop::ThreadFunc()
     {
-        std::vector<struct epoll_event> events(kNetifacesMap.size());
+        std::vector<struct epoll_event> events(std::max<size_t>(ifaces_.size(), 1));
         while (start_)
         {
-            int nfds = epoll_wait(epollfd_, events.data(), 10, -1);
+            uint64_t t0 = EventLoopNowNs();
+            int nfds = epoll_wait(epollfd_, events.data(), events.size(), -1);
+            uint64_t t1 = EventLoopNowNs();
+            sleep_ns_ += t1 - t0;
             if (nfds == -1)
                 continue;
+            wakeups_++;
+
+            int cnt = 0;
             for (int i = 0; i < nfds; i++)
+                cnt += ReadInterface(reinterpret_cast<NetInterface*>(events[i].data.ptr));
+            if (cnt == 0)
+                continue;
+            RecordArrival(t1);
+
+            if (!busy_poll_)
+                continue;
+            // 到达稀疏时轮询大概率等不到下一批,直接睡眠
+            if (adaptive_ && avg_gap_ns_ > budget_us_ * 1000ULL)
             {
-                NetInterface* iface = reinterpret_cast<NetInterface*>(events[i].data.ptr);
-                if (iface->NetRx() == false)     // 从网卡读取并存入到接收队列中,
-                    continue;   // 读取失败因为队列满了,但是这种情况很小
-                
-                pool_.SubmitTask(HandleRecvPktCallback, iface);
+                poll_skips_++;
+                continue;
             }
+            poll_enters_++;
+            BusyPoll();
         }
     }
 
@@ -0,0 +1,147 @@
+#include "gso.h"
+#include "checksum.h"
+#include "ether.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "net_type.h"
+#include "tcp.h"
+#include "udp.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstddef>
+
+namespace netstack
+{
+    /**
+     * @brief UDP分段: 每段都是一个完整的UDP数据报,ipv4标识依次加1
+     * 
+     * @param pkt 
+     * @param hdr_buf 以太网 + ipv4 + UDP 头部
+     * @param l3_offset ipv4头部的位置
+     * @param segs 
+     * @return NetErr_t 
+     */
+    static NetErr_t GsoSegmentUdp(std::shared_ptr<PacketBuffer>& pkt, unsigned char* hdr_buf, 
+        size_t l3_offset, std::vector<std::shared_ptr<PacketBuffer>>& segs)
+    {
+        IPV4_Hdr* ip_hdr = reinterpret_cast<IPV4_Hdr*>(hdr_buf + l3_offset);
+        size_t l4_offset = l3_offset + ip_hdr->HeaderLen();
+        size_t hdr_len = l4_offset + sizeof(UdpHdr);
+        UdpHdr* udp_hdr = reinterpret_cast<UdpHdr*>(hdr_buf + l4_offset);
+        if (pkt->ReadAt(l4_offset, (unsigned char*)udp_hdr, sizeof(UdpHdr)) != 0)
+            return NET_ERR_SIZE;
+
+        size_t payload = pkt->DataSize() - hdr_len;
+        size_t gso_size = pkt->GsoSize();
+        uint16_t id = ntohs(ip_hdr->identification);
+        segs.reserve((payload + gso_size - 1) / gso_size);
+
+        for (size_t offset = 0; offset < payload; offset += gso_size, id++)
+        {
+            size_t seg_size = std::min(gso_size, payload - offset);
+            std::shared_ptr<PacketBuffer> seg = pkt->Slice(hdr_len + offset, seg_size);
+            if (seg == nullptr)
+                return NET_ERR_SIZE;
+
+            uint16_t udp_len = sizeof(UdpHdr) + seg_size;
+            ip_hdr->total_length = htons(ip_hdr->HeaderLen() + udp_len);
+            ip_hdr->identification = htons(id);
+            ip_hdr->head_checksum = 0;
+            ip_hdr->head_checksum = Checksum16(ip_hdr, ip_hdr->HeaderLen());
+
+            udp_hdr->length = htons(udp_len);
+            udp_hdr->checksum = ChecksumFold(ChecksumPseudoHdr(ip_hdr->src_ipaddr, 
+                ip_hdr->dst_ipaddr, TYPE_UDP, udp_len));
+
+            seg->AddHeader(hdr_len, hdr_buf);
+            seg->SetCsumPartial(l4_offset, offsetof(UdpHdr, checksum));
+            segs.push_back(seg);
+        }
+
+        return NET_ERR_OK;
+    }
+
+    /**
+     * @brief TCP分段(TSO): 每段的序号依次增加,FIN和PSH只留在最后一段,ipv4标识依次加1
+     * 
+     * @param pkt 
+     * @param hdr_buf 以太网 + ipv4 + TCP 头部(包括选项)
+     * @param l3_offset ipv4头部的位置
+     * @param segs 
+     * @return NetErr_t 
+     */
+    static NetErr_t GsoSegmentTcp(std::shared_ptr<PacketBuffer>& pkt, unsigned char* hdr_buf, 
+        size_t l3_offset, std::vector<std::shared_ptr<PacketBuffer>>& segs)
+    {
+        IPV4_Hdr* ip_hdr = reinterpret_cast<IPV4_Hdr*>(hdr_buf + l3_offset);
+        size_t l4_offset = l3_offset + ip_hdr->HeaderLen();
+        TcpHdr* tcp_hdr = reinterpret_cast<TcpHdr*>(hdr_buf + l4_offset);
+        if (pkt->ReadAt(l4_offset, (unsigned char*)tcp_hdr, sizeof(TcpHdr)) != 0)
+            return NET_ERR_SIZE;
+        size_t tcp_hdr_len = tcp_hdr->HeaderLen();
+        size_t hdr_len = l4_offset + tcp_hdr_len;
+        if (tcp_hdr_len < sizeof(TcpHdr) || hdr_len > pkt->DataSize() ||
+            pkt->ReadAt(l4_offset, (unsigned char*)tcp_hdr, tcp_hdr_len) != 0)
+            return NET_ERR_SIZE;
+
+        size_t payload = pkt->DataSize() - hdr_len;
+        size_t gso_size = pkt->GsoSize();
+        uint16_t id = ntohs(ip_hdr->identification);
+        uint32_t seq = ntohl(tcp_hdr->seq);
+        uint8_t flags = tcp_hdr->flags;
+        segs.reserve((payload + gso_size - 1) / gso_size);
+
+        for (size_t offset = 0; offset < payload; offset += gso_size, id++)
+        {
+            size_t seg_size = std::min(gso_size, payload - offset);
+            std::shared_ptr<PacketBuffer> seg = pkt->Slice(hdr_len + offset, seg_size);
+            if (seg == nullptr)
+                return NET_ERR_SIZE;
+
+            uint16_t tcp_len = tcp_hdr_len + seg_size;
+            ip_hdr->total_length = htons(ip_hdr->HeaderLen() + tcp_len);
+            ip_hdr->identification = htons(id);
+            ip_hdr->head_checksum = 0;
+            ip_hdr->head_checksum = Checksum16(ip_hdr, ip_hdr->HeaderLen());
+
+            bool last = offset + seg_size == payload;
+            tcp_hdr->seq = htonl(seq + static_cast<uint32_t>(offset));
+            tcp_hdr->flags = last ? flags : flags & ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+            tcp_hdr->checksum = ChecksumFold(ChecksumPseudoHdr(ip_hdr->src_ipaddr, 
+                ip_hdr->dst_ipaddr, TYPE_TCP, tcp_len));
+
+            seg->AddHeader(hdr_len, hdr_buf);
+            seg->SetCsumPartial(l4_offset, offsetof(TcpHdr, checksum));
+            segs.push_back(seg);
+        }
+
+        return NET_ERR_OK;
+    }
+
+    NetErr_t GsoSegment(std::shared_ptr<PacketBuffer>& pkt, std::vector<std::shared_ptr<PacketBuffer>>& segs)
+    {
+        // 以太网头部 + 最长的ipv4头部 + 最长的传输层头部
+        unsigned char hdr_buf[sizeof(EtherHdr) + 60 + 60];
+        size_t l3_offset = sizeof(EtherHdr);
+        if (pkt->GsoSize() == 0 || 
+            pkt->ReadAt(0, hdr_buf, l3_offset + sizeof(IPV4_Hdr)) != 0)
+            return NET_ERR_PARAM;
+
+        IPV4_Hdr* ip_hdr = reinterpret_cast<IPV4_Hdr*>(hdr_buf + l3_offset);
+        size_t ip_hdr_len = ip_hdr->HeaderLen();
+        if (ip_hdr_len < sizeof(IPV4_Hdr) ||
+            pkt->ReadAt(l3_offset, hdr_buf + l3_offset, ip_hdr_len) != 0)
+            return NET_ERR_PARAM;
+
+        switch (pkt->GetGsoType())
+        {
+            case GSO_UDP_L4:
+                return GsoSegmentUdp(pkt, hdr_buf, l3_offset, segs);
+            case GSO_TCPV4:
+                return GsoSegmentTcp(pkt, hdr_buf, l3_offset, segs);
+            default:
+                return NET_ERR_NO_OPS;
+        }
+    }
+}
@@ -1,30 +1,369 @@
 #include "icmp.h"
+#include "arp.h"
+#include "checksum.h"
+#include "ether.h"
+#include "ipv4.h"
+#include "net_type.h"
 #include "net_err.h"
+#include "net_interface.h"
+#include "routing.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#define ICMP_PEER_LOCK_CNT      (64)        // 前缀令牌桶表按下标拆分成多段,每段一把锁
 
 namespace netstack
 {
-    NetErr_t IcmpPush(uint32_t dst_ip)
+    extern std::map<uint32_t, NetInterface*> kNetifacesMap;    // 定义在net_init.cpp中
+
+    static const uint8_t kIcmpReplyTTL = 64;
+
+    struct IcmpStatsCounter
     {
+        std::atomic<uint64_t> in_msgs = 0;
+        std::atomic<uint64_t> in_errors = 0;
+        std::atomic<uint64_t> in_echos = 0;
+        std::atomic<uint64_t> out_echo_reps = 0;
+        std::atomic<uint64_t> out_errors = 0;
+        std::atomic<uint64_t> rate_limited = 0;
+        std::atomic<uint64_t> peer_limited = 0;
+        std::atomic<uint64_t> peer_evictions = 0;
+    };
+    static IcmpStatsCounter kIcmpStats;
+    static std::atomic<IcmpEchoHandler> kIcmpEchoHandler = nullptr;
 
-        return NET_ERR_OK;
+    // 令牌桶,取令牌时按经过的时间补充,不需要定时器
+    struct IcmpTokenBucket
+    {
+        bool Take(uint64_t now_us, uint32_t rate, uint32_t burst)
+        {
+            if (stamp_us != 0)
+                tokens = std::min<double>(burst, tokens + (now_us - stamp_us) * rate / 1e6);
+            stamp_us = now_us;
+            if (tokens < 1)
+                return false;
+            tokens -= 1;
+            return true;
+        }
+
+        double tokens = 0;
+        uint64_t stamp_us = 0;
+    };
+
+    // 按前缀限速的表项,哈希冲突时新的前缀直接替换旧的,从满的令牌桶开始
+    struct IcmpPeerBucket
+    {
+        uint32_t prefix = 0;
+        bool used = false;
+        IcmpTokenBucket bucket;
+    };
+
+    static std::mutex kIcmpRateMutex;
+    static IcmpTokenBucket kIcmpGlobalBucket = { ICMP_ERR_BURST, 0 };
+    static IcmpPeerBucket kIcmpPeerTable[ICMP_PEER_TABLE_SIZE];
+    static std::mutex kIcmpPeerMutex[ICMP_PEER_LOCK_CNT];
+    static std::atomic<int> kIcmpPeerPrefixLen = ICMP_PEER_PREFIX_LEN;
+    static std::atomic<uint32_t> kIcmpPeerRate = ICMP_PEER_RATE;
+    static std::atomic<uint32_t> kIcmpPeerBurst = ICMP_PEER_BURST;
+
+    static uint64_t IcmpNowUs()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
     }
 
+    /**
+     * @brief 差错报文的目的地址所在前缀是否还有令牌
+     * 
+     * @param dst_ip 网络字节序
+     * @param now_us 
+     * @return true 
+     * @return false 
+     */
+    static bool IcmpPeerAllowed(uint32_t dst_ip, uint64_t now_us)
+    {
+        uint32_t rate = kIcmpPeerRate.load(std::memory_order_relaxed);
+        if (rate == 0)
+            return true;
+        uint32_t burst = kIcmpPeerBurst.load(std::memory_order_relaxed);
+        int prefix_len = kIcmpPeerPrefixLen.load(std::memory_order_relaxed);
+        uint32_t prefix = prefix_len == 0 ? 0 : ntohl(dst_ip) & (~0u << (32 - prefix_len));
+
+        uint32_t hash = prefix * 0x9E3779B1u;
+        size_t index = (hash >> 16 ^ hash) & (ICMP_PEER_TABLE_SIZE - 1);
+        IcmpPeerBucket& entry = kIcmpPeerTable[index];
+        std::unique_lock<std::mutex> lock(kIcmpPeerMutex[index % ICMP_PEER_LOCK_CNT]);
+        if (!entry.used || entry.prefix != prefix)
+        {
+            if (entry.used)
+                kIcmpStats.peer_evictions.fetch_add(1, std::memory_order_relaxed);
+            entry.used = true;
+            entry.prefix = prefix;
+            entry.bucket = { static_cast<double>(burst), 0 };
+        }
+        return entry.bucket.Take(now_us, rate, burst);
+    }
 
-    NetErr_t CheckSum(ICMPv4* hdr)
+    /**
+     * @brief 差错报文是否可以发送: 先检查目的前缀,再检查全局,
+     *        这样一个前缀上的突发不会耗尽其他前缀能用的全局令牌
+     * 
+     * @param dst_ip 
+     * @return true 
+     * @return false 
+     */
+    static bool IcmpErrorAllowed(uint32_t dst_ip)
     {
+        uint64_t now = IcmpNowUs();
+        if (!IcmpPeerAllowed(dst_ip, now))
+        {
+            kIcmpStats.peer_limited.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(kIcmpRateMutex);
+        if (!kIcmpGlobalBucket.Take(now, ICMP_ERR_RATE, ICMP_ERR_BURST))
+        {
+            kIcmpStats.rate_limited.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    NetErr_t IcmpPush(uint32_t dst_ip, uint16_t id, uint16_t seq, const void* data, size_t size)
+    {
+        if (size > 0xffff - sizeof(IPV4_Hdr) - sizeof(ICMPv4_Echo) || (data == nullptr && size != 0))
+            return NET_ERR_PARAM;
+
+        // 源地址使用出口网卡的地址
+        Routing routing = GetRouting(dst_ip);
+        if (routing.iface_ == nullptr)
+            return NET_ERR_UNREACH;
+        uint32_t src_ip = *(uint32_t*)routing.iface_->GetNetInfo()->ip;
+
+        ICMPv4_Echo echo;
+        echo.hdr.type = ICMP_ECHO_REQUEST;
+        echo.hdr.code = 0;
+        echo.hdr.checksum = 0;
+        echo.id = htons(id);
+        echo.seq = htons(seq);
+        uint32_t sum = ChecksumPartial(&echo, sizeof(echo));
+        if (size)
+            sum = ChecksumPartial(data, size, sum);
+        echo.hdr.checksum = ~ChecksumFold(sum);
+
+        std::shared_ptr<PacketBuffer> pkt = std::make_shared<PacketBuffer>(sizeof(echo) + size);
+        pkt->WriteAt(0, (const unsigned char*)&echo, sizeof(echo));
+        if (size)
+            pkt->WriteAt(sizeof(echo), static_cast<const unsigned char*>(data), size);
+        return IPv4Push(pkt, src_ip, dst_ip, TYPE_ICMP);
+    }
+
+    void IcmpRegisterEchoHandler(IcmpEchoHandler handler)
+    {
+        kIcmpEchoHandler.store(handler, std::memory_order_release);
+    }
+
+    NetErr_t IcmpSendError(uint8_t type, uint8_t code, std::shared_ptr<PacketBuffer> orig_pkt, 
+        uint16_t next_hop_mtu)
+    {
+        IPV4_Hdr orig_hdr;
+        if (orig_pkt->ReadAt(0, (unsigned char*)&orig_hdr, sizeof(orig_hdr)) != 0)
+            return NET_ERR_PARAM;
+
+        // 不对ICMP差错报文、非第一个分片、广播和多播地址回复差错报文(RFC 1122)
+        uint8_t src_first = ntohl(orig_hdr.src_ipaddr) >> 24;
+        if (orig_hdr.src_ipaddr == 0 || orig_hdr.src_ipaddr == 0xffffffff || src_first >= 224)
+            return NET_ERR_PARAM;
+        if (ntohs(orig_hdr.flags_fragment) & IPV4_FRAG_OFF_MASK)
+            return NET_ERR_PARAM;
+        if (orig_hdr.protocol == TYPE_ICMP)
+        {
+            ICMPv4 orig_icmp;
+            if (orig_pkt->ReadAt(orig_hdr.HeaderLen(), (unsigned char*)&orig_icmp, sizeof(orig_icmp)) != 0 ||
+                (orig_icmp.type != ICMP_ECHO_REQUEST && orig_icmp.type != ICMP_ECHO_REPLY))
+                return NET_ERR_PARAM;
+        }
+
+        // "需要分片" 不限速,否则路径MTU发现会被拖慢(与linux相同)
+        bool pmtu = type == ICMP_DEST_UNREACHABLE && code == ICMP_FRAG_NEEDED;
+        if (!pmtu && !IcmpErrorAllowed(orig_hdr.src_ipaddr))
+            return NET_ERR_FULL;
+
+        // 差错报文的源地址使用回复方向出口网卡的地址
+        Routing routing = GetRouting(orig_hdr.src_ipaddr);
+        if (routing.iface_ == nullptr)
+            return NET_ERR_UNREACH;
+        uint32_t src_ip = *(uint32_t*)routing.iface_->GetNetInfo()->ip;
+
+        // 携带原始数据报的ipv4头部和前8字节数据
+        size_t quote_size = std::min<size_t>(orig_pkt->DataSize(), orig_hdr.HeaderLen() + 8);
+        size_t size = sizeof(ICMPv4_Unreach) + quote_size;
+        std::shared_ptr<PacketBuffer> pkt = std::make_shared<PacketBuffer>(size);
+        unsigned char buf[sizeof(ICMPv4_Unreach) + 60 + 8];
+        ICMPv4_Unreach* icmp = reinterpret_cast<ICMPv4_Unreach*>(buf);
+        icmp->hdr.type = type;
+        icmp->hdr.code = code;
+        icmp->hdr.checksum = 0;
+        icmp->unused = 0;
+        icmp->next_hop_mtu = htons(next_hop_mtu);
+        orig_pkt->ReadAt(0, buf + sizeof(ICMPv4_Unreach), quote_size);
+        icmp->hdr.checksum = Checksum16(buf, size);
+        pkt->Write(buf, size, true);
 
+        kIcmpStats.out_errors.fetch_add(1, std::memory_order_relaxed);
+        return IPv4Push(pkt, src_ip, orig_hdr.src_ipaddr, TYPE_ICMP);
+    }
+
+
+    NetErr_t CheckSum(PacketBuffer& pkt)
+    {
+        if (pkt.CsumVerified())
+            return NET_ERR_OK;
+        // 校验和覆盖整个ICMP报文,包括校验和字段在内累加的结果应该是全1
+        if (ChecksumFold(ChecksumPacket(pkt, 0, pkt.DataSize())) != 0xffff)
+            return NET_ERR_CHECKSUM;
         return NET_ERR_OK;
     }
 
-    void IcmpPop(std::shared_ptr<PacketBuffer> pkt)
+    /**
+     * @brief 处理目的不可达报文. 目前只处理 "需要分片",用来降低路径MTU
+     * 
+     * @param pkt 
+     */
+    static void IcmpUnreachable(std::shared_ptr<PacketBuffer>& pkt)
     {
-        ICMPv4* hdr = pkt->GetObjectPtr<ICMPv4>();
-        if (CheckSum(hdr) != NET_ERR_OK)
+        ICMPv4_Unreach unreach;
+        IPV4_Hdr orig_hdr;
+        if (pkt->ReadAt(0, (unsigned char*)&unreach, sizeof(unreach)) != 0 ||
+            pkt->ReadAt(sizeof(unreach), (unsigned char*)&orig_hdr, sizeof(orig_hdr)) != 0)
+            return;
+
+        if (unreach.hdr.code != ICMP_FRAG_NEEDED)
+            return;
+        // 原始数据报必须是本机发出去的,避免伪造的报文随意修改路径MTU
+        if (kNetifacesMap.find(orig_hdr.src_ipaddr) == kNetifacesMap.end())
+            return;
+
+        UpdatePathMtu(orig_hdr.dst_ipaddr, ntohs(unreach.next_hop_mtu), 
+            ntohs(orig_hdr.total_length));
+    }
+
+    /**
+     * @brief 把回显请求原地改成应答发回去: 改类型并增量更新ICMP校验和,数据原样保留,
+     *        在接收时去掉的头部空间里写入交换了地址的ipv4头部,再直接交给以太网发送,不分配内存.
+     *        广播和多播的回显请求不回应(与linux的 icmp_echo_ignore_broadcasts 默认值相同)
+     * 
+     * @param pkt 从ICMP头部开始的请求
+     * @param ip_hdr 请求的ipv4头部
+     */
+    static void IcmpEchoReply(std::shared_ptr<PacketBuffer>& pkt, const IPV4_Hdr& ip_hdr)
+    {
+        if (kNetifacesMap.find(ip_hdr.dst_ipaddr) == kNetifacesMap.end())
+            return;
+
+        Routing routing = GetRouting(ip_hdr.src_ipaddr);
+        if (routing.iface_ == nullptr)
+            return;
+        uint32_t next_hop = (routing.flag_ & ROUTE_DEFAULT_GATEWAY) ? 
+            routing.gateway_ : ip_hdr.src_ipaddr;
+        uint8_t dst_mac[6];
+        if (ArpLookup(routing.iface_, next_hop, dst_mac) != NET_ERR_OK)
+            return;     // 邻居还没有解析,对端会重发请求
+
+        // 类型和代码组成一个16位字参与校验和计算
+        ICMPv4 icmp;
+        pkt->ReadAt(0, (unsigned char*)&icmp, sizeof(icmp));
+        uint16_t old_word, new_word;
+        memcpy(&old_word, &icmp.type, sizeof(old_word));
+        icmp.type = ICMP_ECHO_REPLY;
+        memcpy(&new_word, &icmp.type, sizeof(new_word));
+        icmp.checksum = ChecksumIncUpdate(icmp.checksum, old_word, new_word);
+        pkt->WriteAt(0, (const unsigned char*)&icmp, sizeof(icmp));
+
+        // 请求的选项(比如记录路由)不带回,应答只使用20字节的头部
+        IPV4_Hdr hdr;
+        hdr.version_length = (4 << 4) | (sizeof(IPV4_Hdr) / 4);
+        hdr.service = ip_hdr.service;
+        hdr.total_length = htons(pkt->DataSize() + sizeof(IPV4_Hdr));
+        hdr.identification = htons(ip_hdr.identification);
+        hdr.flags_fragment = 0;
+        hdr.ttl = kIcmpReplyTTL;
+        hdr.protocol = TYPE_ICMP;
+        hdr.head_checksum = 0;
+        hdr.src_ipaddr = ip_hdr.dst_ipaddr;
+        hdr.dst_ipaddr = ip_hdr.src_ipaddr;
+        hdr.head_checksum = Checksum16(&hdr, sizeof(hdr));
+        pkt->AddHeader(sizeof(hdr), (const unsigned char*)&hdr);
+
+        if (EtherForward(pkt, routing.iface_, dst_mac) == NET_ERR_OK)
+            kIcmpStats.out_echo_reps.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    IcmpStats IcmpGetStats()
+    {
+        IcmpStats stats;
+        stats.in_msgs = kIcmpStats.in_msgs.load(std::memory_order_relaxed);
+        stats.in_errors = kIcmpStats.in_errors.load(std::memory_order_relaxed);
+        stats.in_echos = kIcmpStats.in_echos.load(std::memory_order_relaxed);
+        stats.out_echo_reps = kIcmpStats.out_echo_reps.load(std::memory_order_relaxed);
+        stats.out_errors = kIcmpStats.out_errors.load(std::memory_order_relaxed);
+        stats.rate_limited = kIcmpStats.rate_limited.load(std::memory_order_relaxed);
+        stats.peer_limited = kIcmpStats.peer_limited.load(std::memory_order_relaxed);
+        stats.peer_evictions = kIcmpStats.peer_evictions.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void IcmpSetPeerRateLimit(int prefix_len, uint32_t rate, uint32_t burst)
+    {
+        kIcmpPeerPrefixLen.store(std::clamp(prefix_len, 0, 32), std::memory_order_relaxed);
+        kIcmpPeerBurst.store(std::max<uint32_t>(burst, 1), std::memory_order_relaxed);
+        kIcmpPeerRate.store(rate, std::memory_order_relaxed);
+    }
+
+    void IcmpInit()
+    {
+        Ipv4RegisterProtocol(TYPE_ICMP, IcmpPop);
+    }
+
+    void IcmpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr)
+    {
+        kIcmpStats.in_msgs.fetch_add(1, std::memory_order_relaxed);
+        if (pkt->DataSize() < sizeof(ICMPv4) || CheckSum(*pkt) != NET_ERR_OK)
         {
+            kIcmpStats.in_errors.fetch_add(1, std::memory_order_relaxed);
             pkt.reset();
             return;
         }
 
-        
+        ICMPv4 hdr;
+        pkt->ReadAt(0, (unsigned char*)&hdr, sizeof(hdr));
+        switch (hdr.type)
+        {
+            case ICMP_ECHO_REQUEST:
+                kIcmpStats.in_echos.fetch_add(1, std::memory_order_relaxed);
+                if (hdr.code == 0 && pkt->DataSize() >= sizeof(ICMPv4_Echo))
+                    IcmpEchoReply(pkt, ip_hdr);
+                break;
+            case ICMP_ECHO_REPLY:
+            {
+                ICMPv4_Echo echo;
+                IcmpEchoHandler handler = kIcmpEchoHandler.load(std::memory_order_acquire);
+                if (handler && pkt->ReadAt(0, (unsigned char*)&echo, sizeof(echo)) == 0)
+                    handler(pkt, ip_hdr, ntohs(echo.id), ntohs(echo.seq));
+                break;
+            }
+            case ICMP_DEST_UNREACHABLE:
+                IcmpUnreachable(pkt);
+                break;
+            default:
+                break;
+        }
     }
-}
\ No newline at end of file
+}
@@ -105,6 +105,16 @@ namespace netstack
      */
     NetErr_t ArpPush(uint8_t in_src_ip[4], uint8_t in_need_ip[4], uint8_t out_dst_mac[6], long* time = nullptr);
 
+    /**
+     * @brief 非阻塞地查询ip对应的mac地址,缓存中没有时发送arp请求后直接返回
+     * 
+     * @param iface 发送arp请求的网卡
+     * @param ip 网络字节序
+     * @param out_mac 
+     * @return NetErr_t NET_ERR_OK: 获取成功; NET_ERR_EMPTY: 正在解析
+     */
+    NetErr_t ArpLookup(NetInterface* iface, uint32_t ip, uint8_t out_mac[6]);
+
     /**
      * @brief 
      * 
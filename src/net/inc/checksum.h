@@ -0,0 +1,136 @@
+#pragma once
+/*
+    互联网校验和(RFC 1071): 按16位字累加,溢出部分回卷,最后取反
+
+    校验和的计算对字节序无关,按内存中的原始顺序累加,算出来的结果直接写回报文即可,
+    不需要再做 htons 转换.
+
+    TX: 上层(UDP/TCP)只在 PacketBuffer 上登记 "从 csum_start 开始到报文末尾需要校验和,
+        结果写在 csum_start + csum_offset",并把伪首部的部分和预先填进校验和字段.
+        真正的计算推迟到驱动边界: 网卡支持卸载就交给网卡,否则由 CsumFinalize 软件补齐.
+    RX: 驱动如果已经验证过校验和(比如 vnet 头部带了 DATA_VALID),就在 PacketBuffer 上标记,
+        上层看到标记后直接跳过校验.
+    这样每个字节最多只会被计算一次校验和.
+ */
+#include "net_err.h"
+#include "packet_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// vnet 头部的标志和GSO类型,取值与 linux/virtio_net.h 相同
+#define VNET_HDR_F_NEEDS_CSUM       1   // 需要计算校验和
+#define VNET_HDR_F_DATA_VALID       2   // 校验和已经验证
+#define VNET_HDR_GSO_NONE           0
+#define VNET_HDR_GSO_TCPV4          1
+#define VNET_HDR_GSO_UDP_L4         5
+
+namespace netstack
+{
+    // 与 linux/virtio_net.h 中 struct virtio_net_hdr 的布局相同(该头文件用到了 class 关键字,C++ 中不能直接包含)
+    #pragma pack(1)
+    struct VnetHdr
+    {
+        uint8_t     flags;
+        uint8_t     gso_type;
+        uint16_t    hdr_len;        // 所有协议头部的长度
+        uint16_t    gso_size;       // 每个分段的载荷大小
+        uint16_t    csum_start;     // 校验和计算的起始位置
+        uint16_t    csum_offset;    // 校验和字段相对 csum_start 的偏移
+    };
+    #pragma pack()
+
+    /**
+     * @brief 计算一段内存的部分和(未回卷、未取反)
+     *
+     * @param data
+     * @param size
+     * @param sum 之前累加的部分和
+     * @return uint32_t
+     */
+    uint32_t ChecksumPartial(const void* data, size_t size, uint32_t sum = 0);
+
+    /**
+     * @brief 将部分和回卷成16位(不取反)
+     *
+     * @param sum
+     * @return uint16_t
+     */
+    uint16_t ChecksumFold(uint32_t sum);
+
+    /**
+     * @brief 计算一段内存的校验和(已取反,可以直接写入报文)
+     *
+     * @param data
+     * @param size
+     * @return uint16_t
+     */
+    uint16_t Checksum16(const void* data, size_t size);
+
+    /**
+     * @brief 计算 UDP/TCP 伪首部的部分和
+     *
+     * @param src_ip 源ip(网络字节序)
+     * @param dst_ip 目标ip(网络字节序)
+     * @param proto 协议号
+     * @param len 传输层长度(主机字节序,包含头部)
+     * @return uint32_t
+     */
+    uint32_t ChecksumPseudoHdr(uint32_t src_ip, uint32_t dst_ip, uint8_t proto, uint16_t len);
+
+    /**
+     * @brief 计算数据包中 [offset, offset + size) 的部分和,会跨越多个 PacketBlock
+     *
+     * @param pkt
+     * @param offset 相对数据起始位置的偏移
+     * @param size
+     * @param sum 之前累加的部分和
+     * @return uint32_t
+     */
+    uint32_t ChecksumPacket(PacketBuffer& pkt, size_t offset, size_t size, uint32_t sum = 0);
+
+    /**
+     * @brief 增量更新校验和(RFC 1624): 报文中一个16位字从 old_val 变成 new_val
+     *
+     * @param csum 原校验和(报文中的值)
+     * @param old_val 原来的16位字(报文中的值)
+     * @param new_val 新的16位字(报文中的值)
+     * @return uint16_t 新的校验和
+     */
+    uint16_t ChecksumIncUpdate(uint16_t csum, uint16_t old_val, uint16_t new_val);
+
+    /**
+     * @brief 增量更新校验和: 报文中一个32位字(比如ip地址)发生了变化
+     *
+     * @param csum
+     * @param old_val
+     * @param new_val
+     * @return uint16_t
+     */
+    uint16_t ChecksumIncUpdate32(uint16_t csum, uint32_t old_val, uint32_t new_val);
+
+    /**
+     * @brief 驱动边界上的软件校验和补齐. 如果数据包登记了 CSUM_PARTIAL,
+     *        则计算 [csum_start, 末尾) 的校验和并写到 csum_start + csum_offset 处
+     *
+     * @param pkt
+     * @return NetErr_t
+     */
+    NetErr_t CsumFinalize(PacketBuffer& pkt);
+
+    /**
+     * @brief 把数据包上的校验和信息转换成 vnet 头部,提供给支持 vnet 头部的后端(TAP、AF_PACKET)
+     *
+     * @param pkt
+     * @param vnet_hdr
+     */
+    void CsumToVnetHdr(PacketBuffer& pkt, VnetHdr* vnet_hdr);
+
+    /**
+     * @brief 根据接收到的 vnet 头部设置数据包的校验和状态
+     *
+     * @param vnet_hdr
+     * @param pkt
+     */
+    void CsumFromVnetHdr(const VnetHdr* vnet_hdr, PacketBuffer& pkt);
+}
@@ -18,6 +18,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 #include <netinet/in.h>
 #include <cstring>
 
@@ -134,6 +135,31 @@ namespace netstack
     NetErr_t EtherPush(std::shared_ptr<PacketBuffer> pkt, PROTO_TYPE type, NetInterface* src_iface, 
         NetInfo* dst_iface_info, NetInterface* send_iface = nullptr);
 
+    /**
+     * @brief 批量封装以太网帧并一次性交给网卡发送(比如一个数据报的全部分片)
+     * 
+     * @param pkts 发送完成后会被清空
+     * @param type 
+     * @param src_iface 
+     * @param dst_iface_info 
+     * @return NetErr_t 
+     */
+    NetErr_t EtherPushBatch(std::vector<std::shared_ptr<PacketBuffer>>& pkts, PROTO_TYPE type, 
+        NetInterface* src_iface, NetInfo* dst_iface_info);
+    NetErr_t EtherPushBatch(std::vector<std::shared_ptr<PacketBuffer>>& pkts, PROTO_TYPE type, 
+        NetInterface* src_iface, const uint8_t dst_mac[6]);
+
+    /**
+     * @brief 转发ipv4数据包,写入以太网头部后从出口网卡发送
+     * 
+     * @param pkt 从ipv4头部开始的数据包
+     * @param send_iface 出口网卡
+     * @param dst_mac 下一跳的mac地址
+     * @return NetErr_t 
+     */
+    NetErr_t EtherForward(std::shared_ptr<PacketBuffer> pkt, NetInterface* send_iface, 
+        const uint8_t dst_mac[6]);
+
     /**
      * @brief 接收以太网帧;解析是什么协议,然后交给具体的模块去处理
      * 
@@ -15,8 +15,43 @@
 #include "sys_plat.h"
 #include "threadpool.h"
 
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define BUSY_POLL_DEFAULT_BUDGET_US     (50)
+#define BUSY_POLL_GAP_SHIFT             (3)     // 到达间隔的滑动平均权重为 1/8
+
 namespace netstack
 {
+    /*
+        忙轮询: 收到一批数据包之后不马上回到 epoll_wait 睡眠,而是在 budget_us 内不停地
+        从所有网卡读取,省掉下一批到达时的唤醒和上下文切换,代价是轮询期间占满一个核.
+        超过 budget_us 没有数据包时回到 epoll_wait.
+
+        adaptive 为 true 时只在到达足够密集时轮询: 记录相邻两批数据包之间间隔的滑动平均,
+        平均间隔不超过 budget_us(下一批大概率在轮询期间到达)才进入轮询,
+        否则每次都直接睡眠,稀疏的流量不会浪费CPU.
+     */
+    struct BusyPollOptions
+    {
+        bool enable = false;
+        uint32_t budget_us = BUSY_POLL_DEFAULT_BUDGET_US;   // 最后一个数据包之后继续轮询的时间
+        bool adaptive = true;
+    };
+
+    struct BusyPollStats
+    {
+        uint64_t poll_ns = 0;       // 轮询花费的时间(包括读取到数据包的轮询)
+        uint64_t sleep_ns = 0;      // 在 epoll_wait 中等待的时间
+        uint64_t polls = 0;         // 轮询的次数
+        uint64_t poll_hits = 0;     // 读取到数据包的轮询次数
+        uint64_t wakeups = 0;       // 从 epoll_wait 被唤醒的次数
+        uint64_t poll_enters = 0;   // 进入轮询的次数
+        uint64_t poll_skips = 0;    // 自适应模式下因为到达太稀疏没有进入轮询的次数
+        uint64_t avg_gap_ns = 0;    // 相邻两批数据包之间间隔的滑动平均
+    };
+
     class NetInterface;
     class RecvEventLoop : public NonCopyable
     {
@@ -25,14 +60,41 @@ namespace netstack
         ~RecvEventLoop();
     public:
         bool Start();
+
+        /**
+         * @brief 设置忙轮询,可以在运行中修改,下一次唤醒时生效
+         *
+         * @param opts
+         */
+        void SetBusyPoll(const BusyPollOptions& opts);
+        BusyPollOptions GetBusyPoll() const;
+        BusyPollStats GetBusyPollStats() const;
     private:
         bool InitEpoll();
         void ThreadFunc();
+        void BusyPoll();
+        int ReadInterface(NetInterface* iface);
+        void RecordArrival(uint64_t now);
     private:
         int epollfd_;
         bool start_;
         CustomThread recv_loop_thread_;
         ThreadPool& pool_;
+        std::vector<NetInterface*> ifaces_;     // 加入了epoll的网卡,轮询时逐个读取
+
+        std::atomic<bool> busy_poll_;
+        std::atomic<uint32_t> budget_us_;
+        std::atomic<bool> adaptive_;
+
+        uint64_t last_arrival_ns_ = 0;      // 只在接收线程中访问
+        std::atomic<uint64_t> avg_gap_ns_;
+        std::atomic<uint64_t> poll_ns_;
+        std::atomic<uint64_t> sleep_ns_;
+        std::atomic<uint64_t> polls_;
+        std::atomic<uint64_t> poll_hits_;
+        std::atomic<uint64_t> wakeups_;
+        std::atomic<uint64_t> poll_enters_;
+        std::atomic<uint64_t> poll_skips_;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+/*
+    软件分段卸载(GSO)
+
+    上层只构建一次协议头部,把一个大数据包连同每段的大小交下来,
+    在驱动边界(NetTx)才切分: 每段的数据是原数据包的切片(引用,不拷贝),
+    协议头部从原数据包复制后只修改长度、标识和校验和等少数字段.
+    网卡支持对应的卸载能力时不切分,直接交给网卡.
+ */
+#include "net_err.h"
+#include "packet_buffer.h"
+
+#include <memory>
+#include <vector>
+
+#define GSO_MAX_SEGMENTS    (64)    // 一个数据包最多切分的段数
+
+namespace netstack
+{
+    /**
+     * @brief 按数据包登记的 gso_size 切分成多个报文,每个报文的传输层校验和登记为 CSUM_PARTIAL
+     * 
+     * @param pkt 从以太网头部开始的数据包
+     * @param segs 返回切分后的报文
+     * @return NetErr_t 
+     */
+    NetErr_t GsoSegment(std::shared_ptr<PacketBuffer>& pkt, std::vector<std::shared_ptr<PacketBuffer>>& segs);
+}
@@ -2,17 +2,38 @@
 
 // ICMPv4协议
 #include "net_err.h"
+#include "ipv4.h"
 #include "packet_buffer.h"
+#include <cstdint>
 #include <memory>
+
+#define ICMP_ERR_RATE           (1000)      // 每秒最多生成的差错报文(与linux的 icmp_msgs_per_sec 相同)
+#define ICMP_ERR_BURST          (50)        // 令牌桶的容量,允许的突发
+#define ICMP_PEER_PREFIX_LEN    (24)        // 按差错报文目的地址的这个长度的前缀分别限速
+#define ICMP_PEER_RATE          (10)        // 每个前缀每秒最多的差错报文
+#define ICMP_PEER_BURST         (6)
+#define ICMP_PEER_TABLE_SIZE    (4096)      // 前缀令牌桶表的大小(2的幂)
+
 namespace netstack 
 {
-    enum ICMP_TYPE
+    enum ICMP_MSG_TYPE  // 报文类型
+    {
+        ICMP_ECHO_REPLY         =   0,      // 回显应答
+        ICMP_DEST_UNREACHABLE   =   3,      // 目的不可达
+        ICMP_ECHO_REQUEST       =   8,      // 回显请求
+        ICMP_TIME_EXCEEDED      =   11,     // 超时
+    };
+
+    enum ICMP_TYPE      // 目的不可达的代码
     {
     // 差错报文
         ICMP_NET_UNREACHABLE    =   0x00,   // 网络不可达(没有路由到目的地)
         ICMP_HOST_UNREACHABLE   =   0x01,   // 主机不可达
         ICMP_PROTO_UNREACHABLE  =   0x02,   // 协议不可达(未知协议)
         ICMP_PORT_UNREACHABLE   =   0x03,   // 端口不可达
+        ICMP_FRAG_NEEDED        =   0x04,   // 需要分片但设置了DF(路径MTU发现)
+
+        ICMP_TTL_EXCEEDED       =   0x00,   // 超时报文: 传输过程中TTL减为0
 
 
     // 询问报文
@@ -27,7 +48,82 @@ namespace netstack
     };
     #pragma pack()
 
+    #pragma pack(1)
+    struct ICMPv4_Echo      // 回显请求和应答,后面跟着任意数据,应答原样带回
+    {
+        ICMPv4      hdr;
+        uint16_t    id;
+        uint16_t    seq;
+    };
+    #pragma pack()
+
+    #pragma pack(1)
+    struct ICMPv4_Unreach   // 目的不可达报文,后面跟着原始数据报的ipv4头部和前8字节数据
+    {
+        ICMPv4      hdr;
+        uint16_t    unused;
+        uint16_t    next_hop_mtu;       // 需要分片时为下一跳的MTU(RFC 1191)
+    };
+    #pragma pack()
+
+
+    struct IcmpStats
+    {
+        uint64_t in_msgs = 0;           // 收到的报文
+        uint64_t in_errors = 0;         // 长度或者校验和错误
+        uint64_t in_echos = 0;          // 收到的回显请求
+        uint64_t out_echo_reps = 0;     // 发送的回显应答
+        uint64_t out_errors = 0;        // 发送的差错报文
+        uint64_t rate_limited = 0;      // 被全局令牌桶限制没有发送的差错报文
+        uint64_t peer_limited = 0;      // 被目的前缀的令牌桶限制没有发送的差错报文
+        uint64_t peer_evictions = 0;    // 前缀令牌桶表中被其他前缀替换的表项
+    };
+
+    // 收到回显应答时的处理函数, pkt 从ICMP头部开始, ip_hdr 为主机字节序
+    using IcmpEchoHandler = void (*)(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr,
+        uint16_t id, uint16_t seq);
+
+    /**
+     * @brief 发送回显请求
+     * 
+     * @param dst_ip 目的地址(网络字节序)
+     * @param id 标识(主机字节序),用来区分不同的发送者
+     * @param seq 序号(主机字节序)
+     * @param data 请求中携带的数据,应答会原样带回,可以为空
+     * @param size 
+     * @return NetErr_t 
+     */
+    NetErr_t IcmpPush(uint32_t dst_ip, uint16_t id, uint16_t seq, const void* data = nullptr, size_t size = 0);
+
+    /**
+     * @brief 注册回显应答的处理函数(比如ping),在初始化时调用
+     * 
+     * @param handler 
+     */
+    void IcmpRegisterEchoHandler(IcmpEchoHandler handler);
+
+    /**
+     * @brief 针对收到的数据报回复ICMP差错报文(超时、目的不可达等),
+     *        先经过目的地址所在前缀的令牌桶,再经过全局的令牌桶(每秒 ICMP_ERR_RATE 个,突发 ICMP_ERR_BURST 个)
+     * 
+     * @param type 
+     * @param code 
+     * @param orig_pkt 原始数据报(从ipv4头部开始,网络字节序)
+     * @param next_hop_mtu 需要分片时填写下一跳的MTU
+     * @return NetErr_t 
+     */
+    NetErr_t IcmpSendError(uint8_t type, uint8_t code, std::shared_ptr<PacketBuffer> orig_pkt, 
+        uint16_t next_hop_mtu = 0);
+    /**
+     * @brief 设置按前缀限速的参数,rate 为0表示不按前缀限速
+     * 
+     * @param prefix_len 前缀长度(0 ~ 32)
+     * @param rate 每秒的差错报文
+     * @param burst 
+     */
+    void IcmpSetPeerRateLimit(int prefix_len, uint32_t rate, uint32_t burst);
 
-    NetErr_t IcmpPush(uint32_t dst_ip);
-    void IcmpPop(std::shared_ptr<PacketBuffer> pkt);
+    IcmpStats IcmpGetStats();
+    void IcmpInit();
+    void IcmpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr);
 }
\ No newline at end of file
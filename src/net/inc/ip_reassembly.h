@@ -0,0 +1,139 @@
+#pragma once
+/*
+    ipv4分片重组
+
+    分片表以 (源ip, 目标ip, 协议, 标识) 作为键,只用16位的标识会让不同主机发来的分片互相混在一起.
+    表按键的哈希值拆分成多个 shard,每个 shard 一把锁,不同数据报的分片可以在不同线程上并行重组.
+
+    资源限制:
+        1. 每个未完成的数据报在创建时向定时器注册一个超时任务,超时后整个数据报被丢弃
+        2. 所有未完成数据报占用的内存有一个全局上限,超过上限时按 LRU 淘汰最久没有收到分片的数据报
+    重组完成时,各个分片的数据以引用的方式拼接成一个数据包,不拷贝数据
+ */
+#include "ipv4.h"
+#include "net_err.h"
+#include "noncopyable.h"
+#include "packet_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#define REASS_SHARD_CNT         (16)                // 分片表的 shard 数量
+#define REASS_TIMEOUT_SEC       (30)                // 重组超时时间(秒)
+#define REASS_MEM_LIMIT         (4 * 1024 * 1024)   // 未完成数据报占用内存的上限(字节)
+#define REASS_MAX_FRAGMENTS     (64)                // 一个数据报最多的分片数量
+
+namespace netstack
+{
+    class Timer;
+
+    // 分片表的键
+    struct ReassKey
+    {
+        bool operator==(const ReassKey& rhs) const
+        {
+            return src_ip == rhs.src_ip && dst_ip == rhs.dst_ip
+                && id == rhs.id && protocol == rhs.protocol;
+        }
+
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t id;
+        uint8_t  protocol;
+    };
+
+    struct ReassKeyHash
+    {
+        size_t operator()(const ReassKey& key) const
+        {
+            uint64_t val = ((uint64_t)key.src_ip << 32) ^ key.dst_ip;
+            val ^= ((uint64_t)key.id << 16) ^ key.protocol;
+            val *= 0x9E3779B97F4A7C15ULL;
+            return static_cast<size_t>(val ^ (val >> 29));
+        }
+    };
+
+    // 一个正在重组的数据报
+    struct ReassEntry
+    {
+        ReassKey key;
+        uint64_t serial = 0;        // 创建时的编号,超时任务用来判断数据报是不是同一个
+        uint32_t recv_size = 0;     // 已收到的数据大小(只累加其中的数据大小)
+        uint32_t total_size = 0;    // 如果有值代表收到了分片的最后一片
+        size_t mem_size = 0;        // 占用的内存
+        std::chrono::steady_clock::time_point deadline;     // 超时时间
+        IPV4_Hdr first_hdr;         // 第一个分片的头部(主机字节序)
+        bool has_first = false;
+        // key: 分片偏移(字节),   value: 接收到的分片数据(不含ipv4头部)
+        std::map<uint32_t, std::shared_ptr<PacketBuffer>> fragments;
+        std::list<ReassKey>::iterator lru_it;   // 在 LRU 链表中的位置
+    };
+
+    // 重组统计
+    struct ReassStats
+    {
+        uint64_t completed = 0;     // 重组完成的数据报
+        uint64_t timed_out = 0;     // 超时丢弃的数据报
+        uint64_t evicted = 0;       // 内存不足被淘汰的数据报
+        uint64_t dropped = 0;       // 不合法被丢弃的分片(重叠、越界等)
+        size_t mem_used = 0;        // 当前占用的内存
+    };
+
+
+    class Ipv4Reassembly : public NonCopyable
+    {
+    public:
+        Ipv4Reassembly(size_t mem_limit = REASS_MEM_LIMIT);
+        ~Ipv4Reassembly();
+    public:
+        void SetTimer(Timer* timer)
+        { timer_ = timer; }
+
+        /**
+         * @brief 处理一个分片
+         *
+         * @param pkt 分片的数据(已经去掉ipv4头部)
+         * @param hdr 分片的ipv4头部(主机字节序)
+         * @param out_pkt 重组完成时返回完整的数据报(不含ipv4头部),否则为nullptr
+         * @param out_hdr 重组完成时返回数据报的头部(主机字节序)
+         * @return NetErr_t
+         */
+        NetErr_t Input(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& hdr,
+            std::shared_ptr<PacketBuffer>& out_pkt, IPV4_Hdr& out_hdr);
+
+        ReassStats GetStats() const;
+    private:
+        struct Shard
+        {
+            std::mutex mutex;
+            std::unordered_map<ReassKey, ReassEntry, ReassKeyHash> table;
+            std::list<ReassKey> lru;    // 头部是最久没有收到分片的数据报
+        };
+
+        Shard& GetShard(const ReassKey& key)
+        { return shards_[ReassKeyHash()(key) % REASS_SHARD_CNT]; }
+
+        void Expire(ReassKey key, uint64_t serial);
+        void EraseLocked(Shard& shard, std::unordered_map<ReassKey, ReassEntry, ReassKeyHash>::iterator it);
+        void ExpireLocked(Shard& shard);
+        void EvictLocked(Shard& shard, const ReassKey& keep);
+        void EvictOthers(Shard& self);
+    private:
+        Shard shards_[REASS_SHARD_CNT];
+        Timer* timer_ = nullptr;
+        size_t mem_limit_;
+        std::atomic<size_t> mem_used_ = 0;
+        std::atomic<uint64_t> serial_ = 0;
+
+        std::atomic<uint64_t> completed_ = 0;
+        std::atomic<uint64_t> timed_out_ = 0;
+        std::atomic<uint64_t> evicted_ = 0;
+        std::atomic<uint64_t> dropped_ = 0;
+    };
+}
@@ -63,39 +63,46 @@ namespace netstack
         FRAG_NO_MORE_FRAGMENT   = 0     // 允许分片,没有更多分片 (000)
     };
 
+    #define IPV4_FLAG_DF        (0x4000)    // 禁止分片(flags_fragment 中的位)
+    #define IPV4_FLAG_MF        (0x2000)    // 还有更多分片
+    #define IPV4_FRAG_OFF_MASK  (0x1fff)    // 片偏移掩码,单位8字节
+
+    /*
+        位域的布局依赖编译器(以及大小端),不能直接用来解析报文,
+        这里只保存原始字段,通过下面的成员函数读取其中的各个部分
+     */
     #pragma pack(1)
     struct IPV4_Hdr
     {
-        union {
-            uint8_t     version             : 4;    // 版本
-            uint8_t     header_length       : 4;    // 头部长度(表示头部可以有多少个 (4) 字节[最多15个])
-            uint8_t     version_length;
-        };
-
-        union {
-            /*
-            DS字段: 
-            优先级(3位,数值越大优先级越高)   D(低延迟) T(高吞吐量) R(高可靠性.这些分别设置为1)
-            */
-            uint8_t     ds                  : 6;    // 区分服务字段
-            // ECN字段: [DS5 DS4 DS3 DS2 DS1 DS0(默认为0)]
-            //          DS5、4、3 表示类型; DS2、1表示丢弃概率
-            // 前三个表示流量类别(数值越大处理优先级越高), 后三个表示丢弃优先级(数值越大丢弃优先级越高)
-            uint8_t     ecn                 : 2;    // 显式拥塞通知
-            uint8_t     service;
-        };
-        
+        uint8_t Version() const             // 版本
+        { return version_length >> 4; }
+        uint8_t HeaderLen() const           // 头部长度(字节)
+        { return (version_length & 0x0f) * 4; }
+        uint8_t Dscp() const                // 区分服务
+        { return service >> 2; }
+        uint8_t Ecn() const                 // 显式拥塞通知
+        { return service & 0x03; }
+        // 以下需要 flags_fragment 为主机字节序
+        bool DontFragment() const           
+        { return flags_fragment & IPV4_FLAG_DF; }
+        bool MoreFragment() const
+        { return flags_fragment & IPV4_FLAG_MF; }
+        uint32_t FragOffset() const         // 分片偏移(字节)
+        { return (flags_fragment & IPV4_FRAG_OFF_MASK) * 8; }
+        bool IsFragment() const
+        { return flags_fragment & (IPV4_FLAG_MF | IPV4_FRAG_OFF_MASK); }
+
+        uint8_t     version_length;             // 版本(高4位) + 头部长度(低4位,单位4字节[最多15个])
+        /*
+            DS字段(高6位): 前三个表示流量类别(数值越大处理优先级越高), 后三个表示丢弃优先级(数值越大丢弃优先级越高)
+            ECN字段(低2位): 显式拥塞通知
+        */
+        uint8_t     service;
         uint16_t    total_length;               // 总长度(数据长度,包括头部***)
         uint16_t    identification;             // 标识
-
-        union {
-            // 标志位( 第一位保留位, 第二位[DF禁止分片: 0:允许分片 1:禁止分片], 
-            // 第三位[MF更多分片, 0: 最后一个分片 1:后面还有分片])
-            uint8_t     flags               : 3;    
-            uint16_t    fragment_offset     : 13;   // 分片偏移, 单位(8字节)
-            uint16_t    flags_fragment;
-        } ;
-
+        // 标志位( 第一位保留位, 第二位[DF禁止分片: 0:允许分片 1:禁止分片], 
+        // 第三位[MF更多分片, 0: 最后一个分片 1:后面还有分片]) + 分片偏移(13位, 单位8字节)
+        uint16_t    flags_fragment;
         uint8_t     ttl;                        // 生存时间
         uint8_t     protocol;                   // 协议
         uint16_t    head_checksum;              // 头部校验和
@@ -115,15 +122,66 @@ namespace netstack
 
 
 
-    #pragma pack(1)
-    struct MsgReassembly    // 报文重组
+    class Timer;
+    struct ReassStats;
+
+    // 上层协议的处理函数, pkt 已经去掉了ipv4头部, hdr 为主机字节序
+    using Ipv4Handler = void (*)(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& hdr);
+
+    // 接收时丢弃数据包的原因
+    enum Ipv4DropReason
     {
-        uint32_t recv_size = 0;     // 已收到的分片大小(只累加其中的数据大小)
-        uint32_t total_size = 0;    // 如果有值代表收到了分片的最后一片
-        // key: 分片偏移,   value: 接收到的分片
-        std::map<uint64_t, std::shared_ptr<PacketBuffer>> fragments;
+        IPV4_DROP_TRUNCATED     = 0,    // 数据包比ipv4头部还小
+        IPV4_DROP_VERSION,              // 版本不是4
+        IPV4_DROP_HDR_LEN,              // 头部长度不合法
+        IPV4_DROP_TOTAL_LEN,            // 总长度和数据包大小不符
+        IPV4_DROP_CHECKSUM,             // 头部校验和错误
+        IPV4_DROP_NOT_LOCAL,            // 目的地址不是本机(没有开启转发)
+        IPV4_DROP_REASSEMBLY,           // 分片重组失败
+        IPV4_DROP_NO_PROTO,             // 没有注册的上层协议
+        IPV4_DROP_TTL,                  // 转发: TTL耗尽
+        IPV4_DROP_NO_ROUTE,             // 转发: 没有路由
+        IPV4_DROP_NO_NEIGH,             // 转发: 下一跳的mac地址还没有解析
+        IPV4_DROP_FRAG_NEEDED,          // 转发: 超过出口MTU并且设置了DF
+        IPV4_DROP_REASON_CNT
     };
-    #pragma pack()
+
+    /**
+     * @brief 初始化ipv4模块,分片重组使用定时器回收超时的数据报
+     * 
+     * @param timer 
+     */
+    void Ipv4Init(Timer* timer);
+    ReassStats Ipv4ReassStats();
+
+    /**
+     * @brief 注册上层协议的处理函数,在初始化时调用
+     * 
+     * @param protocol 协议号
+     * @param handler 
+     */
+    void Ipv4RegisterProtocol(uint8_t protocol, Ipv4Handler handler);
+
+    uint64_t Ipv4DropCount(Ipv4DropReason reason);
+
+    /**
+     * @brief 开启/关闭转发. 开启后作为软件路由器在 kNetifacesMap 的网卡之间转发数据报,
+     *        启用了接收过滤器时同时重新生成过滤程序
+     * 
+     * @param enable 
+     */
+    void Ipv4SetForward(bool enable);
+    bool Ipv4GetForward();
+    uint64_t Ipv4ForwardCount();
+
+    /**
+     * @brief 在上层协议收到的数据包前面重新写入20字节的ipv4头部(选项不恢复),
+     *        用来在icmp差错报文中引用原始数据报
+     * 
+     * @param pkt 去掉了ipv4头部的数据包
+     * @param hdr 主机字节序的头部
+     */
+    void Ipv4RestoreHeader(std::shared_ptr<PacketBuffer>& pkt, const IPV4_Hdr& hdr);
 
     NetErr_t IPv4Push(std::shared_ptr<PacketBuffer> pkt, uint32_t src_ip, uint32_t dst_ip, PROTO_TYPE type);
     NetErr_t IPv4Pop(std::shared_ptr<PacketBuffer> pkt);
@@ -3,12 +3,14 @@
 #include "net_interface.h"
 #include "sys_plat.h"
 
+#include <memory>
+
 namespace netstack 
 {
     class NetIfLoop : public NetInterface
     {
     public:
-        NetIfLoop(NetInfo* info);
+        NetIfLoop(NetInfo* info, std::unique_ptr<NetDriver> driver);
         ~NetIfLoop();
     };
 
@@ -0,0 +1,102 @@
+#pragma once
+/*
+    网卡驱动接口: NetInterface 只通过这个接口收发数据包,不关心底层是pcap、TAP、AF_XDP、
+    回放文件还是内存中的虚拟网线. RecvEventLoop 通过 GetFd 等待驱动可读.
+
+    - Open:         打开设备,把设备的mac地址、MTU等信息填到 NetInfo 中(不需要的驱动不修改)
+    - RxBurst:      非阻塞地读取最多 max 个已经到达的数据包
+    - TxBurst:      发送一批已经补齐校验和、切分好的数据包(卸载能力以外的工作由 NetInterface 完成),
+                    驱动接管全部数据包的所有权
+    - GetFd:        可以用 epoll 等待的fd,可读表示有数据包到达;没有时返回-1(只能主动调用 RxBurst)
+    - GetCaps:      卸载能力(NetIfCaps),打开之后才确定
+    - MaxBatch:     一次 RxBurst/TxBurst 最多处理的个数
+    - SetFilter:    把经典BPF程序装到内核中,替换之前的(可选,默认不支持)
+ */
+#include "net_err.h"
+#include "packet_buffer.h"
+
+#include <cstdint>
+#include <memory>
+
+struct sock_filter;     // <linux/filter.h>
+
+namespace netstack
+{
+    // 网卡接口的卸载能力
+    enum NetIfCaps
+    {
+        NETIF_CAP_TX_CSUM   = 0x01,     // 发送时由网卡计算传输层校验和
+        NETIF_CAP_RX_CSUM   = 0x02,     // 接收时由网卡验证校验和
+        NETIF_CAP_GSO_UDP   = 0x04,     // 网卡可以切分 GSO_UDP_L4 数据包
+        NETIF_CAP_GSO_TCP   = 0x08,     // 网卡可以切分 GSO_TCPV4 数据包(TSO)
+    };
+
+    struct NetDriverStats
+    {
+        uint64_t rx_packets = 0;
+        uint64_t rx_bytes = 0;
+        uint64_t rx_errors = 0;         // 读取失败或者帧不合法
+        uint64_t rx_dropped = 0;        // 设备或者内核中丢弃的(缓冲区满了等)
+        uint64_t tx_packets = 0;
+        uint64_t tx_bytes = 0;
+        uint64_t tx_errors = 0;         // 写入失败
+        uint64_t tx_dropped = 0;        // 设备的队列满了等原因没有发送
+    };
+
+    struct NetInfo;
+    using SharedPkt = std::shared_ptr<PacketBuffer>;
+
+    class NetDriver
+    {
+    public:
+        virtual ~NetDriver() = default;
+    public:
+        /**
+         * @brief 打开设备
+         *
+         * @param info 网卡信息,驱动可以填写mac地址、MTU
+         * @return NetErr_t
+         */
+        virtual NetErr_t Open(NetInfo* info) = 0;
+
+        /**
+         * @brief 读取最多 max 个已经到达的数据包,不会阻塞
+         *
+         * @param pkts
+         * @param max
+         * @return int 读取到的个数
+         */
+        virtual int RxBurst(SharedPkt* pkts, int max) = 0;
+
+        /**
+         * @brief 发送 cnt 个数据包,调用之后 pkts 中的数据包都属于驱动(会被清空)
+         *
+         * @param pkts
+         * @param cnt
+         * @return int 成功发送的个数
+         */
+        virtual int TxBurst(SharedPkt* pkts, int cnt) = 0;
+
+        virtual int GetFd() const = 0;
+        virtual uint32_t GetCaps() const = 0;
+        virtual int MaxBatch() const = 0;
+        virtual NetDriverStats GetStats() = 0;
+
+        /**
+         * @brief 在内核中过滤接收的帧,新程序原子地替换旧的
+         *
+         * @param insns 经典BPF指令
+         * @param cnt
+         * @return NetErr_t 驱动没有内核可以过滤时返回 NET_ERR_NO_OPS
+         */
+        virtual NetErr_t SetFilter(const struct sock_filter* insns, int cnt)
+        {
+            (void)insns;
+            (void)cnt;
+            return NET_ERR_NO_OPS;
+        }
+
+        // 驱动的名称,用于输出信息
+        virtual const char* Name() const = 0;
+    };
+}
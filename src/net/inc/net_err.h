@@ -19,5 +19,10 @@ namespace netstack
         NET_ERR_INVALID_FRAME           =   -12,
         NET_ERR_DIFF_SUBNET             =   -13,    // 不是同一子网
         NET_ERR_WAIT_ARP_TIMEOUT        =   -14,    // 等待arp响应包超时
+        NET_ERR_UNREACH                 =   -15,    // 没有可用的路由
+        NET_ERR_CHECKSUM                =   -16,    // 校验和错误
+        NET_ERR_RESET                   =   -17,    // 连接被对端重置
+        NET_ERR_REFUSED                 =   -18,    // 连接被拒绝
+        NET_ERR_TIMEOUT                 =   -19,    // 超时
     };
 }
\ No newline at end of file
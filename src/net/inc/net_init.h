@@ -21,6 +21,10 @@ namespace netstack
         NetErr_t Init(size_t threadpool_cnt = 0);
         ThreadPool& GetTaskThreadPool()
         { return pool; }
+
+        // 接收事件循环,Init 之前为空
+        RecvEventLoop* GetEventLoop()
+        { return event_loop_; }
     public:
         static NetInit* GetInstance()
         {  return Singleton<NetInit>::get(); }
@@ -3,26 +3,36 @@
 #include "packet_buffer.h"
 #include "net_err.h"
 #include "concurrent_queue.h"
+#include "net_driver.h"
 #include "sys_plat.h"
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #define DEFAULT_TX_QUEUE_LEN 1024
+#define NETIF_RX_BATCH       32      // 一次就绪事件最多读取/处理的数据包个数
 
 namespace netstack 
 {
-    
-    using SharedPkt = std::shared_ptr<PacketBuffer>;
     class NetInterface 
     {
         friend NetInterface* GetLoopNetinterface();
         friend void HandleRecvPktCallback(NetInterface* iface);
         friend void HandleSendPktCallback(NetInterface* iface);
     public:
-        NetInterface(NetInfo* netinfo, int queue_max_threshold = DEFAULT_TX_QUEUE_LEN);
+        /**
+         * @brief 构造函数,之后需要调用 Open 打开驱动
+         * 
+         * @param netinfo 
+         * @param driver 网卡驱动,由网卡接口管理
+         * @param queue_max_threshold 
+         */
+        NetInterface(NetInfo* netinfo, std::unique_ptr<NetDriver> driver, 
+            int queue_max_threshold = DEFAULT_TX_QUEUE_LEN);
         virtual ~NetInterface();
         bool operator<(const NetInterface& rhs) 
-        { return netif_fd_ < rhs.netif_fd_; }
+        { return GetFd() < rhs.GetFd(); }
     public:
         void SetDefaultNetif(NetInterface* netif);
         void DisplayInfo();
@@ -30,22 +40,58 @@ namespace netstack
         NetInfo* GetNetInfo()
         { return netinfo_; }
 
+        NetDriver* GetDriver()
+        { return driver_.get(); }
+
         int GetFd() const 
-        { return netif_fd_; }
+        { return driver_->GetFd(); }
+
+        uint32_t GetMtu() const 
+        { return netinfo_->mtu; }
+
+        uint32_t GetCaps() const 
+        { return driver_->GetCaps(); }
+
+        /**
+         * @brief 打开驱动,成功后加入网卡接口表(析构时移除)
+         * 
+         * @return NetErr_t 驱动打开失败的错误
+         */
+        NetErr_t Open();
 
         NetErr_t PushPacket(SharedPkt pkt, bool is_recv_queue = true, bool wait = false);
         NetErr_t PopPacket(SharedPkt& pkt, bool is_recv_queue = true, bool wait = false);
 
-        bool NetRx();   // 从网卡读取数据
+        int NetRx();    // 从网卡读取一批数据,返回读取的个数
+
+        /**
+         * @brief 接收队列满了被丢弃的数据包个数. 这些包已经从驱动中读出来了,驱动的统计中没有
+         * 
+         * @return uint64_t 
+         */
+        uint64_t RxQueueDrops() const
+        { return rx_queue_drops_.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 接收队列中放入了新的数据包之后调用. 同一个网卡同时最多只有一个
+         *        HandleRecvPktCallback 任务,按到达的顺序处理(GRO 的合并依赖这一点)
+         * 
+         * @return true 调用者需要提交一个处理任务
+         * @return false 已经有处理任务,新的数据包会由它处理
+         */
+        bool RxScheduleTask()
+        { return !rx_task_pending_.exchange(true); }
         bool NetTx();   // 向网卡写入数据
         NetErr_t NetTx(SharedPkt pkt);
-    public:
-        
+        NetErr_t NetTxBatch(std::vector<SharedPkt>& pkts);
     private:
         NetInfo* netinfo_;              // 有关网卡的信息,比如ip地址、掩码、mac地址等等
-        int netif_fd_;                  // 每个网卡驱动的fd
+        std::unique_ptr<NetDriver> driver_;     // 网卡驱动
+        bool registered_ = false;       // 是否在网卡接口表中
 
         ConcurrentQueue<SharedPkt> recv_queue_;   // 接收数据包队列
+        std::atomic<bool> rx_task_pending_ = false; // 已经提交了处理任务,还没有处理完接收队列
+        std::atomic<uint64_t> rx_queue_drops_ = 0;  // 接收队列满了丢弃的数据包个数
         ConcurrentQueue<SharedPkt> send_queue_;   // 发送数据包队列
         int queue_max_threshold_ = DEFAULT_TX_QUEUE_LEN;              // 队列存储数据包最大个数
 
@@ -60,7 +106,8 @@ namespace netstack
     NetInterface* GetLoopNetinterface();
 
     /**
-     * @brief 用来处理从网卡接收来的数据包,对其进行拆分
+     * @brief 用来处理从网卡接收来的数据包,对其进行拆分. 每 NETIF_RX_BATCH 个作为一批,
+     *        一直处理到接收队列为空
      * 
      * @param iface 
      */
@@ -3,6 +3,7 @@
 #include "noncopyable.h"
 
 #include <list>
+#include <memory>
 #include <cstddef>
 #include <sys/types.h>
 #include <cstdio>
@@ -11,9 +12,36 @@
 
 namespace netstack 
 {   
+    #define PKT_HEADER_ROOM     (64)    // 添加头部时预留的空间,下层协议的头部可以直接放在前面,不用再分配内存块
+
     class PacketBlock;
     PacketBlock* AllocateBlock(size_t size);
 
+    // 数据包的校验和状态
+    enum CsumState
+    {
+        CSUM_NONE           = 0,    // 没有需要处理的校验和(或者已经计算完成)
+        CSUM_PARTIAL        = 1,    // TX: 校验和推迟到驱动边界计算
+        CSUM_UNNECESSARY    = 2,    // RX: 驱动或网卡已经验证过校验和
+    };
+
+    // 分段卸载(GSO)的类型: 上层交下来一个大数据包,在驱动边界按 gso_size 切分成多个报文
+    enum GsoType
+    {
+        GSO_NONE            = 0,
+        GSO_UDP_L4          = 1,    // 切分成多个UDP数据报
+        GSO_TCPV4           = 2,    // 切分成多个TCP报文段
+    };
+
+    // 接收到的数据包在链路层的目的地址类型
+    enum PktType
+    {
+        PKT_HOST            = 0,    // 发给本机的(目的mac是本机网卡)
+        PKT_BROADCAST       = 1,    // 链路层广播
+        PKT_MULTICAST       = 2,    // 链路层多播
+        PKT_OTHERHOST       = 3,    // 发给其他主机的(混杂模式下抓到的)
+    };
+
 
     class PacketBlock
     {
@@ -40,6 +68,19 @@ namespace netstack
             return total_size_ - curr_pos_;
         }
 
+        // 数据前面还能向前扩展的空间
+        size_t HeadRoom() const 
+        { return head_room_; }
+
+        // 内存是否被其他内存块(切片)引用
+        bool IsShared() const 
+        { return storage_.use_count() > 1; }
+
+        void Reserve(size_t size);
+        void Pull(size_t size);
+        void Trim(size_t size);
+        bool Push(size_t size);
+
         void SetPrevNode(PacketBlock* block);
         void Print()
         {
@@ -55,15 +96,20 @@ namespace netstack
         void CopyData(PacketBlock* src_pkt, int offset, size_t size);
 
         static PacketBlock* CuttingPacket(PacketBlock* block, int offset, size_t size);
+        static PacketBlock* SliceBlock(PacketBlock* block, size_t offset, size_t size);
+        static PacketBlock* WrapBlock(const std::shared_ptr<unsigned char>& storage, size_t size);
     private:
         PacketBlock(size_t size);
+        PacketBlock(const std::shared_ptr<unsigned char>& storage, unsigned char* data, size_t size);
     public:
         PacketBlock* next_;
         PacketBlock* prev_;
     private:
+        std::shared_ptr<unsigned char> storage_;    // 实际的内存,切片之间通过引用计数共享
         unsigned char* data_;		// 存储数据
         size_t total_size_;	        // 空间总大小
         size_t curr_pos_;	        // 当前数据的末尾位置
+        size_t head_room_ = 0;      // data_ 前面可用的空间大小
     };
 
     
@@ -93,6 +139,72 @@ namespace netstack
         void FillTail(size_t size);
         void Merge(PacketBuffer& pkt);
 
+        std::shared_ptr<PacketBuffer> Slice(size_t offset, size_t size);
+        int AppendSlice(PacketBuffer& src, size_t offset, size_t size);
+        int AppendExternal(const std::shared_ptr<unsigned char>& storage, size_t size);
+
+        int ReadAt(size_t offset, unsigned char* dest, size_t size);
+        int WriteAt(size_t offset, const unsigned char* src, size_t size);
+
+        const std::list<PacketBlock*>& GetBlocks() const
+        { return blocks_; }
+
+        /**
+         * @brief 登记TX校验和: 从 csum_start 到末尾需要校验和,结果写到 csum_start + csum_offset
+         *        (偏移都相对于当前数据起始位置,之后添加/去掉头部会自动调整)
+         * 
+         * @param csum_start 
+         * @param csum_offset 
+         */
+        void SetCsumPartial(size_t csum_start, size_t csum_offset)
+        {
+            csum_state_ = CSUM_PARTIAL;
+            csum_start_ = csum_start;
+            csum_offset_ = csum_offset;
+        }
+
+        void SetCsumVerified()
+        { csum_state_ = CSUM_UNNECESSARY; }
+
+        void ClearCsum()
+        { csum_state_ = CSUM_NONE; }
+
+        CsumState GetCsumState() const 
+        { return csum_state_; }
+
+        bool CsumVerified() const 
+        { return csum_state_ == CSUM_UNNECESSARY; }
+
+        size_t CsumStart() const 
+        { return csum_start_; }
+
+        size_t CsumOffset() const 
+        { return csum_offset_; }
+
+        /**
+         * @brief 登记分段卸载: 数据部分在驱动边界按 gso_size 切分,每段都复制一份协议头部
+         * 
+         * @param type 
+         * @param gso_size 每段的载荷大小(不包含头部)
+         */
+        void SetGso(GsoType type, size_t gso_size)
+        {
+            gso_type_ = type;
+            gso_size_ = gso_size;
+        }
+
+        GsoType GetGsoType() const 
+        { return gso_type_; }
+
+        size_t GsoSize() const 
+        { return gso_size_; }
+
+        void SetPktType(PktType type)
+        { pkt_type_ = type; }
+
+        PktType GetPktType() const 
+        { return pkt_type_; }
+
         template <typename T>
         T* AllocateObject()
         {
@@ -138,6 +250,13 @@ namespace netstack
         size_t total_size_;		// 数据包总大小
         size_t data_size_;		// 数据大小
         size_t index_ = 0;
+
+        CsumState csum_state_ = CSUM_NONE;  // 校验和状态
+        size_t csum_start_ = 0;             // 校验和计算的起始位置
+        size_t csum_offset_ = 0;            // 校验和字段相对 csum_start_ 的偏移
+        PktType pkt_type_ = PKT_HOST;       // 链路层的目的地址类型
+        GsoType gso_type_ = GSO_NONE;       // 分段卸载类型
+        size_t gso_size_ = 0;               // 分段卸载时每段的载荷大小
     };
 
 }
\ No newline at end of file
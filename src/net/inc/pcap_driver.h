@@ -0,0 +1,61 @@
+#pragma once
+/*
+    pcap网卡驱动: 通过 PcapNICDriver 打开的pcap句柄收发数据包,是默认的网卡驱动.
+    接收和发送都要复制一次(pcap的缓冲区在下一次读取时会被覆盖),不支持任何卸载.
+ */
+#include "net_driver.h"
+#include "net_err.h"
+#include "sys_plat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace netstack
+{
+    class PcapDriver : public NetDriver
+    {
+    public:
+        /**
+         * @brief 构造函数
+         *
+         * @param handle pcap句柄,由 PcapNICDriver 管理(不在这里关闭)
+         */
+        PcapDriver(pcap_t* handle);
+        ~PcapDriver() = default;
+    public:
+        NetErr_t Open(NetInfo* info) override;
+        int RxBurst(SharedPkt* pkts, int max) override;
+        int TxBurst(SharedPkt* pkts, int cnt) override;
+
+        int GetFd() const override
+        { return fd_; }
+
+        uint32_t GetCaps() const override
+        { return 0; }
+
+        int MaxBatch() const override;
+        NetDriverStats GetStats() override;
+        NetErr_t SetFilter(const struct sock_filter* insns, int cnt) override;
+
+        const char* Name() const override
+        { return "pcap"; }
+
+        pcap_t* GetHandle() const
+        { return handle_; }
+    private:
+        pcap_t* handle_;
+        int fd_ = -1;
+
+        std::mutex tx_mutex_;
+        std::vector<unsigned char> tx_mem_;     // 发送时复制数据的临时内存,所有数据包共用
+
+        std::atomic<uint64_t> rx_packets_;
+        std::atomic<uint64_t> rx_bytes_;
+        std::atomic<uint64_t> rx_errors_;
+        std::atomic<uint64_t> tx_packets_;
+        std::atomic<uint64_t> tx_bytes_;
+        std::atomic<uint64_t> tx_errors_;
+    };
+}
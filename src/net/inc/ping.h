@@ -0,0 +1,71 @@
+#pragma once
+/*
+    ping: 通过协议栈自己的网卡按固定速率发送回显请求,测量协议栈本身的延迟.
+
+    每个请求记录各个阶段的耗时(CLOCK_MONOTONIC_RAW,纳秒),分别放进HDR直方图:
+        route   查路由
+        arp     查邻居缓存(没有解析时会触发解析,计入 arp_misses)
+        tx      构建报文、经过ipv4和以太网层、交给驱动(包括驱动的排队)
+        rtt     从交给 IcmpPush 到接收线程收到应答
+    发送时间写在请求数据的开头,应答原样带回,所以接收时不需要按序号查找.
+ */
+#include "net_err.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#define PING_DEFAULT_PAYLOAD    (56)        // 与 ping 命令的默认值相同
+#define PING_MIN_PAYLOAD        (8)         // 至少要放下发送时间
+
+namespace netstack
+{
+    struct PingOptions
+    {
+        uint32_t dst_ip = 0;                // 目的地址(网络字节序)
+        uint32_t count = 10;                // 发送的请求个数
+        double rate = 1;                    // 每秒发送的请求个数
+        size_t payload = PING_DEFAULT_PAYLOAD;
+        uint32_t timeout_ms = 1000;         // 最后一个请求发出之后等待应答的时间
+    };
+
+    // 一个阶段的延迟分布(纳秒)
+    struct PingStage
+    {
+        uint64_t count = 0;
+        uint64_t min = 0;
+        uint64_t p50 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+        uint64_t max = 0;
+        double mean = 0;
+    };
+
+    struct PingReport
+    {
+        uint32_t sent = 0;
+        uint32_t received = 0;
+        uint32_t duplicates = 0;            // 重复的应答
+        uint32_t send_errors = 0;           // 没有路由或者发送失败
+        uint32_t arp_misses = 0;            // 发送时邻居还没有解析
+        PingStage route;
+        PingStage arp;
+        PingStage tx;
+        PingStage rtt;
+    };
+
+    /**
+     * @brief 注册接收应答的处理函数,协议栈初始化时调用
+     *
+     */
+    void PingInit();
+
+    /**
+     * @brief 按 opts 发送请求并等待应答,阻塞到全部应答收到或者超时.
+     *        可以在多个线程中同时调用,各自使用不同的标识
+     *
+     * @param opts
+     * @param report
+     * @return NetErr_t 参数错误返回 NET_ERR_PARAM
+     */
+    NetErr_t PingRun(const PingOptions& opts, PingReport& report);
+}
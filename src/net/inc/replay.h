@@ -0,0 +1,125 @@
+#pragma once
+/*
+    回放网卡: 从 pcap/pcapng 文件(比如 packet_capture/arp.pcapng)读取以太网帧,
+    全部预先加载到内存中,然后直接交给 EtherPop,不需要root权限和真实的网卡.
+    用来做可重复的接收路径基准测试.
+
+    回放可以全速进行,也可以按照抓包时记录的时间间隔进行. 每一帧按照最上层的协议
+    分类(arp、icmp、udp、tcp……),分别统计处理耗时. 协议栈从这个网卡发送的数据包
+    (比如arp应答、icmp回显应答)只计数,不会发送出去.
+
+    回放驱动没有可以等待的fd,Run 在当前线程直接调用 EtherPop;也可以通过 RxBurst
+    按顺序取出加载的帧(每一帧只取一次).
+ */
+#include "net_driver.h"
+#include "net_err.h"
+#include "net_interface.h"
+#include "sys_plat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace netstack
+{
+    // 帧按最上层的协议分类
+    enum ReplayLayer
+    {
+        REPLAY_LAYER_ARP = 0,
+        REPLAY_LAYER_ICMP,
+        REPLAY_LAYER_UDP,
+        REPLAY_LAYER_TCP,
+        REPLAY_LAYER_IPV4,      // 其他ipv4数据包
+        REPLAY_LAYER_OTHER,     // 其他以太网帧
+        REPLAY_LAYER_CNT,
+    };
+
+    struct ReplayOptions
+    {
+        bool paced = false;     // 按照记录的时间间隔回放,否则全速回放
+        double speed = 1.0;     // 按间隔回放时的倍速
+        uint32_t loops = 1;     // 回放的次数
+    };
+
+    struct ReplayLayerStats
+    {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t total_ns = 0;  // 交给 EtherPop 到返回的总耗时
+        double ns_per_pkt = 0;
+        double pps = 0;         // 只处理这一类帧时每秒可以处理的个数(1e9 / ns_per_pkt)
+    };
+
+    struct ReplayReport
+    {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t elapsed_ns = 0;    // 整个回放的时间,包括构造数据包和按间隔等待的时间
+        double pps = 0;
+        uint64_t tx_packets = 0;    // 协议栈回复的数据包个数
+        ReplayLayerStats layers[REPLAY_LAYER_CNT];
+    };
+
+    class ReplayDriver : public NetDriver
+    {
+    public:
+        ReplayDriver();
+        ~ReplayDriver() = default;
+    public:
+        /**
+         * @brief 读取文件中的全部以太网帧到内存中,之前加载的帧会被清空
+         *
+         * @param path pcap或者pcapng文件
+         * @return NetErr_t 打开失败返回 NET_ERR_IO,不是以太网的抓包文件返回 NET_ERR_PARAM
+         */
+        NetErr_t Load(const char* path);
+
+        /**
+         * @brief 在当前线程回放已经加载的帧,每 NETIF_RX_BATCH 个帧作为一批.
+         *        网卡接口的ip地址、mac地址需要是回放的帧发往的主机
+         *
+         * @param opts
+         * @param report
+         * @return NetErr_t 没有加载任何帧返回 NET_ERR_EMPTY
+         */
+        NetErr_t Run(const ReplayOptions& opts, ReplayReport& report);
+
+        size_t FrameCount() const
+        { return frames_.size(); }
+    public:
+        NetErr_t Open(NetInfo* info) override;
+        int RxBurst(SharedPkt* pkts, int max) override;
+        int TxBurst(SharedPkt* pkts, int cnt) override;
+
+        int GetFd() const override
+        { return -1; }
+
+        uint32_t GetCaps() const override
+        { return 0; }
+
+        int MaxBatch() const override
+        { return NETIF_RX_BATCH; }
+
+        NetDriverStats GetStats() override;
+
+        const char* Name() const override
+        { return "replay"; }
+    private:
+        struct ReplayFrame
+        {
+            size_t offset;          // 在 data_ 中的偏移
+            uint32_t size;
+            uint64_t ts_ns;         // 抓包时记录的时间
+            ReplayLayer layer;
+        };
+
+        std::vector<ReplayFrame> frames_;
+        std::vector<uint8_t> data_;     // 全部帧的数据连续存放
+        size_t rx_next_ = 0;            // RxBurst 下一个取出的帧
+        std::atomic<uint64_t> rx_packets_;
+        std::atomic<uint64_t> rx_bytes_;
+        std::atomic<uint64_t> tx_packets_;
+        std::atomic<uint64_t> tx_bytes_;
+    };
+}
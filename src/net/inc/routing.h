@@ -50,7 +50,36 @@ namespace netstack
     };
     #pragma pack()
 
+    /*
+        路径MTU发现(RFC 1191)
+        
+        每个目的地址缓存一个路径MTU,发送时设置DF标志,中间路由器发现数据报太大时会回复
+        ICMP "需要分片",收到后降低该目的地址的路径MTU.
+        降低之后每隔 PMTU_AGING_SEC 秒尝试往上提升一档(按 RFC 1191 中的 MTU 表),
+        如果链路已经可以通过更大的数据报就逐渐恢复,否则会再次收到 ICMP 被降下来.
+    */
+    #define PMTU_MIN            (552)       // 路径MTU的下限(与linux的min_pmtu相同)
+    #define PMTU_AGING_SEC      (600)       // 路径MTU降低后多久尝试往上提升
+
     Routing GetRouting(uint32_t ip);
 
+    /**
+     * @brief 获取发往目的地址的路径MTU,不会超过出口网卡的MTU
+     * 
+     * @param dst_ip 目的地址(网络字节序)
+     * @param iface 出口网卡
+     * @return uint32_t 
+     */
+    uint32_t GetPathMtu(uint32_t dst_ip, NetInterface* iface);
+
+    /**
+     * @brief 收到 ICMP "需要分片" 时降低目的地址的路径MTU
+     * 
+     * @param dst_ip 目的地址(网络字节序)
+     * @param next_hop_mtu ICMP 报文中的下一跳MTU,为0表示路由器不支持 RFC 1191
+     * @param orig_len 被丢弃的原始数据报总长度,next_hop_mtu 为0时用来估算
+     */
+    void UpdatePathMtu(uint32_t dst_ip, uint16_t next_hop_mtu, uint16_t orig_len);
+
     void InitRoutingMap();
 }
\ No newline at end of file
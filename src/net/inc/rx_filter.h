@@ -0,0 +1,78 @@
+#pragma once
+/*
+    接收过滤器: 根据协议栈自己的表(网卡的ip地址、udp绑定的端口、tcp监听的端口)生成一个
+    经典BPF程序,交给网卡驱动装到内核中(pcap的 PF_PACKET socket、TAP设备),
+    没有人处理的帧在内核中丢弃,不再复制到用户空间.
+
+    放行的帧:
+    - 目的mac是本网卡或者广播,并且源mac不是本网卡(自己发出去又被抓到的帧)
+    - arp: 目标ip是本网卡的地址
+    - ipv4: 目的地址是本网卡的地址、子网广播或者受限广播,并且
+        - icmp
+        - udp/tcp 的目的端口在临时端口的范围内(主动发起的连接),或者是绑定/监听的端口
+        - 不是第一个的分片(没有传输层头部,重组之后再分发)
+    - 开启了转发(Ipv4SetForward)时,目的mac是本网卡的单播ipv4帧不检查目的地址
+
+    绑定、关闭端口时调用 RxFilterUpdate 重新生成,驱动用 SO_ATTACH_FILTER 或者
+    TUNATTACHFILTER 替换,内核原子地切换到新的程序,替换期间不会丢失数据包.
+    没有内核可以过滤的驱动(虚拟网线、回放、AF_XDP)不受影响.
+
+    启用之后发往没有绑定的端口的数据包不会再收到,也就不会回复icmp端口不可达或者RST.
+ */
+#include "net_err.h"
+#include "sys_plat.h"
+
+#include <cstdint>
+#include <linux/filter.h>
+#include <vector>
+
+#define RX_FILTER_MAX_PORTS     (96)        // 每个协议最多单独匹配的端口,更多时放行该协议的全部端口
+#define RX_FILTER_ACCEPT_LEN    (0x40000)   // 放行时返回的长度(和pcap默认的捕获长度相同)
+
+namespace netstack
+{
+    // 生成程序使用的端口(主机字节序),不包括临时端口范围内的
+    struct RxFilterPorts
+    {
+        std::vector<uint16_t> udp;
+        std::vector<uint16_t> tcp;
+        bool forward = false;   // 开启了转发,放行发往其他主机的数据报
+    };
+
+    struct RxFilterStats
+    {
+        bool enabled = false;
+        uint64_t regenerations = 0;     // 重新生成的次数
+        uint64_t installs = 0;          // 装到驱动中的次数
+        uint64_t install_failures = 0;  // 驱动返回错误的次数(不支持的驱动不算)
+        uint32_t insns = 0;             // 最近一次生成的程序的指令数(多个网卡时取最大的)
+        uint32_t udp_ports = 0;         // 最近一次单独匹配的端口个数
+        uint32_t tcp_ports = 0;
+    };
+
+    /**
+     * @brief 生成一个网卡的过滤程序
+     *
+     * @param info 网卡的mac地址、ip地址和掩码
+     * @param ports 为空时只检查mac地址(和 DeviceOpen 中安装的过滤器相同)
+     * @param prog
+     * @return NetErr_t
+     */
+    NetErr_t RxFilterBuild(const NetInfo& info, const RxFilterPorts* ports, std::vector<sock_filter>& prog);
+
+    /**
+     * @brief 启用或者关闭接收过滤器,关闭时恢复成只检查mac地址的程序
+     *
+     * @param enable
+     */
+    void RxFilterEnable(bool enable);
+
+    /**
+     * @brief 从udp/tcp的表和转发开关重新生成程序并装到所有网卡的驱动中,没有启用时什么也不做.
+     *        不能在持有udp、tcp的锁时调用
+     *
+     */
+    void RxFilterUpdate();
+
+    RxFilterStats RxFilterGetStats();
+}
@@ -0,0 +1,108 @@
+#pragma once
+/*
+    TAP网卡: 通过 /dev/net/tun 创建一个TAP设备,协议栈作为这个设备"线缆另一端"的主机,
+    不需要pcap和真实的网卡,在容器中也可以使用(需要 CAP_NET_ADMIN).
+
+    - IFF_MULTI_QUEUE: 同一个设备打开多个队列(多个fd). 发送时每个线程固定使用一个队列,
+      不需要加锁;内核按流把接收到的数据包分散到各个队列.
+    - IFF_VNET_HDR: 每个数据包前面带一个 VnetHdr. 发送时把推迟的校验和、分段卸载交给内核,
+      接收时内核告诉我们校验和已经验证过(或者是本机发出来的,不需要验证).
+    - 发送用 writev 直接写出 PacketBlock 链,不拷贝到临时内存;接收用 readv 读到预先分配
+      好的 PacketBlock 中. 一次就绪事件在每个队列上连续读取,直到读完或者达到批量上限.
+ */
+#include "net_driver.h"
+#include "net_interface.h"
+#include "net_err.h"
+#include "sys_plat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define TAP_MAX_QUEUES      (16)
+#define TAP_MAX_IOV         (64)    // writev 最多使用的内存块个数,更多时先合并成一块
+
+namespace netstack
+{
+    struct TapOptions
+    {
+        std::string name;           // 设备名称,为空时由内核分配(tap0、tap1……)
+        int queues = 1;             // 队列个数,一般和处理数据包的线程个数相同
+        bool vnet_hdr = true;       // 使用 IFF_VNET_HDR 卸载校验和与分段
+    };
+
+    class TapDriver : public NetDriver
+    {
+    public:
+        TapDriver(const TapOptions& opts);
+        ~TapDriver();
+    public:
+        /**
+         * @brief 创建(或者连接到已经存在的)TAP设备,打开全部队列并启用设备.
+         *        设备的MTU填到 info 中;info 中mac地址全为0时随机生成一个本地管理的地址
+         *
+         * @param info
+         * @return NetErr_t 参数错误返回 NET_ERR_PARAM,打开或者配置失败返回 NET_ERR_IO
+         */
+        NetErr_t Open(NetInfo* info) override;
+        int RxBurst(SharedPkt* pkts, int max) override;
+        int TxBurst(SharedPkt* pkts, int cnt) override;
+
+        int GetFd() const override
+        { return epoll_fd_; }
+
+        uint32_t GetCaps() const override
+        { return caps_; }
+
+        int MaxBatch() const override
+        { return NETIF_RX_BATCH; }
+
+        NetDriverStats GetStats() override;
+        NetErr_t SetFilter(const struct sock_filter* insns, int cnt) override;
+
+        const char* Name() const override
+        { return "tap"; }
+    public:
+        const std::string& GetDeviceName() const
+        { return dev_name_; }
+
+        int QueueCount() const
+        { return static_cast<int>(queue_fds_.size()); }
+
+        /**
+         * @brief 从一个队列读取最多 max 个数据包,可以给每个队列单独开一个接收线程
+         *
+         * @param queue
+         * @param pkts
+         * @param max
+         * @return int 读取到的个数
+         */
+        int RecvQueue(int queue, SharedPkt* pkts, int max);
+
+        // 内存块太多,合并之后才写出的个数
+        uint64_t TxLinearized() const
+        { return tx_linearized_; }
+    private:
+        int TxQueueFd();
+        bool WriteFrame(int fd, PacketBuffer& pkt);
+        void Close();
+    private:
+        TapOptions opts_;
+        std::string dev_name_;
+        uint32_t caps_ = 0;
+        std::vector<int> queue_fds_;
+        int epoll_fd_ = -1;             // 所有队列的fd,作为网卡接口的fd交给 RecvEventLoop
+        size_t vnet_hdr_size_ = 0;
+        size_t rx_frame_size_ = 0;      // 接收时为每个数据包分配的大小
+        int rx_next_queue_ = 0;         // 多个队列就绪时轮流读取
+
+        std::atomic<uint64_t> rx_packets_;
+        std::atomic<uint64_t> rx_bytes_;
+        std::atomic<uint64_t> rx_errors_;
+        std::atomic<uint64_t> tx_packets_;
+        std::atomic<uint64_t> tx_bytes_;
+        std::atomic<uint64_t> tx_errors_;
+        std::atomic<uint64_t> tx_linearized_;
+    };
+}
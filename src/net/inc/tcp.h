@@ -1,14 +1,558 @@
 #pragma once
+/*
+    TCP协议(RFC 9293)
 
+    0                   16                  31
+    |       源端口       |      目的端口      |
+    |                  序号                  |
+    |                 确认号                 |
+    |偏移| 保留 |  标志  |        窗口        |
+    |      校验和        |      紧急指针      |
+    |              选项(可选)                |
+
+    连接表: 以四元组为键,按哈希拆分成多个 shard,每个 shard 一把锁; 监听表以 (本地地址, 本地端口) 为键.
+    每个连接有自己的锁,接收线程、定时器线程和应用线程都在这把锁下修改连接的状态.
+    持有连接的锁时只构建要发送的报文段,释放锁之后才交给ipv4发送,避免在锁内等待arp等.
+    发送缓冲区的数据在发送和重传时以引用的方式切片,收到的数据也以引用的方式拼接到接收缓冲区.
+    监听的连接: 握手中的连接个数(SYN队列)超过 backlog 时改用 SYN cookie 回复,不再为SYN创建连接;
+    建立好的连接通过无锁队列交给 Accept,接收线程不需要拿监听连接的锁.
+    所有接口都不阻塞: 连接是否建立看 GetState,有没有数据看 Recv 的返回值.
+ */
+#include "concurrent_queue.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "noncopyable.h"
 #include "packet_buffer.h"
+#include "tcp_cong.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
-namespace netstack 
+#define TCP_SHARD_CNT           (16)                // 连接表的 shard 数量
+#define TCP_DEFAULT_MSS         (536)               // 对端没有携带MSS选项时使用的值
+#define TCP_SND_BUF_SIZE        (4 * 1024 * 1024)   // 发送缓冲区大小
+#define TCP_RCV_BUF_SIZE        (4 * 1024 * 1024)   // 接收缓冲区大小(对端不支持窗口扩大时窗口最大65535)
+#define TCP_MAX_OOO_SEGMENTS    (4096)              // 最多缓存的乱序报文段
+#define TCP_MAX_WSCALE          (14)                // 窗口扩大因子的上限(RFC 7323 2.3)
+#define TCP_TS_OPT_LEN          (12)                // 时间戳选项加上两个NOP
+#define TCP_MAX_SACK_BLOCKS     (4)                 // 一个报文段中最多的SACK块
+#define TCP_RTO_INIT_MS         (1000)              // 初始重传超时(RFC 6298)
+#define TCP_RTO_MIN_MS          (200)               // 重传超时的下限(与linux相同,RFC 6298 中是1秒)
+#define TCP_RTO_MAX_MS          (60000)
+#define TCP_CLOCK_GRANULARITY_MS (50)               // 定时器的精度(滴答时间),计算RTO时的G
+#define TCP_DELACK_MS           (40)                // 延迟确认的时间
+#define TCP_KEEPALIVE_IDLE_SEC  (7200)              // 空闲多久之后开始发送保活探测
+#define TCP_KEEPALIVE_INTVL_SEC (75)                // 保活探测的间隔
+#define TCP_KEEPALIVE_PROBES    (9)                 // 没有回应的保活探测达到这个次数就关闭连接
+#define TCP_TSO_MAX_SIZE        (0xffff - 20 - 60)  // TSO报文段的最大载荷(ipv4总长度的限制)
+#define TCP_DUPACK_THRESH       (3)                 // 重复确认达到这个数量时快速重传
+#define TCP_MAX_RETRIES         (15)                // 数据最多重传的次数
+#define TCP_SYN_RETRIES         (6)                 // SYN最多重传的次数
+#define TCP_TIME_WAIT_SEC       (60)                // TIME_WAIT 持续时间(2MSL)
+#define TCP_EPHEMERAL_MIN       (49152)             // 临时端口的范围
+#define TCP_EPHEMERAL_MAX       (65535)
+#define TCP_DEFAULT_BACKLOG     (128)
+#define TCP_COOKIE_PERIOD_SEC   (64)                // SYN cookie 计数器的周期
+#define TCP_COOKIE_MAX_AGE      (2)                 // SYN cookie 最多在这么多个周期内有效
+
+namespace netstack
 {
+    class Timer;
+    class TimerSlot;
+
+    enum TcpFlag
+    {
+        TCP_FLAG_FIN    = 0x01,
+        TCP_FLAG_SYN    = 0x02,
+        TCP_FLAG_RST    = 0x04,
+        TCP_FLAG_PSH    = 0x08,
+        TCP_FLAG_ACK    = 0x10,
+        TCP_FLAG_URG    = 0x20,
+    };
+
+    enum TcpOption
+    {
+        TCP_OPT_END     = 0,
+        TCP_OPT_NOP     = 1,
+        TCP_OPT_MSS     = 2,
+        TCP_OPT_WSCALE  = 3,        // 窗口扩大(RFC 7323),只能出现在SYN中
+        TCP_OPT_SACK_PERM = 4,      // 允许SACK(RFC 2018),只能出现在SYN中
+        TCP_OPT_SACK    = 5,
+        TCP_OPT_TS      = 8,        // 时间戳(RFC 7323)
+    };
+
+    #pragma pack(1)
+    struct TcpHdr
+    {
+        size_t HeaderLen() const
+        { return (data_offset >> 4) * 4; }
+
+        uint16_t    src_port;       // 源端口
+        uint16_t    dst_port;       // 目的端口
+        uint32_t    seq;            // 序号
+        uint32_t    ack;            // 确认号
+        uint8_t     data_offset;    // 高4位是头部长度(单位4字节)
+        uint8_t     flags;          // TcpFlag
+        uint16_t    window;         // 窗口
+        uint16_t    checksum;       // 校验和(包括伪首部)
+        uint16_t    urgent;         // 紧急指针
+    };
+    #pragma pack()
+
+    enum TcpState
+    {
+        TCP_CLOSED = 0,
+        TCP_LISTEN,
+        TCP_SYN_SENT,
+        TCP_SYN_RECEIVED,
+        TCP_ESTABLISHED,
+        TCP_FIN_WAIT_1,
+        TCP_FIN_WAIT_2,
+        TCP_CLOSE_WAIT,
+        TCP_CLOSING,
+        TCP_LAST_ACK,
+        TCP_TIME_WAIT,
+    };
+
+    const char* TcpStateName(TcpState state);
+
+    enum TcpSynCookieMode
+    {
+        TCP_SYNCOOKIE_OFF = 0,      // SYN队列满了直接丢弃SYN
+        TCP_SYNCOOKIE_PRESSURE,     // SYN队列满了才使用cookie(默认)
+        TCP_SYNCOOKIE_ALWAYS,       // 所有的SYN都用cookie回复
+    };
+
+    // 每个连接上的定时器,各自是一个可以重复设置的 TimerSlot
+    enum TcpTimerKind
+    {
+        TCP_TIMER_RTO = 0,          // 重传(包括SYN和FIN)
+        TCP_TIMER_DELACK,           // 延迟确认
+        TCP_TIMER_PERSIST,          // 对端窗口为0时的窗口探测
+        TCP_TIMER_KEEPALIVE,        // 保活
+        TCP_TIMER_PACE,             // 平滑发送(拥塞控制给出了发送速率时)
+        TCP_TIMER_TIME_WAIT,        // TIME_WAIT 结束后释放连接
+        TCP_TIMER_CNT,
+    };
+
+    // 序号比较,序号是32位回绕的
+    inline bool SeqLt(uint32_t a, uint32_t b)
+    { return static_cast<int32_t>(a - b) < 0; }
+
+    inline bool SeqLeq(uint32_t a, uint32_t b)
+    { return static_cast<int32_t>(a - b) <= 0; }
+
+    inline bool SeqGt(uint32_t a, uint32_t b)
+    { return static_cast<int32_t>(a - b) > 0; }
+
+    inline bool SeqGeq(uint32_t a, uint32_t b)
+    { return static_cast<int32_t>(a - b) >= 0; }
+
+    // 按回绕的序号排序,只要所有元素落在 2^31 的范围内(一个接收窗口之内)就是严格弱序
+    struct TcpSeqLess
+    {
+        bool operator()(uint32_t a, uint32_t b) const
+        { return SeqLt(a, b); }
+    };
+
+    // 连接表的键(地址网络字节序,端口主机字节序)
+    struct TcpConnKey
+    {
+        bool operator==(const TcpConnKey& rhs) const
+        {
+            return local_ip == rhs.local_ip && remote_ip == rhs.remote_ip
+                && local_port == rhs.local_port && remote_port == rhs.remote_port;
+        }
+
+        uint32_t local_ip;
+        uint32_t remote_ip;
+        uint16_t local_port;
+        uint16_t remote_port;
+    };
+
+    struct TcpConnKeyHash
+    {
+        size_t operator()(const TcpConnKey& key) const
+        {
+            uint64_t val = ((uint64_t)key.local_ip << 32) ^ key.remote_ip;
+            val ^= ((uint64_t)key.local_port << 16) ^ key.remote_port;
+            val *= 0x9E3779B97F4A7C15ULL;
+            return static_cast<size_t>(val ^ (val >> 29));
+        }
+    };
+
+    // 解析后的报文段(主机字节序)
+    struct TcpSegment
+    {
+        // 报文段占用的序号空间,SYN和FIN各占一个
+        uint32_t SeqLen() const
+        { return len + ((flags & TCP_FLAG_SYN) ? 1 : 0) + ((flags & TCP_FLAG_FIN) ? 1 : 0); }
+
+        uint32_t    seq = 0;
+        uint32_t    ack = 0;
+        uint16_t    wnd = 0;
+        uint8_t     flags = 0;
+        uint16_t    mss = 0;        // MSS选项,为0表示没有携带
+        int8_t      wscale = -1;    // 窗口扩大选项,-1表示没有携带
+        bool        sack_perm = false;
+        bool        has_ts = false;
+        uint32_t    tsval = 0;
+        uint32_t    tsecr = 0;
+        uint8_t     sack_cnt = 0;
+        uint32_t    sack[TCP_MAX_SACK_BLOCKS][2] = {};  // SACK块 [左边界, 右边界)
+        uint32_t    len = 0;        // 数据的长度
+        std::shared_ptr<PacketBuffer> data;     // 数据(不包含头部)
+    };
+
+    // 释放连接的锁之后再交给ipv4发送的报文段
+    struct TcpTxSeg
+    {
+        std::shared_ptr<PacketBuffer> pkt;
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint32_t segs = 1;      // TSO报文段在驱动边界切分后的个数
+    };
+    using TcpTxList = std::vector<TcpTxSeg>;
+
+    // 全局统计(类似 RFC 4022 中的 tcp 组)
+    struct TcpStats
+    {
+        uint64_t active_opens = 0;      // 主动打开的连接
+        uint64_t passive_opens = 0;     // 被动打开的连接
+        uint64_t attempt_fails = 0;     // 建立连接失败
+        uint64_t estab_resets = 0;      // 已建立的连接被重置
+        uint64_t in_segs = 0;           // 收到的报文段
+        uint64_t out_segs = 0;          // 发送的报文段
+        uint64_t retrans_segs = 0;      // 重传的报文段
+        uint64_t in_errs = 0;           // 格式错误或者校验和错误
+        uint64_t out_rsts = 0;          // 发送的RST
+        uint64_t listen_drops = 0;      // 监听的连接丢弃的SYN或者握手完成的ACK(队列满了)
+        uint64_t syncookies_sent = 0;   // 用cookie回复的SYN
+        uint64_t syncookies_recv = 0;   // 通过cookie校验建立的连接
+        uint64_t syncookies_failed = 0; // cookie校验失败的ACK
+    };
+
+
+    class TcpSocket : public NonCopyable, public std::enable_shared_from_this<TcpSocket>
+    {
+        friend void TcpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr);
+        friend void TcpTimerExpire(std::weak_ptr<TcpSocket> sock, int kind);
+        friend std::shared_ptr<TcpSocket> TcpListen(uint32_t local_ip, uint16_t local_port,
+            int backlog, NetErr_t* err);
+        friend std::shared_ptr<TcpSocket> TcpConnect(uint32_t local_ip, uint32_t remote_ip,
+            uint16_t remote_port, NetErr_t* err);
+    public:
+        TcpSocket();
+        ~TcpSocket();
+    public:
+        /**
+         * @brief 从监听的连接中取出一个已经建立的连接,不阻塞
+         *
+         * @return std::shared_ptr<TcpSocket> 没有已经建立的连接返回nullptr
+         */
+        std::shared_ptr<TcpSocket> Accept();
+
+        /**
+         * @brief 把数据拷贝到发送缓冲区,按窗口发送出去
+         *
+         * @param data
+         * @param size
+         * @return int 放入发送缓冲区的字节数; 缓冲区满了返回 NET_ERR_FULL, 状态不允许发送返回 NET_ERR_STATE
+         */
+        int Send(const void* data, size_t size);
+
+        /**
+         * @brief 零拷贝发送: 以引用的方式把 data 的 [0, size) 放入发送缓冲区,
+         *        发送和重传时都从它切片. data 的删除器在数据全部被确认(或者连接释放)后才会被调用,
+         *        在那之前调用者不能修改这块内存
+         *
+         * @param data
+         * @param size
+         * @return int 放入发送缓冲区的字节数,可能小于 size; 错误码同 Send
+         */
+        int SendZeroCopy(const std::shared_ptr<unsigned char>& data, size_t size);
+
+        /**
+         * @brief 零拷贝发送一个数据包中的全部数据,数据包之后不能再被修改
+         *
+         * @param pkt
+         * @return int 放入发送缓冲区的字节数,可能小于数据包的大小; 错误码同 Send
+         */
+        int SendPacket(const std::shared_ptr<PacketBuffer>& pkt);
+
+        /**
+         * @brief 打开或者关闭TSO: 一次构建多个MSS的报文段,到驱动边界(或者网卡)才切分
+         *
+         * @param enable
+         */
+        void SetTso(bool enable);
+
+        /**
+         * @brief 从接收缓冲区读取数据
+         *
+         * @param buf
+         * @param size
+         * @return int 读取的字节数; 对端已经关闭并且数据读完返回0; 没有数据返回 NET_ERR_EMPTY
+         */
+        int Recv(void* buf, size_t size);
+
+        /**
+         * @brief 正常关闭: 发送缓冲区的数据发完之后发送FIN
+         *
+         */
+        void Close();
+
+        /**
+         * @brief 发送RST立即关闭连接,丢弃缓冲区中的数据
+         *
+         */
+        void Abort();
+
+        TcpState GetState() const;
+
+        /**
+         * @brief 连接出错关闭时的原因(被重置、被拒绝、超时)
+         *
+         * @return NetErr_t
+         */
+        NetErr_t GetError() const;
+
+        void SetNoDelay(bool enable);
+
+        /**
+         * @brief 打开或者关闭保活
+         *
+         * @param enable
+         * @param idle_sec 空闲多久之后开始探测
+         * @param intvl_sec 探测的间隔
+         * @param probes 没有回应的探测达到这个次数就关闭连接
+         */
+        void SetKeepAlive(bool enable, uint32_t idle_sec = TCP_KEEPALIVE_IDLE_SEC,
+            uint32_t intvl_sec = TCP_KEEPALIVE_INTVL_SEC, int probes = TCP_KEEPALIVE_PROBES);
+
+        /**
+         * @brief 平滑后的RTT(微秒),还没有采样时为0
+         *
+         * @return uint32_t
+         */
+        uint32_t SrttUs() const;
+
+        /**
+         * @brief 切换这个连接的拥塞控制算法,状态从初始窗口重新开始
+         *
+         * @param algo
+         */
+        void SetCongestion(TcpCcAlgo algo);
+        const char* CongestionName() const;
+
+        /**
+         * @brief 拥塞窗口(字节)
+         *
+         * @return uint32_t
+         */
+        uint32_t Cwnd() const;
+
+        const TcpConnKey& Key() const
+        { return key_; }
+
+        uint16_t Mss() const
+        { return mss_; }
+    private:
+        void InputLocked(const TcpSegment& seg, TcpTxList& out);
+        void SynSentInputLocked(const TcpSegment& seg, TcpTxList& out);
+        bool AckInputLocked(const TcpSegment& seg, TcpTxList& out);
+        bool DataInputLocked(const TcpSegment& seg);
+        bool OooDrainLocked();
+        void FinInputLocked();
+        bool SeqAcceptable(const TcpSegment& seg) const;
+        void NegotiateLocked(const TcpSegment& syn);
+        void SackUpdateLocked(const TcpSegment& seg);
+        bool SackNextHoleLocked(uint32_t& seq, uint32_t& len) const;
+        uint32_t PipeLocked() const;
+        void EnterRecoveryLocked(TcpTxList& out);
+        void RecoveryOutputLocked(TcpTxList& out);
+
+        void OutputLocked(TcpTxList& out);
+        void SendSegmentLocked(uint32_t seq, uint8_t flags, size_t data_len, TcpTxList& out);
+        void SendAckLocked(TcpTxList& out);
+        int SendRef(PacketBuffer& src, size_t size);
+        size_t TsoSizeLocked() const;
+        size_t BuildOptionsLocked(uint8_t flags, size_t data_len, uint8_t* opts) const;
+        void RetransmitLocked(TcpTxList& out);
+        uint16_t WindowLocked();
+
+        void ArmTimerLocked(int kind, uint32_t delay_ms);
+        void CancelTimerLocked(int kind);
+        bool TimerArmedLocked(int kind) const;
+        void OnTimerLocked(int kind, TcpTxList& out);
+        void OnRtoLocked(TcpTxList& out);
+        void OnPersistLocked(TcpTxList& out);
+        void OnKeepAliveLocked(TcpTxList& out);
+        void RttSampleLocked(uint32_t rtt_us);
+        uint32_t RtoFromEstimateLocked() const;
+        void SendProbeLocked(TcpTxList& out);
+        void CcAckLocked(uint32_t acked, uint32_t rtt_us, uint64_t now_us);
+        void CcLossLocked(TcpLossKind kind);
+        bool PaceLocked(size_t len);
+
+        void InitPassiveLocked(const std::shared_ptr<TcpSocket>& listener, const TcpConnKey& key,
+            const TcpSegment& syn, uint32_t iss);
+        bool EnterEstablishedLocked(TcpTxList& out);
+        void EnterTimeWaitLocked();
+        void CloseLocked(NetErr_t err);
+        std::deque<std::shared_ptr<TcpSocket>> CloseListenLocked();
+
+        static void ListenInput(std::shared_ptr<TcpSocket> listener, const TcpConnKey& key,
+            const TcpSegment& seg, TcpTxList& out);
+        static void CookieInput(std::shared_ptr<TcpSocket> listener, const TcpConnKey& key,
+            const TcpSegment& seg, TcpTxList& out);
+    private:
+        mutable std::mutex mutex_;
+        TcpState state_ = TCP_CLOSED;
+        NetErr_t error_ = NET_ERR_OK;
+        TcpConnKey key_ = {};
+        bool in_table_ = false;         // 是否在连接表中
+
+        // 发送序号空间
+        uint32_t iss_ = 0;              // 初始发送序号
+        uint32_t snd_una_ = 0;          // 最早的没有被确认的序号
+        uint32_t snd_nxt_ = 0;          // 下一个要发送的序号
+        uint32_t snd_wnd_ = 0;          // 对端通告的窗口
+        uint32_t snd_wl1_ = 0;          // 最近一次更新窗口的报文段序号
+        uint32_t snd_wl2_ = 0;          // 最近一次更新窗口的报文段确认号
+        uint16_t mss_ = TCP_DEFAULT_MSS;    // 发送使用的MSS(协商后)
+
+        // 接收序号空间
+        uint32_t irs_ = 0;              // 对端的初始序号
+        uint32_t rcv_nxt_ = 0;          // 期望收到的下一个序号
+        uint32_t rcv_adv_ = 0;          // 已经通告出去的窗口右边界,窗口不能往回缩
+        uint16_t rcv_mss_ = TCP_DEFAULT_MSS;    // 通告给对端的MSS
+
+        // 发送缓冲区: 从 snd_buf_seq_ 开始还没有被确认的数据
+        PacketBuffer snd_buf_;
+        uint32_t snd_buf_seq_ = 0;
+        size_t snd_buf_limit_ = TCP_SND_BUF_SIZE;
+        bool fin_queued_ = false;       // 应用已经关闭,数据发完之后发送FIN
+        bool fin_sent_ = false;
+        bool nodelay_ = false;          // 关闭Nagle算法
+        bool tso_ = true;               // 一次构建多个MSS的报文段
+
+        // 接收缓冲区: 已经按序到达、还没有被应用读取的数据
+        struct OooSegment
+        {
+            std::shared_ptr<PacketBuffer> data;
+            bool fin;
+        };
+        PacketBuffer rcv_buf_;
+        size_t rcv_buf_limit_ = TCP_RCV_BUF_SIZE;
+        bool fin_received_ = false;
+        std::map<uint32_t, OooSegment, TcpSeqLess> ooo_;    // key: 乱序报文段的起始序号
+
+        // 重传和RTT估计(RFC 6298)
+        uint32_t rto_ms_ = TCP_RTO_INIT_MS;     // 当前的重传超时(包括退避)
+        int retries_ = 0;
+        uint32_t srtt_us_ = 0;          // 平滑RTT,为0表示还没有采样
+        uint32_t rttvar_us_ = 0;        // RTT偏差
+        bool rtt_timing_ = false;       // 是否正在对一个报文段计时(Karn算法: 重传的不计时)
+        uint32_t rtt_seq_ = 0;          // 计时的报文段的序号
+        uint64_t rtt_start_us_ = 0;     // 计时的报文段的发送时间
+
+        // 握手时协商的选项
+        bool ws_ok_ = false;            // 窗口扩大(RFC 7323)
+        uint8_t snd_wscale_ = 0;        // 对端窗口的扩大因子
+        uint8_t rcv_wscale_ = 0;        // 通告窗口的扩大因子
+        bool ts_ok_ = false;            // 时间戳(RFC 7323)
+        uint32_t ts_recent_ = 0;        // 要回显给对端的时间戳
+        uint32_t last_ack_sent_ = 0;    // 最近一次发送的确认号,用于更新 ts_recent_
+        bool sack_ok_ = false;          // SACK(RFC 2018)
+        uint32_t sack_recent_ = 0;      // 最近收到的乱序报文段,SACK选项的第一个块要包含它
+
+        // SACK记分板: 被对端选择确认的区间 [左边界, 右边界),按序号排序、互不重叠.
+        // 序号会回绕,所以用 vector 按 SeqLt 维护,区间个数不会太多
+        std::vector<std::pair<uint32_t, uint32_t>> sacked_;
+        uint32_t sacked_bytes_ = 0;
+        uint32_t retran_hi_ = 0;        // 这次恢复中已经重传到的序号
+
+        // 拥塞控制
+        std::unique_ptr<TcpCongestion> cc_;
+        int dupacks_ = 0;               // 连续的重复确认
+        bool in_recovery_ = false;      // 快速恢复中(或者重传超时之后),部分确认时重传下一段
+        bool recovery_rto_ = false;     // 恢复是由重传超时引起的,窗口照常按慢启动增长
+        uint32_t recover_ = 0;          // 进入恢复时的 SND.NXT,确认到这里才退出(RFC 6582)
+        uint64_t delivered_ = 0;        // 累计被确认的字节数,用于交付速率采样
+        uint64_t rtt_delivered_ = 0;    // 计时的报文段发送时的 delivered_
+        bool app_limited_ = false;      // 计时期间发送缓冲区空了
+        double pace_tokens_ = 0;        // 平滑发送的令牌(字节)
+        uint64_t pace_stamp_us_ = 0;
+
+        // 定时器,第一次设置时才创建
+        std::unique_ptr<TimerSlot> timers_[TCP_TIMER_CNT];
+        int delack_segs_ = 0;           // 还没有确认的报文段个数,每收到两个满长度的报文段必须确认
+        uint32_t persist_ms_ = 0;       // 窗口探测的间隔(退避)
+
+        // 保活
+        bool keepalive_ = false;
+        uint32_t keepalive_idle_sec_ = TCP_KEEPALIVE_IDLE_SEC;
+        uint32_t keepalive_intvl_sec_ = TCP_KEEPALIVE_INTVL_SEC;
+        int keepalive_probes_ = TCP_KEEPALIVE_PROBES;
+        int keepalive_sent_ = 0;        // 已经发送的没有回应的保活探测
+        uint64_t last_rcv_us_ = 0;      // 最近一次收到报文段的时间
+
+        // 监听
+        std::weak_ptr<TcpSocket> listener_;     // 被动打开的连接所属的监听连接
+        // 接收线程和 Accept 之间只通过原子变量和无锁队列交互,不拿监听连接的锁
+        int backlog_ = TCP_DEFAULT_BACKLOG;
+        std::atomic<bool> listening_ = false;
+        std::atomic<int> syn_pending_ = 0;      // 还在握手中的连接个数(SYN队列)
+        std::atomic<int> accept_pushers_ = 0;   // 正在放入 accept_queue_ 的线程数,关闭时等它们结束
+        std::unique_ptr<ConcurrentQueue<std::shared_ptr<TcpSocket>>> accept_queue_;    // TcpListen 时创建
+    };
+
+    /**
+     * @brief 监听 (local_ip, local_port)
+     *
+     * @param local_ip 本地地址(网络字节序),0表示任意地址
+     * @param local_port 本地端口(主机字节序)
+     * @param backlog 握手中的连接(超过之后使用SYN cookie)和等待 Accept 的连接各自的上限
+     * @param err 返回错误码,可以为空
+     * @return std::shared_ptr<TcpSocket> 失败返回nullptr
+     */
+    std::shared_ptr<TcpSocket> TcpListen(uint32_t local_ip, uint16_t local_port,
+        int backlog = TCP_DEFAULT_BACKLOG, NetErr_t* err = nullptr);
+
+    /**
+     * @brief 发起连接,不等待握手完成
+     *
+     * @param local_ip 本地地址(网络字节序),0表示使用出口网卡的地址
+     * @param remote_ip 对端地址(网络字节序)
+     * @param remote_port 对端端口(主机字节序)
+     * @param err 返回错误码,可以为空
+     * @return std::shared_ptr<TcpSocket> 状态为 TCP_SYN_SENT,失败返回nullptr
+     */
+    std::shared_ptr<TcpSocket> TcpConnect(uint32_t local_ip, uint32_t remote_ip,
+        uint16_t remote_port, NetErr_t* err = nullptr);
 
+    /**
+     * @brief 读取监听的端口和已经建立的连接使用的非临时端口(可能重复),生成接收过滤器时使用
+     *
+     * @param ports
+     */
+    void TcpLocalPorts(std::vector<uint16_t>& ports);
 
-    void TcpPush(std::shared_ptr<PacketBuffer> pkt);
-    void TcpPop(std::shared_ptr<PacketBuffer> pkt);
+    TcpStats TcpGetStats();
 
+    /**
+     * @brief 设置SYN cookie的使用方式,对所有监听的连接生效
+     *
+     * @param mode
+     */
+    void TcpSetSynCookies(TcpSynCookieMode mode);
 
-}
\ No newline at end of file
+    void TcpInit(Timer* timer);
+    void TcpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr);
+}
@@ -0,0 +1,159 @@
+#pragma once
+/*
+    TCP拥塞控制
+
+    每个连接持有一个 TcpCongestion,在连接的锁内调用:
+        OnAck     收到推进 SND.UNA 的确认(携带这次确认的字节数、RTT采样、交付速率采样)
+        OnLoss    检测到丢包: 三个重复确认(快速重传)或者重传超时
+    发送时的可用窗口是 min(对端窗口, Cwnd()),PacingRate() 不为0时按这个速率平滑发送.
+
+    NewReno(RFC 5681/6582)、CUBIC(RFC 9438)、BBR(基于模型: 瓶颈带宽 x 最小RTT)
+ */
+#include <cstdint>
+#include <memory>
+
+#define TCP_INIT_CWND_SEGS      (10)            // 初始拥塞窗口(RFC 6928)
+#define TCP_MIN_CWND_SEGS       (2)
+
+namespace netstack
+{
+    enum TcpCcAlgo
+    {
+        TCP_CC_NEWRENO = 0,
+        TCP_CC_CUBIC,
+        TCP_CC_BBR,
+    };
+
+    enum TcpLossKind
+    {
+        TCP_LOSS_FAST = 0,      // 三个重复确认
+        TCP_LOSS_RTO,           // 重传超时
+    };
+
+    // 一次确认带来的采样
+    struct TcpAckSample
+    {
+        uint64_t now_us = 0;
+        uint32_t acked = 0;             // 这次确认的字节数
+        uint32_t in_flight = 0;         // 确认之后还在途的字节数
+        uint32_t rtt_us = 0;            // 这次确认得到的RTT采样,0表示没有
+        uint32_t srtt_us = 0;           // 平滑RTT
+        uint64_t delivery_rate = 0;     // 交付速率采样(字节/秒),0表示没有
+        bool app_limited = false;       // 采样期间发送方没有数据可发,速率采样偏低
+        bool in_recovery = false;       // 处于快速恢复(或者超时之后的恢复)中,窗口不增长
+    };
+
+    class TcpCongestion
+    {
+    public:
+        explicit TcpCongestion(uint32_t mss);
+        virtual ~TcpCongestion() = default;
+    public:
+        virtual const char* Name() const = 0;
+        virtual void OnAck(const TcpAckSample& sample) = 0;
+        virtual void OnLoss(TcpLossKind kind, uint32_t in_flight) = 0;
+
+        /**
+         * @brief 发送速率(字节/秒),0表示不限制,只受窗口约束
+         *
+         * @return uint64_t
+         */
+        virtual uint64_t PacingRate() const
+        { return 0; }
+
+        uint32_t Cwnd() const
+        { return cwnd_; }
+
+        uint32_t Ssthresh() const
+        { return ssthresh_; }
+
+        void SetMss(uint32_t mss);
+    protected:
+        uint32_t mss_;
+        uint32_t cwnd_;                 // 拥塞窗口(字节)
+        uint32_t ssthresh_ = UINT32_MAX;
+    };
+
+    class TcpNewReno : public TcpCongestion
+    {
+    public:
+        using TcpCongestion::TcpCongestion;
+    public:
+        const char* Name() const override
+        { return "newreno"; }
+        void OnAck(const TcpAckSample& sample) override;
+        void OnLoss(TcpLossKind kind, uint32_t in_flight) override;
+    private:
+        uint32_t acked_bytes_ = 0;      // 拥塞避免阶段累计的确认字节数
+    };
+
+    class TcpCubic : public TcpCongestion
+    {
+    public:
+        using TcpCongestion::TcpCongestion;
+    public:
+        const char* Name() const override
+        { return "cubic"; }
+        void OnAck(const TcpAckSample& sample) override;
+        void OnLoss(TcpLossKind kind, uint32_t in_flight) override;
+    private:
+        double w_max_ = 0;              // 上一次拥塞事件时的窗口(报文段)
+        double w_last_max_ = 0;         // 用于快速收敛
+        double k_ = 0;                  // 从 epoch 开始到达 w_max_ 需要的时间(秒)
+        double w_est_ = 0;              // 与 Reno 相同速率增长的估计窗口(报文段)
+        uint64_t epoch_us_ = 0;         // 拥塞避免阶段的开始时间,0表示还没有开始
+        double cwnd_frac_ = 0;          // 窗口增长中不足一个字节的部分
+    };
+
+    class TcpBbr : public TcpCongestion
+    {
+    public:
+        explicit TcpBbr(uint32_t mss);
+    public:
+        const char* Name() const override
+        { return "bbr"; }
+        void OnAck(const TcpAckSample& sample) override;
+        void OnLoss(TcpLossKind kind, uint32_t in_flight) override;
+        uint64_t PacingRate() const override;
+    private:
+        enum Mode { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+        uint64_t MaxBw() const;
+        uint64_t Bdp(double gain) const;
+        void UpdateModel(const TcpAckSample& sample);
+        void UpdateMode(const TcpAckSample& sample);
+        void SetCwnd(const TcpAckSample& sample);
+    private:
+        static constexpr int kBwWindow = 10;    // 瓶颈带宽取最近10轮的最大值
+
+        Mode mode_ = STARTUP;
+        uint64_t bw_[kBwWindow] = {};   // 每一轮的最大交付速率
+        uint64_t round_ = 0;            // 轮次,每个交付速率采样是一轮
+        uint32_t min_rtt_us_ = 0;
+        uint64_t min_rtt_stamp_us_ = 0;
+        uint64_t full_bw_ = 0;          // STARTUP 阶段带宽不再增长的判断
+        int full_bw_cnt_ = 0;
+        int cycle_idx_ = 0;             // PROBE_BW 的增益周期
+        uint64_t cycle_stamp_us_ = 0;
+        uint64_t probe_rtt_done_us_ = 0;
+        double pacing_gain_;
+        double cwnd_gain_;
+    };
+
+    /**
+     * @brief 创建拥塞控制模块
+     *
+     * @param algo
+     * @param mss
+     * @return std::unique_ptr<TcpCongestion>
+     */
+    std::unique_ptr<TcpCongestion> TcpCongestionCreate(TcpCcAlgo algo, uint32_t mss);
+
+    /**
+     * @brief 设置新建连接默认使用的拥塞控制算法
+     *
+     * @param algo
+     */
+    void TcpSetDefaultCongestion(TcpCcAlgo algo);
+    TcpCcAlgo TcpGetDefaultCongestion();
+}
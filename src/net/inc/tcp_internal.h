@@ -0,0 +1,138 @@
+#pragma once
+/*
+    tcp 各个源文件之间共享的内部接口,不提供给tcp以外使用
+ */
+#include "tcp.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace netstack
+{
+    class Timer;
+
+    struct TcpStatsCounter
+    {
+        std::atomic<uint64_t> active_opens = 0;
+        std::atomic<uint64_t> passive_opens = 0;
+        std::atomic<uint64_t> attempt_fails = 0;
+        std::atomic<uint64_t> estab_resets = 0;
+        std::atomic<uint64_t> in_segs = 0;
+        std::atomic<uint64_t> out_segs = 0;
+        std::atomic<uint64_t> retrans_segs = 0;
+        std::atomic<uint64_t> in_errs = 0;
+        std::atomic<uint64_t> out_rsts = 0;
+        std::atomic<uint64_t> listen_drops = 0;
+        std::atomic<uint64_t> syncookies_sent = 0;
+        std::atomic<uint64_t> syncookies_recv = 0;
+        std::atomic<uint64_t> syncookies_failed = 0;
+    };
+
+    extern TcpStatsCounter kTcpStats;
+    extern Timer* kTcpTimer;
+
+    void TcpTimerExpire(std::weak_ptr<TcpSocket> sock, int kind);
+
+    /**
+     * @brief 单调时钟(微秒),用于RTT采样和保活的空闲时间
+     *
+     * @return uint64_t
+     */
+    uint64_t TcpNowUs();
+
+    /**
+     * @brief 时间戳选项使用的时钟(毫秒)
+     *
+     * @return uint32_t
+     */
+    uint32_t TcpTsNow();
+
+    /**
+     * @brief 接收缓冲区需要的窗口扩大因子
+     *
+     * @param rcv_buf_limit
+     * @return uint8_t
+     */
+    uint8_t TcpRcvWscale(size_t rcv_buf_limit);
+
+    /**
+     * @brief 从连接表中移除,只有表中的确实是这个连接时才移除
+     *
+     * @param key
+     * @param sock
+     */
+    void TcpTableRemove(const TcpConnKey& key, const TcpSocket* sock);
+
+    /**
+     * @brief 初始序号(RFC 6528): 4微秒递增的时钟加上四元组的带密钥哈希
+     *
+     * @param key
+     * @return uint32_t
+     */
+    uint32_t TcpIsn(const TcpConnKey& key);
+
+    /**
+     * @brief 不创建连接,回复一个序号是 SYN cookie 的 SYN-ACK.
+     *        cookie 中编码了计数器和MSS,对端带了时间戳时窗口扩大因子和SACK编码在 TSval 的低位
+     *
+     * @param key
+     * @param syn
+     * @param out
+     */
+    void TcpCookieSynAck(const TcpConnKey& key, const TcpSegment& syn, TcpTxList& out);
+
+    /**
+     * @brief 校验完成握手的ACK中的 SYN cookie,恢复出当初SYN中协商的选项
+     *
+     * @param key
+     * @param ack
+     * @param syn 返回恢复出来的SYN(序号、MSS、窗口扩大、SACK、时间戳)
+     * @return true cookie有效
+     * @return false
+     */
+    bool TcpCookieCheck(const TcpConnKey& key, const TcpSegment& ack, TcpSegment& syn);
+
+    /**
+     * @brief 本端通告给对端的MSS: 路径MTU减去ipv4和tcp的头部
+     *
+     * @param remote_ip
+     * @return uint16_t
+     */
+    uint16_t TcpLocalMss(uint32_t remote_ip);
+
+    /**
+     * @brief 构建一个报文段,校验和登记为 CSUM_PARTIAL
+     *
+     * @param key
+     * @param seq
+     * @param ack
+     * @param flags
+     * @param wnd
+     * @param opts 选项(长度是4的倍数),可以为空
+     * @param opt_len
+     * @param payload 数据,以引用的方式切片,可以为空
+     * @param payload_off
+     * @param payload_len
+     * @return std::shared_ptr<PacketBuffer>
+     */
+    std::shared_ptr<PacketBuffer> TcpBuildSegment(const TcpConnKey& key, uint32_t seq, uint32_t ack,
+        uint8_t flags, uint16_t wnd, const uint8_t* opts, size_t opt_len,
+        PacketBuffer* payload, size_t payload_off, size_t payload_len);
+
+    /**
+     * @brief 回复RST: 没有连接接收的报文段,或者不可接受的确认
+     *
+     * @param key 收到报文段的连接四元组(以本端为 local)
+     * @param seg
+     * @param out
+     */
+    void TcpSendReset(const TcpConnKey& key, const TcpSegment& seg, TcpTxList& out);
+
+    /**
+     * @brief 把构建好的报文段交给ipv4发送,调用时不能持有连接的锁
+     *
+     * @param out
+     */
+    void TcpXmit(TcpTxList& out);
+}
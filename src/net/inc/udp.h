@@ -1,11 +1,184 @@
 #pragma once
+/*
+    UDP协议
 
+    0                  16                 31
+    |      源端口       |     目的端口     |
+    |      长度         |     校验和       |
+    |              数据部分                |
+
+    接收: 按 (本地地址, 本地端口) 在分发表中查找端点,先精确匹配,再匹配绑定任意地址的端点.
+          每个端点有一个无锁的接收环,接收线程只把数据包的引用放进去,不拷贝数据.
+    发送: 校验和只填入伪首部的部分和,登记为 CSUM_PARTIAL,推迟到驱动边界由网卡或软件补齐.
+    应用通过 SendBatch/RecvBatch 一次收发多个数据报(类似 sendmmsg/recvmmsg).
+    大量发送时可以设置 gso_size,一次交下来一个大数据包,在驱动边界才切分成多个数据报(UDP GSO)
+    接收方向是对称的 GRO: 端点打开后,同一批接收到的连续、同一流、同样大小的数据报合并成一个
+    数据包(以引用的方式拼接,不拷贝),gso_size 记录每段的大小,应用一次出队就拿到整批数据
+ */
+#include "concurrent_queue.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "noncopyable.h"
 #include "packet_buffer.h"
+
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <vector>
+
+#define UDP_RECV_RING_SIZE      (1024)      // 每个端点接收环的大小
+#define UDP_EPHEMERAL_MIN       (49152)     // 临时端口的范围(RFC 6335)
+#define UDP_EPHEMERAL_MAX       (65535)
+#define UDP_GRO_MAX_SEGMENTS    (64)        // 一次最多合并的数据报个数
 
-namespace netstack 
+namespace netstack
 {
+    #pragma pack(1)
+    struct UdpHdr
+    {
+        uint16_t    src_port;       // 源端口
+        uint16_t    dst_port;       // 目的端口
+        uint16_t    length;         // 长度(包括头部)
+        uint16_t    checksum;       // 校验和(包括伪首部)
+    };
+    #pragma pack()
+
+    // 收发的一个数据报
+    struct UdpDatagram
+    {
+        std::shared_ptr<PacketBuffer> pkt;  // 数据(不包含头部)
+        uint32_t    remote_ip = 0;          // 对端地址(网络字节序)
+        uint16_t    remote_port = 0;        // 对端端口(主机字节序)
+        uint32_t    local_ip = 0;           // 接收时为数据报的目的地址(网络字节序)
+        uint16_t    gso_size = 0;           // 发送时不为0表示把数据按这个大小切分成多个数据报(GSO)
+                                            // 接收时不为0表示由多个这个大小的数据报合并而成(GRO),
+                                            // 只有最后一段可以更小
+    };
+
+    // 端点的统计
+    struct UdpEndpointStats
+    {
+        uint64_t rx_packets = 0;        // 放入接收环的数据报(合并前的个数)
+        uint64_t rx_coalesced = 0;      // GRO 合并后放入接收环的数据包
+        uint64_t rx_drop_full = 0;      // 接收环满了被丢弃
+        uint64_t rx_drop_checksum = 0;  // 校验和错误被丢弃
+        uint64_t tx_packets = 0;        // 发送成功的数据报
+        uint64_t tx_errors = 0;         // 发送失败的数据报
+    };
+
+    // 接收时没有对应端点等全局的丢弃统计
+    struct UdpStats
+    {
+        uint64_t drop_no_port = 0;      // 没有端点绑定目的端口
+        uint64_t drop_length = 0;       // 长度不合法
+    };
+
+
+    class UdpEndpoint : public NonCopyable
+    {
+        friend void UdpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr);
+        friend void UdpGroFlush();
+    public:
+        UdpEndpoint(uint32_t local_ip, uint16_t local_port, size_t ring_size = UDP_RECV_RING_SIZE);
+        ~UdpEndpoint();
+    public:
+        /**
+         * @brief 批量发送数据报
+         *
+         * @param dgrams
+         * @param cnt
+         * @return int 发送成功的个数,遇到第一个失败就停止
+         */
+        int SendBatch(const UdpDatagram* dgrams, int cnt);
+
+        /**
+         * @brief 批量接收数据报,不阻塞
+         *
+         * @param dgrams
+         * @param cnt 最多接收的个数
+         * @return int 接收到的个数
+         */
+        int RecvBatch(UdpDatagram* dgrams, int cnt);
+
+        uint32_t LocalIp() const
+        { return local_ip_; }
+
+        uint16_t LocalPort() const
+        { return local_port_; }
+
+        /**
+         * @brief 打开接收合并(GRO),应用需要按 gso_size 拆分收到的数据
+         *
+         * @param enable
+         */
+        void SetGro(bool enable)
+        { gro_.store(enable, std::memory_order_relaxed); }
+
+        bool GroEnabled() const
+        { return gro_.load(std::memory_order_relaxed); }
+
+        UdpEndpointStats GetStats() const;
+    private:
+        void Deliver(UdpDatagram& dgram, int seg_cnt);
+    private:
+        uint32_t local_ip_;         // 为0表示绑定任意地址(网络字节序)
+        uint16_t local_port_;       // 主机字节序
+        ConcurrentQueue<UdpDatagram> recv_ring_;
+        std::atomic<bool> gro_ = false;
+
+        std::atomic<uint64_t> rx_packets_ = 0;
+        std::atomic<uint64_t> rx_coalesced_ = 0;
+        std::atomic<uint64_t> rx_drop_full_ = 0;
+        std::atomic<uint64_t> rx_drop_checksum_ = 0;
+        std::atomic<uint64_t> tx_packets_ = 0;
+        std::atomic<uint64_t> tx_errors_ = 0;
+    };
+
+    /**
+     * @brief 创建一个端点并绑定到 (local_ip, local_port)
+     *
+     * @param local_ip 本地地址(网络字节序),0表示任意地址
+     * @param local_port 本地端口(主机字节序),0表示分配一个临时端口
+     * @param err 返回错误码,可以为空
+     * @return std::shared_ptr<UdpEndpoint> 失败返回nullptr
+     */
+    std::shared_ptr<UdpEndpoint> UdpOpen(uint32_t local_ip, uint16_t local_port, NetErr_t* err = nullptr);
+
+    /**
+     * @brief 从分发表中移除端点,之后不会再收到数据报
+     *
+     * @param endpoint
+     */
+    void UdpClose(const std::shared_ptr<UdpEndpoint>& endpoint);
+
+    /**
+     * @brief 读取所有绑定的本地端口(可能重复),生成接收过滤器时使用
+     *
+     * @param ports
+     */
+    void UdpLocalPorts(std::vector<uint16_t>& ports);
+
+    UdpStats UdpGetStats();
+
+    /**
+     * @brief 添加UDP头部并交给ipv4发送
+     *
+     * @param pkt 数据(不包含头部)
+     * @param src_ip 源地址(网络字节序),0表示使用出口网卡的地址
+     * @param src_port 源端口(主机字节序)
+     * @param dst_ip 目的地址(网络字节序)
+     * @param dst_port 目的端口(主机字节序)
+     * @param gso_size 不为0时数据按这个大小切分成多个数据报,头部只构建一次,在驱动边界切分
+     * @return NetErr_t
+     */
+    NetErr_t UdpPush(std::shared_ptr<PacketBuffer> pkt, uint32_t src_ip, uint16_t src_port,
+        uint32_t dst_ip, uint16_t dst_port, uint16_t gso_size = 0);
+    /**
+     * @brief 一个接收批次结束,把当前线程正在合并的数据报放入端点的接收环
+     *
+     */
+    void UdpGroFlush();
 
-    void UdpPush(std::shared_ptr<PacketBuffer> pkt);
-    void UdpPop(std::shared_ptr<PacketBuffer> pkt);
-}
\ No newline at end of file
+    void UdpInit();
+    void UdpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr);
+}
@@ -0,0 +1,170 @@
+#pragma once
+/*
+    虚拟网线: 两个使用 WireDriver 的网卡接口通过内存中的环形队列直接相连,不需要真实的网卡.
+    一端 NetTx 交给设备的数据包原样(不复制)放进对端的环形队列,对端 NetRx 读出来,
+    可以在一个进程中端到端地运行 arp、ipv4、udp、tcp,用来做可重复的收发基准测试.
+
+    每个方向的链路可以单独设置延迟、带宽、丢包率和乱序:
+        发送时间 = max(现在, 链路空闲时间),链路空闲时间 += 长度 / 带宽
+        排队的数据 = (链路空闲时间 - 现在) * 带宽,设置了队列长度时超过的包被丢弃
+        到达时间 = 发送完成时间 + 延迟,乱序的包再额外加上 reorder_delay_us
+    丢包和乱序使用固定种子的随机数,同样的参数和同样的发送顺序得到同样的结果.
+
+    接收端的 fd 是一个 epoll,里面有一个 eventfd(对端放入了新的数据包)和一个 timerfd
+    (最早的还没到达的数据包的到达时间),所以可以和其他网卡一样交给 RecvEventLoop.
+ */
+#include "concurrent_queue.h"
+#include "net_driver.h"
+#include "net_interface.h"
+#include "net_err.h"
+#include "sys_plat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <vector>
+
+#define WIRE_RING_SIZE          (1024)      // 每个方向的环形队列长度
+
+namespace netstack
+{
+    // 一个方向的链路参数
+    struct WireLinkOptions
+    {
+        uint32_t latency_us = 0;        // 单向延迟
+        uint64_t bandwidth_bps = 0;     // 带宽(比特每秒),0表示不限制
+        uint32_t queue_bytes = 0;       // 瓶颈队列的长度(字节),排队的数据超过时丢弃新来的包,0表示不限制
+        double loss = 0;                // 丢包率(0 ~ 1)
+        double reorder = 0;             // 乱序的比例(0 ~ 1)
+        uint32_t reorder_delay_us = 100;    // 乱序的包额外推迟的时间
+        uint32_t seed = 1;              // 丢包、乱序使用的随机数种子
+    };
+
+    // 一个方向的统计,由发送端记录
+    struct WireLinkStats
+    {
+        uint64_t tx_packets = 0;
+        uint64_t tx_bytes = 0;
+        uint64_t lost = 0;              // 按丢包率丢弃的
+        uint64_t queue_drops = 0;       // 瓶颈队列满了丢弃的
+        uint64_t reordered = 0;
+        uint64_t ring_drops = 0;        // 对端的环形队列满了
+        uint64_t rx_packets = 0;        // 对端已经读取的
+    };
+
+    class WireDriver : public NetDriver
+    {
+        friend class VirtualWire;
+    public:
+        /**
+         * @brief 构造函数,一般通过 VirtualWire 创建
+         *
+         * @param ring_size 接收环形队列的长度
+         */
+        WireDriver(size_t ring_size = WIRE_RING_SIZE);
+        ~WireDriver();
+    public:
+        /**
+         * @brief 设置从这一端发往对端方向的链路参数
+         *
+         * @param opts
+         */
+        void SetLink(const WireLinkOptions& opts);
+
+        /**
+         * @brief 从这一端发往对端方向的统计
+         *
+         * @return WireLinkStats
+         */
+        WireLinkStats GetLinkStats();
+    public:
+        NetErr_t Open(NetInfo* info) override;
+        int RxBurst(SharedPkt* pkts, int max) override;
+        int TxBurst(SharedPkt* pkts, int cnt) override;
+
+        int GetFd() const override
+        { return epoll_fd_; }
+
+        // 和veth一样,发送端不计算校验和,接收端不再验证
+        uint32_t GetCaps() const override
+        { return NETIF_CAP_TX_CSUM | NETIF_CAP_RX_CSUM; }
+
+        int MaxBatch() const override
+        { return NETIF_RX_BATCH; }
+
+        NetDriverStats GetStats() override;
+
+        const char* Name() const override
+        { return "wire"; }
+    private:
+        // 在链路上传输的数据包
+        struct WireFrame
+        {
+            SharedPkt pkt;
+            uint64_t arrive_ns;     // 到达对端的时间(CLOCK_MONOTONIC)
+            uint64_t seq;           // 到达时间相同时按发送顺序
+
+            bool operator>(const WireFrame& rhs) const
+            { return arrive_ns != rhs.arrive_ns ? arrive_ns > rhs.arrive_ns : seq > rhs.seq; }
+        };
+
+        bool TransmitLocked(SharedPkt& pkt, uint64_t now);
+        void NotifyPeer();
+        void ArmTimer();
+    private:
+        WireDriver* peer_ = nullptr;
+
+        // 发送方向的链路,由 link_mutex_ 保护
+        std::mutex link_mutex_;
+        WireLinkOptions link_;
+        WireLinkStats stats_;
+        std::mt19937_64 rng_;
+        uint64_t link_free_ns_ = 0;     // 链路上一个包发送完成的时间
+        uint64_t tx_seq_ = 0;
+
+        // 接收方向. 环形队列可以多个线程放入,只有接收线程读取
+        ConcurrentQueue<WireFrame> ring_;
+        std::atomic<bool> rx_notified_;     // 已经写过 eventfd,接收端还没有处理
+        std::atomic<uint64_t> rx_packets_;
+        std::atomic<uint64_t> rx_bytes_;
+        std::priority_queue<WireFrame, std::vector<WireFrame>, std::greater<WireFrame>> in_flight_;
+        int epoll_fd_ = -1;
+        int event_fd_ = -1;
+        int timer_fd_ = -1;
+    };
+
+    class VirtualWire
+    {
+    public:
+        /**
+         * @brief 创建两个网卡接口并连接起来,打开之后加入网卡接口表.
+         *        创建fd或者打开失败时抛出 std::runtime_error
+         *
+         * @param a
+         * @param b
+         * @param ring_size
+         */
+        VirtualWire(NetInfo* a, NetInfo* b, size_t ring_size = WIRE_RING_SIZE);
+        ~VirtualWire();
+    public:
+        NetInterface* GetA()
+        { return a_.get(); }
+
+        NetInterface* GetB()
+        { return b_.get(); }
+
+        WireDriver* GetDriverA()
+        { return driver_a_; }
+
+        WireDriver* GetDriverB()
+        { return driver_b_; }
+    private:
+        WireDriver* driver_a_;      // 由网卡接口管理
+        WireDriver* driver_b_;
+        std::unique_ptr<NetInterface> a_;
+        std::unique_ptr<NetInterface> b_;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+/*
+    AF_XDP网卡: 网卡队列上挂一个XDP程序,把这个队列收到的帧重定向到 AF_XDP socket,
+    绕过内核协议栈. 不依赖libbpf,XDP程序只有几条指令,直接通过 bpf() 系统调用加载.
+
+    UMEM(和内核共享的一大块内存,按 frame_size 切分成帧)就是数据包的存储:
+    - 接收: RX环中的描述符指向UMEM中的帧,直接包装成 PacketBlock(AppendExternal),
+      不复制. 帧前面的 XDP_PACKET_HEADROOM 留作添加头部的空间. 数据包释放时帧回到
+      空闲队列,接收循环再批量放回填充环(fill ring).
+    - 发送: 数据在本网卡的UMEM帧中(比如原地修改后回复的数据包)时描述符直接指向数据,
+      数据包在完成环(completion ring)确认之前一直保留;其他数据包复制到一个空闲帧中.
+
+    四个环都是单生产者单消费者的: RX环和填充环只由接收线程访问,TX环和完成环由发送锁保护.
+    在没有零拷贝驱动的网卡(比如veth)上使用复制模式(XDP_COPY).
+ */
+#include "concurrent_queue.h"
+#include "net_driver.h"
+#include "net_interface.h"
+#include "net_err.h"
+#include "sys_plat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define XDP_DEFAULT_FRAME_CNT   (4096)
+#define XDP_DEFAULT_FRAME_SIZE  (2048)
+#define XDP_DEFAULT_RING_SIZE   (2048)
+#define XDP_MAX_QUEUE_ID        (64)    // XSKMAP的大小
+
+namespace netstack
+{
+    struct XdpOptions
+    {
+        std::string ifname;                     // 网卡名称
+        uint32_t queue_id = 0;                  // 绑定的网卡接收队列
+        uint32_t frame_cnt = XDP_DEFAULT_FRAME_CNT;
+        uint32_t frame_size = XDP_DEFAULT_FRAME_SIZE;   // 2048或者4096
+        uint32_t ring_size = XDP_DEFAULT_RING_SIZE;     // 四个环的大小,2的幂
+        bool copy_mode = true;                  // XDP_COPY,否则要求驱动支持零拷贝
+        bool skb_mode = false;                  // 使用通用XDP(XDP_FLAGS_SKB_MODE)挂载程序
+    };
+
+    // 环的占用情况(已经放入、对方还没有取走的个数)
+    struct XdpRingStats
+    {
+        uint32_t size = 0;
+        uint32_t used = 0;
+    };
+
+    struct XdpStats
+    {
+        XdpRingStats rx;
+        XdpRingStats fill;
+        XdpRingStats tx;
+        XdpRingStats completion;
+        uint64_t free_frames = 0;       // 空闲队列中的帧
+        uint64_t rx_packets = 0;
+        uint64_t rx_bytes = 0;
+        uint64_t tx_packets = 0;
+        uint64_t tx_bytes = 0;
+        uint64_t tx_zero_copy = 0;      // 直接指向UMEM中数据发送的
+        uint64_t tx_no_frame = 0;       // 没有空闲的帧或者TX环满了,丢弃
+        uint64_t tx_errors = 0;         // 数据包比帧大
+        // 内核的统计(XDP_STATISTICS)
+        uint64_t rx_dropped = 0;
+        uint64_t rx_invalid_descs = 0;
+        uint64_t tx_invalid_descs = 0;
+        uint64_t rx_ring_full = 0;
+        uint64_t rx_fill_ring_empty = 0;
+    };
+
+    struct XdpUmem;
+    class XdpDriver : public NetDriver
+    {
+    public:
+        XdpDriver(const XdpOptions& opts);
+        ~XdpDriver();
+    public:
+        /**
+         * @brief 创建UMEM和四个环,绑定到网卡队列,挂载XDP程序. 网卡的mac地址和MTU填到 info 中.
+         *        需要 CAP_NET_ADMIN 和 CAP_BPF(或者root)
+         *
+         * @param info
+         * @return NetErr_t 参数错误返回 NET_ERR_PARAM,系统调用失败返回 NET_ERR_IO
+         */
+        NetErr_t Open(NetInfo* info) override;
+        int RxBurst(SharedPkt* pkts, int max) override;
+        int TxBurst(SharedPkt* pkts, int cnt) override;
+
+        // RX环中有数据时可读
+        int GetFd() const override
+        { return xsk_fd_; }
+
+        uint32_t GetCaps() const override
+        { return 0; }
+
+        int MaxBatch() const override
+        { return NETIF_RX_BATCH; }
+
+        NetDriverStats GetStats() override;
+
+        const char* Name() const override
+        { return "xdp"; }
+
+        // 包括四个环的占用情况和内核的统计
+        XdpStats GetXdpStats();
+    private:
+        // 映射到用户空间的环
+        struct XdpRing
+        {
+            uint32_t* producer = nullptr;
+            uint32_t* consumer = nullptr;
+            uint32_t* flags = nullptr;
+            void* descs = nullptr;
+            uint32_t size = 0;
+            void* map = nullptr;
+            size_t map_len = 0;
+        };
+
+        NetErr_t MapRing(XdpRing& ring, uint64_t pgoff, size_t desc_size, const void* offsets);
+        NetErr_t AttachProgram(int ifindex, bool skb_mode);
+        bool TxOneLocked(SharedPkt& pkt);
+        void KickTxLocked();
+        void ReapCompletionLocked();
+        void RefillFill();
+        void Close();
+    private:
+        XdpOptions opts_;
+        std::shared_ptr<XdpUmem> umem_;     // 接收的数据包通过释放函数引用,可能比网卡接口活得更久
+        int xsk_fd_ = -1;
+        int map_fd_ = -1;
+        int prog_fd_ = -1;
+        int link_fd_ = -1;
+        uint32_t queue_id_ = 0;
+
+        XdpRing rx_;
+        XdpRing fill_;
+        XdpRing tx_;
+        XdpRing comp_;
+
+        std::mutex tx_mutex_;
+        std::vector<SharedPkt> tx_pending_;     // 下标为帧号,零拷贝发送、还没有完成的数据包
+        uint32_t tx_outstanding_ = 0;           // 已经放入TX环还没有完成的个数
+
+        std::atomic<uint64_t> rx_packets_;
+        std::atomic<uint64_t> rx_bytes_;
+        std::atomic<uint64_t> tx_packets_;
+        std::atomic<uint64_t> tx_bytes_;
+        std::atomic<uint64_t> tx_zero_copy_;
+        std::atomic<uint64_t> tx_no_frame_;
+        std::atomic<uint64_t> tx_errors_;
+    };
+}
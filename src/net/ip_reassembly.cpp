@@ -0,0 +1,244 @@
+#include "ip_reassembly.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "packet_buffer.h"
+#include "time_entry.h"
+#include "timer.h"
+
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+#define REASS_FRAG_OVERHEAD     (64)    // 每个分片除了数据以外额外占用的内存(估算)
+
+namespace netstack
+{
+    Ipv4Reassembly::Ipv4Reassembly(size_t mem_limit)
+        : mem_limit_(mem_limit)
+    {
+
+    }
+
+    Ipv4Reassembly::~Ipv4Reassembly()
+    {
+
+    }
+
+    /**
+     * @brief 处理一个分片,如果数据报的全部分片都到齐了,则拼接成完整的数据报返回
+     *
+     * @param pkt
+     * @param hdr
+     * @param out_pkt
+     * @param out_hdr
+     * @return NetErr_t
+     */
+    NetErr_t Ipv4Reassembly::Input(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& hdr,
+        std::shared_ptr<PacketBuffer>& out_pkt, IPV4_Hdr& out_hdr)
+    {
+        using namespace std::chrono;
+        out_pkt = nullptr;
+
+        uint32_t offset = hdr.FragOffset();
+        bool more_fragment = hdr.MoreFragment();
+        uint32_t size = pkt->DataSize();
+
+        // 除了最后一片,每片的数据大小必须是8的倍数; 重组后的数据报不能超过65535字节
+        if (size == 0 || (more_fragment && (size & 7))
+            || offset + size + sizeof(IPV4_Hdr) > 0xffff)
+        {
+            dropped_++;
+            return NET_ERR_INVALID_FRAME;
+        }
+
+        ReassKey key = { hdr.src_ipaddr, hdr.dst_ipaddr, hdr.identification, hdr.protocol };
+        Shard& shard = GetShard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        ExpireLocked(shard);
+
+        auto it = shard.table.find(key);
+        if (it == shard.table.end())    // 表示当前是这个数据报收到的第一个分片
+        {
+            it = shard.table.emplace(key, ReassEntry()).first;
+            ReassEntry& entry = it->second;
+            entry.key = key;
+            entry.serial = ++serial_;
+            entry.deadline = steady_clock::now() + seconds(REASS_TIMEOUT_SEC);
+            entry.lru_it = shard.lru.insert(shard.lru.end(), key);
+
+            if (timer_)
+                timer_->AddByDelay(TimeEntry({ REASS_TIMEOUT_SEC, 0 }),
+                    &Ipv4Reassembly::Expire, this, key, entry.serial);
+        }
+        else    // 最近收到了分片,移动到 LRU 链表的末尾
+            shard.lru.splice(shard.lru.end(), shard.lru, it->second.lru_it);
+
+        ReassEntry& entry = it->second;
+        bool invalid = false;
+        if (!more_fragment)     // 最后一片设置总大小
+        {
+            if (entry.total_size != 0 && entry.total_size != offset + size)
+                invalid = true;
+            // 之前收到的分片超过了总大小,这个数据报永远不能重组完成
+            if (!entry.fragments.empty())
+            {
+                auto last = entry.fragments.rbegin();
+                if (last->first + last->second->DataSize() > offset + size)
+                    invalid = true;
+            }
+            entry.total_size = offset + size;
+        }
+        if (entry.total_size != 0 && offset + size > entry.total_size)
+            invalid = true;
+
+        // 检查是否和已经收到的分片重叠. 完全相同的重复分片直接忽略,部分重叠的丢弃整个数据报
+        auto next = entry.fragments.lower_bound(offset);
+        if (next != entry.fragments.end() && next->first == offset
+            && next->second->DataSize() == size)
+            return NET_ERR_OK;
+        if (next != entry.fragments.end() && next->first < offset + size)
+            invalid = true;
+        if (next != entry.fragments.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second->DataSize() > offset)
+                invalid = true;
+        }
+        if (entry.fragments.size() >= REASS_MAX_FRAGMENTS)
+            invalid = true;
+
+        if (invalid)
+        {
+            EraseLocked(shard, it);
+            dropped_++;
+            return NET_ERR_INVALID_FRAME;
+        }
+
+        size_t mem_size = pkt->TotalSize() + REASS_FRAG_OVERHEAD;
+        entry.fragments.emplace_hint(next, offset, pkt);
+        entry.recv_size += size;
+        entry.mem_size += mem_size;
+        mem_used_ += mem_size;
+        if (offset == 0)
+        {
+            entry.first_hdr = hdr;
+            entry.has_first = true;
+        }
+
+        // 分片之间没有重叠,数据大小等于总大小就表示全部到齐了
+        if (entry.total_size != 0 && entry.recv_size == entry.total_size)
+        {
+            // 进行分片重组,以引用的方式拼接每个分片的数据
+            out_pkt = std::make_shared<PacketBuffer>();
+            for (auto& fragment : entry.fragments)
+                out_pkt->AppendSlice(*fragment.second, 0, fragment.second->DataSize());
+
+            out_hdr = entry.first_hdr;
+            out_hdr.total_length = entry.total_size + out_hdr.HeaderLen();
+            out_hdr.flags_fragment = 0;
+
+            EraseLocked(shard, it);
+            completed_++;
+            return NET_ERR_OK;
+        }
+
+        // 超过内存上限,先淘汰当前 shard 中最久的数据报,不够再去其他 shard 中淘汰
+        if (mem_used_.load(std::memory_order_relaxed) > mem_limit_)
+        {
+            EvictLocked(shard, key);
+            lock.unlock();
+            if (mem_used_.load(std::memory_order_relaxed) > mem_limit_)
+                EvictOthers(shard);
+        }
+
+        return NET_ERR_OK;
+    }
+
+    ReassStats Ipv4Reassembly::GetStats() const
+    {
+        ReassStats stats;
+        stats.completed = completed_.load(std::memory_order_relaxed);
+        stats.timed_out = timed_out_.load(std::memory_order_relaxed);
+        stats.evicted = evicted_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.mem_used = mem_used_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /**
+     * @brief 定时器回调: 数据报超时还没有重组完成,丢弃已经收到的分片
+     *
+     * @param key
+     * @param serial 创建时的编号,同一个键可能已经是新的数据报了
+     */
+    void Ipv4Reassembly::Expire(ReassKey key, uint64_t serial)
+    {
+        Shard& shard = GetShard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.table.find(key);
+        if (it == shard.table.end() || it->second.serial != serial)
+            return;
+
+        EraseLocked(shard, it);
+        timed_out_++;
+    }
+
+    void Ipv4Reassembly::EraseLocked(Shard& shard,
+        std::unordered_map<ReassKey, ReassEntry, ReassKeyHash>::iterator it)
+    {
+        mem_used_ -= it->second.mem_size;
+        shard.lru.erase(it->second.lru_it);
+        shard.table.erase(it);
+    }
+
+    /**
+     * @brief 清理已经超时的数据报. 按 LRU 顺序检查,遇到没有超时的就停止,
+     *        这样即使定时器还没有运行,超时的数据报也会被回收
+     *
+     * @param shard
+     */
+    void Ipv4Reassembly::ExpireLocked(Shard& shard)
+    {
+        auto now = std::chrono::steady_clock::now();
+        while (!shard.lru.empty())
+        {
+            auto it = shard.table.find(shard.lru.front());
+            if (it->second.deadline > now)
+                break;
+            EraseLocked(shard, it);
+            timed_out_++;
+        }
+    }
+
+    void Ipv4Reassembly::EvictLocked(Shard& shard, const ReassKey& keep)
+    {
+        while (mem_used_.load(std::memory_order_relaxed) > mem_limit_ && !shard.lru.empty())
+        {
+            if (shard.lru.front() == keep)  // 正在重组的数据报是最新的,不淘汰
+                break;
+            EraseLocked(shard, shard.table.find(shard.lru.front()));
+            evicted_++;
+        }
+    }
+
+    void Ipv4Reassembly::EvictOthers(Shard& self)
+    {
+        for (Shard& shard : shards_)
+        {
+            if (&shard == &self)
+                continue;
+            // 其他 shard 正在被使用就跳过,不在这里等待
+            std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+            if (!lock.owns_lock())
+                continue;
+            while (mem_used_.load(std::memory_order_relaxed) > mem_limit_ && !shard.lru.empty())
+            {
+                EraseLocked(shard, shard.table.find(shard.lru.front()));
+                evicted_++;
+            }
+            if (mem_used_.load(std::memory_order_relaxed) <= mem_limit_)
+                return;
+        }
+    }
+}
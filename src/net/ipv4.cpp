@@ -1,128 +1,339 @@
 #include "ipv4.h"
+#include "checksum.h"
+#include "arp.h"
 #include "ether.h"
 #include "icmp.h"
+#include "ip_reassembly.h"
 #include "net_err.h"
 #include "net_interface.h"
 #include "net_type.h"
 #include "packet_buffer.h"
 #include "routing.h"
-#include "tcp.h"
-#include "udp.h"
+#include "rx_filter.h"
 #include "util.h"
 
 #include <arpa/inet.h>
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <memory>
+#include <vector>
 
 
-#define IPV4_DATA_MAX_SIZE  (1480)      // ipv4数据载荷最大支持1480字节: MTU(1500) - ipv4头部(20字节)
-
 namespace netstack 
 {
     extern std::map<uint32_t, NetInterface*> kNetifacesMap;    // 定义在net_init.cpp中
 
-    static uint16_t kDataIdentification = 0;    // 数据包的标识
     static uint16_t kDefaultTTL = 64;           // 默认TTL为64(linux默认为这个值)
 
-    // key: 标识,   value: 收到的报文
-    static std::map<uint16_t, MsgReassembly> kMsgReassemblyMap; // 接收重组分片的map
-    static std::atomic<pthread_t> kMsgRessemblyLock = 0;            // 用于对上面的锁
+    static Ipv4Reassembly kReassembly;          // 接收分片的重组表
+    static Ipv4Handler kProtoHandlers[256];     // 上层协议的处理函数,下标为协议号
+    static std::atomic<uint64_t> kDropCounts[IPV4_DROP_REASON_CNT];    // 各个原因丢弃的数据包数量
+    static std::atomic<bool> kIpForward = false;    // 是否转发不是发给本机的数据报
+    static std::atomic<uint64_t> kForwardCount = 0; // 转发的数据包数量
 
 
 
 
 /////////////////////////////////////////////////////////////// 函数实现
+    // 将ipv4头转成网络字节序
+    void Ipv4Host2Network(IPV4_Hdr* hdr)
+    {
+        hdr->total_length = htons(hdr->total_length);
+        hdr->identification = htons(hdr->identification);
+        hdr->flags_fragment = htons(hdr->flags_fragment);
+        hdr->head_checksum = htons(hdr->head_checksum);
+    }
+
     /**
-     * @brief 计算ipv4的校验和
+     * @brief 将ipv4头部转换成网络字节序
      * 
      * @param hdr 
-     * @return uint16_t 
      */
-    uint16_t CheckSum(IPV4_Hdr* hdr)
+    void Ipv4Network2Host(IPV4_Hdr* hdr)
     {
-        uint32_t sum = 0;
-        uint8_t* hdr_ptr = reinterpret_cast<uint8_t*>(hdr);
-        for (int i = 0; i < 20; i += 2)
+        hdr->total_length = ntohs(hdr->total_length);
+        hdr->identification = ntohs(hdr->identification);
+        hdr->flags_fragment = ntohs(hdr->flags_fragment);
+        hdr->head_checksum = ntohs(hdr->head_checksum);
+    }
+
+    /**
+     * @brief 一次检查ipv4头部的合法性: 版本、头部长度、总长度、校验和.
+     *        以太网帧可能带有填充,总长度比数据包小时去掉末尾的填充
+     * 
+     * @param pkt 
+     * @param hdr 返回主机字节序的头部
+     * @return int 合法返回 -1,否则返回丢弃原因
+     */
+    static int CheckIpv4(std::shared_ptr<PacketBuffer>& pkt, IPV4_Hdr& hdr)
+    {
+        size_t pkt_size = pkt->DataSize();
+        if (pkt_size < sizeof(IPV4_Hdr))
+            return IPV4_DROP_TRUNCATED;
+
+        // 头部通常都在第一个内存块中,直接在原地检查; 否则先拷贝出来
+        uint8_t hdr_buf[60];
+        const uint8_t* hdr_ptr = pkt->GetObjectPtr<uint8_t>();
+        PacketBlock* head = pkt->GetBlocks().front();
+        if (head->DataSize() < sizeof(IPV4_Hdr))
         {
-            uint16_t word = (hdr_ptr[i] << 8) + hdr_ptr[i + 1];
-            sum += word;
+            pkt->ReadAt(0, hdr_buf, sizeof(IPV4_Hdr));
+            hdr_ptr = hdr_buf;
         }
-        while (sum >> 16)
-            // 低16位与溢出部分重新累加
-            sum = (sum & 0xffff) + (sum >> 16);
 
-        // 将结果进行反码
-        return static_cast<uint16_t>(~sum);
+        uint8_t version_length = hdr_ptr[0];
+        size_t hdr_len = (version_length & 0x0f) * 4;
+        if ((version_length >> 4) != 4)
+            return IPV4_DROP_VERSION;
+        if (hdr_len < sizeof(IPV4_Hdr) || hdr_len > pkt_size)
+            return IPV4_DROP_HDR_LEN;
+        if (head->DataSize() < hdr_len)     // 选项不在第一个内存块中(或者只拷贝了固定头部)
+        {
+            pkt->ReadAt(0, hdr_buf, hdr_len);
+            hdr_ptr = hdr_buf;
+        }
+
+        memcpy(&hdr, hdr_ptr, sizeof(IPV4_Hdr));
+        Ipv4Network2Host(&hdr);
+        if (hdr.total_length < hdr_len || hdr.total_length > pkt_size)
+            return IPV4_DROP_TOTAL_LEN;
+        if (!pkt->CsumVerified() && Checksum16(hdr_ptr, hdr_len) != 0)
+            return IPV4_DROP_CHECKSUM;
+
+        if (hdr.total_length < pkt_size)
+            pkt->RemoveTail(pkt_size - hdr.total_length);
+        return -1;
     }
 
+    /**
+     * @brief 查找源ip对应的网卡接口,源ip为任意地址时使用出口网卡
+     * 
+     * @param src_ip 
+     * @param send_iface 
+     * @return NetInterface* 
+     */
+    NetInterface* Ipv4SrcIface(uint32_t src_ip, NetInterface* send_iface)
+    {
+        auto it = kNetifacesMap.find(src_ip);
+        return it != kNetifacesMap.end() ? it->second : send_iface;
+    }
 
-    NetErr_t CheckIpv4(std::shared_ptr<PacketBuffer>& pkt)
+    /**
+     * @brief 数据报分片. 每个分片由新的ipv4头部加上原数据的切片(引用,不拷贝)组成.
+     *        转发已经是分片的数据报时,偏移在原来的基础上累加,原来有MF的最后一片也保留MF.
+     *        选项不会复制到分片中
+     * 
+     * @param pkt 数据报的数据(不包含ipv4头部)
+     * @param hdr 主机字节序的ipv4头部
+     * @param mtu 路径MTU
+     * @param fragments 返回构建好的分片
+     * @return NetErr_t 
+     */
+    static NetErr_t Ipv4BuildFragments(std::shared_ptr<PacketBuffer>& pkt, const IPV4_Hdr& hdr, 
+        uint32_t mtu, std::vector<std::shared_ptr<PacketBuffer>>& fragments)
     {
+        // 除了最后一片,每片的数据大小必须是8的倍数
+        size_t chunk_max = (mtu - sizeof(IPV4_Hdr)) & ~size_t(7);
+        size_t data_size = pkt->DataSize();
+        size_t base_offset = hdr.FragOffset();
+        if (chunk_max == 0)
+            return NET_ERR_SIZE;
+
+        fragments.reserve((data_size + chunk_max - 1) / chunk_max);
+        for (size_t offset = 0; offset < data_size; offset += chunk_max)
+        {
+            size_t chunk_size = std::min(chunk_max, data_size - offset);
+            std::shared_ptr<PacketBuffer> chunk_pkt = pkt->Slice(offset, chunk_size);
+            if (chunk_pkt == nullptr)
+                return NET_ERR_SIZE;
+
+            IPV4_Hdr frag_hdr = hdr;
+            frag_hdr.version_length = (4 << 4) | (sizeof(IPV4_Hdr) / 4);
+            frag_hdr.flags_fragment = ((base_offset + offset) >> 3) & IPV4_FRAG_OFF_MASK;
+            if (offset + chunk_size < data_size || hdr.MoreFragment())    // 还有更多分片
+                frag_hdr.flags_fragment |= IPV4_FLAG_MF;
+            frag_hdr.total_length = chunk_size + sizeof(IPV4_Hdr); // 总长度=数据长度+头部大小
+            frag_hdr.head_checksum = 0;
+            
+            Ipv4Host2Network(&frag_hdr);
+            frag_hdr.head_checksum = Checksum16(&frag_hdr, sizeof(frag_hdr));
+            chunk_pkt->AddHeader(sizeof(IPV4_Hdr), (const unsigned char*)&frag_hdr);
+            fragments.push_back(chunk_pkt);
+        }
 
         return NET_ERR_OK;
     }
 
-    // 将ipv4头转成网络字节序
-    void Ipv4Host2Network(IPV4_Hdr* hdr)
+    /**
+     * @brief 发送本机的数据报时进行分片,全部分片一次性批量发送
+     * 
+     * @param pkt 上层的数据(不包含ipv4头部)
+     * @param hdr 主机字节序的ipv4头部
+     * @param src_iface 
+     * @param send_iface 出口网卡
+     * @param mtu 路径MTU
+     */
+    NetErr_t Ipv4Fragment(std::shared_ptr<PacketBuffer> pkt, IPV4_Hdr hdr, 
+        NetInterface* src_iface, NetInterface* send_iface, uint32_t mtu)
     {
-        hdr->total_length = htons(hdr->total_length);
-        hdr->identification = htons(hdr->identification);
-        hdr->flags_fragment = htons(hdr->flags_fragment);
-        hdr->head_checksum = htons(hdr->head_checksum);
+        // 传输层校验和覆盖整个数据报,分片之后就没法在驱动边界计算了,这里先补齐
+        CsumFinalize(*pkt);
+
+        std::vector<std::shared_ptr<PacketBuffer>> fragments;
+        NetErr_t ret = Ipv4BuildFragments(pkt, hdr, mtu, fragments);
+        if (ret != NET_ERR_OK)
+            return ret;
+
+        return EtherPushBatch(fragments, TYPE_IPV4, src_iface, send_iface->GetNetInfo());
     }
 
     /**
-     * @brief 将ipv4头部转换成网络字节序
+     * @brief TTL减1,并增量更新头部校验和(RFC 1624),不需要重新计算整个头部
      * 
-     * @param hdr 
+     * @param pkt 从ipv4头部开始的数据包
      */
-    void Ipv4Network2Host(IPV4_Hdr* hdr)
+    static void Ipv4DecreaseTTL(std::shared_ptr<PacketBuffer>& pkt)
     {
-        hdr->total_length = ntohs(hdr->total_length);
-        hdr->identification = ntohs(hdr->identification);
-        hdr->flags_fragment = ntohs(hdr->flags_fragment);
-        hdr->head_checksum = ntohs(hdr->head_checksum);
+        IPV4_Hdr hdr_buf;
+        IPV4_Hdr* hdr = &hdr_buf;
+        PacketBlock* head = pkt->GetBlocks().front();
+        bool in_place = head->DataSize() >= sizeof(IPV4_Hdr);
+        if (in_place)   // 通常头部都在第一个内存块中,直接原地修改
+            hdr = reinterpret_cast<IPV4_Hdr*>(head->GetDataPtr());
+        else
+            pkt->ReadAt(0, (unsigned char*)hdr, sizeof(IPV4_Hdr));
+
+        // TTL和协议组成一个16位字参与校验和计算
+        uint16_t old_word, new_word;
+        memcpy(&old_word, &hdr->ttl, sizeof(old_word));
+        hdr->ttl--;
+        memcpy(&new_word, &hdr->ttl, sizeof(new_word));
+        hdr->head_checksum = ChecksumIncUpdate(hdr->head_checksum, old_word, new_word);
+
+        if (!in_place)
+            pkt->WriteAt(0, (const unsigned char*)hdr, sizeof(IPV4_Hdr));
+    }
+
+    static NetErr_t Ipv4Drop(Ipv4DropReason reason)
+    {
+        kDropCounts[reason].fetch_add(1, std::memory_order_relaxed);
+        return NET_ERR_INVALID_FRAME;
     }
 
     /**
-     * @brief 数据报分片
+     * @brief 转发不是发给本机的数据报. 在接收线程中完成查路由、TTL减1、
+     *        查邻居缓存、重写以太网头部和发送,不经过其他队列
      * 
-     * @param pkt 
+     * @param pkt 从ipv4头部开始的数据包
+     * @param hdr 主机字节序的ipv4头部
+     * @return NetErr_t 
      */
-    void Ipv4Fragment(std::shared_ptr<PacketBuffer> pkt, IPV4_Hdr hdr, NetInterface* send_iface)
+    static NetErr_t Ipv4Forward(std::shared_ptr<PacketBuffer>& pkt, IPV4_Hdr& hdr)
     {
-        size_t data_size = pkt->TotalSize();
-        size_t chunk_cnt = data_size / IPV4_DATA_MAX_SIZE;
-        chunk_cnt += (data_size % IPV4_DATA_MAX_SIZE) != 0 ? 1 : 0;
-        size_t index = 0;
+        // 只转发链路层发给本机的单播帧,混杂模式下抓到的其他主机的帧不能转发
+        if (!kIpForward.load(std::memory_order_relaxed) || pkt->GetPktType() != PKT_HOST)
+            return Ipv4Drop(IPV4_DROP_NOT_LOCAL);
 
-        size_t chunk_size;
-        for (size_t i = 0; i < chunk_cnt; i++)
+        if (hdr.ttl <= 1)
         {
-            chunk_size = data_size < IPV4_DATA_MAX_SIZE ? data_size : IPV4_DATA_MAX_SIZE;
-            data_size -= chunk_size;
-            std::shared_ptr<PacketBuffer> chunk_pkt =
-                std::make_shared<PacketBuffer>(chunk_size);
-            
-            pkt->Read(chunk_pkt->GetObjectPtr(), chunk_size);
-            pkt->Seek(chunk_size);
+            IcmpSendError(ICMP_TIME_EXCEEDED, ICMP_TTL_EXCEEDED, pkt);
+            return Ipv4Drop(IPV4_DROP_TTL);
+        }
 
-            hdr.flags = FRAG_MORE_FRAGMENT;     // 允许分片,还有更多分片
-            hdr.fragment_offset = (i * IPV4_DATA_MAX_SIZE);
-            hdr.total_length = chunk_size + 20; // 总长度=数据长度+头部大小
-            hdr.head_checksum = CheckSum(&hdr);
-            
-            Ipv4Host2Network(&hdr);
-            pkt->AddHeader(sizeof(IPV4_Hdr), (const unsigned char*)&hdr);
+        Routing routing = GetRouting(hdr.dst_ipaddr);
+        if (routing.iface_ == nullptr)
+        {
+            IcmpSendError(ICMP_DEST_UNREACHABLE, ICMP_NET_UNREACHABLE, pkt);
+            return Ipv4Drop(IPV4_DROP_NO_ROUTE);
+        }
 
-            EtherPush(pkt, TYPE_IPV4, kNetifacesMap[hdr.src_ipaddr], send_iface->GetNetInfo(), send_iface);
+        uint32_t mtu = routing.iface_->GetMtu();
+        if (hdr.total_length > mtu && hdr.DontFragment())
+        {
+            IcmpSendError(ICMP_DEST_UNREACHABLE, ICMP_FRAG_NEEDED, pkt, mtu);
+            return Ipv4Drop(IPV4_DROP_FRAG_NEEDED);
         }
-        pkt.reset();
+
+        // 下一跳: 经过网关时是网关的地址,否则直接发给目的地址
+        uint32_t next_hop = (routing.flag_ & ROUTE_DEFAULT_GATEWAY) ? 
+            routing.gateway_ : hdr.dst_ipaddr;
+        uint8_t dst_mac[6];
+        if (ArpLookup(routing.iface_, next_hop, dst_mac) != NET_ERR_OK)
+            return Ipv4Drop(IPV4_DROP_NO_NEIGH);
+
+        NetErr_t ret;
+        if (hdr.total_length > mtu)     // 出口MTU更小并且允许分片
+        {
+            hdr.ttl--;
+            pkt->RemoveHeader(hdr.HeaderLen());
+            std::vector<std::shared_ptr<PacketBuffer>> fragments;
+            ret = Ipv4BuildFragments(pkt, hdr, mtu, fragments);
+            if (ret == NET_ERR_OK)
+                ret = EtherPushBatch(fragments, TYPE_IPV4, routing.iface_, dst_mac);
+        }
+        else 
+        {
+            Ipv4DecreaseTTL(pkt);
+            ret = EtherForward(pkt, routing.iface_, dst_mac);
+        }
+
+        if (ret == NET_ERR_OK)
+            kForwardCount.fetch_add(1, std::memory_order_relaxed);
+        return ret;
     }
 
 
 ///////////////////////////////////////////////////////// 提供给外部的接口
 
+    void Ipv4Init(Timer* timer)
+    {
+        kReassembly.SetTimer(timer);
+    }
+
+    ReassStats Ipv4ReassStats()
+    {
+        return kReassembly.GetStats();
+    }
+
+    void Ipv4RegisterProtocol(uint8_t protocol, Ipv4Handler handler)
+    {
+        kProtoHandlers[protocol] = handler;
+    }
+
+    uint64_t Ipv4DropCount(Ipv4DropReason reason)
+    {
+        return kDropCounts[reason].load(std::memory_order_relaxed);
+    }
+
+    void Ipv4SetForward(bool enable)
+    {
+        kIpForward.store(enable, std::memory_order_relaxed);
+        RxFilterUpdate();   // 过滤器要放行发往其他主机的数据报
+    }
+
+    bool Ipv4GetForward()
+    {
+        return kIpForward.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Ipv4ForwardCount()
+    {
+        return kForwardCount.load(std::memory_order_relaxed);
+    }
+
+    void Ipv4RestoreHeader(std::shared_ptr<PacketBuffer>& pkt, const IPV4_Hdr& hdr)
+    {
+        IPV4_Hdr net_hdr = hdr;
+        net_hdr.version_length = (4 << 4) | (sizeof(IPV4_Hdr) / 4);
+        net_hdr.total_length = pkt->DataSize() + sizeof(IPV4_Hdr);
+        net_hdr.flags_fragment = hdr.flags_fragment & IPV4_FLAG_DF;    // 重组后的数据报不再是分片
+        net_hdr.head_checksum = 0;
+        Ipv4Host2Network(&net_hdr);
+        net_hdr.head_checksum = Checksum16(&net_hdr, sizeof(net_hdr));
+        pkt->AddHeader(sizeof(net_hdr), (const unsigned char*)&net_hdr);
+    }
+
     /**
      * @brief 提供给上层传输层使用,比如UDP、TCP、ICMP.
      *        给上层数据增加ipv4头,如果数据包比较大则进行分片
@@ -135,119 +346,99 @@ namespace netstack
     NetErr_t IPv4Push(std::shared_ptr<PacketBuffer> pkt, uint32_t src_ip, uint32_t dst_ip, PROTO_TYPE type)
     {
         Routing routing = GetRouting(dst_ip);
+        if (routing.iface_ == nullptr)
+            return NET_ERR_UNREACH;
+
         IPV4_Hdr hdr;
-        hdr.version = 4;
-        hdr.header_length = 5;
-        hdr.ds = DSCP_CS0;
-        hdr.ecn = 0;
+        hdr.version_length = (4 << 4) | (sizeof(IPV4_Hdr) / 4);    // 版本4,头部长度5(20字节)
+        hdr.service = DSCP_CS0;
         hdr.identification = GetRandomNum();
+        hdr.flags_fragment = 0;
         hdr.ttl = kDefaultTTL;
         hdr.protocol = type;
         hdr.src_ipaddr = src_ip;
         hdr.dst_ipaddr = dst_ip;
         hdr.head_checksum = 0;
 
-        if (pkt->DataSize() > IPV4_DATA_MAX_SIZE)   // 分片
+        NetInterface* src_iface = Ipv4SrcIface(src_ip, routing.iface_);
+        uint32_t mtu = GetPathMtu(dst_ip, routing.iface_);
+        if (pkt->GetGsoType() != GSO_NONE)  // 分段卸载: 每一段的大小由上层保证不超过路径MTU,不进行分片
         {
-            Ipv4Fragment(pkt, hdr, routing.iface_);
-            return NET_ERR_OK;
+            if (pkt->DataSize() + sizeof(IPV4_Hdr) > 0xffff)
+                return NET_ERR_SIZE;
         }
+        else if (pkt->DataSize() + sizeof(IPV4_Hdr) > mtu)   // 分片
+            return Ipv4Fragment(pkt, hdr, src_iface, routing.iface_, mtu);
 
+        // 不超过路径MTU的数据报设置DF,路径上MTU更小时由路由器回复ICMP "需要分片"
+        hdr.flags_fragment = IPV4_FLAG_DF;
+        hdr.total_length = pkt->DataSize() + sizeof(IPV4_Hdr);
         Ipv4Host2Network(&hdr);
+        // 头部校验和只覆盖20字节,在拷贝进数据包之前算好,避免再回头修改数据包
+        hdr.head_checksum = Checksum16(&hdr, sizeof(hdr));
         pkt->AddHeader(sizeof(hdr), (const unsigned char*)&hdr);
-        hdr.head_checksum = CheckSum(&hdr);
-        EtherPush(pkt, TYPE_IPV4, kNetifacesMap[src_ip], routing.iface_->GetNetInfo(), routing.iface_);
+        EtherPush(pkt, TYPE_IPV4, src_iface, routing.iface_->GetNetInfo(), routing.iface_);
         
         return NET_ERR_OK;
     }
 
 
-    NetErr_t IPv4Pop(std::shared_ptr<PacketBuffer> pkt)
+    /**
+     * @brief 判断目的地址是不是发给本机的(本机地址、广播、多播)
+     * 
+     * @param dst_ip 网络字节序
+     * @return true 
+     * @return false 
+     */
+    static bool Ipv4IsLocal(uint32_t dst_ip)
     {
-        return NET_ERR_OK;
-
-        NetErr_t ret = CheckIpv4(pkt);
-        if (ret != NET_ERR_OK)
-            return ret;
-
-        IPV4_Hdr* hdr = pkt->GetObjectPtr<IPV4_Hdr>();
-        Ipv4Network2Host(hdr);
-        MsgReassembly complete_msg;
-        
-        // 是分片数据包
-        if (hdr->flags == FRAG_MORE_FRAGMENT || 
-            hdr->flags_fragment == FRAG_NO_MORE_FRAGMENT)
+        uint8_t first = ntohl(dst_ip) >> 24;
+        if (dst_ip == 0xffffffff || (first >= 224 && first <= 239))
+            return true;
+        if (kNetifacesMap.find(dst_ip) != kNetifacesMap.end())
+            return true;
+
+        // 子网广播地址
+        for (auto& netif : kNetifacesMap)
         {
-            std::map<uint16_t, MsgReassembly>::iterator it;
-            MsgReassembly last_fragment;
-            uint16_t fragment_off = hdr->fragment_offset * 8;
-            pthread_t old = 0;
-            pthread_t self = pthread_self();
-            
-            if (hdr->flags == FRAG_NO_MORE_FRAGMENT)    // 最后一片设置总大小
-                last_fragment.total_size = hdr->fragment_offset * 8 + hdr->total_length;
-
-            // 获取锁
-            while (!kMsgRessemblyLock.compare_exchange_strong(old, self));
-            it = kMsgReassemblyMap.find(hdr->identification);
-            
-            // 表示当前是分片的第一片
-            if (it == kMsgReassemblyMap.end())  
-            {
-                last_fragment.recv_size = hdr->total_length;
-                last_fragment.fragments.insert( { fragment_off, pkt });
-
-                kMsgReassemblyMap.insert({ hdr->identification, last_fragment });
-                kMsgRessemblyLock.store(0, std::memory_order_release);  // 释放锁
-                return NET_ERR_OK;
-            }
-            else   // 当前不是第一片 
-            {
-                it->second.recv_size += hdr->total_length;
-                if (last_fragment.total_size != 0)
-                    it->second.total_size = last_fragment.total_size;
-
-                it->second.fragments.insert( { fragment_off, pkt });
-                if (it->second.recv_size >= it->second.total_size)
-                {
-                    complete_msg = it->second;
-                    kMsgReassemblyMap.erase(it);
-                    kMsgRessemblyLock.store(0, std::memory_order_release);  // 释放锁
-                }
-                else 
-                {
-                    kMsgRessemblyLock.store(0, std::memory_order_release);  // 释放锁
-                    return NET_ERR_OK;
-                }
-            }
+            uint32_t netmask = *(uint32_t*)netif.second->GetNetInfo()->netmask;
+            if ((dst_ip | netmask) == 0xffffffff && (dst_ip & netmask) == (netif.first & netmask))
+                return true;
         }
-        
-        if (complete_msg.recv_size != 0)    // 表示已经接收到一个完整数据报了
+        return false;
+    }
+
+    NetErr_t IPv4Pop(std::shared_ptr<PacketBuffer> pkt)
+    {
+        IPV4_Hdr hdr;
+        int reason = CheckIpv4(pkt, hdr);
+        if (reason >= 0)
+            return Ipv4Drop((Ipv4DropReason)reason);
+        if (!Ipv4IsLocal(hdr.dst_ipaddr))
+            return Ipv4Forward(pkt, hdr);
+
+        // 查找上层协议,没有注册的协议不需要再去重组分片
+        Ipv4Handler handler = kProtoHandlers[hdr.protocol];
+        if (handler == nullptr)
         {
-        // 进行分片重组并把每个小分片内存释放
-            for (auto& fragment : complete_msg.fragments)
-            {
-                pkt->Merge(*fragment.second.get());
-                pkt.reset();
-            }
+            // 只对发给本机单播地址的数据报回复协议不可达,广播和多播不回复(RFC 1122 3.2.2.1)
+            if (kNetifacesMap.find(hdr.dst_ipaddr) != kNetifacesMap.end())
+                IcmpSendError(ICMP_DEST_UNREACHABLE, ICMP_PROTO_UNREACHABLE, pkt);
+            return Ipv4Drop(IPV4_DROP_NO_PROTO);
         }
 
-        switch (hdr->protocol)
+        pkt->RemoveHeader(hdr.HeaderLen());
+        if (hdr.IsFragment())
         {
-            case TYPE_ICMP:
-                IcmpPop(pkt);
-                break;
-            case TYPE_TCP:
-                TcpPop(pkt);
-                break;
-            case TYPE_UDP:
-                UdpPop(pkt);
-                break;
-            default:
-                pkt.reset();
-                break;
+            std::shared_ptr<PacketBuffer> complete_pkt;
+            if (kReassembly.Input(pkt, hdr, complete_pkt, hdr) != NET_ERR_OK)
+                return Ipv4Drop(IPV4_DROP_REASSEMBLY);
+            if (complete_pkt == nullptr)    // 还没有收到全部分片
+                return NET_ERR_OK;
+            pkt = complete_pkt;     // 已经接收到一个完整数据报了
         }
 
+        handler(pkt, hdr);
         return NET_ERR_OK;
     }
 }
\ No newline at end of file
@@ -5,8 +5,8 @@
 
 namespace netstack 
 {   
-    NetIfLoop::NetIfLoop(NetInfo* info)
-        : NetInterface(info)
+    NetIfLoop::NetIfLoop(NetInfo* info, std::unique_ptr<NetDriver> driver)
+        : NetInterface(info, std::move(driver))
     {
 
     }
@@ -4,8 +4,16 @@
 #include "net_err.h"
 #include "net_interface.h"
 #include "net_pcap.h"
+#include "pcap_driver.h"
 #include "sys_plat.h"
 #include "routing.h"
+#include "icmp.h"
+#include "ipv4.h"
+#include "ping.h"
+#include "tcp.h"
+#include "udp.h"
+#include "time_entry.h"
+#include "timer.h"
 
 
 #include <vector>
@@ -13,7 +21,7 @@
 
 
 
-#define TICK_TIME   ((50) * (1000000))  // 滴答时间
+#define TICK_MS     (50)    // 滴答时间(毫秒)
 #define WHEEL_SIZE  (512)
 
 namespace netstack 
@@ -41,11 +49,13 @@ namespace netstack
         NetInterface* netiface = nullptr;
         for (auto& device : kDevices)
         {
+            std::unique_ptr<NetDriver> driver(new PcapDriver(PcapNICDriver::GetHandle(device)));
             if (device->is_default_gateway_)
-                netiface = new NetIfLoop(device);
+                netiface = new NetIfLoop(device, std::move(driver));
             else
-                netiface = new NetInterface(device);
-            kNetifacesMap[*(uint32_t*)device->ip] = netiface;
+                netiface = new NetInterface(device, std::move(driver));
+            if (netiface->Open() != NET_ERR_OK)     // 打开成功才加入网卡接口表
+                delete netiface;
         }
 
     // 初始化线程池
@@ -63,7 +73,20 @@ namespace netstack
     // 初始化默认路由
         InitRoutingMap();
 
-    // 初始化定时器 TODO:
+    // 初始化定时器
+        timer_ = new Timer(TimeEntry({ 0, TICK_MS * 1000 }), WHEEL_SIZE);
+        if (timer_ == nullptr)
+            return NET_ERR_BAD_ALLOC;
+        timer_->Start();
+        Ipv4Init(timer_);
+
+    // 上层协议注册到ipv4的分发表中
+        IcmpInit();
+        PingInit();
+        UdpInit();
+        TcpInit(timer_);
+
+        initialized_ = true;
 
         return NET_ERR_OK;
     }
@@ -1,16 +1,23 @@
 #include "net_interface.h"
+#include "checksum.h"
 #include "concurrent_queue.h"
 #include "ether.h"
+#include "gso.h"
 #include "net_init.h"
 #include "net_err.h"
 #include "packet_buffer.h"
-#include "pcap.h"
+#include "rx_filter.h"
 #include "sys_plat.h"
+#include "udp.h"
 #include "util.h"
+#include <algorithm>
+#include <map>
 #include <memory>
 
 namespace netstack 
 {   
+    extern std::map<uint32_t, NetInterface*> kNetifacesMap; // 定义在net_init.cpp中
+
     NetInterface* NetInterface::kLoopNetinterface = nullptr;
 
     NetInterface* GetLoopNetinterface()
@@ -18,18 +25,33 @@ namespace netstack
 
 
 
-    NetInterface::NetInterface(NetInfo* netinfo, int queue_max_threshold)
-        : netinfo_(netinfo), queue_max_threshold_(queue_max_threshold),
+    NetInterface::NetInterface(NetInfo* netinfo, std::unique_ptr<NetDriver> driver, int queue_max_threshold)
+        : netinfo_(netinfo), driver_(std::move(driver)), queue_max_threshold_(queue_max_threshold),
         recv_queue_(queue_max_threshold), send_queue_(queue_max_threshold)
     {
-        netif_fd_ = pcap_fileno(netinfo->device);
         if (netinfo->is_default_gateway_)
             kLoopNetinterface = this;
     }
 
     NetInterface::~NetInterface()
     {
+        if (registered_)
+        {
+            auto it = kNetifacesMap.find(*(uint32_t*)netinfo_->ip);
+            if (it != kNetifacesMap.end() && it->second == this)
+                kNetifacesMap.erase(it);
+        }
+    }
+
+    NetErr_t NetInterface::Open()
+    {
+        NetErr_t ret = driver_->Open(netinfo_);
+        if (ret != NET_ERR_OK)
+            return ret;
 
+        registered_ = kNetifacesMap.insert({ *(uint32_t*)netinfo_->ip, this }).second;
+        RxFilterUpdate();   // 接收过滤器启用时,新的网卡也装上
+        return NET_ERR_OK;
     }
 
     NetErr_t NetInterface::PushPacket(SharedPkt pkt, bool is_recv_queue, bool wait)
@@ -79,24 +101,25 @@ namespace netstack
     }
 
     /**
-     * @brief 从网卡读取数据放入到接收队列中
+     * @brief 从网卡读取数据放入到接收队列中. 一次就绪事件把网卡中已经到达的数据包
+     *        都读出来(最多 NETIF_RX_BATCH 个),交给同一个回调作为一批处理
      * 
+     * @return int 读取到的数据包个数
      */
-    bool NetInterface::NetRx()
+    int NetInterface::NetRx()
     {
-        pcap_pkthdr* hdr;
-        const u_char* data;
-        pcap_next_ex(netinfo_->device, &hdr, &data);
-
-        std::shared_ptr<PacketBuffer> pkt = std::make_shared<PacketBuffer>(hdr->caplen);
-        pkt->Write(data, hdr->len, true);
-
-        if (recv_queue_.TryPush<std::shared_ptr<PacketBuffer>>(pkt) == false)
+        SharedPkt pkts[NETIF_RX_BATCH];
+        int n = driver_->RxBurst(pkts, std::min(NETIF_RX_BATCH, driver_->MaxBatch()));
+        int cnt = 0;
+        for (; cnt < n; cnt++)
         {
-            pkt.reset();
-            return false;
+            if (recv_queue_.TryPush<std::shared_ptr<PacketBuffer>>(pkts[cnt]) == false)
+            {
+                rx_queue_drops_.fetch_add(n - cnt, std::memory_order_relaxed);
+                break;      // 队列满了,丢弃
+            }
         }
-        return true;
+        return cnt;
     }
 
     /**
@@ -110,43 +133,86 @@ namespace netstack
 
         std::shared_ptr<PacketBuffer> pkt;
         send_queue_.Pop(pkt);
-
-        unsigned char* data = new unsigned char[pkt->DataSize()];
-        pkt->Read(data, pkt->DataSize());
+        if (!(GetCaps() & NETIF_CAP_TX_CSUM))   // 网卡不支持校验和卸载,由软件补齐
+            CsumFinalize(*pkt);
 
         // 这种情况很小,除非网卡掉了或者网卡打开失败
-        if (pcap_inject(netinfo_->device, data, pkt->DataSize()) == -1)
+        return driver_->TxBurst(&pkt, 1) == 1;
+    }
+
+    NetErr_t NetInterface::NetTx(SharedPkt pkt)
+    {
+        if (pkt->DataSize() == 0)
+            return NET_ERR_PARAM;
+
+        // 网卡不支持分段卸载,在这里切分后批量发送
+        uint32_t caps = GetCaps();
+        GsoType gso_type = pkt->GetGsoType();
+        if (gso_type != GSO_NONE)
         {
-            fprintf(stderr, "pcap_inject failed: %s\n", pcap_geterr(netinfo_->device));
-            delete [] data;
-            pkt.reset();
-            return false;
+            uint32_t gso_cap = gso_type == GSO_UDP_L4 ? NETIF_CAP_GSO_UDP : NETIF_CAP_GSO_TCP;
+            if (!(caps & gso_cap))
+            {
+                std::vector<SharedPkt> segs;
+                NetErr_t ret = GsoSegment(pkt, segs);
+                if (ret != NET_ERR_OK)
+                    return ret;
+                return NetTxBatch(segs);
+            }
         }
+        if (!(caps & NETIF_CAP_TX_CSUM))   // 网卡不支持校验和卸载,由软件补齐
+            CsumFinalize(*pkt);
 
-        return true;
+        return driver_->TxBurst(&pkt, 1) == 1 ? NET_ERR_OK : NET_ERR_IO;
     }
 
-    NetErr_t NetInterface::NetTx(SharedPkt pkt)
+
+    /**
+     * @brief 批量发送数据包(比如一个数据报的全部分片),按驱动的批量上限分批交给驱动,
+     *        发送完成后清空 pkts
+     * 
+     * @param pkts 
+     * @return NetErr_t 
+     */
+    NetErr_t NetInterface::NetTxBatch(std::vector<SharedPkt>& pkts)
     {
-        if (pkt->DataSize() == 0)
+        if (pkts.empty())
             return NET_ERR_PARAM;
+        if (!(GetCaps() & NETIF_CAP_TX_CSUM))
+        {
+            for (auto& pkt : pkts)
+                CsumFinalize(*pkt);
+        }
 
-        NetErr_t ret = PcapNICDriver::SendData(netinfo_->device, pkt);
-        pkt.reset();
+        int total = static_cast<int>(pkts.size());
+        int max_batch = std::max(driver_->MaxBatch(), 1);
+        int sent = 0;
+        for (int i = 0; i < total; i += max_batch)
+            sent += driver_->TxBurst(pkts.data() + i, std::min(max_batch, total - i));
+        pkts.clear();
 
-        return ret;
+        return sent == total ? NET_ERR_OK : NET_ERR_IO;
     }
 
 
     void HandleRecvPktCallback(NetInterface* iface)
     {
         SharedPkt pkt;
-        if (iface->recv_queue_.Empty())
-            return;
-        bool ret = iface->recv_queue_.TryPop(pkt);
-        if (ret == false)
-            return;
-        
-        EtherPop(pkt);  // 交给以太网来处理,然后逐层向上传递
+        while (true)
+        {
+            // 一次处理一批数据包,批次结束时把 GRO 合并中的数据报交给端点
+            int i = 0;
+            for (; i < NETIF_RX_BATCH && iface->recv_queue_.TryPop(pkt); i++)
+                EtherPop(std::move(pkt));  // 交给以太网来处理,然后逐层向上传递
+            UdpGroFlush();
+            if (i == NETIF_RX_BATCH)
+                continue;
+
+            // 队列空了. 清除标记之后再检查一次,期间放入的数据包如果没有提交新的任务就继续处理
+            iface->rx_task_pending_.store(false);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (iface->recv_queue_.Empty() || !iface->RxScheduleTask())
+                return;
+        }
     }
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "packet_buffer.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <type_traits>
@@ -19,16 +20,21 @@ namespace netstack
 	: total_size_(size), next_(nullptr),
 	    prev_(nullptr), curr_pos_(0), data_(nullptr)
     {
-        data_ = (unsigned char*)calloc(size, sizeof(char));
+        storage_.reset((unsigned char*)calloc(size ? size : 1, sizeof(char)), free);
+        data_ = storage_.get();
+    }
+
+    PacketBlock::PacketBlock(const std::shared_ptr<unsigned char>& storage, unsigned char* data, size_t size)
+        : storage_(storage), data_(data), total_size_(size),
+        curr_pos_(size), next_(nullptr), prev_(nullptr)
+    {
+
     }
 
     PacketBlock::~PacketBlock()
     {
-        if (data_)
-        {
-            delete data_;
-            data_ = nullptr;
-        }
+        // 最后一个引用这块内存的内存块负责释放
+        data_ = nullptr;
     }
 
 
@@ -80,11 +86,96 @@ namespace netstack
     {
         PacketBlock* after_block = AllocateBlock(size);
         after_block->CopyData(block, offset, size);
+        after_block->SetDataSize(size);
 
         return after_block;
     }
 
 
+    /**
+     * @brief 创建一个引用 block 中 [offset, offset + size) 数据的内存块,不拷贝数据
+     *        切片是只读的,不会再向后追加数据,也不能使用前面的空间
+     * 
+     * @param block 
+     * @param offset 
+     * @param size 
+     * @return PacketBlock* 
+     */
+    PacketBlock* PacketBlock::SliceBlock(PacketBlock* block, size_t offset, size_t size)
+    {
+        return new PacketBlock(block->storage_, block->data_ + offset, size);
+    }
+
+    /**
+     * @brief 创建一个引用外部内存的内存块,不拷贝. 内存的生命周期由 storage 的引用计数管理
+     * 
+     * @param storage 
+     * @param size 
+     * @return PacketBlock* 
+     */
+    PacketBlock* PacketBlock::WrapBlock(const std::shared_ptr<unsigned char>& storage, size_t size)
+    {
+        return new PacketBlock(storage, storage.get(), size);
+    }
+
+    /**
+     * @brief 在空的内存块前面预留 size 字节,之后添加的头部可以向前扩展
+     * 
+     * @param size 
+     */
+    void PacketBlock::Reserve(size_t size)
+    {
+        if (curr_pos_ != 0 || size > total_size_)
+            return;
+        data_ += size;
+        total_size_ -= size;
+        head_room_ += size;
+    }
+
+    /**
+     * @brief 去掉开头 size 字节的数据,不拷贝,去掉的空间留作以后添加头部使用
+     * 
+     * @param size 
+     */
+    void PacketBlock::Pull(size_t size)
+    {
+        if (size > curr_pos_)
+            size = curr_pos_;
+        data_ += size;
+        total_size_ -= size;
+        curr_pos_ -= size;
+        head_room_ += size;
+    }
+
+    /**
+     * @brief 去掉末尾size大小的数据
+     * 
+     * @param size 
+     */
+    void PacketBlock::Trim(size_t size)
+    {
+        curr_pos_ = size < curr_pos_ ? curr_pos_ - size : 0;
+    }
+
+    /**
+     * @brief 使用前面预留的空间向前扩展 size 字节
+     * 
+     * @param size 
+     * @return true 成功
+     * @return false 空间不足或者内存被其他切片共享(前面的数据属于别人)
+     */
+    bool PacketBlock::Push(size_t size)
+    {
+        if (size > head_room_ || IsShared())
+            return false;
+        data_ -= size;
+        total_size_ += size;
+        curr_pos_ += size;
+        head_room_ -= size;
+        return true;
+    }
+
+
     PacketBlock* AllocateBlock(size_t size)
     {
         PacketBlock* block = nullptr;
@@ -113,23 +204,46 @@ namespace netstack
         data_size_(size),
         curr_block_(nullptr)
     {
+        if (size == 0)  // 空数据包,写入数据或者添加切片时再分配内存块
+            return;
         PacketBlock* blk = CreateBlock(size);
         blk->SetDataSize(size);
     }
 
     PacketBuffer::~PacketBuffer()
     {
-
+        for (PacketBlock* block : blocks_)
+            delete block;
+        blocks_.clear();
     }
 
 
     int PacketBuffer::AddHeader(size_t size, const unsigned char* data)
     {
-        PacketBlock* block = AllocateBlock(size);
-        block->SetData(size, data);
+        if (csum_state_ == CSUM_PARTIAL)    // 校验和的起始位置向后移动
+            csum_start_ += size;
         data_size_ += size;
+
+        // 第一个内存块前面还有空间,直接向前扩展,不用分配内存
+        if (!blocks_.empty() && blocks_.front()->Push(size))
+        {
+            memcpy(blocks_.front()->GetDataPtr(), data, size);
+            return 0;
+        }
+
+        // 多分配一些空间留给下层协议的头部
+        PacketBlock* block = AllocateBlock(size + PKT_HEADER_ROOM);
+        block->Reserve(PKT_HEADER_ROOM);
+        block->SetData(size, data);
         total_size_ += size;
 
+        if (blocks_.empty())
+        {
+            blocks_.push_front(block);
+            curr_block_ = block;
+            return 0;
+        }
+
         PacketBlock* head = *blocks_.begin();
         head->SetPrevNode(block);
         blocks_.push_front(block);
@@ -144,60 +258,80 @@ namespace netstack
         return 0;
     }
 
+    /**
+     * @brief 去掉开头 size 字节的数据(可以跨越多个内存块),不拷贝数据
+     * 
+     * @param size 
+     * @return int 
+     */
     int PacketBuffer::RemoveHeader(size_t size)
     {
-        if (blocks_.empty())
+        if (blocks_.empty() || size > data_size_)
             return -1;
-        PacketBlock* block = blocks_.front();
         
-        if (block->TotalSize() > size)
-        {
-            // 拆分
-            blocks_.pop_front();
-            // 丢弃开头size字节大小的数据
-            PacketBlock* after_cutting_pkt = 
-                PacketBlock::CuttingPacket(block, size, block->TotalSize() - size);
-            blocks_.push_front(after_cutting_pkt);
-            delete block;
-            curr_block_ = after_cutting_pkt;
-        }
-        else if (block->TotalSize() == size)
+        size_t remain = size;
+        while (remain && !blocks_.empty())
         {
+            PacketBlock* block = blocks_.front();
+            size_t block_size = block->DataSize();
+            if (block_size > remain)
+            {
+                // 丢弃开头remain字节大小的数据,空间留给以后添加头部
+                block->Pull(remain);
+                total_size_ -= remain;
+                remain = 0;
+                break;
+            }
+
             blocks_.pop_front();
+            if (block->next_)
+                block->next_->prev_ = nullptr;
+            total_size_ -= block->TotalSize();
+            if (curr_block_ == block)
+                curr_block_ = blocks_.empty() ? nullptr : blocks_.back();
+            remain -= block_size;
             delete block;
-            curr_block_ = nullptr;
         }
-        else if (block->TotalSize() < size)
-            return -1;
         
+        data_size_ -= size;
+        if (csum_state_ == CSUM_PARTIAL)
+            csum_start_ = csum_start_ > size ? csum_start_ - size : 0;
         return 0;
     }
 
+    /**
+     * @brief 去掉末尾size大小的数据(比如以太网帧的填充),可以跨越多个内存块
+     * 
+     * @param size 
+     * @return int 0: 成功; -1: 数据不够
+     */
     int PacketBuffer::RemoveTail(size_t size)
     {
-        if (blocks_.empty())
+        if (size > data_size_)
             return -1;
-        PacketBlock* tail = blocks_.back();
-        if (tail->TotalSize() < size)
-            return -1;
-        else if (tail->TotalSize() == size)
+
+        data_size_ -= size;
+        while (size > 0 && !blocks_.empty())
         {
+            PacketBlock* tail = blocks_.back();
+            size_t block_size = tail->DataSize();
+            if (block_size > size)
+            {
+                tail->Trim(size);
+                break;
+            }
+
             blocks_.pop_back();
+            if (tail->prev_)
+                tail->prev_->next_ = nullptr;
+            total_size_ -= tail->TotalSize();
+            size -= block_size;
             delete tail;
         }
-        else if (tail->TotalSize() > size)
-        {
-            blocks_.pop_back();
-            // 不要末尾size大小的字节数据
-            PacketBlock* after_cutting_pkt = 
-                PacketBlock::CuttingPacket(tail, 0, tail->TotalSize() - size);
-        }
-
-
+        curr_block_ = blocks_.empty() ? nullptr : blocks_.back();
 
         return 0;
     }
-
     int PacketBuffer::Resize(size_t)
     {
         return 0;
@@ -246,37 +380,77 @@ namespace netstack
 
     int PacketBuffer::Read(unsigned char* dest, size_t size, PacketBlock* block, int offset)
     {
-        if (dest == nullptr || size == 0 || index_ + size > total_size_)
+        if (dest == nullptr || size == 0)
             return -1;
         
-        if ((offset + size) > data_size_)
+        // 从当前读取位置(Seek设置)开始读取
+        return ReadAt(index_ + offset, dest, size);
+    }
+
+    /**
+     * @brief 从数据起始位置偏移 offset 处读取 size 字节,可以跨越多个内存块
+     * 
+     * @param offset 
+     * @param dest 
+     * @param size 
+     * @return int 0: 成功; -1: 越界
+     */
+    int PacketBuffer::ReadAt(size_t offset, unsigned char* dest, size_t size)
+    {
+        if (dest == nullptr || offset + size > data_size_)
             return -1;
 
-        int start = 0;
-        PacketBlock* curr = *blocks_.begin();
-        while (curr)
+        for (PacketBlock* block : blocks_)
         {
-            if (curr->DataSize() < offset)
+            if (size == 0)
+                break;
+            size_t block_size = block->DataSize();
+            if (offset >= block_size)
             {
-                offset -= curr->DataSize();
-                curr = curr->next_;
+                offset -= block_size;
+                continue;
             }
-            break;
+            size_t copy_size = std::min(block_size - offset, size);
+            memcpy(dest, (unsigned char*)block->GetDataPtr() + offset, copy_size);
+            dest += copy_size;
+            size -= copy_size;
+            offset = 0;
         }
 
-        int index = 0;
-        int curr_blk_size = 0;
-        while (curr && size)
+        return size == 0 ? 0 : -1;
+    }
+
+    /**
+     * @brief 覆盖写数据起始位置偏移 offset 处的 size 字节,不会改变数据大小
+     * 
+     * @param offset 
+     * @param src 
+     * @param size 
+     * @return int 0: 成功; -1: 越界
+     */
+    int PacketBuffer::WriteAt(size_t offset, const unsigned char* src, size_t size)
+    {
+        if (src == nullptr || offset + size > data_size_)
+            return -1;
+
+        for (PacketBlock* block : blocks_)
         {
-            curr_blk_size = (curr->DataSize() - start < size) ? curr->DataSize() - start : size;
-            memcpy(dest + index, (char*)curr->GetDataPtr() + start, curr_blk_size);
-            size -= curr->DataSize() - start;
-            index += curr->DataSize() - start;
-            curr = curr->next_;
-            start = 0;
+            if (size == 0)
+                break;
+            size_t block_size = block->DataSize();
+            if (offset >= block_size)
+            {
+                offset -= block_size;
+                continue;
+            }
+            size_t copy_size = std::min(block_size - offset, size);
+            memcpy((unsigned char*)block->GetDataPtr() + offset, src, copy_size);
+            src += copy_size;
+            size -= copy_size;
+            offset = 0;
         }
-        
-        return 0;
+
+        return size == 0 ? 0 : -1;
     }
 
     int PacketBuffer::Seek(int offset)
@@ -325,15 +499,91 @@ namespace netstack
     void PacketBuffer::FillTail(size_t size)
     {
         PacketBlock* blk = AllocateBlock(size);
-        memset(blk->GetDataPtr(), 0, sizeof(size));
-        blk->SetPrevNode(curr_block_);
+        memset(blk->GetDataPtr(), 0, size);
+        blk->SetPrevNode(blocks_.empty() ? nullptr : blocks_.back());
         blocks_.push_back(blk);
         blk->SetDataSize(size);
+        curr_block_ = blk;
 
         total_size_ += size;
         data_size_ += size;
     }
 
+    /**
+     * @brief 创建一个新的数据包,引用当前数据包中 [offset, offset + size) 的数据,不拷贝
+     * 
+     * @param offset 
+     * @param size 
+     * @return std::shared_ptr<PacketBuffer> 失败返回nullptr
+     */
+    std::shared_ptr<PacketBuffer> PacketBuffer::Slice(size_t offset, size_t size)
+    {
+        std::shared_ptr<PacketBuffer> pkt = std::make_shared<PacketBuffer>();
+        if (pkt->AppendSlice(*this, offset, size) != 0)
+            return nullptr;
+        return pkt;
+    }
+
+    /**
+     * @brief 把 src 中 [offset, offset + size) 的数据以引用的方式追加到当前数据包末尾
+     * 
+     * @param src 
+     * @param offset 
+     * @param size 
+     * @return int 0: 成功; -1: 越界
+     */
+    int PacketBuffer::AppendSlice(PacketBuffer& src, size_t offset, size_t size)
+    {
+        if (offset + size > src.DataSize())
+            return -1;
+
+        for (PacketBlock* block : src.blocks_)
+        {
+            if (size == 0)
+                break;
+            size_t block_size = block->DataSize();
+            if (offset >= block_size)
+            {
+                offset -= block_size;
+                continue;
+            }
+
+            size_t slice_size = std::min(block_size - offset, size);
+            PacketBlock* slice = PacketBlock::SliceBlock(block, offset, slice_size);
+            slice->SetPrevNode(blocks_.empty() ? nullptr : blocks_.back());
+            blocks_.push_back(slice);
+            curr_block_ = slice;
+            total_size_ += slice_size;
+            data_size_ += slice_size;
+
+            size -= slice_size;
+            offset = 0;
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief 把外部内存以引用的方式追加到数据包末尾(零拷贝).
+     *        最后一个引用它的切片释放时 storage 的删除器被调用,使用者可以借此知道内存已经不再被使用
+     * 
+     * @param storage 
+     * @param size 
+     * @return int 0: 成功; -1: 参数错误
+     */
+    int PacketBuffer::AppendExternal(const std::shared_ptr<unsigned char>& storage, size_t size)
+    {
+        if (storage == nullptr || size == 0)
+            return -1;
+
+        PacketBlock* block = PacketBlock::WrapBlock(storage, size);
+        block->SetPrevNode(blocks_.empty() ? nullptr : blocks_.back());
+        blocks_.push_back(block);
+        curr_block_ = block;
+        total_size_ += size;
+        data_size_ += size;
+        return 0;
+    }
 
     void PacketBuffer::Merge(PacketBuffer& pkt)
     {
@@ -0,0 +1,134 @@
+#include "pcap_driver.h"
+#include "net_interface.h"
+
+#include <cstdio>
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+namespace netstack
+{
+    PcapDriver::PcapDriver(pcap_t* handle)
+        : handle_(handle), rx_packets_(0), rx_bytes_(0), rx_errors_(0),
+        tx_packets_(0), tx_bytes_(0), tx_errors_(0)
+    {
+
+    }
+
+    NetErr_t PcapDriver::Open(NetInfo* info)
+    {
+        (void)info;     // mac地址、MTU在枚举网卡时已经读取
+        if (handle_ == nullptr)
+            return NET_ERR_PARAM;
+
+        fd_ = pcap_fileno(handle_);
+        return NET_ERR_OK;
+    }
+
+    int PcapDriver::MaxBatch() const
+    {
+        return NETIF_RX_BATCH;
+    }
+
+    int PcapDriver::RxBurst(SharedPkt* pkts, int max)
+    {
+        if (handle_ == nullptr)
+            return 0;
+
+        int cnt = 0;
+        struct pcap_pkthdr* pkt_hdr;
+        const u_char* pkt_data;
+        while (cnt < max)
+        {
+            int ret = pcap_next_ex(handle_, &pkt_hdr, &pkt_data);
+            if (ret == 0)           // 没有更多数据包了
+                break;
+            if (ret < 0)
+            {
+                rx_errors_++;
+                break;
+            }
+
+            // 复制一次(下一次pcap读取会覆盖这块内存),缓冲区中只有 caplen 个字节
+            SharedPkt pkt = std::make_shared<PacketBuffer>(pkt_hdr->caplen);
+            pkt->Write(pkt_data, pkt_hdr->caplen, true);
+            rx_bytes_ += pkt_hdr->caplen;
+            pkts[cnt++] = std::move(pkt);
+        }
+        rx_packets_ += cnt;
+        return cnt;
+    }
+
+    int PcapDriver::TxBurst(SharedPkt* pkts, int cnt)
+    {
+        if (handle_ == nullptr)
+        {
+            for (int i = 0; i < cnt; i++)
+                pkts[i].reset();
+            tx_errors_ += cnt;
+            return 0;
+        }
+
+        int sent = 0;
+        std::unique_lock<std::mutex> lock(tx_mutex_);
+        for (int i = 0; i < cnt; i++)
+        {
+            size_t data_size = pkts[i]->DataSize();
+            if (tx_mem_.size() < data_size)
+                tx_mem_.resize(data_size);
+            pkts[i]->ReadAt(0, tx_mem_.data(), data_size);
+            pkts[i].reset();
+
+            if (pcap_inject(handle_, tx_mem_.data(), data_size) == -1)
+            {
+                printf("err: %s\n", pcap_geterr(handle_));
+                tx_errors_++;
+                continue;
+            }
+            tx_bytes_ += data_size;
+            sent++;
+        }
+        tx_packets_ += sent;
+        return sent;
+    }
+
+    NetDriverStats PcapDriver::GetStats()
+    {
+        NetDriverStats stats;
+        stats.rx_packets = rx_packets_;
+        stats.rx_bytes = rx_bytes_;
+        stats.rx_errors = rx_errors_;
+        stats.tx_packets = tx_packets_;
+        stats.tx_bytes = tx_bytes_;
+        stats.tx_errors = tx_errors_;
+
+        struct pcap_stat ps;
+        if (handle_ != nullptr && pcap_stats(handle_, &ps) == 0)
+            stats.rx_dropped = ps.ps_drop + ps.ps_ifdrop;
+        return stats;
+    }
+
+    /**
+     * @brief 直接替换socket上的过滤器. pcap_setfilter 会先装一个全部丢弃的程序再清空socket,
+     *        替换期间到达的帧会丢失;SO_ATTACH_FILTER 由内核原子地切换.
+     *        打开时已经由pcap装过内核过滤器,pcap不会再在用户空间过滤
+     *
+     * @param insns
+     * @param cnt
+     * @return NetErr_t
+     */
+    NetErr_t PcapDriver::SetFilter(const struct sock_filter* insns, int cnt)
+    {
+        if (fd_ == -1)
+            return NET_ERR_STATE;
+
+        struct sock_fprog fprog;
+        fprog.len = static_cast<unsigned short>(cnt);
+        fprog.filter = const_cast<struct sock_filter*>(insns);
+        if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == -1)
+        {
+            perror("setsockopt SO_ATTACH_FILTER");
+            return NET_ERR_IO;
+        }
+        return NET_ERR_OK;
+    }
+}
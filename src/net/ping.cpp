@@ -0,0 +1,180 @@
+#include "ping.h"
+#include "arp.h"
+#include "hdr_histogram.h"
+#include "icmp.h"
+#include "net_interface.h"
+#include "routing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace netstack
+{
+    // 一次 PingRun 的状态,接收线程通过标识找到它
+    struct PingSession
+    {
+        std::mutex mutex;
+        uint32_t dst_ip = 0;
+        std::vector<bool> replied;      // 下标为序号
+        uint32_t received = 0;
+        uint32_t duplicates = 0;
+        HdrHistogram rtt;
+    };
+
+    static std::mutex kPingMutex;
+    static std::unordered_map<uint16_t, PingSession*> kPingSessions;     // key: 标识
+    static std::atomic<uint16_t> kPingNextId = static_cast<uint16_t>(std::random_device()());
+
+    static uint64_t PingNowNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static PingStage PingStageOf(const HdrHistogram& hist)
+    {
+        PingStage stage;
+        stage.count = hist.Count();
+        stage.min = hist.Min();
+        stage.p50 = hist.ValueAtPercentile(50);
+        stage.p99 = hist.ValueAtPercentile(99);
+        stage.p999 = hist.ValueAtPercentile(99.9);
+        stage.max = hist.Max();
+        stage.mean = hist.Mean();
+        return stage;
+    }
+
+    /**
+     * @brief 在接收线程中处理回显应答,应答数据的开头是发送时间
+     *
+     * @param pkt
+     * @param ip_hdr
+     * @param id
+     * @param seq
+     */
+    static void PingEchoInput(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr,
+        uint16_t id, uint16_t seq)
+    {
+        uint64_t now = PingNowNs();
+        uint64_t sent_ns;
+        if (pkt->ReadAt(sizeof(ICMPv4_Echo), (unsigned char*)&sent_ns, sizeof(sent_ns)) != 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(kPingMutex);
+        auto it = kPingSessions.find(id);
+        if (it == kPingSessions.end())
+            return;
+        PingSession* session = it->second;
+        std::unique_lock<std::mutex> session_lock(session->mutex);
+        if (ip_hdr.src_ipaddr != session->dst_ip || seq >= session->replied.size())
+            return;
+        if (session->replied[seq])
+        {
+            session->duplicates++;
+            return;
+        }
+        session->replied[seq] = true;
+        session->received++;
+        if (now > sent_ns)
+            session->rtt.Record(now - sent_ns);
+    }
+
+    void PingInit()
+    {
+        IcmpRegisterEchoHandler(PingEchoInput);
+    }
+
+    NetErr_t PingRun(const PingOptions& opts, PingReport& report)
+    {
+        if (opts.count == 0 || opts.count > 0x10000 || opts.rate <= 0 || opts.payload < PING_MIN_PAYLOAD)
+            return NET_ERR_PARAM;
+
+        report = PingReport();
+        PingSession session;
+        session.dst_ip = opts.dst_ip;
+        session.replied.assign(opts.count, false);
+        uint16_t id;
+        {
+            std::unique_lock<std::mutex> lock(kPingMutex);
+            do {
+                id = kPingNextId.fetch_add(1, std::memory_order_relaxed);
+            } while (kPingSessions.count(id));
+            kPingSessions[id] = &session;
+        }
+
+        HdrHistogram route, arp, tx;
+        std::vector<unsigned char> payload(opts.payload);
+        for (size_t i = sizeof(uint64_t); i < payload.size(); i++)
+            payload[i] = static_cast<unsigned char>(i);
+
+        auto interval = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / opts.rate));
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t seq = 0; seq < opts.count; seq++)
+        {
+            std::this_thread::sleep_until(start + interval * seq);
+
+            uint64_t t0 = PingNowNs();
+            Routing routing = GetRouting(opts.dst_ip);
+            uint64_t t1 = PingNowNs();
+            if (routing.iface_ == nullptr)
+            {
+                report.send_errors++;
+                continue;
+            }
+            uint32_t next_hop = (routing.flag_ & ROUTE_DEFAULT_GATEWAY) ? routing.gateway_ : opts.dst_ip;
+            uint8_t mac[6];
+            if (ArpLookup(routing.iface_, next_hop, mac) != NET_ERR_OK)
+                report.arp_misses++;
+            uint64_t t2 = PingNowNs();
+
+            memcpy(payload.data(), &t2, sizeof(t2));
+            NetErr_t ret = IcmpPush(opts.dst_ip, id, static_cast<uint16_t>(seq), payload.data(), payload.size());
+            uint64_t t3 = PingNowNs();
+            if (ret != NET_ERR_OK)
+            {
+                report.send_errors++;
+                continue;
+            }
+
+            report.sent++;
+            route.Record(t1 - t0);
+            arp.Record(t2 - t1);
+            tx.Record(t3 - t2);
+        }
+
+        // 等待还没有回来的应答
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(opts.timeout_ms);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            {
+                std::unique_lock<std::mutex> lock(session.mutex);
+                if (session.received >= report.sent)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(kPingMutex);
+            kPingSessions.erase(id);
+        }
+
+        // 已经从表中移除,接收线程不会再访问 session
+        report.received = session.received;
+        report.duplicates = session.duplicates;
+        report.route = PingStageOf(route);
+        report.arp = PingStageOf(arp);
+        report.tx = PingStageOf(tx);
+        report.rtt = PingStageOf(session.rtt);
+        return NET_ERR_OK;
+    }
+}
@@ -0,0 +1,198 @@
+#include "replay.h"
+#include "ether.h"
+#include "net_type.h"
+#include "udp.h"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+#define REPLAY_SPIN_NS      (100 * 1000)    // 离下一帧的时间小于这个值时忙等,不再睡眠
+
+namespace netstack
+{
+    static uint64_t ReplayNowNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    static void ReplayWaitUntil(uint64_t deadline)
+    {
+        uint64_t now = ReplayNowNs();
+        if (deadline > now + REPLAY_SPIN_NS)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - REPLAY_SPIN_NS));
+        while (ReplayNowNs() < deadline)
+            continue;
+    }
+
+    static ReplayLayer ReplayClassify(const uint8_t* data, uint32_t size)
+    {
+        if (size < sizeof(EtherHdr))
+            return REPLAY_LAYER_OTHER;
+        uint16_t type = (data[12] << 8) | data[13];
+        if (type == TYPE_ARP)
+            return REPLAY_LAYER_ARP;
+        if (type != TYPE_IPV4 || size < sizeof(EtherHdr) + 20)
+            return REPLAY_LAYER_OTHER;
+
+        switch (data[sizeof(EtherHdr) + 9])     // ipv4头部中的协议字段
+        {
+            case TYPE_ICMP: return REPLAY_LAYER_ICMP;
+            case TYPE_UDP:  return REPLAY_LAYER_UDP;
+            case TYPE_TCP:  return REPLAY_LAYER_TCP;
+            default:        return REPLAY_LAYER_IPV4;
+        }
+    }
+
+    ReplayDriver::ReplayDriver()
+        : rx_packets_(0), rx_bytes_(0), tx_packets_(0), tx_bytes_(0)
+    {
+
+    }
+
+    NetErr_t ReplayDriver::Open(NetInfo* info)
+    {
+        (void)info;     // 地址由使用者设置成回放的帧发往的主机
+        return NET_ERR_OK;
+    }
+
+    NetErr_t ReplayDriver::Load(const char* path)
+    {
+        frames_.clear();
+        data_.clear();
+        rx_next_ = 0;
+
+        char err_buf[PCAP_ERRBUF_SIZE];
+        pcap_t* file = pcap_open_offline_with_tstamp_precision(path, PCAP_TSTAMP_PRECISION_NANO, err_buf);
+        if (file == nullptr)
+        {
+            fprintf(stderr, "pcap_open_offline failed: %s\n", err_buf);
+            return NET_ERR_IO;
+        }
+        if (pcap_datalink(file) != DLT_EN10MB)
+        {
+            fprintf(stderr, "%s: 不是以太网的抓包文件\n", path);
+            pcap_close(file);
+            return NET_ERR_PARAM;
+        }
+
+        pcap_pkthdr* hdr;
+        const u_char* data;
+        while (pcap_next_ex(file, &hdr, &data) == 1)
+        {
+            ReplayFrame frame;
+            frame.offset = data_.size();
+            frame.size = hdr->caplen;
+            // 以纳秒精度打开时 tv_usec 中是纳秒
+            frame.ts_ns = static_cast<uint64_t>(hdr->ts.tv_sec) * 1000000000ULL + hdr->ts.tv_usec;
+            frame.layer = ReplayClassify(data, hdr->caplen);
+            data_.insert(data_.end(), data, data + hdr->caplen);
+            frames_.push_back(frame);
+        }
+        pcap_close(file);
+
+        return NET_ERR_OK;
+    }
+
+    NetErr_t ReplayDriver::Run(const ReplayOptions& opts, ReplayReport& report)
+    {
+        report = ReplayReport();
+        if (frames_.empty())
+            return NET_ERR_EMPTY;
+        if (opts.paced && opts.speed <= 0)
+            return NET_ERR_PARAM;
+
+        uint64_t tx_start = tx_packets_;
+        uint64_t first_ts = frames_.front().ts_ns;
+        uint64_t start = ReplayNowNs();
+        for (uint32_t loop = 0; loop < opts.loops; loop++)
+        {
+            uint64_t loop_start = ReplayNowNs();
+            int batch = 0;
+            for (auto& frame : frames_)
+            {
+                if (opts.paced && frame.ts_ns > first_ts)
+                    ReplayWaitUntil(loop_start + static_cast<uint64_t>((frame.ts_ns - first_ts) / opts.speed));
+
+                // 和 NetRx 一样为每一帧分配数据包,EtherPop 会原地修改数据
+                SharedPkt pkt = std::make_shared<PacketBuffer>(frame.size);
+                pkt->Write(&data_[frame.offset], frame.size, true);
+
+                uint64_t t0 = ReplayNowNs();
+                EtherPop(std::move(pkt));
+                uint64_t t1 = ReplayNowNs();
+
+                ReplayLayerStats& layer = report.layers[frame.layer];
+                layer.packets++;
+                layer.bytes += frame.size;
+                layer.total_ns += t1 - t0;
+
+                // 和 HandleRecvPktCallback 一样在一批结束时交付 GRO 合并的数据报,耗时算在udp上
+                if (++batch == NETIF_RX_BATCH)
+                {
+                    UdpGroFlush();
+                    report.layers[REPLAY_LAYER_UDP].total_ns += ReplayNowNs() - t1;
+                    batch = 0;
+                }
+            }
+            uint64_t t0 = ReplayNowNs();
+            UdpGroFlush();
+            report.layers[REPLAY_LAYER_UDP].total_ns += ReplayNowNs() - t0;
+        }
+        report.elapsed_ns = ReplayNowNs() - start;
+
+        for (auto& layer : report.layers)
+        {
+            report.packets += layer.packets;
+            report.bytes += layer.bytes;
+            if (layer.packets == 0 || layer.total_ns == 0)
+                continue;
+            layer.ns_per_pkt = static_cast<double>(layer.total_ns) / layer.packets;
+            layer.pps = 1e9 / layer.ns_per_pkt;
+        }
+        if (report.elapsed_ns)
+            report.pps = report.packets * 1e9 / report.elapsed_ns;
+        report.tx_packets = tx_packets_ - tx_start;
+
+        return NET_ERR_OK;
+    }
+
+    int ReplayDriver::RxBurst(SharedPkt* pkts, int max)
+    {
+        int cnt = 0;
+        for (; cnt < max && rx_next_ < frames_.size(); cnt++)
+        {
+            ReplayFrame& frame = frames_[rx_next_++];
+            pkts[cnt] = std::make_shared<PacketBuffer>(frame.size);
+            pkts[cnt]->Write(&data_[frame.offset], frame.size, true);
+            rx_bytes_ += frame.size;
+        }
+        rx_packets_ += cnt;
+        return cnt;
+    }
+
+    int ReplayDriver::TxBurst(SharedPkt* pkts, int cnt)
+    {
+        for (int i = 0; i < cnt; i++)
+        {
+            tx_bytes_ += pkts[i]->DataSize();
+            pkts[i].reset();
+        }
+        tx_packets_ += cnt;
+        return cnt;
+    }
+
+    NetDriverStats ReplayDriver::GetStats()
+    {
+        NetDriverStats stats;
+        stats.rx_packets = rx_packets_;
+        stats.rx_bytes = rx_bytes_;
+        stats.tx_packets = tx_packets_;
+        stats.tx_bytes = tx_bytes_;
+        return stats;
+    }
+}
\ No newline at end of file
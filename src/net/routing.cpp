@@ -4,11 +4,30 @@
 #include "arp.h"
 #include "net_interface.h"
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
 namespace netstack 
 {
     extern std::map<uint32_t, NetInterface*> kNetifacesMap;    // 定义在net_init.cpp中
     static std::map<uint32_t, Routing> kRoutingMap;    // 路由表
     static Routing kDefGateway;
+    static std::mutex kRoutingMutex;                    // 保护路由表和路径MTU缓存
+
+    struct PmtuEntry
+    {
+        uint32_t pmtu;                                  // 路径MTU
+        std::chrono::steady_clock::time_point update;   // 最近一次修改的时间
+    };
+    // key: 目的地址,   value: 路径MTU. 只保存比出口网卡MTU小的目的地址
+    static std::unordered_map<uint32_t, PmtuEntry> kPmtuCache;
+
+    // RFC 1191 中常见的MTU,从大到小
+    static const uint32_t kMtuPlateaus[] = {
+        65535, 32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68
+    };
 
 
     Routing::Routing()
@@ -82,6 +101,7 @@ namespace netstack
             kDefGateway.netmask_ = *(uint32_t*)def_gateway->GetNetInfo()->netmask;
             kDefGateway.flag_ = RoutingFlag(ROUTE_DEFAULT_GATEWAY | ROUTE_DIRECT_SEND);
             kDefGateway.iface_ = def_gateway;
+            std::lock_guard<std::mutex> lock(kRoutingMutex);
             kRoutingMap.insert({0, kDefGateway});   // 插入默认路由
         }
     }
@@ -96,8 +116,81 @@ namespace netstack
         routing.iface_ = netif;
         routing.ip_ = ip;
         routing.flag_ = (RoutingFlag)ROUTE_INDIRECT_SEND;
+        std::lock_guard<std::mutex> lock(kRoutingMutex);
         kRoutingMap.insert( { ip, routing });
 
         return routing;
     }
+
+    /**
+     * @brief 查找比 mtu 小的下一档MTU
+     * 
+     * @param mtu 
+     * @return uint32_t 
+     */
+    static uint32_t PlateauBelow(uint32_t mtu)
+    {
+        for (uint32_t plateau : kMtuPlateaus)
+        {
+            if (plateau < mtu)
+                return plateau;
+        }
+        return kMtuPlateaus[sizeof(kMtuPlateaus) / sizeof(kMtuPlateaus[0]) - 1];
+    }
+
+    /**
+     * @brief 查找比 mtu 大的上一档MTU
+     * 
+     * @param mtu 
+     * @return uint32_t 
+     */
+    static uint32_t PlateauAbove(uint32_t mtu)
+    {
+        uint32_t above = kMtuPlateaus[0];
+        for (uint32_t plateau : kMtuPlateaus)
+        {
+            if (plateau <= mtu)
+                break;
+            above = plateau;
+        }
+        return above;
+    }
+
+    uint32_t GetPathMtu(uint32_t dst_ip, NetInterface* iface)
+    {
+        uint32_t iface_mtu = iface->GetMtu();
+        std::lock_guard<std::mutex> lock(kRoutingMutex);
+        auto it = kPmtuCache.find(dst_ip);
+        if (it == kPmtuCache.end())
+            return iface_mtu;
+
+        // 老化: 降低之后过了一段时间,往上提升一档进行探测
+        auto now = std::chrono::steady_clock::now();
+        if (now - it->second.update >= std::chrono::seconds(PMTU_AGING_SEC))
+        {
+            it->second.pmtu = PlateauAbove(it->second.pmtu);
+            it->second.update = now;
+            if (it->second.pmtu >= iface_mtu)   // 已经恢复到网卡MTU,不用再缓存了
+            {
+                kPmtuCache.erase(it);
+                return iface_mtu;
+            }
+        }
+
+        return std::min(it->second.pmtu, iface_mtu);
+    }
+
+    void UpdatePathMtu(uint32_t dst_ip, uint16_t next_hop_mtu, uint16_t orig_len)
+    {
+        uint32_t pmtu = next_hop_mtu;
+        if (pmtu == 0 || pmtu >= orig_len)  // 路由器没有给出下一跳MTU,按原始数据报长度估算
+            pmtu = PlateauBelow(orig_len);
+        pmtu = std::max<uint32_t>(pmtu, PMTU_MIN);
+
+        std::lock_guard<std::mutex> lock(kRoutingMutex);
+        auto it = kPmtuCache.find(dst_ip);
+        if (it != kPmtuCache.end() && it->second.pmtu <= pmtu)  // 路径MTU只会被ICMP降低
+            return;
+        kPmtuCache[dst_ip] = { pmtu, std::chrono::steady_clock::now() };
+    }
 }
\ No newline at end of file
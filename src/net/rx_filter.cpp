@@ -0,0 +1,301 @@
+#include "rx_filter.h"
+#include "ipv4.h"
+#include "net_interface.h"
+#include "net_type.h"
+#include "tcp.h"
+#include "udp.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#define RX_FILTER_ETH_HLEN      (14)
+
+namespace netstack
+{
+    extern std::map<uint32_t, NetInterface*> kNetifacesMap; // 定义在net_init.cpp中
+
+    static std::mutex kRxFilterMutex;       // 重新生成、安装的过程是串行的
+    static RxFilterStats kRxFilterStats;
+
+    /**
+     * @brief 经典BPF只能向前跳转,跳转距离是8位的. 先用标签记录跳转目标,
+     *        全部指令生成之后再计算距离
+     *
+     */
+    class RxFilterAsm
+    {
+    public:
+        int NewLabel()
+        {
+            labels_.push_back(-1);
+            return static_cast<int>(labels_.size()) - 1;
+        }
+
+        void Bind(int label)
+        { labels_[label] = static_cast<int>(insns_.size()); }
+
+        void Stmt(uint16_t code, uint32_t k)
+        { insns_.push_back(BPF_STMT(code, k)); }
+
+        // 比较成功跳到 jt,失败跳到 jf,标签为-1表示下一条指令
+        void Jump(uint16_t code, uint32_t k, int jt, int jf)
+        {
+            fixups_.push_back({ static_cast<int>(insns_.size()), jt, jf });
+            insns_.push_back(BPF_JUMP(code, k, 0, 0));
+        }
+
+        NetErr_t Finish(std::vector<sock_filter>& prog)
+        {
+            for (auto& fixup : fixups_)
+            {
+                for (int i = 0; i < 2; i++)
+                {
+                    int label = i == 0 ? fixup.jt : fixup.jf;
+                    if (label == -1)
+                        continue;
+                    int offset = labels_[label] - fixup.pos - 1;
+                    if (labels_[label] < 0 || offset < 0 || offset > 255)
+                        return NET_ERR_SIZE;
+                    (i == 0 ? insns_[fixup.pos].jt : insns_[fixup.pos].jf) = static_cast<uint8_t>(offset);
+                }
+            }
+            if (insns_.size() > BPF_MAXINSNS)
+                return NET_ERR_SIZE;
+            prog = std::move(insns_);
+            return NET_ERR_OK;
+        }
+    private:
+        struct Fixup
+        {
+            int pos;
+            int jt;
+            int jf;
+        };
+
+        std::vector<sock_filter> insns_;
+        std::vector<int> labels_;
+        std::vector<Fixup> fixups_;
+    };
+
+    static uint32_t RxFilterLoad32(const uint8_t* p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    /**
+     * @brief 匹配传输层的目的端口,没有匹配的丢弃
+     *
+     * @param code
+     * @param ports 为空指针时放行全部端口
+     * @param ephemeral_min
+     * @param accept
+     */
+    static void RxFilterPortMatch(RxFilterAsm& code, const std::vector<uint16_t>* ports,
+        uint16_t ephemeral_min, int accept)
+    {
+        if (ports == nullptr)
+        {
+            code.Stmt(BPF_RET | BPF_K, RX_FILTER_ACCEPT_LEN);
+            return;
+        }
+
+        // 不是第一个的分片没有传输层头部,交给重组
+        code.Stmt(BPF_LD | BPF_H | BPF_ABS, RX_FILTER_ETH_HLEN + 6);
+        code.Jump(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, accept, -1);
+        code.Stmt(BPF_LDX | BPF_B | BPF_MSH, RX_FILTER_ETH_HLEN);
+        code.Stmt(BPF_LD | BPF_H | BPF_IND, RX_FILTER_ETH_HLEN + 2);
+        code.Jump(BPF_JMP | BPF_JGE | BPF_K, ephemeral_min, accept, -1);
+        for (uint16_t port : *ports)
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, port, accept, -1);
+        code.Stmt(BPF_RET | BPF_K, 0);
+    }
+
+    static NetErr_t RxFilterAssemble(const NetInfo& info, const RxFilterPorts* ports,
+        bool match_udp, bool match_tcp, std::vector<sock_filter>& prog)
+    {
+        RxFilterAsm code;
+        int accept = code.NewLabel();
+        int drop = code.NewLabel();
+        int dst_lo = code.NewLabel();
+        int bcast = code.NewLabel();
+        int src = code.NewLabel();
+        int src_lo = code.NewLabel();
+        int type = code.NewLabel();
+
+        uint32_t mac_hi = RxFilterLoad32(info.mac);
+        uint32_t mac_lo = ((uint32_t)info.mac[4] << 8) | info.mac[5];
+
+        // 以太网层: 目的mac是本网卡或者广播,源mac不是本网卡
+        code.Stmt(BPF_LD | BPF_W | BPF_ABS, 0);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, mac_hi, dst_lo, bcast);
+        code.Bind(dst_lo);
+        code.Stmt(BPF_LD | BPF_H | BPF_ABS, 4);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, mac_lo, src, drop);
+        code.Bind(bcast);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, 0xffffffff, -1, drop);
+        code.Stmt(BPF_LD | BPF_H | BPF_ABS, 4);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, 0xffff, src, drop);
+        code.Bind(src);
+        code.Stmt(BPF_LD | BPF_W | BPF_ABS, 6);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, mac_hi, src_lo, type);
+        code.Bind(src_lo);
+        code.Stmt(BPF_LD | BPF_H | BPF_ABS, 10);
+        code.Jump(BPF_JMP | BPF_JEQ | BPF_K, mac_lo, drop, type);
+        code.Bind(type);
+
+        if (ports != nullptr)
+        {
+            uint32_t ip = RxFilterLoad32(info.ip);
+            uint32_t subnet_bcast = ip | ~RxFilterLoad32(info.netmask);
+            int arp = code.NewLabel();
+            int ipv4 = code.NewLabel();
+            int ip_ok = code.NewLabel();
+            int udp = code.NewLabel();
+            int tcp = code.NewLabel();
+
+            code.Stmt(BPF_LD | BPF_H | BPF_ABS, 12);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, TYPE_ARP, arp, -1);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, TYPE_IPV4, ipv4, drop);
+
+            // arp: 目标协议地址是本网卡
+            code.Bind(arp);
+            code.Stmt(BPF_LD | BPF_W | BPF_ABS, RX_FILTER_ETH_HLEN + 24);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, ip, accept, drop);
+
+            // ipv4: 目的地址是本网卡、子网广播或者受限广播
+            code.Bind(ipv4);
+            code.Stmt(BPF_LD | BPF_W | BPF_ABS, RX_FILTER_ETH_HLEN + 16);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, ip, ip_ok, -1);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, subnet_bcast, ip_ok, -1);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, 0xffffffff, ip_ok, ports->forward ? -1 : drop);
+            if (ports->forward)
+            {
+                // 开启了转发: 发往本网卡mac的单播帧不检查目的地址,交给 Ipv4Forward;
+                // 上面已经检查过目的mac是本网卡或者广播,组播位为0就是本网卡
+                int transit = code.NewLabel();
+                code.Stmt(BPF_LD | BPF_B | BPF_ABS, 0);
+                code.Jump(BPF_JMP | BPF_JSET | BPF_K, 0x01, -1, transit);
+                code.Stmt(BPF_RET | BPF_K, 0);
+                code.Bind(transit);
+                code.Stmt(BPF_RET | BPF_K, RX_FILTER_ACCEPT_LEN);
+            }
+            code.Bind(ip_ok);
+            code.Stmt(BPF_LD | BPF_B | BPF_ABS, RX_FILTER_ETH_HLEN + 9);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, TYPE_ICMP, accept, -1);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, TYPE_UDP, udp, -1);
+            code.Jump(BPF_JMP | BPF_JEQ | BPF_K, TYPE_TCP, tcp, drop);
+
+            code.Bind(udp);
+            RxFilterPortMatch(code, match_udp ? &ports->udp : nullptr, UDP_EPHEMERAL_MIN, accept);
+            code.Bind(tcp);
+            RxFilterPortMatch(code, match_tcp ? &ports->tcp : nullptr, TCP_EPHEMERAL_MIN, accept);
+        }
+
+        code.Bind(accept);
+        code.Stmt(BPF_RET | BPF_K, RX_FILTER_ACCEPT_LEN);
+        code.Bind(drop);
+        code.Stmt(BPF_RET | BPF_K, 0);
+        return code.Finish(prog);
+    }
+
+    NetErr_t RxFilterBuild(const NetInfo& info, const RxFilterPorts* ports, std::vector<sock_filter>& prog)
+    {
+        if (ports == nullptr)
+            return RxFilterAssemble(info, nullptr, false, false, prog);
+
+        // 端口太多(跳转距离超过8位)时先放弃匹配tcp端口,再放弃udp端口
+        bool match_udp = ports->udp.size() <= RX_FILTER_MAX_PORTS;
+        bool match_tcp = ports->tcp.size() <= RX_FILTER_MAX_PORTS;
+        NetErr_t ret = RxFilterAssemble(info, ports, match_udp, match_tcp, prog);
+        if (ret == NET_ERR_SIZE && match_tcp)
+            ret = RxFilterAssemble(info, ports, match_udp, match_tcp = false, prog);
+        if (ret == NET_ERR_SIZE && match_udp)
+            ret = RxFilterAssemble(info, ports, match_udp = false, match_tcp, prog);
+        return ret;
+    }
+
+    /**
+     * @brief 生成并安装到所有网卡,调用者持有 kRxFilterMutex
+     *
+     * @param ports
+     */
+    static void RxFilterInstallLocked(const RxFilterPorts* ports)
+    {
+        kRxFilterStats.regenerations++;
+        kRxFilterStats.insns = 0;
+        for (auto& item : kNetifacesMap)
+        {
+            std::vector<sock_filter> prog;
+            NetInterface* iface = item.second;
+            if (RxFilterBuild(*iface->GetNetInfo(), ports, prog) != NET_ERR_OK)
+            {
+                kRxFilterStats.install_failures++;
+                continue;
+            }
+            kRxFilterStats.insns = std::max<uint32_t>(kRxFilterStats.insns, prog.size());
+
+            NetErr_t ret = iface->GetDriver()->SetFilter(prog.data(), static_cast<int>(prog.size()));
+            if (ret == NET_ERR_OK)
+                kRxFilterStats.installs++;
+            else if (ret != NET_ERR_NO_OPS)
+                kRxFilterStats.install_failures++;
+        }
+    }
+
+    /**
+     * @brief 读取udp绑定的端口和tcp监听(以及已经建立连接)的端口,去掉临时端口范围内的
+     *
+     * @param ports
+     */
+    static void RxFilterCollect(RxFilterPorts& ports)
+    {
+        UdpLocalPorts(ports.udp);
+        TcpLocalPorts(ports.tcp);
+        ports.forward = Ipv4GetForward();
+        ports.udp.erase(std::remove_if(ports.udp.begin(), ports.udp.end(),
+            [](uint16_t port) { return port >= UDP_EPHEMERAL_MIN; }), ports.udp.end());
+        ports.tcp.erase(std::remove_if(ports.tcp.begin(), ports.tcp.end(),
+            [](uint16_t port) { return port >= TCP_EPHEMERAL_MIN; }), ports.tcp.end());
+        for (auto* list : { &ports.udp, &ports.tcp })
+        {
+            std::sort(list->begin(), list->end());
+            list->erase(std::unique(list->begin(), list->end()), list->end());
+        }
+    }
+
+    void RxFilterEnable(bool enable)
+    {
+        std::unique_lock<std::mutex> lock(kRxFilterMutex);
+        if (kRxFilterStats.enabled == enable)
+            return;
+        kRxFilterStats.enabled = enable;
+
+        RxFilterPorts ports;
+        if (enable)
+            RxFilterCollect(ports);
+        kRxFilterStats.udp_ports = ports.udp.size();
+        kRxFilterStats.tcp_ports = ports.tcp.size();
+        RxFilterInstallLocked(enable ? &ports : nullptr);
+    }
+
+    void RxFilterUpdate()
+    {
+        // 在锁中读取端口,保证后安装的程序一定是根据更新的表生成的
+        std::unique_lock<std::mutex> lock(kRxFilterMutex);
+        if (!kRxFilterStats.enabled)
+            return;
+
+        RxFilterPorts ports;
+        RxFilterCollect(ports);
+        kRxFilterStats.udp_ports = ports.udp.size();
+        kRxFilterStats.tcp_ports = ports.tcp.size();
+        RxFilterInstallLocked(&ports);
+    }
+
+    RxFilterStats RxFilterGetStats()
+    {
+        std::unique_lock<std::mutex> lock(kRxFilterMutex);
+        return kRxFilterStats;
+    }
+}
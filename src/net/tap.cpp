@@ -0,0 +1,332 @@
+#include "tap.h"
+#include "checksum.h"
+#include "ether.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <random>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace netstack
+{
+    // 每个发送线程第一次发送时分到一个编号,按编号选择队列
+    static std::atomic<int> kTapNextThread(0);
+    static thread_local int kTapThreadIndex = -1;
+
+    TapDriver::TapDriver(const TapOptions& opts)
+        : opts_(opts), rx_packets_(0), rx_bytes_(0), rx_errors_(0),
+        tx_packets_(0), tx_bytes_(0), tx_errors_(0), tx_linearized_(0)
+    {
+
+    }
+
+    TapDriver::~TapDriver()
+    {
+        Close();
+    }
+
+    void TapDriver::Close()
+    {
+        for (int fd : queue_fds_)
+            close(fd);
+        queue_fds_.clear();
+        if (epoll_fd_ != -1)
+            close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+
+    NetErr_t TapDriver::Open(NetInfo* info)
+    {
+        const TapOptions& opts = opts_;
+        if (opts.queues < 1 || opts.queues > TAP_MAX_QUEUES || opts.name.size() >= IFNAMSIZ)
+            return NET_ERR_PARAM;
+        Close();
+
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_MULTI_QUEUE;
+        if (opts.vnet_hdr)
+            ifr.ifr_flags |= IFF_VNET_HDR;
+        strncpy(ifr.ifr_name, opts.name.c_str(), IFNAMSIZ - 1);
+
+        // 每打开一个队列就是一个新的fd,第一次之后内核填好的名字用来连接同一个设备
+        for (int i = 0; i < opts.queues; i++)
+        {
+            int fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+            if (fd == -1)
+            {
+                perror("open /dev/net/tun");
+                Close();
+                return NET_ERR_IO;
+            }
+            queue_fds_.push_back(fd);
+            if (ioctl(fd, TUNSETIFF, &ifr) == -1)
+            {
+                perror("ioctl TUNSETIFF");
+                Close();
+                return NET_ERR_IO;
+            }
+        }
+        dev_name_ = ifr.ifr_name;
+
+        vnet_hdr_size_ = 0;
+        caps_ = 0;
+        if (opts.vnet_hdr)
+        {
+            // 接收方向只接受需要计算校验和的包,不接受内核合并的大包(GRO)
+            int hdr_size = sizeof(VnetHdr);
+            if (ioctl(queue_fds_[0], TUNSETVNETHDRSZ, &hdr_size) == -1 ||
+                ioctl(queue_fds_[0], TUNSETOFFLOAD, TUN_F_CSUM) == -1)
+            {
+                perror("ioctl TUNSETVNETHDRSZ/TUNSETOFFLOAD");
+                Close();
+                return NET_ERR_IO;
+            }
+            vnet_hdr_size_ = sizeof(VnetHdr);
+            caps_ = NETIF_CAP_TX_CSUM | NETIF_CAP_RX_CSUM | NETIF_CAP_GSO_UDP | NETIF_CAP_GSO_TCP;
+        }
+
+        // 读取设备的MTU,并启用设备
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock != -1)
+        {
+            struct ifreq req;
+            memset(&req, 0, sizeof(req));
+            strncpy(req.ifr_name, dev_name_.c_str(), IFNAMSIZ - 1);
+            if (ioctl(sock, SIOCGIFMTU, &req) == 0)
+                info->mtu = req.ifr_mtu;
+            if (ioctl(sock, SIOCGIFFLAGS, &req) == 0 && !(req.ifr_flags & IFF_UP))
+            {
+                req.ifr_flags |= IFF_UP;
+                if (ioctl(sock, SIOCSIFFLAGS, &req) == -1)
+                    perror("ioctl SIOCSIFFLAGS");
+            }
+            close(sock);
+        }
+        rx_frame_size_ = info->mtu + sizeof(EtherHdr) + sizeof(Vlan);
+
+        static const uint8_t kZeroMac[6] = { 0 };
+        if (memcmp(info->mac, kZeroMac, sizeof(kZeroMac)) == 0)
+        {
+            std::random_device rd;
+            for (auto& byte : info->mac)
+                byte = static_cast<uint8_t>(rd());
+            info->mac[0] = (info->mac[0] & 0xfe) | 0x02;    // 单播、本地管理
+        }
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ == -1)
+        {
+            Close();
+            return NET_ERR_IO;
+        }
+        for (int i = 0; i < QueueCount(); i++)
+        {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u32 = i;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, queue_fds_[i], &event);
+        }
+
+        return NET_ERR_OK;
+    }
+
+    NetDriverStats TapDriver::GetStats()
+    {
+        NetDriverStats stats;
+        stats.rx_packets = rx_packets_;
+        stats.rx_bytes = rx_bytes_;
+        stats.rx_errors = rx_errors_;
+        stats.tx_packets = tx_packets_;
+        stats.tx_bytes = tx_bytes_;
+        stats.tx_errors = tx_errors_;
+        return stats;
+    }
+
+    /**
+     * @brief 过滤内核交给TAP设备的帧(读取之前),所有队列使用同一个程序.
+     *        内核逐个队列原子地替换
+     *
+     * @param insns
+     * @param cnt
+     * @return NetErr_t
+     */
+    NetErr_t TapDriver::SetFilter(const struct sock_filter* insns, int cnt)
+    {
+        if (queue_fds_.empty())
+            return NET_ERR_STATE;
+
+        struct sock_fprog fprog;
+        fprog.len = static_cast<unsigned short>(cnt);
+        fprog.filter = const_cast<struct sock_filter*>(insns);
+        if (ioctl(queue_fds_[0], TUNATTACHFILTER, &fprog) == -1)
+        {
+            perror("ioctl TUNATTACHFILTER");
+            return NET_ERR_IO;
+        }
+        return NET_ERR_OK;
+    }
+
+    int TapDriver::RecvQueue(int queue, SharedPkt* pkts, int max)
+    {
+        if (queue < 0 || queue >= QueueCount())
+            return 0;
+
+        int fd = queue_fds_[queue];
+        int cnt = 0;
+        while (cnt < max)
+        {
+            SharedPkt pkt = std::make_shared<PacketBuffer>(rx_frame_size_);
+            VnetHdr vnet_hdr;
+            struct iovec iov[TAP_MAX_IOV + 1];
+            int iovcnt = 0;
+            if (vnet_hdr_size_)
+                iov[iovcnt++] = { &vnet_hdr, vnet_hdr_size_ };
+            for (PacketBlock* block : pkt->GetBlocks())
+            {
+                if (iovcnt > TAP_MAX_IOV)
+                    break;
+                iov[iovcnt++] = { block->GetDataPtr(), block->DataSize() };
+            }
+
+            ssize_t n = readv(fd, iov, iovcnt);
+            if (n < 0)
+            {
+                if (errno != EAGAIN && errno != EINTR)
+                    rx_errors_++;
+                break;
+            }
+            size_t frame_size = static_cast<size_t>(n) - std::min(static_cast<size_t>(n), vnet_hdr_size_);
+            if (frame_size < sizeof(EtherHdr))
+            {
+                rx_errors_++;
+                continue;
+            }
+            pkt->RemoveTail(rx_frame_size_ - frame_size);
+            if (vnet_hdr_size_)
+                CsumFromVnetHdr(&vnet_hdr, *pkt);
+
+            rx_bytes_ += frame_size;
+            pkts[cnt++] = std::move(pkt);
+        }
+        rx_packets_ += cnt;
+        return cnt;
+    }
+
+    int TapDriver::RxBurst(SharedPkt* pkts, int max)
+    {
+        // 只读取有数据的队列,多个队列就绪时从上次之后的队列开始,避免一直偏向前面的队列
+        struct epoll_event events[TAP_MAX_QUEUES];
+        int nfds = epoll_wait(epoll_fd_, events, TAP_MAX_QUEUES, 0);
+        if (nfds <= 0)
+            return 0;
+
+        bool ready[TAP_MAX_QUEUES] = { false };
+        for (int i = 0; i < nfds; i++)
+            ready[events[i].data.u32] = true;
+
+        int cnt = 0;
+        for (int i = 0; i < QueueCount() && cnt < max; i++)
+        {
+            int queue = (rx_next_queue_ + i) % QueueCount();
+            if (ready[queue])
+                cnt += RecvQueue(queue, pkts + cnt, max - cnt);
+        }
+        rx_next_queue_ = (rx_next_queue_ + 1) % QueueCount();
+        return cnt;
+    }
+
+    int TapDriver::TxQueueFd()
+    {
+        if (kTapThreadIndex == -1)
+            kTapThreadIndex = kTapNextThread.fetch_add(1, std::memory_order_relaxed);
+        return queue_fds_[kTapThreadIndex % QueueCount()];
+    }
+
+    /**
+     * @brief 把一个数据包写到队列中. 内存块直接作为 writev 的参数,
+     *        块太多(或者块的长度和数据包对不上)时才合并成一块
+     *
+     * @param fd
+     * @param pkt
+     * @return true
+     * @return false
+     */
+    bool TapDriver::WriteFrame(int fd, PacketBuffer& pkt)
+    {
+        VnetHdr vnet_hdr;
+        struct iovec iov[TAP_MAX_IOV + 1];
+        int iovcnt = 0;
+        if (vnet_hdr_size_)
+        {
+            CsumToVnetHdr(pkt, &vnet_hdr);
+            iov[iovcnt++] = { &vnet_hdr, vnet_hdr_size_ };
+        }
+
+        size_t data_size = pkt.DataSize();
+        size_t total = 0;
+        for (PacketBlock* block : pkt.GetBlocks())
+        {
+            if (block->DataSize() == 0)
+                continue;
+            if (iovcnt > TAP_MAX_IOV)
+            {
+                total = 0;
+                break;
+            }
+            iov[iovcnt++] = { block->GetDataPtr(), block->DataSize() };
+            total += block->DataSize();
+        }
+
+        std::vector<unsigned char> linear;
+        if (total != data_size)
+        {
+            linear.resize(data_size);
+            pkt.ReadAt(0, linear.data(), data_size);
+            iovcnt = vnet_hdr_size_ ? 1 : 0;
+            iov[iovcnt++] = { linear.data(), data_size };
+            tx_linearized_++;
+        }
+
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n != static_cast<ssize_t>(vnet_hdr_size_ + data_size))
+        {
+            tx_errors_++;
+            return false;
+        }
+        tx_packets_++;
+        tx_bytes_ += data_size;
+        return true;
+    }
+
+    int TapDriver::TxBurst(SharedPkt* pkts, int cnt)
+    {
+        if (queue_fds_.empty())
+        {
+            for (int i = 0; i < cnt; i++)
+                pkts[i].reset();
+            return 0;
+        }
+
+        // 同一批都写到当前线程的队列,保持顺序
+        int fd = TxQueueFd();
+        int sent = 0;
+        for (int i = 0; i < cnt; i++)
+        {
+            if (WriteFrame(fd, *pkts[i]))
+                sent++;
+            pkts[i].reset();
+        }
+        return sent;
+    }
+}
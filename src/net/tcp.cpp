@@ -1,14 +1,913 @@
 #include "tcp.h"
+#include "checksum.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "net_interface.h"
+#include "net_type.h"
+#include "routing.h"
+#include "rx_filter.h"
+#include "tcp_internal.h"
+#include "timer_task_list.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace netstack
 {
-    void TcpPush(std::shared_ptr<PacketBuffer> pkt)
+    struct TcpShard
+    {
+        std::mutex mutex;
+        std::unordered_map<TcpConnKey, std::shared_ptr<TcpSocket>, TcpConnKeyHash> table;
+    };
+
+    // 连接表,按四元组的哈希值拆分
+    static TcpShard kTcpShards[TCP_SHARD_CNT];
+
+    // 监听表 key: (本地地址 << 16) | 本地端口,   value: 监听的连接
+    static std::unordered_map<uint64_t, std::shared_ptr<TcpSocket>> kTcpListenMap;
+    static std::shared_mutex kTcpListenMutex;
+
+    static std::mutex kTcpPortMutex;    // 分配临时端口
+    static uint16_t kNextEphemeralPort = TCP_EPHEMERAL_MIN;
+
+    TcpStatsCounter kTcpStats;
+    Timer* kTcpTimer = nullptr;
+    static std::atomic<TcpSynCookieMode> kTcpSynCookies = TCP_SYNCOOKIE_PRESSURE;
+
+    static const char* kTcpStateNames[] = {
+        "CLOSED", "LISTEN", "SYN_SENT", "SYN_RECEIVED", "ESTABLISHED", "FIN_WAIT_1",
+        "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK", "TIME_WAIT",
+    };
+
+
+    static TcpShard& TcpGetShard(const TcpConnKey& key)
+    {
+        return kTcpShards[TcpConnKeyHash()(key) % TCP_SHARD_CNT];
+    }
+
+    static bool TcpTableInsert(const TcpConnKey& key, const std::shared_ptr<TcpSocket>& sock)
+    {
+        TcpShard& shard = TcpGetShard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        return shard.table.emplace(key, sock).second;
+    }
+
+    static std::shared_ptr<TcpSocket> TcpTableLookup(const TcpConnKey& key)
+    {
+        TcpShard& shard = TcpGetShard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.table.find(key);
+        return it == shard.table.end() ? nullptr : it->second;
+    }
+
+    void TcpTableRemove(const TcpConnKey& key, const TcpSocket* sock)
+    {
+        TcpShard& shard = TcpGetShard(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.table.find(key);
+        if (it != shard.table.end() && it->second.get() == sock)
+            shard.table.erase(it);
+    }
+
+    static uint64_t TcpListenKey(uint32_t local_ip, uint16_t local_port)
+    {
+        return ((uint64_t)local_ip << 16) | local_port;
+    }
+
+    /**
+     * @brief 查找监听的连接,先精确匹配本地地址,再匹配监听任意地址的
+     *
+     * @param local_ip
+     * @param local_port
+     * @return std::shared_ptr<TcpSocket>
+     */
+    static std::shared_ptr<TcpSocket> TcpListenLookup(uint32_t local_ip, uint16_t local_port)
+    {
+        std::shared_lock<std::shared_mutex> lock(kTcpListenMutex);
+        auto it = kTcpListenMap.find(TcpListenKey(local_ip, local_port));
+        if (it != kTcpListenMap.end())
+            return it->second;
+        it = kTcpListenMap.find(TcpListenKey(0, local_port));
+        if (it != kTcpListenMap.end())
+            return it->second;
+        return nullptr;
+    }
+
+    static uint32_t TcpReadU32(const uint8_t* p)
+    {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    /**
+     * @brief 解析选项: MSS、窗口扩大、允许SACK(只在SYN中有效)、时间戳、SACK块
+     *
+     * @param opts
+     * @param len
+     * @param seg
+     * @return true
+     * @return false 选项格式错误
+     */
+    static bool TcpParseOptions(const uint8_t* opts, size_t len, TcpSegment& seg)
+    {
+        bool syn = seg.flags & TCP_FLAG_SYN;
+        size_t i = 0;
+        while (i < len)
+        {
+            uint8_t kind = opts[i];
+            if (kind == TCP_OPT_END)
+                break;
+            if (kind == TCP_OPT_NOP)
+            {
+                i++;
+                continue;
+            }
+            if (i + 1 >= len || opts[i + 1] < 2 || i + opts[i + 1] > len)
+                return false;
+
+            uint8_t opt_len = opts[i + 1];
+            const uint8_t* val = opts + i + 2;
+            switch (kind)
+            {
+            case TCP_OPT_MSS:
+                if (opt_len == 4 && syn)
+                    seg.mss = (val[0] << 8) | val[1];
+                break;
+            case TCP_OPT_WSCALE:
+                if (opt_len == 3 && syn)
+                    seg.wscale = static_cast<int8_t>(std::min<uint8_t>(val[0], TCP_MAX_WSCALE));
+                break;
+            case TCP_OPT_SACK_PERM:
+                if (opt_len == 2 && syn)
+                    seg.sack_perm = true;
+                break;
+            case TCP_OPT_TS:
+                if (opt_len == 10)
+                {
+                    seg.has_ts = true;
+                    seg.tsval = TcpReadU32(val);
+                    seg.tsecr = TcpReadU32(val + 4);
+                }
+                break;
+            case TCP_OPT_SACK:
+                if (!syn && (opt_len - 2) % 8 == 0)
+                {
+                    for (size_t off = 0; off + 8 <= (size_t)opt_len - 2 && seg.sack_cnt < TCP_MAX_SACK_BLOCKS; off += 8)
+                    {
+                        seg.sack[seg.sack_cnt][0] = TcpReadU32(val + off);
+                        seg.sack[seg.sack_cnt][1] = TcpReadU32(val + off + 4);
+                        seg.sack_cnt++;
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            i += opt_len;
+        }
+        return true;
+    }
+
+
+    const char* TcpStateName(TcpState state)
+    {
+        if (state < TCP_CLOSED || state > TCP_TIME_WAIT)
+            return "UNKNOWN";
+        return kTcpStateNames[state];
+    }
+
+    TcpSocket::TcpSocket()
+        : cc_(TcpCongestionCreate(TcpGetDefaultCongestion(), TCP_DEFAULT_MSS))
+    {
+
+    }
+
+    TcpSocket::~TcpSocket()
+    {
+
+    }
+
+    std::shared_ptr<TcpSocket> TcpSocket::Accept()
+    {
+        // accept_queue_ 在 TcpListen 返回之前创建,之后不再改变,不需要拿锁
+        std::shared_ptr<TcpSocket> child;
+        if (accept_queue_ == nullptr || !accept_queue_->TryPop(child))
+            return nullptr;
+        return child;
+    }
+
+    int TcpSocket::Send(const void* data, size_t size)
+    {
+        TcpTxList out;
+        int ret;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (fin_queued_ || (state_ != TCP_ESTABLISHED && state_ != TCP_CLOSE_WAIT
+                && state_ != TCP_SYN_SENT && state_ != TCP_SYN_RECEIVED))
+                return error_ != NET_ERR_OK ? error_ : NET_ERR_STATE;
+
+            size_t space = snd_buf_limit_ - std::min(snd_buf_limit_, snd_buf_.DataSize());
+            if (space == 0)
+                return NET_ERR_FULL;
+            size = std::min(size, space);
+            if (size == 0)
+                return 0;
+
+            snd_buf_.Write(static_cast<const unsigned char*>(data), size);
+            OutputLocked(out);
+            ret = static_cast<int>(size);
+        }
+
+        TcpXmit(out);
+        return ret;
+    }
+
+    int TcpSocket::SendZeroCopy(const std::shared_ptr<unsigned char>& data, size_t size)
+    {
+        if (data == nullptr)
+            return NET_ERR_PARAM;
+        if (size == 0)
+            return 0;
+        PacketBuffer src;
+        src.AppendExternal(data, size);
+        return SendRef(src, size);
+    }
+
+    int TcpSocket::SendPacket(const std::shared_ptr<PacketBuffer>& pkt)
+    {
+        if (pkt == nullptr)
+            return NET_ERR_PARAM;
+        return SendRef(*pkt, pkt->DataSize());
+    }
+
+    /**
+     * @brief 以引用的方式把 src 开头的 size 字节放入发送缓冲区
+     *
+     * @param src
+     * @param size
+     * @return int
+     */
+    int TcpSocket::SendRef(PacketBuffer& src, size_t size)
+    {
+        TcpTxList out;
+        int ret;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (fin_queued_ || (state_ != TCP_ESTABLISHED && state_ != TCP_CLOSE_WAIT
+                && state_ != TCP_SYN_SENT && state_ != TCP_SYN_RECEIVED))
+                return error_ != NET_ERR_OK ? error_ : NET_ERR_STATE;
+
+            size_t space = snd_buf_limit_ - std::min(snd_buf_limit_, snd_buf_.DataSize());
+            if (space == 0)
+                return NET_ERR_FULL;
+            size = std::min(size, space);
+            if (size == 0)
+                return 0;
+
+            snd_buf_.AppendSlice(src, 0, size);
+            OutputLocked(out);
+            ret = static_cast<int>(size);
+        }
+
+        TcpXmit(out);
+        return ret;
+    }
+
+    int TcpSocket::Recv(void* buf, size_t size)
+    {
+        TcpTxList out;
+        int ret;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            size_t avail = rcv_buf_.DataSize();
+            if (avail == 0)
+            {
+                if (fin_received_)
+                    return 0;
+                if (state_ == TCP_CLOSED)
+                    return error_ != NET_ERR_OK ? error_ : NET_ERR_STATE;
+                return NET_ERR_EMPTY;
+            }
+
+            size = std::min(size, avail);
+            rcv_buf_.ReadAt(0, static_cast<unsigned char*>(buf), size);
+            rcv_buf_.RemoveHeader(size);
+            ret = static_cast<int>(size);
+
+            // 窗口打开了足够大(一个MSS或者缓冲区的一半)才通告,避免糊涂窗口综合症
+            if (state_ == TCP_ESTABLISHED || state_ == TCP_FIN_WAIT_1 || state_ == TCP_FIN_WAIT_2)
+            {
+                size_t adv = rcv_adv_ - rcv_nxt_;
+                size_t space = rcv_buf_limit_ - std::min(rcv_buf_limit_, rcv_buf_.DataSize());
+                if (space > adv && space - adv >= std::min<size_t>(rcv_buf_limit_ / 2, rcv_mss_))
+                    SendAckLocked(out);
+            }
+        }
+
+        TcpXmit(out);
+        return ret;
+    }
+
+    void TcpSocket::Close()
+    {
+        TcpTxList out;
+        std::deque<std::shared_ptr<TcpSocket>> children;
+        bool listen_closed = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            switch (state_)
+            {
+            case TCP_LISTEN:
+                children = CloseListenLocked();
+                listen_closed = true;
+                break;
+            case TCP_SYN_SENT:
+                CloseLocked(NET_ERR_OK);
+                break;
+            case TCP_SYN_RECEIVED:
+            case TCP_ESTABLISHED:
+                fin_queued_ = true;
+                state_ = TCP_FIN_WAIT_1;
+                OutputLocked(out);
+                break;
+            case TCP_CLOSE_WAIT:
+                fin_queued_ = true;
+                state_ = TCP_LAST_ACK;
+                OutputLocked(out);
+                break;
+            default:
+                break;
+            }
+        }
+
+        TcpXmit(out);
+        // 还没有被 Accept 的连接直接重置
+        for (auto& child : children)
+            child->Abort();
+        if (listen_closed)
+            RxFilterUpdate();
+    }
+
+    void TcpSocket::Abort()
+    {
+        TcpTxList out;
+        std::deque<std::shared_ptr<TcpSocket>> children;
+        bool listen_closed = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            switch (state_)
+            {
+            case TCP_CLOSED:
+                break;
+            case TCP_LISTEN:
+                children = CloseListenLocked();
+                listen_closed = true;
+                break;
+            case TCP_SYN_SENT:
+            case TCP_TIME_WAIT:
+                CloseLocked(NET_ERR_OK);
+                break;
+            default:
+                out.push_back({ TcpBuildSegment(key_, snd_nxt_, 0, TCP_FLAG_RST, 0,
+                    nullptr, 0, nullptr, 0, 0), key_.local_ip, key_.remote_ip });
+                kTcpStats.out_rsts.fetch_add(1, std::memory_order_relaxed);
+                CloseLocked(NET_ERR_OK);
+                break;
+            }
+        }
+
+        TcpXmit(out);
+        for (auto& child : children)
+            child->Abort();
+        if (listen_closed)
+            RxFilterUpdate();
+    }
+
+    TcpState TcpSocket::GetState() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    NetErr_t TcpSocket::GetError() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return error_;
+    }
+
+    void TcpSocket::SetNoDelay(bool enable)
+    {
+        TcpTxList out;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            nodelay_ = enable;
+            if (enable)     // 被 Nagle 算法攒着的数据现在可以发送了
+                OutputLocked(out);
+        }
+        TcpXmit(out);
+    }
+
+    void TcpSocket::SetTso(bool enable)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        tso_ = enable;
+    }
+
+    void TcpSocket::SetKeepAlive(bool enable, uint32_t idle_sec, uint32_t intvl_sec, int probes)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        keepalive_ = enable;
+        keepalive_idle_sec_ = std::max<uint32_t>(idle_sec, 1);
+        keepalive_intvl_sec_ = std::max<uint32_t>(intvl_sec, 1);
+        keepalive_probes_ = std::max(probes, 1);
+        keepalive_sent_ = 0;
+        if (!enable)
+            CancelTimerLocked(TCP_TIMER_KEEPALIVE);
+        else if (state_ == TCP_ESTABLISHED || state_ == TCP_CLOSE_WAIT || state_ == TCP_FIN_WAIT_2)
+            ArmTimerLocked(TCP_TIMER_KEEPALIVE, keepalive_idle_sec_ * 1000);
+    }
+
+    uint32_t TcpSocket::SrttUs() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return srtt_us_;
+    }
+
+    void TcpSocket::SetCongestion(TcpCcAlgo algo)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cc_ = TcpCongestionCreate(algo, mss_);
+    }
+
+    const char* TcpSocket::CongestionName() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cc_->Name();
+    }
+
+    uint32_t TcpSocket::Cwnd() const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cc_->Cwnd();
+    }
+
+    /**
+     * @brief 被动打开的连接先放入监听连接的 accept 队列,队列满了保持 SYN_RECEIVED,
+     *        丢弃这个ACK,等重传的 SYN-ACK 让对端再确认一次; 监听已经关闭了就重置连接
+     *
+     * @param out
+     * @return true
+     * @return false 没有进入 ESTABLISHED,丢弃这个报文段
+     */
+    bool TcpSocket::EnterEstablishedLocked(TcpTxList& out)
     {
-        
+        std::shared_ptr<TcpSocket> listener = listener_.lock();
+        if (listener)
+        {
+            // 先登记再检查 listening_,关闭监听的线程先清除 listening_ 再等登记的线程退出,
+            // 这样要么这里看到已经关闭,要么关闭的线程在清空队列时能取到这个连接
+            listener->accept_pushers_.fetch_add(1);
+            bool listening = listener->listening_.load();
+            bool queued = listening && listener->accept_queue_->TryEmplace(shared_from_this());
+            listener->accept_pushers_.fetch_sub(1);
+            if (!listening)
+            {
+                out.push_back({ TcpBuildSegment(key_, snd_nxt_, 0, TCP_FLAG_RST, 0,
+                    nullptr, 0, nullptr, 0, 0), key_.local_ip, key_.remote_ip });
+                kTcpStats.out_rsts.fetch_add(1, std::memory_order_relaxed);
+                CloseLocked(NET_ERR_OK);
+                return false;
+            }
+            if (!queued)
+            {
+                kTcpStats.listen_drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            listener->syn_pending_.fetch_sub(1, std::memory_order_relaxed);
+            listener_.reset();
+        }
+
+        state_ = TCP_ESTABLISHED;
+        last_rcv_us_ = TcpNowUs();
+        if (keepalive_)
+            ArmTimerLocked(TCP_TIMER_KEEPALIVE, keepalive_idle_sec_ * 1000);
+        return true;
+    }
+
+    void TcpSocket::CloseLocked(NetErr_t err)
+    {
+        if (state_ == TCP_SYN_RECEIVED)     // 握手没有完成,归还监听连接的名额
+        {
+            std::shared_ptr<TcpSocket> listener = listener_.lock();
+            if (listener)
+                listener->syn_pending_.fetch_sub(1, std::memory_order_relaxed);
+            listener_.reset();
+        }
+
+        state_ = TCP_CLOSED;
+        if (err != NET_ERR_OK)
+            error_ = err;
+        for (int kind = 0; kind < TCP_TIMER_CNT; kind++)
+            CancelTimerLocked(kind);
+
+        snd_buf_.RemoveHeader(snd_buf_.DataSize());
+        ooo_.clear();
+        if (err == NET_ERR_RESET)   // 被重置时缓冲区中的数据也不再交给应用
+            rcv_buf_.RemoveHeader(rcv_buf_.DataSize());
+
+        if (in_table_)
+        {
+            TcpTableRemove(key_, this);
+            in_table_ = false;
+        }
     }
 
-    void TcpPop(std::shared_ptr<PacketBuffer> pkt)
+    std::deque<std::shared_ptr<TcpSocket>> TcpSocket::CloseListenLocked()
     {
+        {
+            std::unique_lock<std::shared_mutex> lock(kTcpListenMutex);
+            auto it = kTcpListenMap.find(TcpListenKey(key_.local_ip, key_.local_port));
+            if (it != kTcpListenMap.end() && it->second.get() == this)
+                kTcpListenMap.erase(it);
+        }
+
+        state_ = TCP_CLOSED;
+        listening_.store(false);
+        while (accept_pushers_.load() > 0)    // 等正在放入队列的接收线程结束
+            std::this_thread::yield();
+
+        std::deque<std::shared_ptr<TcpSocket>> children;
+        std::shared_ptr<TcpSocket> child;
+        while (accept_queue_->TryPop(child))
+            children.push_back(std::move(child));
+        return children;
+    }
+
+    /**
+     * @brief 按对端的SYN初始化被动打开的连接,状态是 SYN_RECEIVED
+     *
+     * @param listener
+     * @param key
+     * @param syn
+     * @param iss
+     */
+    void TcpSocket::InitPassiveLocked(const std::shared_ptr<TcpSocket>& listener, const TcpConnKey& key,
+        const TcpSegment& syn, uint32_t iss)
+    {
+        key_ = key;
+        listener_ = listener;
+        state_ = TCP_SYN_RECEIVED;
+        irs_ = syn.seq;
+        rcv_nxt_ = syn.seq + 1;
+        rcv_adv_ = rcv_nxt_;
+        iss_ = iss;
+        snd_una_ = iss_;
+        snd_nxt_ = iss_;
+        snd_buf_seq_ = iss_ + 1;
+        snd_wnd_ = syn.wnd;
+        snd_wl1_ = syn.seq;
+        snd_wl2_ = iss_;
+        rcv_mss_ = TcpLocalMss(key.remote_ip);
+        mss_ = std::min<uint16_t>(syn.mss ? syn.mss : TCP_DEFAULT_MSS, rcv_mss_);
+        rcv_wscale_ = TcpRcvWscale(rcv_buf_limit_);
+        NegotiateLocked(syn);
+        cc_->SetMss(mss_);
+        recover_ = iss_;
+    }
+
+    /**
+     * @brief 监听的连接收到报文段: SYN 在SYN队列没满时创建一个 SYN_RECEIVED 状态的连接,
+     *        满了用 SYN cookie 回复; 单独的ACK可能是完成 cookie 握手的
+     *
+     * @param listener
+     * @param key
+     * @param seg
+     * @param out
+     */
+    void TcpSocket::ListenInput(std::shared_ptr<TcpSocket> listener, const TcpConnKey& key,
+        const TcpSegment& seg, TcpTxList& out)
+    {
+        if (seg.flags & TCP_FLAG_RST)
+            return;
+        if ((seg.flags & TCP_FLAG_ACK) && !(seg.flags & TCP_FLAG_SYN))
+        {
+            CookieInput(listener, key, seg, out);
+            return;
+        }
+        if (seg.flags & TCP_FLAG_ACK)
+        {
+            TcpSendReset(key, seg, out);
+            return;
+        }
+        if (!(seg.flags & TCP_FLAG_SYN) || !listener->listening_.load(std::memory_order_relaxed))
+            return;
+
+        // accept 队列满了,cookie 建立的连接也放不进去,丢弃SYN,对端会重传
+        if (listener->accept_queue_->Size() >= listener->backlog_)
+        {
+            kTcpStats.listen_drops.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        TcpSynCookieMode mode = kTcpSynCookies.load(std::memory_order_relaxed);
+        int pending = listener->syn_pending_.fetch_add(1, std::memory_order_relaxed);
+        if (mode == TCP_SYNCOOKIE_ALWAYS || pending >= listener->backlog_)
+        {
+            listener->syn_pending_.fetch_sub(1, std::memory_order_relaxed);
+            if (mode == TCP_SYNCOOKIE_OFF)
+            {
+                kTcpStats.listen_drops.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            TcpCookieSynAck(key, seg, out);
+            kTcpStats.syncookies_sent.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        auto child = std::make_shared<TcpSocket>();
+        std::unique_lock<std::mutex> lock(child->mutex_);
+        child->InitPassiveLocked(listener, key, seg, TcpIsn(key));
+        if (!TcpTableInsert(key, child))    // 另一个线程已经为这个四元组创建了连接
+        {
+            child->CloseLocked(NET_ERR_OK);
+            return;
+        }
+        child->in_table_ = true;
+        kTcpStats.passive_opens.fetch_add(1, std::memory_order_relaxed);
+        child->OutputLocked(out);   // 发送 SYN-ACK
+    }
+
+    /**
+     * @brief 没有对应连接的ACK: 确认号是有效的 SYN cookie 时按恢复出来的SYN创建连接,
+     *        再把这个ACK(可能带着数据)交给它处理; 否则回复RST
+     *
+     * @param listener
+     * @param key
+     * @param seg
+     * @param out
+     */
+    void TcpSocket::CookieInput(std::shared_ptr<TcpSocket> listener, const TcpConnKey& key,
+        const TcpSegment& seg, TcpTxList& out)
+    {
+        TcpSegment syn;
+        if (kTcpSynCookies.load(std::memory_order_relaxed) == TCP_SYNCOOKIE_OFF ||
+            !TcpCookieCheck(key, seg, syn))
+        {
+            if (kTcpSynCookies.load(std::memory_order_relaxed) != TCP_SYNCOOKIE_OFF)
+                kTcpStats.syncookies_failed.fetch_add(1, std::memory_order_relaxed);
+            TcpSendReset(key, seg, out);
+            return;
+        }
+        if (!listener->listening_.load(std::memory_order_relaxed))
+            return;
+
+        syn.wnd = seg.wnd;
+        listener->syn_pending_.fetch_add(1, std::memory_order_relaxed);   // 建立之后和普通的握手一样归还
+        auto child = std::make_shared<TcpSocket>();
+        std::unique_lock<std::mutex> lock(child->mutex_);
+        child->InitPassiveLocked(listener, key, syn, seg.ack - 1);
+        child->snd_nxt_ = child->iss_ + 1;      // SYN-ACK 已经发送过了
+        child->rcv_adv_ = child->rcv_nxt_ + std::min<size_t>(child->rcv_buf_limit_, 0xffff);
+        if (!TcpTableInsert(key, child))
+        {
+            child->CloseLocked(NET_ERR_OK);
+            return;
+        }
+        child->in_table_ = true;
+
+        child->InputLocked(seg, out);
+        if (child->state_ == TCP_SYN_RECEIVED)  // accept 队列满了,不保留状态,等对端重传
+        {
+            child->CloseLocked(NET_ERR_OK);
+            return;
+        }
+        kTcpStats.passive_opens.fetch_add(1, std::memory_order_relaxed);
+        kTcpStats.syncookies_recv.fetch_add(1, std::memory_order_relaxed);
+    }
+
+
+///////////////////////////////////////////////////////////////// 以下是提供给外面的接口
+
+    std::shared_ptr<TcpSocket> TcpListen(uint32_t local_ip, uint16_t local_port,
+        int backlog, NetErr_t* err)
+    {
+        if (local_port == 0 || backlog <= 0)
+        {
+            if (err)
+                *err = NET_ERR_PARAM;
+            return nullptr;
+        }
+
+        auto sock = std::make_shared<TcpSocket>();
+        sock->key_.local_ip = local_ip;
+        sock->key_.local_port = local_port;
+        sock->backlog_ = backlog;
+        sock->state_ = TCP_LISTEN;
+        sock->listening_ = true;
+        sock->accept_queue_ = std::make_unique<ConcurrentQueue<std::shared_ptr<TcpSocket>>>(backlog);
+
+        std::unique_lock<std::shared_mutex> lock(kTcpListenMutex);
+        // 监听任意地址和监听具体地址互相冲突
+        bool in_use = kTcpListenMap.count(TcpListenKey(local_ip, local_port)) ||
+            kTcpListenMap.count(TcpListenKey(0, local_port));
+        for (auto& item : kTcpListenMap)
+        {
+            if (local_ip == 0 && item.second->key_.local_port == local_port)
+                in_use = true;
+        }
+        if (in_use)
+        {
+            if (err)
+                *err = NET_ERR_STATE;
+            return nullptr;
+        }
+
+        kTcpListenMap[TcpListenKey(local_ip, local_port)] = sock;
+        lock.unlock();
+
+        RxFilterUpdate();
+        if (err)
+            *err = NET_ERR_OK;
+        return sock;
+    }
+
+    void TcpLocalPorts(std::vector<uint16_t>& ports)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(kTcpListenMutex);
+            for (auto& item : kTcpListenMap)
+                ports.push_back(static_cast<uint16_t>(item.first & 0xffff));   // 见 TcpListenKey
+        }
+
+        // 监听关闭之后,已经建立的连接还在使用这个端口
+        for (auto& shard : kTcpShards)
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            for (auto& item : shard.table)
+            {
+                if (item.first.local_port < TCP_EPHEMERAL_MIN)
+                    ports.push_back(item.first.local_port);
+            }
+        }
+    }
+
+    std::shared_ptr<TcpSocket> TcpConnect(uint32_t local_ip, uint32_t remote_ip,
+        uint16_t remote_port, NetErr_t* err)
+    {
+        if (err)
+            *err = NET_ERR_OK;
+        if (local_ip == 0)  // 没有指定地址,使用出口网卡的地址
+        {
+            Routing routing = GetRouting(remote_ip);
+            if (routing.iface_ == nullptr)
+            {
+                if (err)
+                    *err = NET_ERR_UNREACH;
+                return nullptr;
+            }
+            local_ip = *(uint32_t*)routing.iface_->GetNetInfo()->ip;
+        }
+
+        auto sock = std::make_shared<TcpSocket>();
+        TcpTxList out;
+        {
+            std::unique_lock<std::mutex> lock(sock->mutex_);
+            TcpConnKey key = { local_ip, remote_ip, 0, remote_port };
+
+            // 分配一个四元组没有被使用、也没有被监听的临时端口
+            {
+                std::unique_lock<std::mutex> port_lock(kTcpPortMutex);
+                int range = TCP_EPHEMERAL_MAX - TCP_EPHEMERAL_MIN + 1;
+                for (int i = 0; i < range; i++)
+                {
+                    uint16_t port = kNextEphemeralPort;
+                    kNextEphemeralPort = port == TCP_EPHEMERAL_MAX ? TCP_EPHEMERAL_MIN : port + 1;
+                    key.local_port = port;
+                    if (TcpListenLookup(local_ip, port) == nullptr && TcpTableInsert(key, sock))
+                        break;
+                    key.local_port = 0;
+                }
+            }
+            if (key.local_port == 0)
+            {
+                if (err)
+                    *err = NET_ERR_FULL;
+                return nullptr;
+            }
+
+            sock->key_ = key;
+            sock->in_table_ = true;
+            sock->state_ = TCP_SYN_SENT;
+            sock->iss_ = TcpIsn(key);
+            sock->snd_una_ = sock->iss_;
+            sock->snd_nxt_ = sock->iss_;
+            sock->snd_buf_seq_ = sock->iss_ + 1;
+            sock->rcv_mss_ = TcpLocalMss(remote_ip);
+            sock->mss_ = sock->rcv_mss_;
+            sock->rcv_wscale_ = TcpRcvWscale(sock->rcv_buf_limit_);
+            sock->cc_->SetMss(sock->mss_);
+            sock->recover_ = sock->iss_;
+            kTcpStats.active_opens.fetch_add(1, std::memory_order_relaxed);
+            sock->OutputLocked(out);    // 发送SYN
+        }
+
+        TcpXmit(out);
+        return sock;
+    }
+
+    TcpStats TcpGetStats()
+    {
+        TcpStats stats;
+        stats.active_opens = kTcpStats.active_opens.load(std::memory_order_relaxed);
+        stats.passive_opens = kTcpStats.passive_opens.load(std::memory_order_relaxed);
+        stats.attempt_fails = kTcpStats.attempt_fails.load(std::memory_order_relaxed);
+        stats.estab_resets = kTcpStats.estab_resets.load(std::memory_order_relaxed);
+        stats.in_segs = kTcpStats.in_segs.load(std::memory_order_relaxed);
+        stats.out_segs = kTcpStats.out_segs.load(std::memory_order_relaxed);
+        stats.retrans_segs = kTcpStats.retrans_segs.load(std::memory_order_relaxed);
+        stats.in_errs = kTcpStats.in_errs.load(std::memory_order_relaxed);
+        stats.out_rsts = kTcpStats.out_rsts.load(std::memory_order_relaxed);
+        stats.listen_drops = kTcpStats.listen_drops.load(std::memory_order_relaxed);
+        stats.syncookies_sent = kTcpStats.syncookies_sent.load(std::memory_order_relaxed);
+        stats.syncookies_recv = kTcpStats.syncookies_recv.load(std::memory_order_relaxed);
+        stats.syncookies_failed = kTcpStats.syncookies_failed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void TcpSetSynCookies(TcpSynCookieMode mode)
+    {
+        kTcpSynCookies.store(mode, std::memory_order_relaxed);
+    }
+
+    void TcpInit(Timer* timer)
+    {
+        kTcpTimer = timer;
+        Ipv4RegisterProtocol(TYPE_TCP, TcpPop);
+    }
+
+    void TcpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr)
+    {
+        TcpHdr hdr;
+        size_t pkt_size = pkt->DataSize();
+        if (pkt->ReadAt(0, (unsigned char*)&hdr, sizeof(hdr)) != 0 ||
+            hdr.HeaderLen() < sizeof(TcpHdr) || hdr.HeaderLen() > pkt_size)
+        {
+            kTcpStats.in_errs.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (!pkt->CsumVerified())
+        {
+            uint32_t sum = ChecksumPseudoHdr(ip_hdr.src_ipaddr, ip_hdr.dst_ipaddr, TYPE_TCP, pkt_size);
+            if (ChecksumFold(ChecksumPacket(*pkt, 0, pkt_size, sum)) != 0xffff)
+            {
+                kTcpStats.in_errs.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        TcpSegment seg;
+        seg.seq = ntohl(hdr.seq);
+        seg.ack = ntohl(hdr.ack);
+        seg.wnd = ntohs(hdr.window);
+        seg.flags = hdr.flags;
+        size_t opt_len = hdr.HeaderLen() - sizeof(TcpHdr);
+        if (opt_len)
+        {
+            uint8_t opts[40];
+            pkt->ReadAt(sizeof(TcpHdr), opts, opt_len);
+            if (!TcpParseOptions(opts, opt_len, seg))
+            {
+                kTcpStats.in_errs.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        pkt->RemoveHeader(hdr.HeaderLen());
+        seg.len = pkt_size - hdr.HeaderLen();
+        seg.data = pkt;
+        kTcpStats.in_segs.fetch_add(1, std::memory_order_relaxed);
+
+        TcpConnKey key = { ip_hdr.dst_ipaddr, ip_hdr.src_ipaddr, ntohs(hdr.dst_port), ntohs(hdr.src_port) };
+        TcpTxList out;
+        std::shared_ptr<TcpSocket> sock = TcpTableLookup(key);
+        if (sock)
+        {
+            std::unique_lock<std::mutex> lock(sock->mutex_);
+            if (sock->state_ != TCP_CLOSED)
+                sock->InputLocked(seg, out);
+        }
+        else
+        {
+            std::shared_ptr<TcpSocket> listener = TcpListenLookup(key.local_ip, key.local_port);
+            if (listener)
+                TcpSocket::ListenInput(listener, key, seg, out);
+            else
+                TcpSendReset(key, seg, out);
+        }
 
+        TcpXmit(out);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,167 @@
+#include "tcp_cong.h"
+
+#include <algorithm>
+
+namespace netstack
+{
+    static constexpr double kBbrHighGain = 2.885;               // 2/ln2,慢启动一样每轮翻倍
+    static constexpr double kBbrDrainGain = 1.0 / 2.885;
+    static constexpr double kBbrCwndGain = 2.0;
+    static constexpr double kBbrCycleGain[] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+    static constexpr int kBbrCycleLen = sizeof(kBbrCycleGain) / sizeof(kBbrCycleGain[0]);
+    static constexpr uint64_t kBbrMinRttWinUs = 10 * 1000000ULL;  // 最小RTT的有效期
+    static constexpr uint64_t kBbrProbeRttUs = 200 * 1000;      // PROBE_RTT 持续的时间
+    static constexpr uint32_t kBbrMinCwndSegs = 4;
+    static constexpr int kBbrFullBwRounds = 3;                  // 连续3轮带宽增长不到25%认为已经占满管道
+
+    TcpBbr::TcpBbr(uint32_t mss)
+        : TcpCongestion(mss), pacing_gain_(kBbrHighGain), cwnd_gain_(kBbrHighGain)
+    {
+
+    }
+
+    uint64_t TcpBbr::MaxBw() const
+    {
+        return *std::max_element(bw_, bw_ + kBwWindow);
+    }
+
+    /**
+     * @brief 带宽时延积乘以增益(字节),还没有模型时使用初始窗口
+     *
+     * @param gain
+     * @return uint64_t
+     */
+    uint64_t TcpBbr::Bdp(double gain) const
+    {
+        uint64_t bw = MaxBw();
+        if (bw == 0 || min_rtt_us_ == 0)
+            return TCP_INIT_CWND_SEGS * mss_;
+        return static_cast<uint64_t>(bw * min_rtt_us_ / 1e6 * gain);
+    }
+
+    uint64_t TcpBbr::PacingRate() const
+    {
+        return static_cast<uint64_t>(MaxBw() * pacing_gain_);
+    }
+
+    void TcpBbr::UpdateModel(const TcpAckSample& sample)
+    {
+        if (sample.rtt_us)
+        {
+            bool expired = sample.now_us - min_rtt_stamp_us_ > kBbrMinRttWinUs;
+            if (min_rtt_us_ == 0 || sample.rtt_us <= min_rtt_us_ || expired)
+            {
+                min_rtt_us_ = sample.rtt_us;
+                min_rtt_stamp_us_ = sample.now_us;
+            }
+        }
+
+        // 应用没有数据可发时的采样偏低,只有比当前估计大时才使用
+        if (sample.delivery_rate == 0 || (sample.app_limited && sample.delivery_rate < MaxBw()))
+            return;
+        round_++;
+        bw_[round_ % kBwWindow] = sample.delivery_rate;
+
+        if (mode_ == STARTUP && full_bw_cnt_ < kBbrFullBwRounds)
+        {
+            uint64_t bw = MaxBw();
+            if (bw >= full_bw_ + full_bw_ / 4)
+            {
+                full_bw_ = bw;
+                full_bw_cnt_ = 0;
+            }
+            else
+                full_bw_cnt_++;
+        }
+    }
+
+    void TcpBbr::UpdateMode(const TcpAckSample& sample)
+    {
+        switch (mode_)
+        {
+        case STARTUP:
+            if (full_bw_cnt_ >= kBbrFullBwRounds)
+            {
+                mode_ = DRAIN;
+                pacing_gain_ = kBbrDrainGain;
+                cwnd_gain_ = kBbrHighGain;
+            }
+            break;
+        case DRAIN:
+            if (sample.in_flight <= Bdp(1.0))
+            {
+                mode_ = PROBE_BW;
+                cycle_idx_ = static_cast<int>(round_ % (kBbrCycleLen - 1)) + 1;  // 不从降速的那一格开始
+                cycle_stamp_us_ = sample.now_us;
+                pacing_gain_ = kBbrCycleGain[cycle_idx_];
+                cwnd_gain_ = kBbrCwndGain;
+            }
+            break;
+        case PROBE_BW:
+            if (sample.now_us - cycle_stamp_us_ > min_rtt_us_)     // 每个增益持续一个最小RTT
+            {
+                cycle_idx_ = (cycle_idx_ + 1) % kBbrCycleLen;
+                cycle_stamp_us_ = sample.now_us;
+                pacing_gain_ = kBbrCycleGain[cycle_idx_];
+            }
+            break;
+        case PROBE_RTT:
+            if (probe_rtt_done_us_ == 0 && sample.in_flight <= kBbrMinCwndSegs * mss_)
+                probe_rtt_done_us_ = sample.now_us + kBbrProbeRttUs;
+            else if (probe_rtt_done_us_ && sample.now_us >= probe_rtt_done_us_)
+            {
+                min_rtt_stamp_us_ = sample.now_us;
+                bool full = full_bw_cnt_ >= kBbrFullBwRounds;
+                mode_ = full ? PROBE_BW : STARTUP;
+                pacing_gain_ = full ? 1.0 : kBbrHighGain;
+                cwnd_gain_ = full ? kBbrCwndGain : kBbrHighGain;
+                cycle_stamp_us_ = sample.now_us;
+            }
+            break;
+        }
+
+        // 最小RTT太久没有更新,排空队列重新测量
+        if (mode_ != PROBE_RTT && min_rtt_us_ && sample.now_us - min_rtt_stamp_us_ > kBbrMinRttWinUs)
+        {
+            mode_ = PROBE_RTT;
+            pacing_gain_ = 1.0;
+            probe_rtt_done_us_ = 0;
+        }
+    }
+
+    void TcpBbr::SetCwnd(const TcpAckSample& sample)
+    {
+        uint64_t target = Bdp(cwnd_gain_) + 3 * mss_;  // 额外的窗口应对延迟确认和聚合
+        uint64_t cwnd = cwnd_;
+        if (full_bw_cnt_ >= kBbrFullBwRounds)
+            cwnd = std::min<uint64_t>(cwnd + sample.acked, target);
+        else if (cwnd < target || MaxBw() == 0)
+            cwnd += sample.acked;
+
+        cwnd = std::max<uint64_t>(cwnd, kBbrMinCwndSegs * mss_);
+        if (mode_ == PROBE_RTT)
+            cwnd = std::min<uint64_t>(cwnd, kBbrMinCwndSegs * mss_);
+        cwnd_ = static_cast<uint32_t>(std::min<uint64_t>(cwnd, UINT32_MAX));
+    }
+
+    void TcpBbr::OnAck(const TcpAckSample& sample)
+    {
+        UpdateModel(sample);
+        UpdateMode(sample);
+        SetCwnd(sample);
+    }
+
+    /**
+     * @brief 不把丢包当作拥塞信号,只在恢复期间保守地按在途数据发送
+     *
+     * @param kind
+     * @param in_flight
+     */
+    void TcpBbr::OnLoss(TcpLossKind kind, uint32_t in_flight)
+    {
+        if (kind == TCP_LOSS_RTO)
+            cwnd_ = mss_;
+        else
+            cwnd_ = std::max(in_flight, kBbrMinCwndSegs * mss_);
+    }
+}
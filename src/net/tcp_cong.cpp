@@ -0,0 +1,81 @@
+#include "tcp_cong.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace netstack
+{
+    static std::atomic<int> kTcpDefaultCc(TCP_CC_CUBIC);
+
+    TcpCongestion::TcpCongestion(uint32_t mss)
+        : mss_(mss), cwnd_(TCP_INIT_CWND_SEGS * mss)
+    {
+
+    }
+
+    /**
+     * @brief 握手确定了MSS之后按报文段个数换算拥塞窗口
+     *
+     * @param mss
+     */
+    void TcpCongestion::SetMss(uint32_t mss)
+    {
+        if (mss == 0 || mss == mss_)
+            return;
+        cwnd_ = std::max<uint32_t>(cwnd_ / mss_, TCP_MIN_CWND_SEGS) * mss;
+        mss_ = mss;
+    }
+
+    ////////////////////////////////////////////////// NewReno
+    void TcpNewReno::OnAck(const TcpAckSample& sample)
+    {
+        if (sample.in_recovery)
+            return;
+
+        if (cwnd_ < ssthresh_)  // 慢启动,每个确认最多增长2个MSS(RFC 3465)
+        {
+            cwnd_ += std::min(sample.acked, 2 * mss_);
+            return;
+        }
+
+        // 拥塞避免: 每确认一个窗口的数据增长一个MSS
+        acked_bytes_ += sample.acked;
+        if (acked_bytes_ >= cwnd_)
+        {
+            acked_bytes_ -= cwnd_;
+            cwnd_ += mss_;
+        }
+    }
+
+    void TcpNewReno::OnLoss(TcpLossKind kind, uint32_t in_flight)
+    {
+        ssthresh_ = std::max(in_flight / 2, TCP_MIN_CWND_SEGS * mss_);
+        cwnd_ = kind == TCP_LOSS_RTO ? mss_ : ssthresh_;
+        acked_bytes_ = 0;
+    }
+
+
+    std::unique_ptr<TcpCongestion> TcpCongestionCreate(TcpCcAlgo algo, uint32_t mss)
+    {
+        switch (algo)
+        {
+        case TCP_CC_CUBIC:
+            return std::make_unique<TcpCubic>(mss);
+        case TCP_CC_BBR:
+            return std::make_unique<TcpBbr>(mss);
+        case TCP_CC_NEWRENO:
+        default:
+            return std::make_unique<TcpNewReno>(mss);
+        }
+    }
+
+    void TcpSetDefaultCongestion(TcpCcAlgo algo)
+    {
+        kTcpDefaultCc.store(algo, std::memory_order_relaxed);
+    }
+
+    TcpCcAlgo TcpGetDefaultCongestion()
+    {
+        return static_cast<TcpCcAlgo>(kTcpDefaultCc.load(std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,74 @@
+#include "tcp_cong.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace netstack
+{
+    static constexpr double kCubicC = 0.4;
+    static constexpr double kCubicBeta = 0.7;
+    // 与 Reno 公平时的增长系数(RFC 9438 4.3)
+    static constexpr double kCubicAlpha = 3.0 * (1.0 - kCubicBeta) / (1.0 + kCubicBeta);
+
+    void TcpCubic::OnAck(const TcpAckSample& sample)
+    {
+        if (sample.in_recovery)
+            return;
+
+        if (cwnd_ < ssthresh_)  // 慢启动
+        {
+            cwnd_ += std::min(sample.acked, 2 * mss_);
+            return;
+        }
+
+        double cwnd = static_cast<double>(cwnd_) / mss_;
+        if (epoch_us_ == 0)     // 拥塞避免阶段开始
+        {
+            epoch_us_ = sample.now_us;
+            if (w_max_ <= cwnd)
+            {
+                w_max_ = cwnd;
+                k_ = 0;
+            }
+            else
+                k_ = std::cbrt((w_max_ - cwnd) / kCubicC);
+            w_est_ = cwnd;
+        }
+
+        // 以一个RTT之后的三次函数的值作为目标(RFC 9438 4.2)
+        double t = (sample.now_us - epoch_us_ + sample.srtt_us) / 1e6;
+        double w_cubic = kCubicC * std::pow(t - k_, 3) + w_max_;
+        double acked = static_cast<double>(sample.acked) / mss_;
+        w_est_ += kCubicAlpha * acked / cwnd;
+
+        double target = std::min(std::max(w_cubic, w_est_), cwnd * 1.5);
+        if (target <= cwnd)
+            return;
+        cwnd_frac_ += (target - cwnd) / cwnd * acked * mss_;
+        uint32_t inc = static_cast<uint32_t>(cwnd_frac_);
+        cwnd_frac_ -= inc;
+        cwnd_ += inc;
+    }
+
+    void TcpCubic::OnLoss(TcpLossKind kind, uint32_t in_flight)
+    {
+        (void)in_flight;
+        double cwnd = static_cast<double>(cwnd_) / mss_;
+        // 快速收敛: 窗口比上一次拥塞时小,说明有新的流加入,进一步让出带宽
+        if (cwnd < w_last_max_)
+        {
+            w_last_max_ = cwnd;
+            w_max_ = cwnd * (1.0 + kCubicBeta) / 2.0;
+        }
+        else
+        {
+            w_last_max_ = cwnd;
+            w_max_ = cwnd;
+        }
+
+        epoch_us_ = 0;
+        cwnd_frac_ = 0;
+        ssthresh_ = std::max<uint32_t>(static_cast<uint32_t>(cwnd_ * kCubicBeta), TCP_MIN_CWND_SEGS * mss_);
+        cwnd_ = kind == TCP_LOSS_RTO ? mss_ : ssthresh_;
+    }
+}
@@ -0,0 +1,662 @@
+#include "tcp.h"
+#include "net_err.h"
+#include "packet_buffer.h"
+#include "tcp_internal.h"
+
+#include <algorithm>
+
+namespace netstack
+{
+    /**
+     * @brief 报文段的序号是否落在接收窗口内(RFC 9293 3.10.7.4)
+     *
+     * @param seg
+     * @return true
+     * @return false
+     */
+    bool TcpSocket::SeqAcceptable(const TcpSegment& seg) const
+    {
+        // 正好是期望的序号总是可以接受,窗口为0时也要处理其中的ACK和RST
+        if (seg.seq == rcv_nxt_)
+            return true;
+
+        uint32_t wnd = rcv_adv_ - rcv_nxt_;
+        uint32_t seq_len = seg.SeqLen();
+        if (wnd == 0)
+            return false;
+        if (SeqGeq(seg.seq, rcv_nxt_) && SeqLt(seg.seq, rcv_nxt_ + wnd))
+            return true;
+        return seq_len > 0 && SeqGeq(seg.seq + seq_len - 1, rcv_nxt_)
+            && SeqLt(seg.seq + seq_len - 1, rcv_nxt_ + wnd);
+    }
+
+    /**
+     * @brief 处理收到的报文段(除了 LISTEN 状态)
+     *
+     * @param seg
+     * @param out
+     */
+    void TcpSocket::InputLocked(const TcpSegment& seg, TcpTxList& out)
+    {
+        if (state_ == TCP_SYN_SENT)
+        {
+            SynSentInputLocked(seg, out);
+            return;
+        }
+
+        // 对端没有收到 SYN-ACK 重传了SYN
+        if (state_ == TCP_SYN_RECEIVED && (seg.flags & TCP_FLAG_SYN) && seg.seq == irs_
+            && !(seg.flags & (TCP_FLAG_ACK | TCP_FLAG_RST)))
+        {
+            SendSegmentLocked(iss_, TCP_FLAG_SYN | TCP_FLAG_ACK, 0, out);
+            return;
+        }
+
+        last_rcv_us_ = TcpNowUs();
+        keepalive_sent_ = 0;
+
+        // PAWS(RFC 7323 5.3): 时间戳比最近收到的还旧,是回绕之前的旧报文段
+        if (ts_ok_ && seg.has_ts && !(seg.flags & TCP_FLAG_RST)
+            && static_cast<int32_t>(seg.tsval - ts_recent_) < 0)
+        {
+            SendAckLocked(out);
+            return;
+        }
+
+        // 1. 检查序号,不在窗口内的回复一个ACK告诉对端期望的序号
+        if (!SeqAcceptable(seg))
+        {
+            if (!(seg.flags & TCP_FLAG_RST))
+            {
+                if (state_ == TCP_TIME_WAIT && (seg.flags & TCP_FLAG_FIN))    // 对端重传了FIN
+                    ArmTimerLocked(TCP_TIMER_TIME_WAIT, TCP_TIME_WAIT_SEC * 1000);
+                SendAckLocked(out);
+            }
+            return;
+        }
+
+        // 要回显的时间戳取覆盖了上一次确认号的报文段(RFC 7323 4.3)
+        if (ts_ok_ && seg.has_ts && SeqLeq(seg.seq, last_ack_sent_))
+            ts_recent_ = seg.tsval;
+
+        // 2. RST: 只有序号正好是期望的序号才接受,否则回复 challenge ACK(RFC 5961)
+        if (seg.flags & TCP_FLAG_RST)
+        {
+            if (seg.seq != rcv_nxt_)
+            {
+                SendAckLocked(out);
+                return;
+            }
+            if (state_ == TCP_ESTABLISHED || state_ == TCP_CLOSE_WAIT)
+                kTcpStats.estab_resets.fetch_add(1, std::memory_order_relaxed);
+            // 被动打开还在握手中的连接直接释放,不通知应用
+            CloseLocked(state_ == TCP_SYN_RECEIVED ? NET_ERR_OK : NET_ERR_RESET);
+            return;
+        }
+
+        // 3. 已经同步的连接上收到SYN,回复 challenge ACK(RFC 5961)
+        if (seg.flags & TCP_FLAG_SYN)
+        {
+            SendAckLocked(out);
+            return;
+        }
+
+        // 4. ACK
+        if (!(seg.flags & TCP_FLAG_ACK))
+            return;
+        if (!AckInputLocked(seg, out))
+            return;
+
+        // 5. 数据和FIN
+        bool ack_now = false;
+        if (seg.SeqLen() > 0)
+        {
+            uint32_t rcv_nxt = rcv_nxt_;
+            bool had_ooo = !ooo_.empty();
+            bool fin = DataInputLocked(seg);
+            if (fin)
+                FinInputLocked();
+            // 乱序、重复、填补缺口的报文段和FIN立即确认,其余每两个报文段确认一次(RFC 5681 4.2)
+            delack_segs_++;
+            ack_now = fin || rcv_nxt_ == rcv_nxt || had_ooo || !ooo_.empty() || delack_segs_ >= 2;
+        }
+
+        // 有乱序数据时单独发送带SACK块的确认,数据报文段不携带SACK块
+        if (ack_now && sack_ok_ && !ooo_.empty())
+            SendAckLocked(out);
+        OutputLocked(out);  // 发送的数据会捎带确认
+        if (delack_segs_ > 0)
+        {
+            if (ack_now)
+                SendAckLocked(out);
+            else if (!TimerArmedLocked(TCP_TIMER_DELACK))
+                ArmTimerLocked(TCP_TIMER_DELACK, TCP_DELACK_MS);
+        }
+    }
+
+    /**
+     * @brief SYN_SENT 状态收到报文段
+     *
+     * @param seg
+     * @param out
+     */
+    void TcpSocket::SynSentInputLocked(const TcpSegment& seg, TcpTxList& out)
+    {
+        bool has_ack = seg.flags & TCP_FLAG_ACK;
+        if (has_ack && (SeqLeq(seg.ack, iss_) || SeqGt(seg.ack, snd_nxt_)))
+        {
+            if (!(seg.flags & TCP_FLAG_RST))
+                TcpSendReset(key_, seg, out);
+            return;
+        }
+
+        if (seg.flags & TCP_FLAG_RST)
+        {
+            if (has_ack)    // 对端没有监听这个端口
+            {
+                kTcpStats.attempt_fails.fetch_add(1, std::memory_order_relaxed);
+                CloseLocked(NET_ERR_REFUSED);
+            }
+            return;
+        }
+
+        if (!(seg.flags & TCP_FLAG_SYN))
+            return;
+
+        irs_ = seg.seq;
+        rcv_nxt_ = seg.seq + 1;
+        rcv_adv_ = rcv_nxt_;
+        mss_ = std::min<uint16_t>(seg.mss ? seg.mss : TCP_DEFAULT_MSS, rcv_mss_);
+        NegotiateLocked(seg);
+        cc_->SetMss(mss_);
+        snd_wnd_ = seg.wnd;
+        snd_wl1_ = seg.seq;
+        snd_wl2_ = seg.ack;
+
+        if (has_ack)
+        {
+            snd_una_ = seg.ack;
+            retries_ = 0;
+            if (rtt_timing_)
+            {
+                RttSampleLocked(static_cast<uint32_t>(TcpNowUs() - rtt_start_us_));
+                rtt_timing_ = false;
+            }
+            rto_ms_ = RtoFromEstimateLocked();
+            CancelTimerLocked(TCP_TIMER_RTO);
+            EnterEstablishedLocked(out);
+            SendAckLocked(out);
+            OutputLocked(out);  // 握手期间放入缓冲区的数据
+            return;
+        }
+
+        // 同时打开: 双方都发送了SYN
+        state_ = TCP_SYN_RECEIVED;
+        SendSegmentLocked(iss_, TCP_FLAG_SYN | TCP_FLAG_ACK, 0, out);
+    }
+
+    /**
+     * @brief 处理报文段中的确认号和窗口
+     *
+     * @param seg
+     * @param out
+     * @return true 继续处理报文段中的数据
+     * @return false 丢弃报文段(或者连接已经关闭)
+     */
+    bool TcpSocket::AckInputLocked(const TcpSegment& seg, TcpTxList& out)
+    {
+        if (state_ == TCP_SYN_RECEIVED)
+        {
+            if (SeqLeq(seg.ack, snd_una_) || SeqGt(seg.ack, snd_nxt_))
+            {
+                TcpSendReset(key_, seg, out);
+                return false;
+            }
+            snd_wnd_ = seg.wnd << snd_wscale_;
+            snd_wl1_ = seg.seq;
+            snd_wl2_ = seg.ack;
+            if (!EnterEstablishedLocked(out))
+                return false;
+        }
+
+        if (SeqGt(seg.ack, snd_nxt_))   // 确认了还没有发送的数据
+        {
+            SendAckLocked(out);
+            return false;
+        }
+
+        uint32_t seg_wnd = seg.wnd << snd_wscale_;
+        if (sack_ok_ && seg.sack_cnt)
+            SackUpdateLocked(seg);
+
+        if (SeqGt(seg.ack, snd_una_))
+        {
+            // 释放被确认的数据,SYN和FIN不在发送缓冲区中
+            uint32_t data_end = snd_buf_seq_ + snd_buf_.DataSize();
+            if (SeqGt(seg.ack, snd_buf_seq_))
+            {
+                uint32_t acked_end = SeqLt(seg.ack, data_end) ? seg.ack : data_end;
+                snd_buf_.RemoveHeader(acked_end - snd_buf_seq_);
+                snd_buf_seq_ = acked_end;
+            }
+
+            uint32_t acked = seg.ack - snd_una_;
+            uint64_t now = TcpNowUs();
+            uint32_t rtt_us = 0;
+            snd_una_ = seg.ack;
+            retries_ = 0;
+            dupacks_ = 0;
+            if (rtt_timing_ && SeqGt(seg.ack, rtt_seq_))
+            {
+                rtt_us = static_cast<uint32_t>(now - rtt_start_us_);
+                RttSampleLocked(rtt_us);
+                rtt_timing_ = false;
+            }
+            else if (ts_ok_ && seg.has_ts && seg.tsecr)
+            {
+                // 重传过的数据也可以用回显的时间戳采样(RFC 7323 4.1),精度是毫秒
+                uint32_t ms = TcpTsNow() - seg.tsecr;
+                if (ms > 0 && ms < TCP_RTO_MAX_MS)
+                {
+                    rtt_us = ms * 1000;
+                    RttSampleLocked(rtt_us);
+                }
+            }
+            rto_ms_ = RtoFromEstimateLocked();     // 收到新的确认,清除退避
+
+            // 记分板中已经被累计确认的部分
+            while (!sacked_.empty() && SeqLeq(sacked_.front().first, snd_una_))
+            {
+                if (SeqGt(sacked_.front().second, snd_una_))
+                {
+                    sacked_bytes_ -= snd_una_ - sacked_.front().first;
+                    sacked_.front().first = snd_una_;
+                    break;
+                }
+                sacked_bytes_ -= sacked_.front().second - sacked_.front().first;
+                sacked_.erase(sacked_.begin());
+            }
+            if (SeqLt(retran_hi_, snd_una_))
+                retran_hi_ = snd_una_;
+            CcAckLocked(acked, rtt_us, now);
+
+            if (in_recovery_)
+            {
+                if (SeqGeq(snd_una_, recover_))
+                    in_recovery_ = false;
+                else if (sack_ok_)
+                    RecoveryOutputLocked(out);
+                else    // 部分确认: 下一段也丢了,不用等重复确认立即重传
+                    RetransmitLocked(out);
+            }
+
+            if (snd_una_ == snd_nxt_)
+                CancelTimerLocked(TCP_TIMER_RTO);
+            else
+                ArmTimerLocked(TCP_TIMER_RTO, rto_ms_);
+        }
+        else if (seg.ack == snd_una_ && snd_una_ != snd_nxt_ && seg.len == 0
+            && !(seg.flags & (TCP_FLAG_SYN | TCP_FLAG_FIN)) && seg_wnd == snd_wnd_)
+        {
+            // 重复确认(RFC 5681 2): 达到阈值(或者SACK确认的数据超过阈值个报文段)时进入快速恢复
+            dupacks_++;
+            if (!in_recovery_ && (dupacks_ >= TCP_DUPACK_THRESH
+                || (sack_ok_ && sacked_bytes_ >= TCP_DUPACK_THRESH * mss_)))
+                EnterRecoveryLocked(out);
+            else if (in_recovery_ && sack_ok_)
+                RecoveryOutputLocked(out);
+        }
+
+        // 更新发送窗口,用 wl1/wl2 防止旧的报文段把窗口改回去
+        if (SeqLt(snd_wl1_, seg.seq) || (snd_wl1_ == seg.seq && SeqLeq(snd_wl2_, seg.ack)))
+        {
+            snd_wnd_ = seg_wnd;
+            snd_wl1_ = seg.seq;
+            snd_wl2_ = seg.ack;
+        }
+
+        bool fin_acked = fin_sent_ && snd_una_ == snd_nxt_;
+        switch (state_)
+        {
+        case TCP_FIN_WAIT_1:
+            if (fin_acked)
+                state_ = TCP_FIN_WAIT_2;
+            break;
+        case TCP_CLOSING:
+            if (fin_acked)
+                EnterTimeWaitLocked();
+            break;
+        case TCP_LAST_ACK:
+            if (fin_acked)
+            {
+                CloseLocked(NET_ERR_OK);
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    /**
+     * @brief 把一次新的确认交给拥塞控制,计时的报文段被确认时附带交付速率采样
+     *
+     * @param acked 新确认的字节数
+     * @param rtt_us 这次确认得到的RTT采样,0表示没有
+     * @param now_us
+     */
+    void TcpSocket::CcAckLocked(uint32_t acked, uint32_t rtt_us, uint64_t now_us)
+    {
+        delivered_ += acked;
+
+        TcpAckSample sample;
+        sample.now_us = now_us;
+        sample.acked = acked;
+        sample.in_flight = snd_nxt_ - snd_una_;
+        sample.rtt_us = rtt_us;
+        sample.srtt_us = srtt_us_;
+        sample.in_recovery = in_recovery_ && !recovery_rto_;
+        if (rtt_us)
+        {
+            sample.delivery_rate = (delivered_ - rtt_delivered_) * 1000000ULL / rtt_us;
+            sample.app_limited = app_limited_;
+        }
+        cc_->OnAck(sample);
+    }
+
+    void TcpSocket::CcLossLocked(TcpLossKind kind)
+    {
+        cc_->OnLoss(kind, snd_nxt_ - snd_una_);
+    }
+
+    /**
+     * @brief 根据对端的SYN确定连接使用的选项. 对端没有携带的选项双方都不使用
+     *
+     * @param syn
+     */
+    void TcpSocket::NegotiateLocked(const TcpSegment& syn)
+    {
+        ws_ok_ = syn.wscale >= 0;
+        snd_wscale_ = ws_ok_ ? syn.wscale : 0;
+        if (!ws_ok_)
+            rcv_wscale_ = 0;
+        sack_ok_ = syn.sack_perm;
+        ts_ok_ = syn.has_ts;
+        if (ts_ok_)
+        {
+            ts_recent_ = syn.tsval;
+            mss_ -= TCP_TS_OPT_LEN;     // 每个报文段都携带时间戳,数据相应地减少
+        }
+    }
+
+    /**
+     * @brief 把SACK块合并到记分板中,忽略不在 (SND.UNA, SND.NXT] 内的块
+     *
+     * @param seg
+     */
+    void TcpSocket::SackUpdateLocked(const TcpSegment& seg)
+    {
+        for (int i = 0; i < seg.sack_cnt; i++)
+        {
+            uint32_t left = seg.sack[i][0];
+            uint32_t right = seg.sack[i][1];
+            if (!SeqLt(left, right) || SeqLeq(right, snd_una_) || SeqGt(right, snd_nxt_))
+                continue;
+            if (SeqLt(left, snd_una_))
+                left = snd_una_;
+
+            // 找到第一个右边界不小于 left 的区间,和后面重叠或者相邻的区间合并
+            auto it = std::find_if(sacked_.begin(), sacked_.end(),
+                [left](const std::pair<uint32_t, uint32_t>& r) { return SeqGeq(r.second, left); });
+            auto end = it;
+            while (end != sacked_.end() && SeqLeq(end->first, right))
+            {
+                if (SeqLt(end->first, left))
+                    left = end->first;
+                if (SeqGt(end->second, right))
+                    right = end->second;
+                sacked_bytes_ -= end->second - end->first;
+                ++end;
+            }
+            it = sacked_.erase(it, end);
+            sacked_.insert(it, { left, right });
+            sacked_bytes_ += right - left;
+        }
+    }
+
+    /**
+     * @brief 下一个需要重传的空洞: 从 max(SND.UNA, retran_hi_) 开始、最高的SACK块之下
+     *        没有被选择确认的数据,最多一个MSS(RFC 6675 NextSeg 的简化)
+     *
+     * @param seq
+     * @param len
+     * @return true
+     * @return false 没有空洞
+     */
+    bool TcpSocket::SackNextHoleLocked(uint32_t& seq, uint32_t& len) const
+    {
+        uint32_t start = SeqLt(retran_hi_, snd_una_) ? snd_una_ : retran_hi_;
+        for (const auto& range : sacked_)
+        {
+            if (SeqLt(start, range.first))
+            {
+                seq = start;
+                len = std::min<uint32_t>(range.first - start, mss_);
+                return true;
+            }
+            if (SeqLt(start, range.second))
+                start = range.second;
+        }
+        return false;
+    }
+
+    /**
+     * @brief 在途的数据量(RFC 6675 pipe): 已发送未确认的数据,
+     *        减去被选择确认的和恢复中判断为丢失但还没有重传的
+     *
+     * @return uint32_t
+     */
+    uint32_t TcpSocket::PipeLocked() const
+    {
+        uint32_t pipe = snd_nxt_ - snd_una_ - sacked_bytes_;
+        if (!in_recovery_ || sacked_.empty())
+            return pipe;
+
+        uint32_t lost = 0;
+        uint32_t start = SeqLt(retran_hi_, snd_una_) ? snd_una_ : retran_hi_;
+        for (const auto& range : sacked_)
+        {
+            if (SeqLt(start, range.first))
+                lost += range.first - start;
+            if (SeqLt(start, range.second))
+                start = range.second;
+        }
+        return pipe > lost ? pipe - lost : 0;
+    }
+
+    void TcpSocket::EnterRecoveryLocked(TcpTxList& out)
+    {
+        CcLossLocked(TCP_LOSS_FAST);
+        in_recovery_ = true;
+        recovery_rto_ = false;
+        recover_ = snd_nxt_;
+        retran_hi_ = snd_una_;
+        rtt_timing_ = false;
+        if (sack_ok_)
+            RecoveryOutputLocked(out);
+        else
+            RetransmitLocked(out);
+        ArmTimerLocked(TCP_TIMER_RTO, rto_ms_);
+    }
+
+    /**
+     * @brief 恢复期间按 pipe 和拥塞窗口重传记分板中的空洞,新数据由 OutputLocked 发送
+     *
+     * @param out
+     */
+    void TcpSocket::RecoveryOutputLocked(TcpTxList& out)
+    {
+        // SND.UNA 处的数据还没有在这次恢复中重传过(刚进入恢复,或者部分确认),不管有没有SACK信息先重传
+        if (SeqLeq(retran_hi_, snd_una_) && (sacked_.empty() || sacked_.front().first != snd_una_))
+        {
+            RetransmitLocked(out);
+            retran_hi_ = snd_una_ + std::min<uint32_t>(snd_nxt_ - snd_una_, mss_);
+        }
+
+        uint32_t seq, len;
+        while (PipeLocked() < cc_->Cwnd() && SackNextHoleLocked(seq, len))
+        {
+            SendSegmentLocked(seq, TCP_FLAG_ACK, len, out);
+            retran_hi_ = seq + len;
+            kTcpStats.retrans_segs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 处理报文段中的数据和FIN. 按序到达的以引用的方式拼接到接收缓冲区,
+     *        乱序到达的先缓存起来,等中间的数据到达后再拼接
+     *
+     * @param seg
+     * @return true 收到了对端的FIN(按序)
+     * @return false
+     */
+    bool TcpSocket::DataInputLocked(const TcpSegment& seg)
+    {
+        if (state_ != TCP_ESTABLISHED && state_ != TCP_FIN_WAIT_1 && state_ != TCP_FIN_WAIT_2)
+            return false;
+        if (fin_received_)
+            return false;
+
+        uint32_t seq = seg.seq;
+        uint32_t len = seg.len;
+        bool fin = seg.flags & TCP_FLAG_FIN;
+        std::shared_ptr<PacketBuffer> data = seg.data;
+
+        // 去掉已经收到过的部分
+        if (SeqLt(seq, rcv_nxt_))
+        {
+            uint32_t dup = rcv_nxt_ - seq;
+            if (dup > len)      // 数据和FIN都是重复的
+                return false;
+            data->RemoveHeader(dup);
+            len -= dup;
+            seq = rcv_nxt_;
+        }
+
+        // 去掉超出接收缓冲区的部分,FIN也一起丢弃
+        size_t space = rcv_buf_limit_ - std::min(rcv_buf_limit_, rcv_buf_.DataSize());
+        uint32_t right = rcv_nxt_ + static_cast<uint32_t>(space);
+        if (SeqGt(seq + len, right))
+        {
+            uint32_t cut = seq + len - right;
+            if (cut >= len)
+                return false;
+            data->RemoveTail(cut);
+            len -= cut;
+            fin = false;
+        }
+
+        if (seq != rcv_nxt_)    // 乱序,缓存起来(同一个序号保留更长的)
+        {
+            if (len == 0 && !fin)
+                return false;
+            sack_recent_ = seq;
+            auto it = ooo_.find(seq);
+            if (it != ooo_.end())
+            {
+                if (it->second.data->DataSize() < len)
+                    it->second = { data, fin };
+            }
+            else if (ooo_.size() < TCP_MAX_OOO_SEGMENTS)
+                ooo_.emplace(seq, OooSegment{ data, fin });
+            return false;
+        }
+
+        if (len)
+        {
+            rcv_buf_.AppendSlice(*data, 0, len);
+            rcv_nxt_ += len;
+        }
+        if (fin)
+        {
+            rcv_nxt_++;
+            fin_received_ = true;
+            ooo_.clear();
+            return true;
+        }
+        return OooDrainLocked();
+    }
+
+    /**
+     * @brief 缺口被填上之后,把连续的乱序报文段拼接到接收缓冲区
+     *
+     * @return true 拼接的报文段中有FIN
+     * @return false
+     */
+    bool TcpSocket::OooDrainLocked()
+    {
+        while (!ooo_.empty())
+        {
+            auto it = ooo_.begin();
+            uint32_t seq = it->first;
+            if (SeqGt(seq, rcv_nxt_))
+                break;
+
+            OooSegment ooo = it->second;
+            ooo_.erase(it);
+            uint32_t len = ooo.data->DataSize();
+            uint32_t end = seq + len;
+            if (SeqLt(end, rcv_nxt_) || (end == rcv_nxt_ && !ooo.fin))
+                continue;   // 已经完全被之前的数据覆盖
+
+            uint32_t off = rcv_nxt_ - seq;
+            if (len > off)
+            {
+                rcv_buf_.AppendSlice(*ooo.data, off, len - off);
+                rcv_nxt_ = end;
+            }
+            if (ooo.fin)
+            {
+                rcv_nxt_++;
+                fin_received_ = true;
+                ooo_.clear();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief 按序收到对端的FIN之后的状态转换,FIN的确认由调用者立即发送
+     *
+     */
+    void TcpSocket::FinInputLocked()
+    {
+        switch (state_)
+        {
+        case TCP_SYN_RECEIVED:
+        case TCP_ESTABLISHED:
+            state_ = TCP_CLOSE_WAIT;
+            break;
+        case TCP_FIN_WAIT_1:
+            if (fin_sent_ && snd_una_ == snd_nxt_)
+                EnterTimeWaitLocked();
+            else
+                state_ = TCP_CLOSING;
+            break;
+        case TCP_FIN_WAIT_2:
+            EnterTimeWaitLocked();
+            break;
+        default:
+            break;
+        }
+    }
+
+    void TcpSocket::EnterTimeWaitLocked()
+    {
+        state_ = TCP_TIME_WAIT;
+        CancelTimerLocked(TCP_TIMER_RTO);
+        ArmTimerLocked(TCP_TIMER_TIME_WAIT, TCP_TIME_WAIT_SEC * 1000);
+    }
+}
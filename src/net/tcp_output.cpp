@@ -0,0 +1,448 @@
+#include "tcp.h"
+#include "checksum.h"
+#include "gso.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "net_type.h"
+#include "routing.h"
+#include "tcp_internal.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <random>
+
+namespace netstack
+{
+    static uint64_t TcpIsnSecret()
+    {
+        static const uint64_t secret = ((uint64_t)std::random_device()() << 32) | std::random_device()();
+        return secret;
+    }
+
+    uint32_t TcpIsn(const TcpConnKey& key)
+    {
+        using namespace std::chrono;
+        uint64_t clock = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count() / 4;
+        uint64_t hash = TcpConnKeyHash()(key) ^ TcpIsnSecret();
+        hash *= 0x9E3779B97F4A7C15ULL;
+        return static_cast<uint32_t>(clock + (hash >> 32));
+    }
+
+    uint16_t TcpLocalMss(uint32_t remote_ip)
+    {
+        Routing routing = GetRouting(remote_ip);
+        if (routing.iface_ == nullptr)
+            return TCP_DEFAULT_MSS;
+        uint32_t mtu = GetPathMtu(remote_ip, routing.iface_);
+        if (mtu <= sizeof(IPV4_Hdr) + sizeof(TcpHdr) + TCP_DEFAULT_MSS)
+            return TCP_DEFAULT_MSS;
+        return static_cast<uint16_t>(std::min<uint32_t>(mtu - sizeof(IPV4_Hdr) - sizeof(TcpHdr), 0xffff));
+    }
+
+    uint8_t TcpRcvWscale(size_t rcv_buf_limit)
+    {
+        uint8_t wscale = 0;
+        while (wscale < TCP_MAX_WSCALE && (rcv_buf_limit >> wscale) > 0xffff)
+            wscale++;
+        return wscale;
+    }
+
+    static uint8_t* TcpWriteU32(uint8_t* p, uint32_t val)
+    {
+        p[0] = val >> 24;
+        p[1] = (val >> 16) & 0xff;
+        p[2] = (val >> 8) & 0xff;
+        p[3] = val & 0xff;
+        return p + 4;
+    }
+
+    std::shared_ptr<PacketBuffer> TcpBuildSegment(const TcpConnKey& key, uint32_t seq, uint32_t ack,
+        uint8_t flags, uint16_t wnd, const uint8_t* opts, size_t opt_len,
+        PacketBuffer* payload, size_t payload_off, size_t payload_len)
+    {
+        auto pkt = std::make_shared<PacketBuffer>();
+        if (payload_len)    // 以引用的方式切片,重传时同样从发送缓冲区切片
+            pkt->AppendSlice(*payload, payload_off, payload_len);
+
+        size_t hdr_len = sizeof(TcpHdr) + opt_len;
+        uint8_t buf[sizeof(TcpHdr) + 40];
+        TcpHdr* hdr = reinterpret_cast<TcpHdr*>(buf);
+        hdr->src_port = htons(key.local_port);
+        hdr->dst_port = htons(key.remote_port);
+        hdr->seq = htonl(seq);
+        hdr->ack = (flags & TCP_FLAG_ACK) ? htonl(ack) : 0;
+        hdr->data_offset = static_cast<uint8_t>((hdr_len / 4) << 4);
+        hdr->flags = flags;
+        hdr->window = htons(wnd);
+        hdr->urgent = 0;
+        // 校验和字段先填入伪首部的部分和,剩下的推迟到驱动边界计算
+        hdr->checksum = ChecksumFold(ChecksumPseudoHdr(key.local_ip, key.remote_ip, TYPE_TCP,
+            static_cast<uint16_t>(hdr_len + payload_len)));
+        if (opt_len)
+            memcpy(buf + sizeof(TcpHdr), opts, opt_len);
+
+        pkt->AddHeader(hdr_len, buf);
+        pkt->SetCsumPartial(0, offsetof(TcpHdr, checksum));
+        return pkt;
+    }
+
+    void TcpSendReset(const TcpConnKey& key, const TcpSegment& seg, TcpTxList& out)
+    {
+        if (seg.flags & TCP_FLAG_RST)
+            return;
+
+        std::shared_ptr<PacketBuffer> pkt;
+        if (seg.flags & TCP_FLAG_ACK)
+            pkt = TcpBuildSegment(key, seg.ack, 0, TCP_FLAG_RST, 0, nullptr, 0, nullptr, 0, 0);
+        else
+            pkt = TcpBuildSegment(key, 0, seg.seq + seg.SeqLen(), TCP_FLAG_RST | TCP_FLAG_ACK, 0,
+                nullptr, 0, nullptr, 0, 0);
+        out.push_back({ pkt, key.local_ip, key.remote_ip });
+        kTcpStats.out_rsts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void TcpXmit(TcpTxList& out)
+    {
+        for (TcpTxSeg& seg : out)
+        {
+            if (IPv4Push(seg.pkt, seg.src_ip, seg.dst_ip, TYPE_TCP) == NET_ERR_OK)
+                kTcpStats.out_segs.fetch_add(seg.segs, std::memory_order_relaxed);
+        }
+        out.clear();
+    }
+
+
+    /**
+     * @brief 通告给对端的窗口(已经按扩大因子缩小). 已经通告出去的右边界不能往回缩
+     *
+     * @return uint16_t
+     */
+    uint16_t TcpSocket::WindowLocked()
+    {
+        size_t space = rcv_buf_limit_ - std::min(rcv_buf_limit_, rcv_buf_.DataSize());
+        uint32_t wnd = static_cast<uint32_t>(std::min<size_t>(space, (size_t)0xffff << rcv_wscale_));
+        uint32_t field = wnd >> rcv_wscale_;
+        if (SeqLt(rcv_nxt_ + (field << rcv_wscale_), rcv_adv_))   // 向上取整,保证不缩小
+            field = (rcv_adv_ - rcv_nxt_ + (1u << rcv_wscale_) - 1) >> rcv_wscale_;
+        rcv_adv_ = rcv_nxt_ + (field << rcv_wscale_);
+        return static_cast<uint16_t>(field);
+    }
+
+    /**
+     * @brief 构建选项. SYN中携带MSS、允许SACK、时间戳和窗口扩大,主动打开时全部提供,
+     *        被动打开时只回应对端提供了的; 之后的报文段携带时间戳,没有数据的确认携带SACK块
+     *
+     * @param flags
+     * @param data_len
+     * @param opts 至少40字节
+     * @return size_t 选项长度(4的倍数)
+     */
+    size_t TcpSocket::BuildOptionsLocked(uint8_t flags, size_t data_len, uint8_t* opts) const
+    {
+        uint8_t* p = opts;
+        bool syn = flags & TCP_FLAG_SYN;
+        bool offer = syn && state_ == TCP_SYN_SENT;
+        bool ts = offer || ts_ok_;
+        bool sack_perm = syn && (offer || sack_ok_);
+
+        if (syn)
+        {
+            *p++ = TCP_OPT_MSS;
+            *p++ = 4;
+            *p++ = rcv_mss_ >> 8;
+            *p++ = rcv_mss_ & 0xff;
+        }
+
+        if (sack_perm)
+        {
+            if (!ts)
+            {
+                *p++ = TCP_OPT_NOP;
+                *p++ = TCP_OPT_NOP;
+            }
+            *p++ = TCP_OPT_SACK_PERM;
+            *p++ = 2;
+        }
+        else if (ts)
+        {
+            *p++ = TCP_OPT_NOP;
+            *p++ = TCP_OPT_NOP;
+        }
+        if (ts)
+        {
+            *p++ = TCP_OPT_TS;
+            *p++ = 10;
+            p = TcpWriteU32(p, TcpTsNow());
+            p = TcpWriteU32(p, (flags & TCP_FLAG_ACK) ? ts_recent_ : 0);
+        }
+
+        if (syn && (offer || ws_ok_))
+        {
+            *p++ = TCP_OPT_NOP;
+            *p++ = TCP_OPT_WSCALE;
+            *p++ = 3;
+            *p++ = rcv_wscale_;
+        }
+
+        if (!syn && sack_ok_ && data_len == 0 && !ooo_.empty())
+        {
+            // 把连续的乱序报文段合并成块,包含最近收到的报文段的块放在第一个(RFC 2018 4)
+            std::pair<uint32_t, uint32_t> recent = { 0, 0 };
+            std::pair<uint32_t, uint32_t> blocks[TCP_MAX_SACK_BLOCKS];
+            int max_blocks = std::min<int>(TCP_MAX_SACK_BLOCKS, (40 - (p - opts) - 4) / 8);
+            int cnt = 0;
+            bool has_recent = false;
+            auto emit = [&](const std::pair<uint32_t, uint32_t>& range) {
+                if (SeqLeq(range.first, sack_recent_) && SeqLt(sack_recent_, range.second))
+                {
+                    recent = range;
+                    has_recent = true;
+                }
+                else if (cnt < max_blocks)
+                    blocks[cnt++] = range;
+            };
+
+            std::pair<uint32_t, uint32_t> cur = { 0, 0 };
+            bool has_cur = false;
+            for (const auto& item : ooo_)
+            {
+                uint32_t end = item.first + item.second.data->DataSize() + (item.second.fin ? 1 : 0);
+                if (has_cur && SeqLeq(item.first, cur.second))
+                {
+                    if (SeqGt(end, cur.second))
+                        cur.second = end;
+                    continue;
+                }
+                if (has_cur)
+                    emit(cur);
+                cur = { item.first, end };
+                has_cur = true;
+            }
+            emit(cur);
+
+            // 没有包含最近报文段的块时(例如它已经被按序接收),其余的块占满全部位置
+            if (has_recent)
+                cnt = std::min(cnt, max_blocks - 1);
+            int total = cnt + (has_recent ? 1 : 0);
+            if (max_blocks > 0 && total > 0)
+            {
+                *p++ = TCP_OPT_NOP;
+                *p++ = TCP_OPT_NOP;
+                *p++ = TCP_OPT_SACK;
+                *p++ = static_cast<uint8_t>(2 + 8 * total);
+                if (has_recent)
+                {
+                    p = TcpWriteU32(p, recent.first);
+                    p = TcpWriteU32(p, recent.second);
+                }
+                for (int i = 0; i < cnt; i++)
+                {
+                    p = TcpWriteU32(p, blocks[i].first);
+                    p = TcpWriteU32(p, blocks[i].second);
+                }
+            }
+        }
+        return p - opts;
+    }
+
+    /**
+     * @brief 发送一个报文段,数据从发送缓冲区中 seq 对应的位置开始
+     *
+     * @param seq
+     * @param flags
+     * @param data_len
+     * @param out
+     */
+    void TcpSocket::SendSegmentLocked(uint32_t seq, uint8_t flags, size_t data_len, TcpTxList& out)
+    {
+        uint8_t opts[40];
+        size_t opt_len = BuildOptionsLocked(flags, data_len, opts);
+
+        // SYN中的窗口不扩大(RFC 7323 2.2)
+        uint16_t wnd = (flags & TCP_FLAG_ACK) ? WindowLocked() : static_cast<uint16_t>(
+            std::min<size_t>(rcv_buf_limit_, 0xffff));
+        std::shared_ptr<PacketBuffer> pkt = TcpBuildSegment(key_, seq, rcv_nxt_, flags, wnd, opts, opt_len,
+            &snd_buf_, data_len ? seq - snd_buf_seq_ : 0, data_len);
+        uint32_t segs = 1;
+        if (data_len > mss_)    // TSO: 在驱动边界按MSS切分
+        {
+            pkt->SetGso(GSO_TCPV4, mss_);
+            segs = static_cast<uint32_t>((data_len + mss_ - 1) / mss_);
+        }
+        out.push_back({ pkt, key_.local_ip, key_.remote_ip, segs });
+
+        if (flags & TCP_FLAG_ACK)   // 捎带了确认,不用再延迟确认
+        {
+            last_ack_sent_ = rcv_nxt_;
+            delack_segs_ = 0;
+            CancelTimerLocked(TCP_TIMER_DELACK);
+        }
+    }
+
+    /**
+     * @brief 一个报文段最多携带的数据. 打开TSO时是多个MSS,
+     *        有发送速率时限制在大约1毫秒的数据量,避免一次发出太大的突发
+     *
+     * @return size_t
+     */
+    size_t TcpSocket::TsoSizeLocked() const
+    {
+        if (!tso_)
+            return mss_;
+        size_t size = std::min<size_t>(TCP_TSO_MAX_SIZE / mss_, GSO_MAX_SEGMENTS) * mss_;
+        uint64_t rate = cc_->PacingRate();
+        if (rate)
+            size = std::min<size_t>(size, std::max<size_t>(rate / 1000 / mss_, 1) * mss_);
+        return std::max<size_t>(size, mss_);
+    }
+
+    void TcpSocket::SendAckLocked(TcpTxList& out)
+    {
+        SendSegmentLocked(snd_nxt_, TCP_FLAG_ACK, 0, out);
+    }
+
+    /**
+     * @brief 按照对端的窗口发送缓冲区中还没有发送的数据,数据发完之后发送FIN
+     *
+     * @param out
+     */
+    void TcpSocket::OutputLocked(TcpTxList& out)
+    {
+        if (state_ == TCP_SYN_SENT || state_ == TCP_SYN_RECEIVED)
+        {
+            if (snd_nxt_ == iss_)   // 还没有发送SYN
+            {
+                uint8_t flags = state_ == TCP_SYN_SENT ? TCP_FLAG_SYN : TCP_FLAG_SYN | TCP_FLAG_ACK;
+                SendSegmentLocked(iss_, flags, 0, out);
+                snd_nxt_ = iss_ + 1;
+                rtt_timing_ = true;
+                rtt_seq_ = iss_;
+                rtt_start_us_ = TcpNowUs();
+                ArmTimerLocked(TCP_TIMER_RTO, rto_ms_);
+            }
+            return;
+        }
+        if (state_ != TCP_ESTABLISHED && state_ != TCP_CLOSE_WAIT && state_ != TCP_FIN_WAIT_1
+            && state_ != TCP_CLOSING && state_ != TCP_LAST_ACK)
+            return;
+
+        while (!fin_sent_)
+        {
+            size_t off = snd_nxt_ - snd_buf_seq_;
+            size_t avail = snd_buf_.DataSize() - off;
+            // 对端窗口从 SND.UNA 算起; 拥塞窗口限制的是在途的数据,有SACK时不包括被选择确认的
+            uint32_t outstanding = snd_nxt_ - snd_una_;
+            uint32_t in_flight = sack_ok_ ? PipeLocked() : outstanding;
+            uint32_t usable = std::min(snd_wnd_ > outstanding ? snd_wnd_ - outstanding : 0,
+                cc_->Cwnd() > in_flight ? cc_->Cwnd() - in_flight : 0);
+            size_t len = std::min<size_t>({ avail, usable, TsoSizeLocked() });
+            if (len > mss_ && len < avail)  // TSO报文段中间不留不满MSS的段
+                len -= len % mss_;
+            bool fin = fin_queued_ && len == avail;
+            if (avail == 0 && !fin_queued_)     // 窗口还有空间但是没有数据可发
+                app_limited_ = true;
+            if (len == 0 && !fin)
+                break;
+
+            // Nagle: 有没被确认的数据时,不满一个MSS的小段先攒着
+            if (len < mss_ && !fin && in_flight > 0 && !(nodelay_ && len == avail))
+                break;
+            if (len && !PaceLocked(len))
+                break;
+
+            uint8_t flags = TCP_FLAG_ACK;
+            if (len && len == avail)
+                flags |= TCP_FLAG_PSH;
+            if (fin)
+                flags |= TCP_FLAG_FIN;
+            SendSegmentLocked(snd_nxt_, flags, len, out);
+            if (!rtt_timing_)   // 每个RTT只对一个报文段计时
+            {
+                rtt_timing_ = true;
+                rtt_seq_ = snd_nxt_;
+                rtt_start_us_ = TcpNowUs();
+                rtt_delivered_ = delivered_;
+                app_limited_ = false;
+            }
+            snd_nxt_ += len + (fin ? 1 : 0);
+            fin_sent_ = fin;
+
+            if (!TimerArmedLocked(TCP_TIMER_RTO))
+                ArmTimerLocked(TCP_TIMER_RTO, rto_ms_);
+        }
+
+        // 对端窗口为0并且没有在途的数据,不会再有ACK带来窗口更新,需要定期探测
+        bool pending = !fin_sent_ && (fin_queued_ || snd_nxt_ - snd_buf_seq_ < snd_buf_.DataSize());
+        if (snd_wnd_ == 0 && pending && snd_una_ == snd_nxt_)
+        {
+            if (!TimerArmedLocked(TCP_TIMER_PERSIST))
+            {
+                persist_ms_ = RtoFromEstimateLocked();
+                ArmTimerLocked(TCP_TIMER_PERSIST, persist_ms_);
+            }
+        }
+        else
+            CancelTimerLocked(TCP_TIMER_PERSIST);
+    }
+
+    /**
+     * @brief 拥塞控制给出了发送速率时按令牌桶平滑发送. 定时器的精度是一个滴答,
+     *        所以允许一个滴答内的数据成批发出,令牌不够时等到下一个滴答
+     *
+     * @param len
+     * @return true 可以发送
+     * @return false 令牌不够,已经设置了定时器
+     */
+    bool TcpSocket::PaceLocked(size_t len)
+    {
+        uint64_t rate = cc_->PacingRate();
+        if (rate == 0)
+            return true;
+
+        uint64_t now = TcpNowUs();
+        double burst = std::max<double>(2.0 * mss_, rate * TCP_CLOCK_GRANULARITY_MS / 1000.0);
+        pace_tokens_ = std::min(burst, pace_tokens_ + rate * (now - pace_stamp_us_) / 1e6);
+        pace_stamp_us_ = now;
+        if (pace_tokens_ >= len)
+        {
+            pace_tokens_ -= len;
+            return true;
+        }
+
+        if (!TimerArmedLocked(TCP_TIMER_PACE))
+        {
+            uint64_t wait_ms = static_cast<uint64_t>((len - pace_tokens_) * 1000 / rate) + 1;
+            ArmTimerLocked(TCP_TIMER_PACE, static_cast<uint32_t>(std::min<uint64_t>(wait_ms, TCP_RTO_MAX_MS)));
+        }
+        return false;
+    }
+
+    /**
+     * @brief 重传最早没有被确认的一段(SYN、数据或者FIN)
+     *
+     * @param out
+     */
+    void TcpSocket::RetransmitLocked(TcpTxList& out)
+    {
+        if (state_ == TCP_SYN_SENT || state_ == TCP_SYN_RECEIVED)
+        {
+            uint8_t flags = state_ == TCP_SYN_SENT ? TCP_FLAG_SYN : TCP_FLAG_SYN | TCP_FLAG_ACK;
+            SendSegmentLocked(iss_, flags, 0, out);
+        }
+        else
+        {
+            size_t sent = snd_nxt_ - snd_una_ - (fin_sent_ ? 1 : 0);
+            size_t len = std::min<size_t>(sent, mss_);
+            bool fin = fin_sent_ && len == sent;
+
+            uint8_t flags = TCP_FLAG_ACK;
+            if (fin)
+                flags |= TCP_FLAG_FIN;
+            SendSegmentLocked(snd_una_, flags, len, out);
+        }
+        kTcpStats.retrans_segs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
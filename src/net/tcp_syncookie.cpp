@@ -0,0 +1,154 @@
+#include "tcp.h"
+#include "tcp_internal.h"
+
+#include <algorithm>
+#include <random>
+
+/*
+    SYN cookie: SYN队列满了之后不再为SYN保存任何状态,把需要记住的东西编码在 SYN-ACK 里,
+    对端完成握手的ACK带回来时再恢复出来.
+
+    序号(ISS):  | 计数器(5位) | MSS下标(3位) | 带密钥的哈希(24位) |
+        计数器每 TCP_COOKIE_PERIOD_SEC 秒加一,哈希覆盖四元组、对端的初始序号和完整的计数器.
+    TSval:      | 时钟(毫秒,低5位清零) | SACK(1位) | 窗口扩大因子(4位,0xf表示没有) |
+        只有对端带了时间戳时才能记住窗口扩大和SACK,否则这两个选项都不使用.
+ */
+#define TCP_COOKIE_COUNTER_BITS (5)
+#define TCP_COOKIE_HASH_BITS    (24)
+#define TCP_COOKIE_MSS_BITS     (3)
+#define TCP_COOKIE_TS_BITS      (5)
+#define TCP_COOKIE_NO_WSCALE    (0xf)
+#define TCP_COOKIE_SACK         (0x10)
+
+namespace netstack
+{
+    // 可以编码的MSS,向下取到表中不大于协商结果的值
+    static const uint16_t kTcpCookieMss[1 << TCP_COOKIE_MSS_BITS] = {
+        536, 1024, 1200, 1300, 1380, 1440, 1460, 8960,
+    };
+
+    static uint64_t TcpCookieSecret()
+    {
+        static const uint64_t secret = ((uint64_t)std::random_device()() << 32) | std::random_device()();
+        return secret;
+    }
+
+    static uint64_t TcpCookieMix(uint64_t val)
+    {
+        val ^= val >> 30;
+        val *= 0xBF58476D1CE4E5B9ULL;
+        val ^= val >> 27;
+        val *= 0x94D049BB133111EBULL;
+        return val ^ (val >> 31);
+    }
+
+    static uint32_t TcpCookieCounter()
+    {
+        return static_cast<uint32_t>(TcpNowUs() / (TCP_COOKIE_PERIOD_SEC * 1000000ULL));
+    }
+
+    static uint32_t TcpCookieHash(const TcpConnKey& key, uint32_t peer_isn, uint32_t counter)
+    {
+        uint64_t hash = TcpCookieMix(TcpCookieSecret() ^ (((uint64_t)key.local_ip << 32) | key.remote_ip));
+        hash = TcpCookieMix(hash ^ ((uint64_t)key.local_port << 48) ^ ((uint64_t)key.remote_port << 32) ^ peer_isn);
+        hash = TcpCookieMix(hash ^ counter);
+        return static_cast<uint32_t>(hash) & ((1u << TCP_COOKIE_HASH_BITS) - 1);
+    }
+
+    static uint8_t* TcpCookieWriteU32(uint8_t* p, uint32_t val)
+    {
+        p[0] = val >> 24;
+        p[1] = (val >> 16) & 0xff;
+        p[2] = (val >> 8) & 0xff;
+        p[3] = val & 0xff;
+        return p + 4;
+    }
+
+    void TcpCookieSynAck(const TcpConnKey& key, const TcpSegment& syn, TcpTxList& out)
+    {
+        uint16_t local_mss = TcpLocalMss(key.remote_ip);
+        uint16_t mss = std::min<uint16_t>(syn.mss ? syn.mss : TCP_DEFAULT_MSS, local_mss);
+        uint32_t idx = 0;
+        while (idx + 1 < (1u << TCP_COOKIE_MSS_BITS) && kTcpCookieMss[idx + 1] <= mss)
+            idx++;
+
+        uint32_t counter = TcpCookieCounter();
+        uint32_t iss = ((counter & ((1u << TCP_COOKIE_COUNTER_BITS) - 1)) << (TCP_COOKIE_MSS_BITS + TCP_COOKIE_HASH_BITS))
+            | (idx << TCP_COOKIE_HASH_BITS) | TcpCookieHash(key, syn.seq, counter);
+
+        // 选项的排列和 BuildOptionsLocked 相同
+        uint8_t opts[40];
+        uint8_t* p = opts;
+        *p++ = TCP_OPT_MSS;
+        *p++ = 4;
+        *p++ = local_mss >> 8;
+        *p++ = local_mss & 0xff;
+        if (syn.has_ts)
+        {
+            uint32_t bits = syn.wscale >= 0 ? syn.wscale : TCP_COOKIE_NO_WSCALE;
+            if (syn.sack_perm)
+                bits |= TCP_COOKIE_SACK;
+
+            if (syn.sack_perm)
+            {
+                *p++ = TCP_OPT_SACK_PERM;
+                *p++ = 2;
+            }
+            else
+            {
+                *p++ = TCP_OPT_NOP;
+                *p++ = TCP_OPT_NOP;
+            }
+            *p++ = TCP_OPT_TS;
+            *p++ = 10;
+            p = TcpCookieWriteU32(p, (TcpTsNow() & ~((1u << TCP_COOKIE_TS_BITS) - 1)) | bits);
+            p = TcpCookieWriteU32(p, syn.tsval);
+
+            if (syn.wscale >= 0)
+            {
+                *p++ = TCP_OPT_NOP;
+                *p++ = TCP_OPT_WSCALE;
+                *p++ = 3;
+                *p++ = TcpRcvWscale(TCP_RCV_BUF_SIZE);
+            }
+        }
+
+        // SYN中的窗口不扩大
+        uint16_t wnd = static_cast<uint16_t>(std::min<size_t>(TCP_RCV_BUF_SIZE, 0xffff));
+        out.push_back({ TcpBuildSegment(key, iss, syn.seq + 1, TCP_FLAG_SYN | TCP_FLAG_ACK, wnd,
+            opts, p - opts, nullptr, 0, 0), key.local_ip, key.remote_ip });
+    }
+
+    bool TcpCookieCheck(const TcpConnKey& key, const TcpSegment& ack, TcpSegment& syn)
+    {
+        uint32_t cookie = ack.ack - 1;
+        uint32_t peer_isn = ack.seq - 1;
+        uint32_t now = TcpCookieCounter();
+        uint32_t mask = (1u << TCP_COOKIE_COUNTER_BITS) - 1;
+        uint32_t age = (now - (cookie >> (TCP_COOKIE_MSS_BITS + TCP_COOKIE_HASH_BITS))) & mask;
+        if (age > TCP_COOKIE_MAX_AGE)
+            return false;
+        if (TcpCookieHash(key, peer_isn, now - age) != (cookie & ((1u << TCP_COOKIE_HASH_BITS) - 1)))
+            return false;
+
+        syn = TcpSegment();
+        syn.seq = peer_isn;
+        syn.flags = TCP_FLAG_SYN;
+        syn.mss = kTcpCookieMss[(cookie >> TCP_COOKIE_HASH_BITS) & ((1u << TCP_COOKIE_MSS_BITS) - 1)];
+        if (!ack.has_ts)
+            return true;
+
+        // 回显的时间戳(去掉编码的低位)不能来自将来,也不能比cookie的有效期还旧
+        int32_t ts_age = static_cast<int32_t>(TcpTsNow() - (ack.tsecr & ~((1u << TCP_COOKIE_TS_BITS) - 1)));
+        if (ts_age < 0 || ts_age > (int32_t)((TCP_COOKIE_MAX_AGE + 1) * TCP_COOKIE_PERIOD_SEC * 1000))
+            return false;
+        uint32_t wscale = ack.tsecr & TCP_COOKIE_NO_WSCALE;
+        if (wscale != TCP_COOKIE_NO_WSCALE && wscale > TCP_MAX_WSCALE)
+            return false;
+        syn.wscale = wscale == TCP_COOKIE_NO_WSCALE ? -1 : static_cast<int8_t>(wscale);
+        syn.sack_perm = ack.tsecr & TCP_COOKIE_SACK;
+        syn.has_ts = true;
+        syn.tsval = ack.tsval;
+        return true;
+    }
+}
@@ -0,0 +1,229 @@
+#include "tcp.h"
+#include "net_err.h"
+#include "tcp_internal.h"
+#include "time_entry.h"
+#include "timer.h"
+#include "timer_task_list.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace netstack
+{
+    uint64_t TcpNowUs()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t TcpTsNow()
+    {
+        return static_cast<uint32_t>(TcpNowUs() / 1000);
+    }
+
+    /**
+     * @brief 定时器回调. 连接已经释放,或者到期之后定时器被重新设置、取消了,什么都不做
+     *
+     * @param sock
+     * @param kind
+     */
+    void TcpTimerExpire(std::weak_ptr<TcpSocket> sock, int kind)
+    {
+        std::shared_ptr<TcpSocket> conn = sock.lock();
+        if (conn == nullptr)
+            return;
+
+        TcpTxList out;
+        {
+            std::unique_lock<std::mutex> lock(conn->mutex_);
+            TimerSlot* slot = conn->timers_[kind].get();
+            if (slot == nullptr || !slot->Fired())
+                return;
+            conn->OnTimerLocked(kind, out);
+        }
+        TcpXmit(out);
+    }
+
+    /**
+     * @brief 设置定时器,第一次设置时创建这个连接的定时器槽,之后重新设置不再分配内存
+     *
+     * @param kind
+     * @param delay_ms
+     */
+    void TcpSocket::ArmTimerLocked(int kind, uint32_t delay_ms)
+    {
+        if (kTcpTimer == nullptr)
+            return;
+        if (timers_[kind] == nullptr)
+            timers_[kind] = std::make_unique<TimerSlot>(std::bind(&TcpTimerExpire, weak_from_this(), kind));
+        kTcpTimer->Arm(timers_[kind].get(), TimeEntry({ delay_ms / 1000, (delay_ms % 1000) * 1000 }));
+    }
+
+    void TcpSocket::CancelTimerLocked(int kind)
+    {
+        if (TimerArmedLocked(kind))
+            kTcpTimer->Cancel(timers_[kind].get());
+    }
+
+    bool TcpSocket::TimerArmedLocked(int kind) const
+    {
+        return timers_[kind] != nullptr && timers_[kind]->Armed();
+    }
+
+    /**
+     * @brief 用一次RTT采样更新 SRTT 和 RTTVAR(RFC 6298 2.2、2.3)
+     *
+     * @param rtt_us
+     */
+    void TcpSocket::RttSampleLocked(uint32_t rtt_us)
+    {
+        rtt_us = std::max<uint32_t>(rtt_us, 1);
+        if (srtt_us_ == 0)
+        {
+            srtt_us_ = rtt_us;
+            rttvar_us_ = rtt_us / 2;
+        }
+        else
+        {
+            uint32_t delta = srtt_us_ > rtt_us ? srtt_us_ - rtt_us : rtt_us - srtt_us_;
+            rttvar_us_ = rttvar_us_ - rttvar_us_ / 4 + delta / 4;
+            srtt_us_ = std::max<uint32_t>(srtt_us_ - srtt_us_ / 8 + rtt_us / 8, 1);
+        }
+    }
+
+    /**
+     * @brief RTO = SRTT + max(G, 4 * RTTVAR),限制在 [TCP_RTO_MIN_MS, TCP_RTO_MAX_MS] 之间
+     *
+     * @return uint32_t 毫秒
+     */
+    uint32_t TcpSocket::RtoFromEstimateLocked() const
+    {
+        if (srtt_us_ == 0)
+            return TCP_RTO_INIT_MS;
+        uint64_t rto_us = srtt_us_ + std::max<uint64_t>(TCP_CLOCK_GRANULARITY_MS * 1000ULL, 4ULL * rttvar_us_);
+        uint64_t rto_ms = (rto_us + 999) / 1000;
+        return static_cast<uint32_t>(std::clamp<uint64_t>(rto_ms, TCP_RTO_MIN_MS, TCP_RTO_MAX_MS));
+    }
+
+    /**
+     * @brief 发送一个序号为 SND.UNA-1 的空报文段,对端一定会回复ACK(窗口探测和保活都用它)
+     *
+     * @param out
+     */
+    void TcpSocket::SendProbeLocked(TcpTxList& out)
+    {
+        SendSegmentLocked(snd_una_ - 1, TCP_FLAG_ACK, 0, out);
+    }
+
+    void TcpSocket::OnTimerLocked(int kind, TcpTxList& out)
+    {
+        switch (kind)
+        {
+        case TCP_TIMER_RTO:
+            OnRtoLocked(out);
+            break;
+        case TCP_TIMER_DELACK:
+            if (delack_segs_ > 0 && state_ != TCP_CLOSED)
+                SendAckLocked(out);
+            break;
+        case TCP_TIMER_PERSIST:
+            OnPersistLocked(out);
+            break;
+        case TCP_TIMER_KEEPALIVE:
+            OnKeepAliveLocked(out);
+            break;
+        case TCP_TIMER_PACE:
+            OutputLocked(out);
+            break;
+        case TCP_TIMER_TIME_WAIT:
+            CloseLocked(NET_ERR_OK);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void TcpSocket::OnRtoLocked(TcpTxList& out)
+    {
+        if (snd_una_ == snd_nxt_)   // 已经全部被确认了
+            return;
+
+        int max_retries = (state_ == TCP_SYN_SENT || state_ == TCP_SYN_RECEIVED) ?
+            TCP_SYN_RETRIES : TCP_MAX_RETRIES;
+        if (++retries_ > max_retries)
+        {
+            if (state_ == TCP_SYN_SENT)
+                kTcpStats.attempt_fails.fetch_add(1, std::memory_order_relaxed);
+            else
+                out.push_back({ TcpBuildSegment(key_, snd_nxt_, 0, TCP_FLAG_RST, 0,
+                    nullptr, 0, nullptr, 0, 0), key_.local_ip, key_.remote_ip });
+            CloseLocked(NET_ERR_TIMEOUT);
+            return;
+        }
+
+        if (retries_ == 1)      // 同一段数据连续超时只算一次拥塞
+            CcLossLocked(TCP_LOSS_RTO);
+        in_recovery_ = true;
+        recovery_rto_ = true;
+        recover_ = snd_nxt_;
+        dupacks_ = 0;
+        rtt_timing_ = false;    // Karn: 重传过的报文段不能用来采样
+        rto_ms_ = std::min<uint32_t>(rto_ms_ * 2, TCP_RTO_MAX_MS);     // 指数退避
+        RetransmitLocked(out);
+        // 对端可能已经丢弃了选择确认过的数据(RFC 2018 8),记分板从头开始
+        sacked_.clear();
+        sacked_bytes_ = 0;
+        retran_hi_ = snd_una_ + std::min<uint32_t>(snd_nxt_ - snd_una_, mss_);
+        ArmTimerLocked(TCP_TIMER_RTO, rto_ms_);
+    }
+
+    /**
+     * @brief 对端窗口为0并且没有在途的数据时,定期探测窗口是否已经打开
+     *
+     * @param out
+     */
+    void TcpSocket::OnPersistLocked(TcpTxList& out)
+    {
+        if (snd_wnd_ != 0 || snd_una_ != snd_nxt_ || state_ == TCP_CLOSED)
+            return;
+        SendProbeLocked(out);
+        persist_ms_ = std::min<uint32_t>(persist_ms_ * 2, TCP_RTO_MAX_MS);
+        ArmTimerLocked(TCP_TIMER_PERSIST, persist_ms_);
+    }
+
+    /**
+     * @brief 空闲超过 keepalive_idle_sec_ 之后每隔 keepalive_intvl_sec_ 发送一个探测,
+     *        连续 keepalive_probes_ 个没有回应就重置连接
+     *
+     * @param out
+     */
+    void TcpSocket::OnKeepAliveLocked(TcpTxList& out)
+    {
+        if (!keepalive_ || (state_ != TCP_ESTABLISHED && state_ != TCP_CLOSE_WAIT
+            && state_ != TCP_FIN_WAIT_2))
+            return;
+
+        uint64_t idle_us = keepalive_idle_sec_ * 1000000ULL;
+        uint64_t elapsed_us = TcpNowUs() - last_rcv_us_;
+        if (keepalive_sent_ == 0 && (elapsed_us < idle_us || snd_una_ != snd_nxt_))
+        {
+            // 期间收到过报文段,或者有在途的数据(由重传定时器负责),从最近一次收到的时间重新计算
+            uint64_t remain_ms = elapsed_us < idle_us ? (idle_us - elapsed_us + 999) / 1000 : idle_us / 1000;
+            ArmTimerLocked(TCP_TIMER_KEEPALIVE, static_cast<uint32_t>(remain_ms));
+            return;
+        }
+
+        if (keepalive_sent_ >= keepalive_probes_)
+        {
+            out.push_back({ TcpBuildSegment(key_, snd_nxt_, 0, TCP_FLAG_RST, 0,
+                nullptr, 0, nullptr, 0, 0), key_.local_ip, key_.remote_ip });
+            CloseLocked(NET_ERR_TIMEOUT);
+            return;
+        }
+
+        keepalive_sent_++;
+        SendProbeLocked(out);
+        ArmTimerLocked(TCP_TIMER_KEEPALIVE, keepalive_intvl_sec_ * 1000);
+    }
+}
@@ -1,14 +1,390 @@
 #include "udp.h"
+#include "checksum.h"
+#include "gso.h"
+#include "icmp.h"
+#include "ipv4.h"
+#include "net_err.h"
+#include "net_interface.h"
+#include "net_type.h"
+#include "routing.h"
+#include "rx_filter.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 
 namespace netstack
 {
-    void UdpPush(std::shared_ptr<PacketBuffer> pkt)
+    extern std::map<uint32_t, NetInterface*> kNetifacesMap;    // 定义在net_init.cpp中
+
+    // key: (本地地址 << 16) | 本地端口,   value: 端点
+    static std::unordered_map<uint64_t, std::shared_ptr<UdpEndpoint>> kUdpDemuxMap;
+    static std::shared_mutex kUdpDemuxMutex;    // 接收线程只读,绑定/关闭时才写
+    static uint16_t kNextEphemeralPort = UDP_EPHEMERAL_MIN;
+
+    static std::atomic<uint64_t> kDropNoPort = 0;
+    static std::atomic<uint64_t> kDropLength = 0;
+
+    // 当前线程正在合并的数据报. 一个网卡同时只有一个处理任务(RxScheduleTask),
+    // 一个接收批次只在一个线程上处理,批次结束时交给端点
+    struct UdpGroHeld
+    {
+        std::shared_ptr<UdpEndpoint> endpoint;
+        UdpDatagram dgram;
+        size_t seg_size = 0;    // 第一段的大小,后面的段必须相同
+        int seg_cnt = 0;
+        bool closed = false;    // 收到了更小的一段,之后不能再合并
+    };
+    static thread_local UdpGroHeld kGroHeld;
+
+
+    static uint64_t UdpDemuxKey(uint32_t local_ip, uint16_t local_port)
+    {
+        return ((uint64_t)local_ip << 16) | local_port;
+    }
+
+    /**
+     * @brief 查找接收数据报的端点,先精确匹配本地地址,再匹配绑定任意地址的端点
+     *
+     * @param local_ip
+     * @param local_port
+     * @return std::shared_ptr<UdpEndpoint>
+     */
+    static std::shared_ptr<UdpEndpoint> UdpLookup(uint32_t local_ip, uint16_t local_port)
+    {
+        std::shared_lock<std::shared_mutex> lock(kUdpDemuxMutex);
+        auto it = kUdpDemuxMap.find(UdpDemuxKey(local_ip, local_port));
+        if (it != kUdpDemuxMap.end())
+            return it->second;
+        it = kUdpDemuxMap.find(UdpDemuxKey(0, local_port));
+        if (it != kUdpDemuxMap.end())
+            return it->second;
+        return nullptr;
+    }
+
+    /**
+     * @brief 端口是否已经被占用. 绑定任意地址和绑定具体地址互相冲突
+     *
+     * @param local_ip
+     * @param local_port
+     * @return true
+     * @return false
+     */
+    static bool UdpPortInUseLocked(uint32_t local_ip, uint16_t local_port)
+    {
+        if (kUdpDemuxMap.count(UdpDemuxKey(local_ip, local_port)) ||
+            kUdpDemuxMap.count(UdpDemuxKey(0, local_port)))
+            return true;
+        if (local_ip != 0)
+            return false;
+
+        for (auto& item : kUdpDemuxMap)
+        {
+            if (item.second->LocalPort() == local_port)
+                return true;
+        }
+        return false;
+    }
+
+
+
+    UdpEndpoint::UdpEndpoint(uint32_t local_ip, uint16_t local_port, size_t ring_size)
+        : local_ip_(local_ip), local_port_(local_port), recv_ring_(ring_size)
+    {
+
+    }
+
+    UdpEndpoint::~UdpEndpoint()
+    {
+
+    }
+
+    int UdpEndpoint::SendBatch(const UdpDatagram* dgrams, int cnt)
+    {
+        int sent = 0;
+        for (; sent < cnt; sent++)
+        {
+            const UdpDatagram& dgram = dgrams[sent];
+            NetErr_t ret = UdpPush(dgram.pkt, local_ip_, local_port_,
+                dgram.remote_ip, dgram.remote_port, dgram.gso_size);
+            if (ret != NET_ERR_OK)
+            {
+                tx_errors_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        tx_packets_.fetch_add(sent, std::memory_order_relaxed);
+        return sent;
+    }
+
+    int UdpEndpoint::RecvBatch(UdpDatagram* dgrams, int cnt)
+    {
+        int recv = 0;
+        while (recv < cnt && recv_ring_.TryPop(dgrams[recv]))
+            recv++;
+        return recv;
+    }
+
+    /**
+     * @brief 放入接收环
+     *
+     * @param dgram
+     * @param seg_cnt 合并的数据报个数
+     */
+    void UdpEndpoint::Deliver(UdpDatagram& dgram, int seg_cnt)
+    {
+        if (!recv_ring_.TryPush<UdpDatagram>(dgram))
+        {
+            rx_drop_full_.fetch_add(seg_cnt, std::memory_order_relaxed);
+            return;
+        }
+        rx_packets_.fetch_add(seg_cnt, std::memory_order_relaxed);
+        if (seg_cnt > 1)
+            rx_coalesced_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    UdpEndpointStats UdpEndpoint::GetStats() const
+    {
+        UdpEndpointStats stats;
+        stats.rx_packets = rx_packets_.load(std::memory_order_relaxed);
+        stats.rx_coalesced = rx_coalesced_.load(std::memory_order_relaxed);
+        stats.rx_drop_full = rx_drop_full_.load(std::memory_order_relaxed);
+        stats.rx_drop_checksum = rx_drop_checksum_.load(std::memory_order_relaxed);
+        stats.tx_packets = tx_packets_.load(std::memory_order_relaxed);
+        stats.tx_errors = tx_errors_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+
+    /**
+     * @brief 尝试把数据报合并到当前线程正在合并的数据报后面,
+     *        不是同一个流或者大小不符合就先交出之前的,再从这个数据报开始合并
+     *
+     * @param endpoint
+     * @param dgram
+     */
+    static void UdpGroReceive(std::shared_ptr<UdpEndpoint>& endpoint, UdpDatagram& dgram)
+    {
+        UdpGroHeld& held = kGroHeld;
+        size_t size = dgram.pkt->DataSize();
+        if (held.endpoint == endpoint && !held.closed && held.seg_size != 0
+            && held.dgram.remote_ip == dgram.remote_ip && held.dgram.remote_port == dgram.remote_port
+            && held.dgram.local_ip == dgram.local_ip
+            && size != 0 && size <= held.seg_size && held.seg_cnt < UDP_GRO_MAX_SEGMENTS
+            && held.dgram.pkt->DataSize() + size + sizeof(UdpHdr) <= 0xffff - sizeof(IPV4_Hdr))
+        {
+            held.dgram.pkt->AppendSlice(*dgram.pkt, 0, size);
+            held.seg_cnt++;
+            held.closed = size < held.seg_size;
+            return;
+        }
+
+        UdpGroFlush();
+        held.endpoint = endpoint;
+        held.dgram = std::move(dgram);
+        held.seg_size = size;
+        held.seg_cnt = 1;
+        held.closed = false;
+    }
+
+
+///////////////////////////////////////////////////////////////// 以下是提供给外面的接口
+
+    std::shared_ptr<UdpEndpoint> UdpOpen(uint32_t local_ip, uint16_t local_port, NetErr_t* err)
+    {
+        std::unique_lock<std::shared_mutex> lock(kUdpDemuxMutex);
+        if (local_port == 0)    // 分配一个临时端口
+        {
+            int range = UDP_EPHEMERAL_MAX - UDP_EPHEMERAL_MIN + 1;
+            for (int i = 0; i < range; i++)
+            {
+                uint16_t port = kNextEphemeralPort;
+                kNextEphemeralPort = port == UDP_EPHEMERAL_MAX ? UDP_EPHEMERAL_MIN : port + 1;
+                if (!UdpPortInUseLocked(local_ip, port))
+                {
+                    local_port = port;
+                    break;
+                }
+            }
+        }
+
+        if (local_port == 0 || UdpPortInUseLocked(local_ip, local_port))
+        {
+            if (err)
+                *err = NET_ERR_STATE;
+            return nullptr;
+        }
+
+        auto endpoint = std::make_shared<UdpEndpoint>(local_ip, local_port);
+        kUdpDemuxMap[UdpDemuxKey(local_ip, local_port)] = endpoint;
+        lock.unlock();
+
+        if (local_port < UDP_EPHEMERAL_MIN)    // 临时端口总是放行的
+            RxFilterUpdate();
+        if (err)
+            *err = NET_ERR_OK;
+        return endpoint;
+    }
+
+    void UdpClose(const std::shared_ptr<UdpEndpoint>& endpoint)
+    {
+        {
+            std::unique_lock<std::shared_mutex> lock(kUdpDemuxMutex);
+            auto it = kUdpDemuxMap.find(UdpDemuxKey(endpoint->LocalIp(), endpoint->LocalPort()));
+            if (it == kUdpDemuxMap.end() || it->second != endpoint)
+                return;
+            kUdpDemuxMap.erase(it);
+        }
+        if (endpoint->LocalPort() < UDP_EPHEMERAL_MIN)
+            RxFilterUpdate();
+    }
+
+    void UdpLocalPorts(std::vector<uint16_t>& ports)
+    {
+        std::shared_lock<std::shared_mutex> lock(kUdpDemuxMutex);
+        for (auto& item : kUdpDemuxMap)
+            ports.push_back(item.second->LocalPort());
+    }
+
+    UdpStats UdpGetStats()
+    {
+        UdpStats stats;
+        stats.drop_no_port = kDropNoPort.load(std::memory_order_relaxed);
+        stats.drop_length = kDropLength.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    NetErr_t UdpPush(std::shared_ptr<PacketBuffer> pkt, uint32_t src_ip, uint16_t src_port,
+        uint32_t dst_ip, uint16_t dst_port, uint16_t gso_size)
+    {
+        size_t length = pkt->DataSize() + sizeof(UdpHdr);
+        if (length > 0xffff - sizeof(IPV4_Hdr))
+            return NET_ERR_SIZE;
+        if (gso_size >= pkt->DataSize())  // 只有一段,不需要分段
+            gso_size = 0;
+
+        if (src_ip == 0 || gso_size != 0)
+        {
+            Routing routing = GetRouting(dst_ip);
+            if (routing.iface_ == nullptr)
+                return NET_ERR_UNREACH;
+            if (src_ip == 0)    // 没有绑定地址,使用出口网卡的地址(伪首部需要)
+                src_ip = *(uint32_t*)routing.iface_->GetNetInfo()->ip;
+
+            // 切分后的每个数据报都不能超过路径MTU
+            size_t seg_cnt = (pkt->DataSize() + gso_size - 1) / std::max<size_t>(gso_size, 1);
+            if (gso_size != 0 && (seg_cnt > GSO_MAX_SEGMENTS ||
+                gso_size + sizeof(UdpHdr) + sizeof(IPV4_Hdr) > GetPathMtu(dst_ip, routing.iface_)))
+                return NET_ERR_SIZE;
+        }
+
+        UdpHdr hdr;
+        hdr.src_port = htons(src_port);
+        hdr.dst_port = htons(dst_port);
+        hdr.length = htons(length);
+        // 校验和字段先填入伪首部的部分和,剩下的推迟到驱动边界计算
+        hdr.checksum = ChecksumFold(ChecksumPseudoHdr(src_ip, dst_ip, TYPE_UDP, length));
+        pkt->AddHeader(sizeof(hdr), (const unsigned char*)&hdr);
+        pkt->SetCsumPartial(0, offsetof(UdpHdr, checksum));
+        if (gso_size != 0)  // 头部只构建这一次,在驱动边界切分时复制
+            pkt->SetGso(GSO_UDP_L4, gso_size);
+
+        return IPv4Push(pkt, src_ip, dst_ip, TYPE_UDP);
+    }
+
+    void UdpGroFlush()
+    {
+        UdpGroHeld& held = kGroHeld;
+        if (held.endpoint == nullptr)
+            return;
+
+        if (held.seg_cnt > 1)
+        {
+            held.dgram.gso_size = static_cast<uint16_t>(held.seg_size);
+            held.dgram.pkt->SetGso(GSO_UDP_L4, held.seg_size);
+        }
+        held.endpoint->Deliver(held.dgram, held.seg_cnt);
+        held.endpoint.reset();
+        held.dgram = UdpDatagram();
+    }
+
+    void UdpInit()
     {
+        Ipv4RegisterProtocol(TYPE_UDP, UdpPop);
+    }
 
+    /**
+     * @brief 校验和为0表示发送方没有计算校验和
+     *
+     * @param pkt 从udp头部开始的数据报
+     * @param hdr
+     * @param ip_hdr
+     * @param length udp头部中的长度
+     * @return true
+     * @return false
+     */
+    static bool UdpChecksumOk(PacketBuffer& pkt, const UdpHdr& hdr, const IPV4_Hdr& ip_hdr, uint16_t length)
+    {
+        if (hdr.checksum == 0 || pkt.CsumVerified())
+            return true;
+        uint32_t sum = ChecksumPseudoHdr(ip_hdr.src_ipaddr, ip_hdr.dst_ipaddr, TYPE_UDP, length);
+        return ChecksumFold(ChecksumPacket(pkt, 0, length, sum)) == 0xffff;
     }
-    
-    void UdpPop(std::shared_ptr<PacketBuffer> pkt)
+
+    void UdpPop(std::shared_ptr<PacketBuffer> pkt, const IPV4_Hdr& ip_hdr)
     {
+        UdpHdr hdr;
+        size_t pkt_size = pkt->DataSize();
+        if (pkt->ReadAt(0, (unsigned char*)&hdr, sizeof(hdr)) != 0)
+        {
+            kDropLength.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        uint16_t length = ntohs(hdr.length);
+        if (length < sizeof(UdpHdr) || length > pkt_size)
+        {
+            kDropLength.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // 先查找端点,没有端点接收的数据报不需要再计算校验和
+        std::shared_ptr<UdpEndpoint> endpoint = UdpLookup(ip_hdr.dst_ipaddr, ntohs(hdr.dst_port));
+        if (endpoint == nullptr)
+        {
+            kDropNoPort.fetch_add(1, std::memory_order_relaxed);
+            // 发给本机单播地址并且校验和正确的数据报回复端口不可达(RFC 1122 4.1.3.1),由icmp限速
+            if (kNetifacesMap.find(ip_hdr.dst_ipaddr) != kNetifacesMap.end() && 
+                UdpChecksumOk(*pkt, hdr, ip_hdr, length))
+            {
+                Ipv4RestoreHeader(pkt, ip_hdr);
+                IcmpSendError(ICMP_DEST_UNREACHABLE, ICMP_PORT_UNREACHABLE, pkt);
+            }
+            return;
+        }
+
+        if (!UdpChecksumOk(*pkt, hdr, ip_hdr, length))
+        {
+            endpoint->rx_drop_checksum_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        if (length < pkt_size)
+            pkt->RemoveTail(pkt_size - length);
+        pkt->RemoveHeader(sizeof(UdpHdr));
 
+        UdpDatagram dgram;
+        dgram.pkt = pkt;
+        dgram.remote_ip = ip_hdr.src_ipaddr;
+        dgram.remote_port = ntohs(hdr.src_port);
+        dgram.local_ip = ip_hdr.dst_ipaddr;
+        if (endpoint->GroEnabled())
+            UdpGroReceive(endpoint, dgram);
+        else
+            endpoint->Deliver(dgram, 1);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,238 @@
+#include "wire.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace netstack
+{
+    static uint64_t WireNowNs()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);    // 和 timerfd 使用同一个时钟
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    WireDriver::WireDriver(size_t ring_size)
+        : rng_(link_.seed), ring_(ring_size), rx_notified_(false), rx_packets_(0), rx_bytes_(0)
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (epoll_fd_ == -1 || event_fd_ == -1 || timer_fd_ == -1)
+            throw std::runtime_error("create wire fd failed");
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = event_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event);
+        event.data.fd = timer_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event);
+    }
+
+    WireDriver::~WireDriver()
+    {
+        close(timer_fd_);
+        close(event_fd_);
+        close(epoll_fd_);
+    }
+
+    void WireDriver::SetLink(const WireLinkOptions& opts)
+    {
+        std::unique_lock<std::mutex> lock(link_mutex_);
+        link_ = opts;
+        link_.loss = std::clamp(link_.loss, 0.0, 1.0);
+        link_.reorder = std::clamp(link_.reorder, 0.0, 1.0);
+        rng_.seed(link_.seed);
+    }
+
+    NetErr_t WireDriver::Open(NetInfo* info)
+    {
+        (void)info;     // 地址由使用者设置
+        return peer_ ? NET_ERR_OK : NET_ERR_STATE;
+    }
+
+    WireLinkStats WireDriver::GetLinkStats()
+    {
+        std::unique_lock<std::mutex> lock(link_mutex_);
+        WireLinkStats stats = stats_;
+        stats.rx_packets = peer_ ? peer_->rx_packets_.load() : 0;
+        return stats;
+    }
+
+    /**
+     * @brief 计算数据包到达对端的时间,放入对端的环形队列. 不复制数据,
+     *        对端拿到的就是这个 PacketBuffer
+     *
+     * @param pkt
+     * @param now
+     * @return true 放到了链路上(包括按丢包率丢弃的和瓶颈队列满了丢弃的)
+     * @return false 对端的环形队列满了
+     */
+    bool WireDriver::TransmitLocked(SharedPkt& pkt, uint64_t now)
+    {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        size_t size = pkt->DataSize();
+        if (link_.loss > 0 && dist(rng_) < link_.loss)
+        {
+            stats_.lost++;
+            pkt.reset();
+            return true;
+        }
+
+        uint64_t start = std::max(now, link_free_ns_);
+        if (link_.queue_bytes && link_.bandwidth_bps)   // 尾部丢弃
+        {
+            uint64_t queued = (start - now) * (link_.bandwidth_bps / 8) / 1000000000ULL;
+            if (queued + size > link_.queue_bytes)
+            {
+                stats_.queue_drops++;
+                pkt.reset();
+                return true;
+            }
+        }
+        uint64_t tx_ns = link_.bandwidth_bps ? size * 8 * 1000000000ULL / link_.bandwidth_bps : 0;
+        link_free_ns_ = start + tx_ns;
+        uint64_t arrive = link_free_ns_ + link_.latency_us * 1000ULL;
+        if (link_.reorder > 0 && dist(rng_) < link_.reorder)
+        {
+            arrive += link_.reorder_delay_us * 1000ULL;
+            stats_.reordered++;
+        }
+
+        // 和 CsumFromVnetHdr 一样: 对端收到时还没有计算校验和的包是本机构造的,内容可信
+        if (pkt->GetCsumState() == CSUM_PARTIAL)
+            pkt->SetCsumVerified();
+
+        if (!peer_->ring_.TryEmplace(WireFrame{ std::move(pkt), arrive, tx_seq_++ }))
+        {
+            stats_.ring_drops++;
+            pkt.reset();
+            return false;
+        }
+        stats_.tx_packets++;
+        stats_.tx_bytes += size;
+        return true;
+    }
+
+    void WireDriver::NotifyPeer()
+    {
+        // 接收端处理之前只通知一次
+        if (!peer_->rx_notified_.exchange(true))
+        {
+            uint64_t one = 1;
+            if (write(peer_->event_fd_, &one, sizeof(one)) != sizeof(one))
+                perror("wire eventfd write");
+        }
+    }
+
+    int WireDriver::TxBurst(SharedPkt* pkts, int cnt)
+    {
+        if (peer_ == nullptr)
+        {
+            for (int i = 0; i < cnt; i++)
+                pkts[i].reset();
+            return 0;
+        }
+
+        int sent = 0;
+        {
+            std::unique_lock<std::mutex> lock(link_mutex_);
+            uint64_t now = WireNowNs();
+            for (int i = 0; i < cnt; i++)
+                sent += TransmitLocked(pkts[i], now) ? 1 : 0;
+        }
+        NotifyPeer();
+        return sent;
+    }
+
+    /**
+     * @brief 把环形队列中的数据包移到按到达时间排序的在途队列中,取出已经到达的.
+     *        只在接收线程中调用
+     *
+     * @param pkts
+     * @param max
+     * @return int
+     */
+    int WireDriver::RxBurst(SharedPkt* pkts, int max)
+    {
+        // 先清除通知再读取队列,之后放入的数据包一定会再次通知
+        uint64_t val;
+        if (read(event_fd_, &val, sizeof(val)) < 0)
+            val = 0;
+        rx_notified_.store(false);
+
+        WireFrame frame;
+        while (ring_.TryPop(frame))
+            in_flight_.push(std::move(frame));
+
+        uint64_t now = WireNowNs();
+        int cnt = 0;
+        while (cnt < max && !in_flight_.empty() && in_flight_.top().arrive_ns <= now)
+        {
+            pkts[cnt] = std::move(const_cast<WireFrame&>(in_flight_.top()).pkt);
+            in_flight_.pop();
+            rx_bytes_ += pkts[cnt++]->DataSize();
+        }
+        rx_packets_ += cnt;
+
+        ArmTimer();
+        return cnt;
+    }
+
+    /**
+     * @brief 定时器设置为最早的在途数据包的到达时间,没有在途的数据包时关闭.
+     *        时间已经过去(一次没有取完)时会立即触发
+     *
+     */
+    void WireDriver::ArmTimer()
+    {
+        uint64_t val;
+        if (read(timer_fd_, &val, sizeof(val)) < 0)
+            val = 0;
+
+        struct itimerspec spec = {};
+        if (!in_flight_.empty())
+        {
+            uint64_t arrive = std::max<uint64_t>(in_flight_.top().arrive_ns, 1);
+            spec.it_value.tv_sec = arrive / 1000000000ULL;
+            spec.it_value.tv_nsec = arrive % 1000000000ULL;
+        }
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    NetDriverStats WireDriver::GetStats()
+    {
+        NetDriverStats stats;
+        stats.rx_packets = rx_packets_;
+        stats.rx_bytes = rx_bytes_;
+
+        std::unique_lock<std::mutex> lock(link_mutex_);
+        stats.tx_packets = stats_.tx_packets;
+        stats.tx_bytes = stats_.tx_bytes;
+        stats.tx_dropped = stats_.ring_drops;
+        return stats;
+    }
+
+    VirtualWire::VirtualWire(NetInfo* a, NetInfo* b, size_t ring_size)
+        : driver_a_(new WireDriver(ring_size)), driver_b_(new WireDriver(ring_size)),
+        a_(new NetInterface(a, std::unique_ptr<NetDriver>(driver_a_))),
+        b_(new NetInterface(b, std::unique_ptr<NetDriver>(driver_b_)))
+    {
+        driver_a_->peer_ = driver_b_;
+        driver_b_->peer_ = driver_a_;
+        if (a_->Open() != NET_ERR_OK || b_->Open() != NET_ERR_OK)
+            throw std::runtime_error("open virtual wire failed");
+    }
+
+    VirtualWire::~VirtualWire()
+    {
+        driver_a_->peer_ = nullptr;
+        driver_b_->peer_ = nullptr;
+    }
+}
\ No newline at end of file
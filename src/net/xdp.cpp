@@ -0,0 +1,554 @@
+#include "xdp.h"
+#include "ether.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+// pcap 的 bpf.h 已经定义了经典BPF的 struct bpf_insn,内核头文件中的eBPF指令换个名字
+#define bpf_insn ebpf_insn
+#include <linux/bpf.h>
+#undef bpf_insn
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef AF_XDP
+#define AF_XDP  44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+namespace netstack
+{
+    // UMEM和空闲帧队列. 接收到的数据包在释放函数中把帧放回空闲队列,所以用 shared_ptr 管理
+    struct XdpUmem
+    {
+        XdpUmem(size_t frame_cnt)
+            : free_frames(frame_cnt)
+        {}
+
+        ~XdpUmem()
+        {
+            if (area != nullptr)
+                munmap(area, size);
+        }
+
+        unsigned char* area = nullptr;
+        size_t size = 0;
+        uint32_t frame_size = 0;
+        ConcurrentQueue<uint64_t> free_frames;  // 空闲帧在UMEM中的偏移
+    };
+
+    static long XdpBpf(int cmd, union bpf_attr* attr)
+    {
+        return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+    }
+
+    static uint32_t XdpLoadAcquire(const uint32_t* ptr)
+    {
+        return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+    }
+
+    static void XdpStoreRelease(uint32_t* ptr, uint32_t val)
+    {
+        __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+    }
+
+    XdpDriver::XdpDriver(const XdpOptions& opts)
+        : opts_(opts), rx_packets_(0), rx_bytes_(0), tx_packets_(0), tx_bytes_(0),
+        tx_zero_copy_(0), tx_no_frame_(0), tx_errors_(0)
+    {
+
+    }
+
+    XdpDriver::~XdpDriver()
+    {
+        Close();
+    }
+
+    void XdpDriver::Close()
+    {
+        // 先卸载程序,内核不再往socket中放数据包
+        for (int* fd : { &link_fd_, &prog_fd_, &map_fd_ })
+        {
+            if (*fd != -1)
+                close(*fd);
+            *fd = -1;
+        }
+        for (XdpRing* ring : { &rx_, &fill_, &tx_, &comp_ })
+        {
+            if (ring->map != nullptr)
+                munmap(ring->map, ring->map_len);
+            *ring = XdpRing();
+        }
+        if (xsk_fd_ != -1)
+            close(xsk_fd_);
+        xsk_fd_ = -1;
+
+        tx_pending_.clear();
+        tx_outstanding_ = 0;
+        umem_.reset();
+    }
+
+    NetErr_t XdpDriver::MapRing(XdpRing& ring, uint64_t pgoff, size_t desc_size, const void* offsets)
+    {
+        const xdp_ring_offset* off = reinterpret_cast<const xdp_ring_offset*>(offsets);
+        ring.map_len = off->desc + ring.size * desc_size;
+        void* map = mmap(nullptr, ring.map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd_, pgoff);
+        if (map == MAP_FAILED)
+        {
+            perror("mmap xdp ring");
+            return NET_ERR_IO;
+        }
+        ring.map = map;
+        ring.producer = reinterpret_cast<uint32_t*>((char*)map + off->producer);
+        ring.consumer = reinterpret_cast<uint32_t*>((char*)map + off->consumer);
+        ring.flags = reinterpret_cast<uint32_t*>((char*)map + off->flags);
+        ring.descs = (char*)map + off->desc;
+        return NET_ERR_OK;
+    }
+
+    /**
+     * @brief 加载XDP程序并挂载到网卡: 按接收队列号在XSKMAP中查找socket并重定向,
+     *        没有绑定socket的队列交给内核协议栈
+     *
+     *        r2 = ctx->rx_queue_index
+     *        r1 = xsks_map
+     *        r3 = XDP_PASS               // 查找失败时的返回值
+     *        return bpf_redirect_map(r1, r2, r3)
+     *
+     * @param ifindex
+     * @param skb_mode
+     * @return NetErr_t
+     */
+    NetErr_t XdpDriver::AttachProgram(int ifindex, bool skb_mode)
+    {
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size = sizeof(uint32_t);
+        attr.value_size = sizeof(uint32_t);
+        attr.max_entries = XDP_MAX_QUEUE_ID;
+        map_fd_ = XdpBpf(BPF_MAP_CREATE, &attr);
+        if (map_fd_ < 0)
+        {
+            perror("bpf BPF_MAP_CREATE");
+            return NET_ERR_IO;
+        }
+
+        uint32_t key = queue_id_;
+        uint32_t value = xsk_fd_;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = map_fd_;
+        attr.key = reinterpret_cast<uint64_t>(&key);
+        attr.value = reinterpret_cast<uint64_t>(&value);
+        if (XdpBpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+        {
+            perror("bpf BPF_MAP_UPDATE_ELEM");
+            return NET_ERR_IO;
+        }
+
+        struct ebpf_insn insns[] = {
+            { BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, rx_queue_index), 0 },
+            { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd_ },
+            { 0, 0, 0, 0, 0 },
+            { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+            { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+            { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 },
+        };
+        static const char kLicense[] = "GPL";
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+        attr.insns = reinterpret_cast<uint64_t>(insns);
+        attr.license = reinterpret_cast<uint64_t>(kLicense);
+        attr.expected_attach_type = BPF_XDP;
+        strncpy(attr.prog_name, "netstack_xsk", sizeof(attr.prog_name) - 1);
+        prog_fd_ = XdpBpf(BPF_PROG_LOAD, &attr);
+        if (prog_fd_ < 0)
+        {
+            perror("bpf BPF_PROG_LOAD");
+            return NET_ERR_IO;
+        }
+
+        // 通过 bpf_link 挂载,fd关闭时(包括进程退出)自动卸载
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = prog_fd_;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = skb_mode ? XDP_FLAGS_SKB_MODE : 0;
+        link_fd_ = XdpBpf(BPF_LINK_CREATE, &attr);
+        if (link_fd_ < 0)
+        {
+            perror("bpf BPF_LINK_CREATE");
+            return NET_ERR_IO;
+        }
+        return NET_ERR_OK;
+    }
+
+    NetErr_t XdpDriver::Open(NetInfo* info)
+    {
+        const XdpOptions& opts = opts_;
+        auto is_pow2 = [](uint32_t val) { return val && !(val & (val - 1)); };
+        if (opts.ifname.empty() || opts.ifname.size() >= IFNAMSIZ || opts.queue_id >= XDP_MAX_QUEUE_ID ||
+            (opts.frame_size != 2048 && opts.frame_size != 4096) || !is_pow2(opts.ring_size) ||
+            opts.frame_cnt < opts.ring_size)
+            return NET_ERR_PARAM;
+        Close();
+
+        int ifindex = if_nametoindex(opts.ifname.c_str());
+        if (ifindex == 0)
+            return NET_ERR_PARAM;
+
+        // 网卡的mac地址和MTU
+        int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (sock != -1)
+        {
+            struct ifreq req;
+            memset(&req, 0, sizeof(req));
+            strncpy(req.ifr_name, opts.ifname.c_str(), IFNAMSIZ - 1);
+            if (ioctl(sock, SIOCGIFHWADDR, &req) == 0)
+                memcpy(info->mac, req.ifr_hwaddr.sa_data, 6);
+            if (ioctl(sock, SIOCGIFMTU, &req) == 0)
+                info->mtu = req.ifr_mtu;
+            close(sock);
+        }
+        if (info->mtu + sizeof(EtherHdr) + sizeof(Vlan) > opts.frame_size - XDP_PACKET_HEADROOM)
+            return NET_ERR_PARAM;
+
+        queue_id_ = opts.queue_id;
+        umem_ = std::make_shared<XdpUmem>(opts.frame_cnt);
+        umem_->frame_size = opts.frame_size;
+        umem_->size = static_cast<size_t>(opts.frame_cnt) * opts.frame_size;
+        void* area = mmap(nullptr, umem_->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (area == MAP_FAILED)
+        {
+            perror("mmap umem");
+            Close();
+            return NET_ERR_NO_MEM;
+        }
+        umem_->area = static_cast<unsigned char*>(area);
+        for (uint64_t i = 0; i < opts.frame_cnt; i++)
+            umem_->free_frames.TryEmplace(i * opts.frame_size);
+        tx_pending_.assign(opts.frame_cnt, nullptr);
+
+        xsk_fd_ = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+        if (xsk_fd_ == -1)
+        {
+            perror("socket AF_XDP");
+            Close();
+            return NET_ERR_IO;
+        }
+
+        struct xdp_umem_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = reinterpret_cast<uint64_t>(umem_->area);
+        reg.len = umem_->size;
+        reg.chunk_size = opts.frame_size;
+        reg.headroom = 0;
+        int ring_size = opts.ring_size;
+        if (setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) ||
+            setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) ||
+            setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) ||
+            setsockopt(xsk_fd_, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) ||
+            setsockopt(xsk_fd_, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)))
+        {
+            perror("setsockopt SOL_XDP");
+            Close();
+            return NET_ERR_IO;
+        }
+
+        struct xdp_mmap_offsets off;
+        socklen_t optlen = sizeof(off);
+        if (getsockopt(xsk_fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen))
+        {
+            perror("getsockopt XDP_MMAP_OFFSETS");
+            Close();
+            return NET_ERR_IO;
+        }
+        rx_.size = fill_.size = tx_.size = comp_.size = opts.ring_size;
+        if (MapRing(rx_, XDP_PGOFF_RX_RING, sizeof(xdp_desc), &off.rx) != NET_ERR_OK ||
+            MapRing(tx_, XDP_PGOFF_TX_RING, sizeof(xdp_desc), &off.tx) != NET_ERR_OK ||
+            MapRing(fill_, XDP_UMEM_PGOFF_FILL_RING, sizeof(uint64_t), &off.fr) != NET_ERR_OK ||
+            MapRing(comp_, XDP_UMEM_PGOFF_COMPLETION_RING, sizeof(uint64_t), &off.cr) != NET_ERR_OK)
+        {
+            Close();
+            return NET_ERR_IO;
+        }
+
+        // 绑定之前先放好接收用的帧
+        RefillFill();
+
+        struct sockaddr_xdp addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sxdp_family = AF_XDP;
+        addr.sxdp_ifindex = ifindex;
+        addr.sxdp_queue_id = opts.queue_id;
+        addr.sxdp_flags = XDP_USE_NEED_WAKEUP | (opts.copy_mode ? XDP_COPY : XDP_ZEROCOPY);
+        if (bind(xsk_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)))
+        {
+            perror("bind AF_XDP");
+            Close();
+            return NET_ERR_IO;
+        }
+
+        if (AttachProgram(ifindex, opts.skb_mode) != NET_ERR_OK)
+        {
+            Close();
+            return NET_ERR_IO;
+        }
+        return NET_ERR_OK;
+    }
+
+    /**
+     * @brief 把空闲帧批量放回填充环
+     *
+     */
+    void XdpDriver::RefillFill()
+    {
+        uint32_t prod = *fill_.producer;
+        uint32_t free = fill_.size - (prod - XdpLoadAcquire(fill_.consumer));
+        uint64_t* descs = static_cast<uint64_t*>(fill_.descs);
+        uint32_t n = 0;
+        uint64_t frame;
+        while (n < free && umem_->free_frames.TryPop(frame))
+        {
+            descs[(prod + n) & (fill_.size - 1)] = frame;
+            n++;
+        }
+        if (n == 0)
+            return;
+        XdpStoreRelease(fill_.producer, prod + n);
+
+        // 填充环曾经空了,内核在等待唤醒
+        if (xsk_fd_ != -1 && (__atomic_load_n(fill_.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP))
+            recvfrom(xsk_fd_, nullptr, 0, MSG_DONTWAIT, nullptr, nullptr);
+    }
+
+    int XdpDriver::RxBurst(SharedPkt* pkts, int max)
+    {
+        if (xsk_fd_ == -1)
+            return 0;
+
+        uint32_t cons = *rx_.consumer;
+        uint32_t avail = XdpLoadAcquire(rx_.producer) - cons;
+        int cnt = static_cast<int>(std::min<uint32_t>(avail, max));
+        const xdp_desc* descs = static_cast<const xdp_desc*>(rx_.descs);
+        uint32_t frame_size = umem_->frame_size;
+        uint64_t bytes = 0;
+        for (int i = 0; i < cnt; i++)
+        {
+            const xdp_desc& desc = descs[(cons + i) & (rx_.size - 1)];
+            uint64_t base = desc.addr - desc.addr % frame_size;
+            size_t headroom = desc.addr - base;
+
+            // 帧直接作为数据包的内存块,数据包释放时帧回到空闲队列
+            std::shared_ptr<XdpUmem> umem = umem_;
+            std::shared_ptr<unsigned char> storage(umem->area + base,
+                [umem, base](unsigned char*) { umem->free_frames.TryEmplace(base); });
+            SharedPkt pkt = std::make_shared<PacketBuffer>();
+            pkt->AppendExternal(storage, headroom + desc.len);
+            pkt->RemoveHeader(headroom);
+            pkts[i] = std::move(pkt);
+            bytes += desc.len;
+        }
+        if (cnt > 0)
+            XdpStoreRelease(rx_.consumer, cons + cnt);
+        rx_packets_ += cnt;
+        rx_bytes_ += bytes;
+
+        // 接收循环顺便回收发送完成的帧,再批量补充填充环
+        if (tx_mutex_.try_lock())
+        {
+            ReapCompletionLocked();
+            tx_mutex_.unlock();
+        }
+        RefillFill();
+        return cnt;
+    }
+
+    void XdpDriver::ReapCompletionLocked()
+    {
+        uint32_t cons = *comp_.consumer;
+        uint32_t avail = XdpLoadAcquire(comp_.producer) - cons;
+        const uint64_t* descs = static_cast<const uint64_t*>(comp_.descs);
+        uint32_t frame_size = umem_->frame_size;
+        for (uint32_t i = 0; i < avail; i++)
+        {
+            uint64_t addr = descs[(cons + i) & (comp_.size - 1)];
+            SharedPkt& pending = tx_pending_[addr / frame_size];
+            if (pending)
+                pending.reset();    // 零拷贝发送的数据包,释放时帧回到空闲队列
+            else
+                umem_->free_frames.TryEmplace(addr - addr % frame_size);
+        }
+        if (avail > 0)
+            XdpStoreRelease(comp_.consumer, cons + avail);
+        tx_outstanding_ -= avail;
+    }
+
+    void XdpDriver::KickTxLocked()
+    {
+        if (__atomic_load_n(tx_.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+            sendto(xsk_fd_, nullptr, 0, MSG_DONTWAIT, nullptr, 0);
+    }
+
+    /**
+     * @brief 把一个数据包放入TX环(还没有通知内核)
+     *
+     * @param pkt
+     * @return true
+     * @return false
+     */
+    bool XdpDriver::TxOneLocked(SharedPkt& pkt)
+    {
+        size_t size = pkt->DataSize();
+        uint32_t frame_size = umem_->frame_size;
+        uint32_t prod = *tx_.producer;
+        if (prod - XdpLoadAcquire(tx_.consumer) >= tx_.size)
+        {
+            tx_no_frame_++;
+            return false;
+        }
+
+        // 数据在本网卡UMEM的一个帧中时直接发送,否则复制到空闲帧
+        uint64_t addr = 0;
+        bool zero_copy = false;
+        PacketBlock* only = nullptr;
+        int blocks = 0;
+        for (PacketBlock* block : pkt->GetBlocks())
+        {
+            if (block->DataSize() == 0)
+                continue;
+            only = block;
+            blocks++;
+        }
+        if (blocks == 1)
+        {
+            unsigned char* data = static_cast<unsigned char*>(only->GetDataPtr());
+            if (data >= umem_->area && data < umem_->area + umem_->size && only->DataSize() == size)
+            {
+                addr = data - umem_->area;
+                zero_copy = addr % frame_size + size <= frame_size && !tx_pending_[addr / frame_size];
+            }
+        }
+
+        if (!zero_copy)
+        {
+            if (size > frame_size)
+            {
+                tx_errors_++;
+                return false;
+            }
+            if (!umem_->free_frames.TryPop(addr))
+            {
+                ReapCompletionLocked();
+                if (!umem_->free_frames.TryPop(addr))
+                {
+                    tx_no_frame_++;
+                    return false;
+                }
+            }
+            pkt->ReadAt(0, umem_->area + addr, size);
+        }
+        else
+        {
+            tx_pending_[addr / frame_size] = pkt;
+            tx_zero_copy_++;
+        }
+
+        xdp_desc& desc = static_cast<xdp_desc*>(tx_.descs)[prod & (tx_.size - 1)];
+        desc.addr = addr;
+        desc.len = size;
+        desc.options = 0;
+        XdpStoreRelease(tx_.producer, prod + 1);
+        tx_outstanding_++;
+        tx_packets_++;
+        tx_bytes_ += size;
+        return true;
+    }
+
+    int XdpDriver::TxBurst(SharedPkt* pkts, int cnt)
+    {
+        if (xsk_fd_ == -1)
+        {
+            for (int i = 0; i < cnt; i++)
+                pkts[i].reset();
+            return 0;
+        }
+
+        int sent = 0;
+        std::unique_lock<std::mutex> lock(tx_mutex_);
+        ReapCompletionLocked();
+        for (int i = 0; i < cnt; i++)
+        {
+            if (TxOneLocked(pkts[i]))
+                sent++;
+            pkts[i].reset();
+        }
+        KickTxLocked();     // 一批只唤醒一次
+        ReapCompletionLocked();
+        return sent;
+    }
+
+    NetDriverStats XdpDriver::GetStats()
+    {
+        NetDriverStats stats;
+        XdpStats xdp = GetXdpStats();
+        stats.rx_packets = xdp.rx_packets;
+        stats.rx_bytes = xdp.rx_bytes;
+        stats.rx_errors = xdp.rx_invalid_descs;
+        stats.rx_dropped = xdp.rx_dropped + xdp.rx_ring_full;
+        stats.tx_packets = xdp.tx_packets;
+        stats.tx_bytes = xdp.tx_bytes;
+        stats.tx_errors = xdp.tx_errors + xdp.tx_invalid_descs;
+        stats.tx_dropped = xdp.tx_no_frame;
+        return stats;
+    }
+
+    XdpStats XdpDriver::GetXdpStats()
+    {
+        auto occupancy = [](const XdpRing& ring) {
+            XdpRingStats stats;
+            stats.size = ring.size;
+            if (ring.map != nullptr)
+                stats.used = __atomic_load_n(ring.producer, __ATOMIC_RELAXED) - __atomic_load_n(ring.consumer, __ATOMIC_RELAXED);
+            return stats;
+        };
+
+        XdpStats stats;
+        stats.rx = occupancy(rx_);
+        stats.fill = occupancy(fill_);
+        stats.tx = occupancy(tx_);
+        stats.completion = occupancy(comp_);
+        stats.free_frames = umem_ ? std::max<std::ptrdiff_t>(umem_->free_frames.Size(), 0) : 0;
+        stats.rx_packets = rx_packets_;
+        stats.rx_bytes = rx_bytes_;
+        stats.tx_packets = tx_packets_;
+        stats.tx_bytes = tx_bytes_;
+        stats.tx_zero_copy = tx_zero_copy_;
+        stats.tx_no_frame = tx_no_frame_;
+        stats.tx_errors = tx_errors_;
+
+        struct xdp_statistics xs;
+        memset(&xs, 0, sizeof(xs));
+        socklen_t optlen = sizeof(xs);
+        if (xsk_fd_ != -1 && getsockopt(xsk_fd_, SOL_XDP, XDP_STATISTICS, &xs, &optlen) == 0)
+        {
+            stats.rx_dropped = xs.rx_dropped;
+            stats.rx_invalid_descs = xs.rx_invalid_descs;
+            stats.tx_invalid_descs = xs.tx_invalid_descs;
+            stats.rx_ring_full = xs.rx_ring_full;
+            stats.rx_fill_ring_empty = xs.rx_fill_ring_empty_descs;
+        }
+        return stats;
+    }
+}
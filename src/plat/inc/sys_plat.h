@@ -14,6 +14,7 @@
 #include <thread>
 #include <chrono>
 #include <type_traits>
+#include <vector>
 
 
 using net_time_t = struct timeval;
@@ -76,8 +77,8 @@ namespace netstack
         uint8_t mac[6];     // 网卡名称
         std::string name;   // 子网掩码
         NetIfType type;     // 网卡类型: 是普通网卡还是回环网卡
-        pcap_t* device = nullptr;   // 操作网卡的指针
         bool is_default_gateway_;   // 是否是默认网关
+        uint32_t mtu = 1500;        // 网卡的MTU
     };
     #pragma pack()
 
@@ -91,7 +92,16 @@ namespace netstack
         bool FindDevice(const char* ip, char* name_buf);
         bool ShowList();
 
+        /**
+         * @brief 获取打开网卡时创建的pcap句柄,交给 PcapDriver 使用
+         * 
+         * @param info 
+         * @return pcap_t* 不是pcap打开的网卡返回nullptr
+         */
+        static pcap_t* GetHandle(const NetInfo* info);
+
         static NetErr_t SendData(pcap_t* netif, std::shared_ptr<PacketBuffer>& pkt);
+        static NetErr_t SendBatch(pcap_t* netif, std::vector<std::shared_ptr<PacketBuffer>>& pkts);
         static NetErr_t RecvData(pcap_t* netif, std::shared_ptr<PacketBuffer>& pkt);
     private:
         NetErr_t DeviceOpen(const char* ip, const uint8_t* mac_addr);
@@ -66,7 +66,7 @@ namespace netstack
         // 将网卡的接收事件添加到epoll中
         for (auto& netif : kNetifLists)
         {
-            int pcap_fd = pcap_fileno(netif->GetNetInfo()->device);
+            int pcap_fd = pcap_fileno(PcapNICDriver::GetHandle(netif->GetNetInfo()));
             event.events = EPOLLIN;
             event.data.ptr = netif;
             if (epoll_ctl(recv_epollfd_, EPOLL_CTL_ADD, pcap_fd, &event) == -1)
@@ -94,7 +94,7 @@ namespace netstack
                 const u_char* pkt_data;
                 
                 
-                if (pcap_next_ex(netif->GetNetInfo()->device, &pkt_hdr, &pkt_data))   // 成功捕获数据包
+                if (pcap_next_ex(PcapNICDriver::GetHandle(netif->GetNetInfo()), &pkt_hdr, &pkt_data))   // 成功捕获数据包
                 {
                     // 其他超时、发生错误等情况则不考虑.只考虑成功情况.保证程序的稳定性
 
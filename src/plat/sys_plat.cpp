@@ -5,6 +5,7 @@
 #include "util.h"
 
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <climits>
@@ -27,17 +28,27 @@
 #include <exception>
 #include <unordered_map>
 #include <netpacket/packet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
 
 namespace netstack 
 {
     std::vector<NetInfo*> kDevices;
+    static std::unordered_map<const NetInfo*, pcap_t*> kPcapHandles;  // 网卡信息对应的pcap句柄
 
 
     ////////////////////////////////////////////////// PcapNICDriver
     PcapNICDriver::~PcapNICDriver()
     {
-        for (auto& device : kDevices)
-            pcap_close(device->device);
+        for (auto& handle : kPcapHandles)
+            pcap_close(handle.second);
+        kPcapHandles.clear();
+    }
+
+    pcap_t* PcapNICDriver::GetHandle(const NetInfo* info)
+    {
+        auto it = kPcapHandles.find(info);
+        return it == kPcapHandles.end() ? nullptr : it->second;
     }
 
 
@@ -111,19 +122,29 @@ namespace netstack
                     info->SetType(dev->name);
                 // 记录网卡名称
                     info->name = dev->name;
-                // 设置网卡操作的指针
-                    info->device = handle;
+                // 记录网卡操作的指针
+                    kPcapHandles[info] = handle;
                     kDevices.push_back(info);   
                     if (info->type == NETIF_TYPE_LOOP)
                         loop_device_ = kDevices.back();
                 }
             }
         }
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
         for (auto& device : kDevices)
         {
             uint64_t mac = mac_map.find(device->name)->second;
             memcpy(device->mac, &mac, sizeof(char) * 6);
+
+            // 记录网卡的MTU,获取失败则使用以太网默认的1500
+            struct ifreq ifr;
+            memset(&ifr, 0, sizeof(ifr));
+            strncpy(ifr.ifr_name, device->name.c_str(), IFNAMSIZ - 1);
+            if (sock != -1 && ioctl(sock, SIOCGIFMTU, &ifr) == 0)
+                device->mtu = ifr.ifr_mtu;
         }
+        if (sock != -1)
+            close(sock);
         
         return true;
     }
@@ -248,7 +269,7 @@ namespace netstack
     NetErr_t PcapNICDriver::DeviceOpen(const char* ip, const uint8_t* mac_addr)
     {
         pcap_t* device = nullptr;
-        NetInfo* info;
+        NetInfo* info = nullptr;
         // 利用上层传来的ip地址
         char name_buf[256];
         if (!FindDevice(ip, name_buf))
@@ -315,7 +336,7 @@ namespace netstack
         }
 
         // 设置为非阻塞模式,使得读取数据包不会阻塞当前线程
-        if (pcap_setnonblock(device, 0, err_buf) != 0)
+        if (pcap_setnonblock(device, 1, err_buf) != 0)
         {
             fprintf(stderr, "pcap_setnonblock error: %s\n", pcap_geterr(device));
             return NET_ERR_IO;
@@ -344,7 +365,10 @@ namespace netstack
             return NET_ERR_IO;
         }
 
-        info->device = device;
+        info = new NetInfo;
+        info->SetType(name_buf);
+        info->name = name_buf;
+        kPcapHandles[info] = device;
         kDevices.push_back(info);   // TODO:
         return NET_ERR_OK;
     }
@@ -382,6 +406,40 @@ namespace netstack
         return NET_ERR_OK;
     }
     
+    /**
+     * @brief 批量发送数据包,所有数据包共用一块临时内存,只分配一次
+     * 
+     * @param netif 
+     * @param pkts 
+     * @return NetErr_t 
+     */
+    NetErr_t PcapNICDriver::SendBatch(pcap_t* netif, std::vector<std::shared_ptr<PacketBuffer>>& pkts)
+    {
+        if (netif == nullptr)
+            return NET_ERR_PARAM;
+
+        size_t max_size = 0;
+        for (auto& pkt : pkts)
+            max_size = std::max(max_size, pkt->DataSize());
+
+        std::vector<unsigned char> data_mem(max_size);
+        NetErr_t ret = NET_ERR_OK;
+        for (auto& pkt : pkts)
+        {
+            int data_size = pkt->DataSize();
+            pkt->ReadAt(0, data_mem.data(), data_size);
+            if (pcap_inject(netif, data_mem.data(), data_size) == -1)
+            {
+                printf("err: %s\n", pcap_geterr(netif));
+                ret = NET_ERR_IO;
+            }
+            pkt.reset();
+        }
+        pkts.clear();
+
+        return ret;
+    }
+    
     NetErr_t PcapNICDriver::RecvData(pcap_t* netif, std::shared_ptr<PacketBuffer>& pkt)
     {
         if (netif == nullptr)
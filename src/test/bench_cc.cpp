@@ -0,0 +1,189 @@
+/*
+    拥塞控制对比: 两个网卡接口通过虚拟网线相连,在同一个进程中分别用 NewReno、CUBIC、BBR
+    做一次批量传输,输出有效吞吐、平滑RTT、重传的报文段个数和结束时的拥塞窗口.
+
+    数据方向的链路按场景设置带宽、延迟、丢包率和瓶颈队列,ACK方向只有延迟.
+    丢包使用固定的种子,同样的参数得到同样的丢包序列(线程调度仍然会带来少量差异).
+    最后一个场景是不限制队列的 10Gb/s 链路,看协议栈本身能跑到多快.
+
+    用法: bench_cc [每次传输的秒数]
+          bench_cc 秒数 带宽(bit/s) 单向延迟(us) 丢包率 [队列长度(字节)]    只运行这一个场景
+ */
+#include "event_loop.h"
+#include "icmp.h"
+#include "ipv4.h"
+#include "tcp.h"
+#include "tcp_cong.h"
+#include "threadpool.h"
+#include "time_entry.h"
+#include "timer.h"
+#include "udp.h"
+#include "wire.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace netstack;
+
+struct CcScenario
+{
+    const char* name;
+    uint64_t bandwidth_bps;
+    uint32_t latency_us;        // 单向延迟
+    double loss;                // 数据方向的丢包率
+    uint32_t queue_bytes;       // 瓶颈队列,0表示不限制
+};
+
+struct CcResult
+{
+    const char* algo = "";
+    double goodput_mbps = 0;
+    uint32_t srtt_us = 0;
+    uint32_t cwnd = 0;
+    uint64_t retrans = 0;
+    uint64_t lost = 0;          // 链路按丢包率丢弃的
+    uint64_t queue_drops = 0;   // 瓶颈队列满了丢弃的
+};
+
+static const TcpCcAlgo kAlgos[] = { TCP_CC_NEWRENO, TCP_CC_CUBIC, TCP_CC_BBR };
+
+static void SetLinks(VirtualWire& wire, const CcScenario& sc)
+{
+    WireLinkOptions data;
+    data.latency_us = sc.latency_us;
+    data.bandwidth_bps = sc.bandwidth_bps;
+    data.loss = sc.loss;
+    data.queue_bytes = sc.queue_bytes;
+    wire.GetDriverA()->SetLink(data);
+
+    WireLinkOptions ack;
+    ack.latency_us = sc.latency_us;
+    wire.GetDriverB()->SetLink(ack);
+}
+
+/**
+ * @brief A 向 B 批量发送 secs 秒,B 一直读取
+ */
+static bool RunOnce(VirtualWire& wire, uint16_t port, TcpCcAlgo algo, int secs, CcResult& result)
+{
+    uint32_t ip_a = *reinterpret_cast<uint32_t*>(wire.GetA()->GetNetInfo()->ip);
+    uint32_t ip_b = *reinterpret_cast<uint32_t*>(wire.GetB()->GetNetInfo()->ip);
+
+    TcpSetDefaultCongestion(algo);
+    auto listener = TcpListen(ip_b, port);
+    auto client = TcpConnect(ip_a, ip_b, port);
+    if (listener == nullptr || client == nullptr)
+        return false;
+    std::shared_ptr<TcpSocket> server;
+    for (int i = 0; i < 2000 && (server = listener->Accept()) == nullptr; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (server == nullptr)
+        return false;
+
+    WireLinkStats link_start = wire.GetDriverA()->GetLinkStats();
+    uint64_t retrans_start = TcpGetStats().retrans_segs;
+    static unsigned char buf[64 * 1024];
+    uint64_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(secs))
+    {
+        while (client->Send(buf, sizeof(buf)) > 0)
+            ;
+        int n;
+        while ((n = server->Recv(buf, sizeof(buf))) > 0)
+            received += n;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    WireLinkStats link_end = wire.GetDriverA()->GetLinkStats();
+
+    result.algo = client->CongestionName();
+    result.goodput_mbps = received * 8 / elapsed / 1e6;
+    result.srtt_us = client->SrttUs();
+    result.cwnd = client->Cwnd();
+    result.retrans = TcpGetStats().retrans_segs - retrans_start;
+    result.lost = link_end.lost - link_start.lost;
+    result.queue_drops = link_end.queue_drops - link_start.queue_drops;
+
+    client->Abort();
+    server->Abort();
+    listener->Close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));   // 等链路上剩下的包到达
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int secs = argc > 1 ? atoi(argv[1]) : 3;
+    if (secs <= 0)
+        secs = 3;
+
+    std::vector<CcScenario> scenarios = {
+        // 瓶颈队列是两个BDP
+        { "20Mb/s 10ms", 20000000, 5000, 0, 50000 },
+        { "20Mb/s 10ms 1% loss", 20000000, 5000, 0.01, 50000 },
+        { "10Gb/s 100us", 10000000000ULL, 50, 0, 0 },
+    };
+    if (argc > 4)
+    {
+        scenarios = { { "custom", strtoull(argv[2], nullptr, 10), static_cast<uint32_t>(atoi(argv[3])),
+            atof(argv[4]), argc > 5 ? static_cast<uint32_t>(atoi(argv[5])) : 0 } };
+    }
+
+    NetInfo a, b;
+    inet_pton(AF_INET, "10.0.1.1", a.ip);
+    inet_pton(AF_INET, "255.255.255.0", a.netmask);
+    inet_pton(AF_INET, "10.0.2.1", b.ip);
+    inet_pton(AF_INET, "255.255.255.0", b.netmask);
+    const uint8_t mac_a[6] = { 0x02, 0, 0, 0, 0x01, 0x01 };
+    const uint8_t mac_b[6] = { 0x02, 0, 0, 0, 0x02, 0x01 };
+    memcpy(a.mac, mac_a, sizeof(mac_a));
+    memcpy(b.mac, mac_b, sizeof(mac_b));
+    a.mtu = b.mtu = 1500;
+    a.is_default_gateway_ = b.is_default_gateway_ = false;
+
+    // 线程池要在其他线程之前创建,网卡接口要在事件循环之前创建
+    ThreadPool pool;
+    pool.Start(4);
+    VirtualWire wire(&a, &b);
+    // 10Gb/s链路上RTT只有0.1毫秒,滴答用1毫秒
+    Timer* timer = new Timer(TimeEntry({ 0, 1000 }), 512);
+    timer->Start();
+    Ipv4Init(timer);
+    IcmpInit();
+    UdpInit();
+    TcpInit(timer);
+    RecvEventLoop loop(pool);
+    loop.Start();
+
+    // A和B在不同的子网,数据从A发出经过A->B方向的链路,ACK经过B->A方向,不需要arp
+    printf("%-22s %-8s %10s %10s %10s %8s %8s %8s\n", "scenario", "algo", "Mb/s", "srtt(us)",
+        "cwnd", "retrans", "lost", "qdrops");
+    uint16_t port = 5001;
+    for (auto& sc : scenarios)
+    {
+        SetLinks(wire, sc);
+        for (TcpCcAlgo algo : kAlgos)
+        {
+            CcResult r;
+            if (!RunOnce(wire, port++, algo, secs, r))
+            {
+                fprintf(stderr, "%s: connection failed\n", sc.name);
+                return 1;
+            }
+            printf("%-22s %-8s %10.1f %10u %10u %8lu %8lu %8lu\n", sc.name, r.algo, r.goodput_mbps,
+                r.srtt_us, r.cwnd, r.retrans, r.lost, r.queue_drops);
+            fflush(stdout);
+        }
+    }
+
+    // 网卡接口和定时器还有线程在使用,直接退出
+    _exit(0);
+}
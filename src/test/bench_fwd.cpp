@@ -0,0 +1,107 @@
+/*
+    转发基准测试: 两个回放网卡,入口 10.0.1.1/24、出口 10.0.2.1/24,打开转发之后
+    把发往 10.0.2.2 的 udp 数据报从入口全速回放,统计每秒转发的包数.
+    出口网卡的回放驱动只计数不发送,所以测到的是 EtherPop 到出口驱动之间的全部开销
+    (校验、查路由、TTL减一和增量校验和、查邻居表、重写以太网头部).
+
+    用法: bench_fwd [回放次数] [抓包文件]
+    不指定抓包文件时生成一个: 第一帧是 10.0.2.2 的arp应答(填充邻居表),
+    之后是 1024 个最小长度的 udp 帧. 自己的抓包需要发往入口网卡的mac地址
+ */
+#include "bench_pcap.h"
+#include "ipv4.h"
+#include "net_interface.h"
+#include "replay.h"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace netstack;
+
+#define BENCH_FWD_FRAMES    (1024)
+
+static const uint8_t kInMac[6] = { 0x02, 0, 0, 0, 0x01, 0x01 };
+static const uint8_t kOutMac[6] = { 0x02, 0, 0, 0, 0x02, 0x01 };
+static const uint8_t kSrcHostMac[6] = { 0x02, 0, 0, 0, 0x01, 0x02 };
+static const uint8_t kDstHostMac[6] = { 0x02, 0, 0, 0, 0x02, 0x02 };
+
+static bool WriteCapture(const char* path)
+{
+    BenchPcapWriter writer;
+    if (!writer.Open(path))
+        return false;
+
+    uint8_t frame[BENCH_FRAME_MAX];
+    uint32_t src_host = inet_addr("10.0.1.2");
+    uint32_t dst_host = inet_addr("10.0.2.2");
+    writer.Write(frame, BenchArpReply(frame, kOutMac, kDstHostMac, inet_addr("10.0.2.1"), dst_host));
+
+    uint8_t udp[8 + 18] = {};
+    for (int i = 0; i < BENCH_FWD_FRAMES; i++)
+    {
+        uint16_t src_port = htons(static_cast<uint16_t>(10000 + i));
+        uint16_t dst_port = htons(9);
+        uint16_t length = htons(sizeof(udp));
+        memcpy(udp, &src_port, 2);
+        memcpy(udp + 2, &dst_port, 2);
+        memcpy(udp + 4, &length, 2);
+        writer.Write(frame, BenchIpv4Frame(frame, kInMac, kSrcHostMac, src_host, dst_host, 17,
+            udp, sizeof(udp), 6));
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t loops = argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : 1000;
+    const char* path = argc > 2 ? argv[2] : "/tmp/bench_fwd.pcap";
+    if (argc <= 2 && !WriteCapture(path))
+    {
+        fprintf(stderr, "failed to write %s\n", path);
+        return 1;
+    }
+
+    NetInfo in, out;
+    inet_pton(AF_INET, "10.0.1.1", in.ip);
+    inet_pton(AF_INET, "255.255.255.0", in.netmask);
+    inet_pton(AF_INET, "10.0.2.1", out.ip);
+    inet_pton(AF_INET, "255.255.255.0", out.netmask);
+    memcpy(in.mac, kInMac, sizeof(kInMac));
+    memcpy(out.mac, kOutMac, sizeof(kOutMac));
+    in.mtu = out.mtu = 1500;
+    in.is_default_gateway_ = out.is_default_gateway_ = false;
+
+    ReplayDriver* in_driver = new ReplayDriver();
+    ReplayDriver* out_driver = new ReplayDriver();
+    NetInterface in_iface(&in, std::unique_ptr<NetDriver>(in_driver));
+    NetInterface out_iface(&out, std::unique_ptr<NetDriver>(out_driver));
+    if (in_iface.Open() != NET_ERR_OK || out_iface.Open() != NET_ERR_OK ||
+        in_driver->Load(path) != NET_ERR_OK)
+    {
+        fprintf(stderr, "failed to load %s\n", path);
+        return 1;
+    }
+    Ipv4SetForward(true);
+
+    ReplayOptions opts;
+    opts.loops = loops ? loops : 1;
+    ReplayReport report;
+    in_driver->Run(opts, report);       // 预热: 学习邻居表、建立路由缓存
+    uint64_t forwarded = Ipv4ForwardCount();
+    uint64_t tx_start = out_driver->GetStats().tx_packets;
+    if (in_driver->Run(opts, report) != NET_ERR_OK)
+        return 1;
+    forwarded = Ipv4ForwardCount() - forwarded;
+    uint64_t tx = out_driver->GetStats().tx_packets - tx_start;
+
+    double secs = report.elapsed_ns / 1e9;
+    printf("%s: %zu frames x %u loops\n", path, in_driver->FrameCount(), opts.loops);
+    printf("forwarded %lu (egress tx %lu) in %.3f s: %.3f Mpps, %.1f ns/pkt\n", forwarded, tx, secs,
+        forwarded / secs / 1e6, forwarded ? report.elapsed_ns / static_cast<double>(forwarded) : 0.0);
+    printf("drops: not_local %lu no_route %lu no_neigh %lu ttl %lu\n", Ipv4DropCount(IPV4_DROP_NOT_LOCAL),
+        Ipv4DropCount(IPV4_DROP_NO_ROUTE), Ipv4DropCount(IPV4_DROP_NO_NEIGH), Ipv4DropCount(IPV4_DROP_TTL));
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+    UDP GSO 基准测试: 同样的数据分别逐个数据报调用 UdpPush,和每次交下 segs 个数据报大小的
+    一个大数据包(gso_size = 数据报大小),比较每秒发送的数据报个数.
+    网卡接口使用回放驱动,没有分段卸载能力,所以 GSO 的数据包在 NetTx 中由软件切分;
+    回放驱动只计数不发送,测到的是从 UdpPush 到驱动之间的开销.
+
+    用法: bench_gso [数据报个数] [每个数据报的大小] [GSO一次的段数]
+ */
+#include "gso.h"
+#include "net_interface.h"
+#include "replay.h"
+#include "udp.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace netstack;
+
+static double NowSec()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int size = argc > 2 ? atoi(argv[2]) : 1400;
+    int segs = argc > 3 ? atoi(argv[3]) : 32;
+    if (count <= 0 || size <= 0 || size > 1472 || segs <= 0 || segs > GSO_MAX_SEGMENTS ||
+        static_cast<size_t>(size) * segs + 28 > 0xffff)
+    {
+        fprintf(stderr, "usage: bench_gso [datagrams] [size <= 1472] [segs <= %d, size*segs < 64K]\n",
+            GSO_MAX_SEGMENTS);
+        return 1;
+    }
+    count = count / segs * segs;
+
+    NetInfo info;
+    inet_pton(AF_INET, "10.0.0.1", info.ip);
+    inet_pton(AF_INET, "255.255.255.0", info.netmask);
+    const uint8_t mac[6] = { 0x02, 0, 0, 0, 0, 0x01 };
+    memcpy(info.mac, mac, sizeof(mac));
+    info.mtu = 1500;
+    info.is_default_gateway_ = false;
+
+    ReplayDriver* driver = new ReplayDriver();
+    NetInterface iface(&info, std::unique_ptr<NetDriver>(driver));
+    if (iface.Open() != NET_ERR_OK)
+        return 1;
+
+    uint32_t src_ip = *reinterpret_cast<uint32_t*>(info.ip);
+    uint32_t dst_ip = inet_addr("10.0.0.2");
+    std::vector<unsigned char> data(static_cast<size_t>(size) * segs, 'x');
+
+    // 逐个数据报发送
+    uint64_t tx_start = driver->GetStats().tx_packets;
+    double t0 = NowSec();
+    for (int i = 0; i < count; i++)
+    {
+        auto pkt = std::make_shared<PacketBuffer>(size);
+        pkt->Write(data.data(), size, true);
+        UdpPush(pkt, src_ip, 5000, dst_ip, 9);
+    }
+    double single = NowSec() - t0;
+    uint64_t single_tx = driver->GetStats().tx_packets - tx_start;
+
+    // 一次交下 segs 个数据报
+    tx_start = driver->GetStats().tx_packets;
+    t0 = NowSec();
+    for (int i = 0; i < count; i += segs)
+    {
+        auto pkt = std::make_shared<PacketBuffer>(data.size());
+        pkt->Write(data.data(), data.size(), true);
+        UdpPush(pkt, src_ip, 5000, dst_ip, 9, static_cast<uint16_t>(size));
+    }
+    double gso = NowSec() - t0;
+    uint64_t gso_tx = driver->GetStats().tx_packets - tx_start;
+
+    printf("%d datagrams of %d bytes\n", count, size);
+    printf("per-datagram  %10lu sent  %12.0f dgram/s  %8.1f ns/dgram\n", single_tx, count / single,
+        single * 1e9 / count);
+    printf("gso x%-3d      %10lu sent  %12.0f dgram/s  %8.1f ns/dgram\n", segs, gso_tx, count / gso,
+        gso * 1e9 / count);
+    return 0;
+}
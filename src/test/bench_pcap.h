@@ -0,0 +1,129 @@
+#pragma once
+/*
+    基准测试用的抓包文件: 在内存中构造以太网帧(arp应答、ipv4数据报),
+    写成 pcap 文件之后交给回放网卡,和真实的抓包走同样的加载和回放流程.
+ */
+#include "checksum.h"
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <pcap.h>
+
+#define BENCH_FRAME_MAX     (1514)
+
+class BenchPcapWriter
+{
+public:
+    ~BenchPcapWriter()
+    { Close(); }
+
+    bool Open(const char* path)
+    {
+        pcap_ = pcap_open_dead(DLT_EN10MB, 65535);
+        if (pcap_ == nullptr)
+            return false;
+        dumper_ = pcap_dump_open(pcap_, path);
+        return dumper_ != nullptr;
+    }
+
+    /**
+     * @brief 写入一帧,时间戳每帧递增1微秒
+     */
+    void Write(const uint8_t* frame, size_t size)
+    {
+        struct pcap_pkthdr hdr = {};
+        hdr.ts.tv_sec = ts_us_ / 1000000;
+        hdr.ts.tv_usec = ts_us_ % 1000000;
+        hdr.caplen = hdr.len = static_cast<uint32_t>(size);
+        pcap_dump(reinterpret_cast<u_char*>(dumper_), &hdr, frame);
+        ts_us_++;
+    }
+
+    void Close()
+    {
+        if (dumper_)
+            pcap_dump_close(dumper_);
+        if (pcap_)
+            pcap_close(pcap_);
+        dumper_ = nullptr;
+        pcap_ = nullptr;
+    }
+private:
+    pcap_t* pcap_ = nullptr;
+    pcap_dumper_t* dumper_ = nullptr;
+    uint64_t ts_us_ = 0;
+};
+
+static inline uint8_t* BenchEtherHdr(uint8_t* p, const uint8_t dst_mac[6], const uint8_t src_mac[6],
+    uint16_t type)
+{
+    memcpy(p, dst_mac, 6);
+    memcpy(p + 6, src_mac, 6);
+    p[12] = type >> 8;
+    p[13] = type & 0xff;
+    return p + 14;
+}
+
+/**
+ * @brief 构造arp应答: sender 的 ip 是 src_ip、mac 是 src_mac
+ *
+ * @return size_t 帧长度
+ */
+static inline size_t BenchArpReply(uint8_t* frame, const uint8_t dst_mac[6], const uint8_t src_mac[6],
+    uint32_t dst_ip, uint32_t src_ip)
+{
+    memset(frame, 0, 60);
+    uint8_t* p = BenchEtherHdr(frame, dst_mac, src_mac, 0x0806);
+    const uint8_t fixed[8] = { 0x00, 0x01, 0x08, 0x00, 6, 4, 0x00, 0x02 };
+    memcpy(p, fixed, sizeof(fixed));
+    memcpy(p + 8, src_mac, 6);
+    memcpy(p + 14, &src_ip, 4);
+    memcpy(p + 18, dst_mac, 6);
+    memcpy(p + 24, &dst_ip, 4);
+    return 60;
+}
+
+/**
+ * @brief 构造ipv4数据报,l4 是传输层的头部和数据. 传输层的校验和字段在 csum_off 处,
+ *        会按伪首部重新计算(csum_off 为负数时不计算)
+ *
+ * @param ip 地址都是网络字节序
+ * @return size_t 帧长度
+ */
+static inline size_t BenchIpv4Frame(uint8_t* frame, const uint8_t dst_mac[6], const uint8_t src_mac[6],
+    uint32_t src_ip, uint32_t dst_ip, uint8_t proto, const uint8_t* l4, size_t l4_len, int csum_off,
+    uint8_t ttl = 64)
+{
+    uint8_t* p = BenchEtherHdr(frame, dst_mac, src_mac, 0x0800);
+    uint16_t total = static_cast<uint16_t>(20 + l4_len);
+    memset(p, 0, 20);
+    p[0] = 0x45;
+    p[2] = total >> 8;
+    p[3] = total & 0xff;
+    p[6] = 0x40;        // DF
+    p[8] = ttl;
+    p[9] = proto;
+    memcpy(p + 12, &src_ip, 4);
+    memcpy(p + 16, &dst_ip, 4);
+    uint16_t csum = netstack::Checksum16(p, 20);
+    memcpy(p + 10, &csum, 2);
+
+    uint8_t* l4_ptr = p + 20;
+    memcpy(l4_ptr, l4, l4_len);
+    if (csum_off >= 0)
+    {
+        memset(l4_ptr + csum_off, 0, 2);
+        uint32_t sum = netstack::ChecksumPseudoHdr(src_ip, dst_ip, proto, static_cast<uint16_t>(l4_len));
+        csum = static_cast<uint16_t>(~netstack::ChecksumFold(netstack::ChecksumPartial(l4_ptr, l4_len, sum)));
+        memcpy(l4_ptr + csum_off, &csum, 2);
+    }
+
+    size_t size = 14 + total;
+    if (size < 60)
+    {
+        memset(frame + size, 0, 60 - size);
+        size = 60;
+    }
+    return size;
+}
@@ -0,0 +1,108 @@
+/*
+    接收路径基准测试: 用回放网卡把抓包文件中的以太网帧全速交给协议栈,
+    输出总的每秒处理的包数,以及按最上层协议分类的包数和每个包的耗时.
+
+    每一类的耗时是整个 EtherPop 的耗时(以太网、ipv4、传输层加在一起),
+    按这一帧最上层的协议归类,不是单独某一层的耗时.
+    最后输出 ipv4 按原因统计的丢弃个数,可以看出有多少数据包在校验时就被丢掉了.
+
+    用法: bench_rx [抓包文件] [回放次数] [本机ip] [本机mac]
+    默认回放 packet_capture/arp.pcapng,本机是抓包中的 192.168.56.101
+ */
+#include "icmp.h"
+#include "ipv4.h"
+#include "net_interface.h"
+#include "replay.h"
+#include "tcp.h"
+#include "time_entry.h"
+#include "timer.h"
+#include "udp.h"
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+using namespace netstack;
+
+static const char* kLayerNames[REPLAY_LAYER_CNT] = { "arp", "icmp", "udp", "tcp", "ipv4", "other" };
+static const char* kIpv4DropNames[IPV4_DROP_REASON_CNT] = { "truncated", "version", "hdr_len",
+    "total_len", "checksum", "not_local", "reassembly", "no_proto", "ttl", "no_route", "no_neigh",
+    "frag_needed" };
+
+static bool ParseMac(const char* str, uint8_t mac[6])
+{
+    unsigned int v[6];
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) != 6)
+        return false;
+    for (int i = 0; i < 6; i++)
+        mac[i] = static_cast<uint8_t>(v[i]);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "packet_capture/arp.pcapng";
+    uint32_t loops = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 10000;
+    const char* ip = argc > 3 ? argv[3] : "192.168.56.101";
+    const char* mac = argc > 4 ? argv[4] : "08:00:27:cf:16:fb";
+
+    NetInfo info;
+    if (inet_pton(AF_INET, ip, info.ip) != 1 || !ParseMac(mac, info.mac))
+    {
+        fprintf(stderr, "invalid ip or mac: %s %s\n", ip, mac);
+        return 1;
+    }
+    inet_pton(AF_INET, "255.255.255.0", info.netmask);
+    info.is_default_gateway_ = false;
+
+    ReplayDriver* driver = new ReplayDriver();
+    NetInterface iface(&info, std::unique_ptr<NetDriver>(driver));
+    if (iface.Open() != NET_ERR_OK || driver->Load(path) != NET_ERR_OK)
+    {
+        fprintf(stderr, "failed to load %s\n", path);
+        return 1;
+    }
+
+    // 注册上层协议,否则ipv4的数据包在查找协议时就被丢弃了
+    Timer* timer = new Timer(TimeEntry({ 0, 50000 }), 512);
+    timer->Start();
+    Ipv4Init(timer);
+    IcmpInit();
+    UdpInit();
+    TcpInit(timer);
+
+    ReplayOptions opts;
+    opts.loops = loops ? loops : 1;
+    ReplayReport report;
+    driver->Run(opts, report);      // 预热: 建立arp表项、分配内存块
+    uint64_t drops[IPV4_DROP_REASON_CNT];
+    for (int i = 0; i < IPV4_DROP_REASON_CNT; i++)
+        drops[i] = Ipv4DropCount(static_cast<Ipv4DropReason>(i));
+    NetErr_t err = driver->Run(opts, report);
+    if (err != NET_ERR_OK)
+    {
+        fprintf(stderr, "replay failed: %d\n", err);
+        return 1;
+    }
+
+    printf("%s: %zu frames x %u loops\n", path, driver->FrameCount(), opts.loops);
+    printf("total  %10lu pkts  %12.0f pps  %8.1f ns/pkt  tx %lu\n", report.packets, report.pps,
+        report.packets ? static_cast<double>(report.elapsed_ns) / report.packets : 0.0, report.tx_packets);
+    for (int i = 0; i < REPLAY_LAYER_CNT; i++)
+    {
+        const ReplayLayerStats& layer = report.layers[i];
+        if (layer.packets == 0)
+            continue;
+        printf("%-6s %10lu pkts  %12.0f pps  %8.1f ns/pkt\n", kLayerNames[i], layer.packets, layer.pps,
+            layer.ns_per_pkt);
+    }
+    for (int i = 0; i < IPV4_DROP_REASON_CNT; i++)
+    {
+        uint64_t cnt = Ipv4DropCount(static_cast<Ipv4DropReason>(i)) - drops[i];
+        if (cnt)
+            printf("ipv4 drop %-12s %10lu\n", kIpv4DropNames[i], cnt);
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+    定时器槽基准测试: 模拟很多连接各自的重传定时器,测量 Timer::Arm(设置)、
+    再次 Arm(重新设置,比如每收到一个ACK推迟重传)和 Cancel 的每次耗时,
+    和原来每次设置都分配任务的 AddByDelay 对比.
+    到期时间都在几秒之后,测量期间不会有定时器到期.
+
+    用法: bench_timer [定时器个数] [轮数]
+ */
+#include "time_entry.h"
+#include "timer.h"
+#include "timer_task_list.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+using namespace netstack;
+
+static double NowSec()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void OnExpire()
+{
+}
+
+static void Report(const char* name, double secs, uint64_t ops)
+{
+    printf("%-10s %12.0f ops/s  %8.1f ns/op\n", name, ops / secs, secs * 1e9 / ops);
+}
+
+int main(int argc, char** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (count <= 0 || rounds <= 0)
+        return 1;
+
+    // 和协议栈一样1毫秒的滴答,512个槽的时间轮
+    Timer* timer = new Timer(TimeEntry({ 0, 1000 }), 512);
+    timer->Start();
+
+    std::vector<std::unique_ptr<TimerSlot>> slots;
+    slots.reserve(count);
+    for (int i = 0; i < count; i++)
+        slots.push_back(std::make_unique<TimerSlot>(&OnExpire));
+
+    uint64_t ops = static_cast<uint64_t>(count) * rounds;
+    double arm = 0, rearm = 0, cancel = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        // 延迟分布在 2 ~ 6 秒之间,落在时间轮的不同层
+        double t0 = NowSec();
+        for (int i = 0; i < count; i++)
+            timer->Arm(slots[i].get(), TimeEntry({ 2 + i % 4, (i % 1000) * 1000 }));
+        double t1 = NowSec();
+        for (int i = 0; i < count; i++)
+            timer->Arm(slots[i].get(), TimeEntry({ 3 + i % 4, (i % 997) * 1000 }));
+        double t2 = NowSec();
+        for (int i = 0; i < count; i++)
+            timer->Cancel(slots[i].get());
+        double t3 = NowSec();
+        arm += t1 - t0;
+        rearm += t2 - t1;
+        cancel += t3 - t2;
+    }
+
+    // 原来的方式: 每次都分配任务和条目,不能取消
+    double t0 = NowSec();
+    for (int i = 0; i < count; i++)
+        timer->AddByDelay(TimeEntry({ 60, 0 }), &OnExpire);
+    double add_by_delay = NowSec() - t0;
+
+    printf("%d timers x %d rounds\n", count, rounds);
+    Report("arm", arm, ops);
+    Report("rearm", rearm, ops);
+    Report("cancel", cancel, ops);
+    Report("addbydelay", add_by_delay, count);
+    printf("arm+cancel %.2f M/s\n", 2 * ops / (arm + cancel) / 1e6);
+
+    // AddByDelay 添加的任务还在时间轮中,直接退出
+    fflush(stdout);
+    _exit(0);
+}
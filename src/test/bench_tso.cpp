@@ -0,0 +1,164 @@
+/*
+    TSO 和零拷贝发送的吞吐测试: 两个网卡接口通过虚拟网线相连(不限制带宽,单向延迟50微秒),
+    分别用 关闭TSO、打开TSO、打开TSO并零拷贝发送 做一次批量传输,输出有效吞吐和
+    每传输1MB整个进程消耗的CPU时间(收发两端都在这个进程中)、重传的报文段个数,
+    以及接收端的接收队列满了丢弃的帧数(没有丢包的链路上重传都来自这里).
+    虚拟网线没有分段卸载能力,TSO的报文段在 NetTx 中由软件切分.
+
+    用法: bench_tso [每次传输的秒数]
+ */
+#include "event_loop.h"
+#include "icmp.h"
+#include "ipv4.h"
+#include "tcp.h"
+#include "threadpool.h"
+#include "time_entry.h"
+#include "timer.h"
+#include "udp.h"
+#include "wire.h"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+using namespace netstack;
+
+enum TsoMode
+{
+    TSO_MODE_OFF = 0,
+    TSO_MODE_ON,
+    TSO_MODE_ZEROCOPY,
+};
+
+static const char* kModeNames[] = { "tso off", "tso on", "tso on, zero-copy" };
+
+#define BENCH_TSO_CHUNK     (256 * 1024)
+
+/**
+ * @brief 把 [offset, BENCH_TSO_CHUNK) 交给发送缓冲区,返回放入的字节数
+ */
+static int SendChunk(TcpSocket& sock, TsoMode mode, const std::shared_ptr<unsigned char>& chunk,
+    size_t offset)
+{
+    size_t size = BENCH_TSO_CHUNK - offset;
+    if (mode != TSO_MODE_ZEROCOPY)
+        return sock.Send(chunk.get() + offset, size);
+
+    // 和 chunk 共享所有权,指向还没有发送的部分
+    std::shared_ptr<unsigned char> rest(chunk, chunk.get() + offset);
+    return sock.SendZeroCopy(rest, size);
+}
+
+static double RunOnce(VirtualWire& wire, uint16_t port, TsoMode mode, int secs, double& cpu_us_per_mb,
+    uint64_t& retrans, uint64_t& rx_drops)
+{
+    uint32_t ip_a = *reinterpret_cast<uint32_t*>(wire.GetA()->GetNetInfo()->ip);
+    uint32_t ip_b = *reinterpret_cast<uint32_t*>(wire.GetB()->GetNetInfo()->ip);
+    auto listener = TcpListen(ip_b, port);
+    auto client = TcpConnect(ip_a, ip_b, port);
+    if (listener == nullptr || client == nullptr)
+        return -1;
+    std::shared_ptr<TcpSocket> server;
+    for (int i = 0; i < 2000 && (server = listener->Accept()) == nullptr; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (server == nullptr)
+        return -1;
+    client->SetTso(mode != TSO_MODE_OFF);
+
+    // 零拷贝时每一块发送出去之后就不再修改,用新的一块继续发送
+    std::shared_ptr<unsigned char> chunk(new unsigned char[BENCH_TSO_CHUNK](),
+        std::default_delete<unsigned char[]>());
+    size_t offset = 0;
+    static unsigned char buf[64 * 1024];
+    uint64_t received = 0;
+    uint64_t retrans_start = TcpGetStats().retrans_segs;
+    uint64_t drops_start = wire.GetB()->RxQueueDrops();
+    std::clock_t cpu_start = std::clock();
+    auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(secs))
+    {
+        int n;
+        while ((n = SendChunk(*client, mode, chunk, offset)) > 0)
+        {
+            offset += n;
+            if (offset < BENCH_TSO_CHUNK)
+                continue;
+            offset = 0;
+            if (mode == TSO_MODE_ZEROCOPY)
+                chunk.reset(new unsigned char[BENCH_TSO_CHUNK](), std::default_delete<unsigned char[]>());
+        }
+        while ((n = server->Recv(buf, sizeof(buf))) > 0)
+            received += n;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    cpu_us_per_mb = received ? cpu * 1e6 / (received / 1e6) : 0;
+    retrans = TcpGetStats().retrans_segs - retrans_start;
+    rx_drops = wire.GetB()->RxQueueDrops() - drops_start;
+
+    client->Abort();
+    server->Abort();
+    listener->Close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return received * 8 / elapsed / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    int secs = argc > 1 ? atoi(argv[1]) : 3;
+    if (secs <= 0)
+        secs = 3;
+
+    NetInfo a, b;
+    inet_pton(AF_INET, "10.0.1.1", a.ip);
+    inet_pton(AF_INET, "255.255.255.0", a.netmask);
+    inet_pton(AF_INET, "10.0.2.1", b.ip);
+    inet_pton(AF_INET, "255.255.255.0", b.netmask);
+    const uint8_t mac_a[6] = { 0x02, 0, 0, 0, 0x01, 0x01 };
+    const uint8_t mac_b[6] = { 0x02, 0, 0, 0, 0x02, 0x01 };
+    memcpy(a.mac, mac_a, sizeof(mac_a));
+    memcpy(b.mac, mac_b, sizeof(mac_b));
+    a.mtu = b.mtu = 1500;
+    a.is_default_gateway_ = b.is_default_gateway_ = false;
+
+    ThreadPool pool;
+    pool.Start(4);
+    VirtualWire wire(&a, &b);
+    WireLinkOptions link;
+    link.latency_us = 50;
+    wire.GetDriverA()->SetLink(link);
+    wire.GetDriverB()->SetLink(link);
+    Timer* timer = new Timer(TimeEntry({ 0, 1000 }), 512);
+    timer->Start();
+    Ipv4Init(timer);
+    IcmpInit();
+    UdpInit();
+    TcpInit(timer);
+    RecvEventLoop loop(pool);
+    loop.Start();
+
+    uint16_t port = 5001;
+    for (TsoMode mode : { TSO_MODE_OFF, TSO_MODE_ON, TSO_MODE_ZEROCOPY })
+    {
+        double cpu_us_per_mb = 0;
+        uint64_t retrans = 0;
+        uint64_t rx_drops = 0;
+        double mbps = RunOnce(wire, port++, mode, secs, cpu_us_per_mb, retrans, rx_drops);
+        if (mbps < 0)
+        {
+            fprintf(stderr, "connection failed\n");
+            return 1;
+        }
+        printf("%-18s %10.1f Mb/s  %8.0f us cpu/MB  retrans %6lu  rx queue drops %6lu\n", kModeNames[mode],
+            mbps, cpu_us_per_mb, retrans, rx_drops);
+        fflush(stdout);
+    }
+    _exit(0);
+}
@@ -0,0 +1,94 @@
+#include "hdr_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace netstack
+{
+    HdrHistogram::HdrHistogram(uint64_t highest, int significant_digits)
+        : highest_(std::max<uint64_t>(highest, 2))
+    {
+        significant_digits = std::clamp(significant_digits, 1, 5);
+        // 能够区分 10^digits 个值需要的子桶个数(取2的幂)
+        uint64_t largest_single_unit = 2 * static_cast<uint64_t>(std::pow(10, significant_digits));
+        int sub_bucket_count_magnitude = static_cast<int>(std::ceil(std::log2(static_cast<double>(largest_single_unit))));
+        sub_bucket_half_count_magnitude_ = std::max(sub_bucket_count_magnitude, 1) - 1;
+        sub_bucket_count_ = 1ULL << (sub_bucket_half_count_magnitude_ + 1);
+        sub_bucket_half_count_ = sub_bucket_count_ / 2;
+        sub_bucket_mask_ = sub_bucket_count_ - 1;
+
+        // 桶的个数: 最后一个桶要能覆盖 highest_
+        size_t bucket_count = 1;
+        uint64_t smallest_untrackable = sub_bucket_count_;
+        while (smallest_untrackable <= highest_)
+        {
+            if (smallest_untrackable > UINT64_MAX / 2)
+            {
+                bucket_count++;
+                break;
+            }
+            smallest_untrackable <<= 1;
+            bucket_count++;
+        }
+        counts_.assign((bucket_count + 1) * sub_bucket_half_count_, 0);
+    }
+
+    size_t HdrHistogram::CountsIndex(uint64_t value) const
+    {
+        // value 最高位所在的桶,小于 sub_bucket_count_ 的值都在第0个桶
+        int pow2_ceiling = 64 - __builtin_clzll(value | sub_bucket_mask_);
+        int bucket_index = pow2_ceiling - (sub_bucket_half_count_magnitude_ + 1);
+        uint64_t sub_bucket_index = value >> bucket_index;
+        return ((static_cast<size_t>(bucket_index) + 1) << sub_bucket_half_count_magnitude_)
+            + (sub_bucket_index - sub_bucket_half_count_);
+    }
+
+    uint64_t HdrHistogram::HighestEquivalentValue(size_t index) const
+    {
+        int bucket_index = static_cast<int>(index >> sub_bucket_half_count_magnitude_) - 1;
+        uint64_t sub_bucket_index = (index & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+        if (bucket_index < 0)
+        {
+            sub_bucket_index -= sub_bucket_half_count_;
+            bucket_index = 0;
+        }
+        uint64_t lowest = sub_bucket_index << bucket_index;
+        return lowest + (1ULL << bucket_index) - 1;
+    }
+
+    void HdrHistogram::Record(uint64_t value, uint64_t count)
+    {
+        value = std::min(value, highest_);
+        counts_[std::min(CountsIndex(value), counts_.size() - 1)] += count;
+        total_ += count;
+        sum_ += value * count;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void HdrHistogram::Reset()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_ = 0;
+        min_ = UINT64_MAX;
+        max_ = 0;
+        sum_ = 0;
+    }
+
+    uint64_t HdrHistogram::ValueAtPercentile(double percentile) const
+    {
+        if (total_ == 0)
+            return 0;
+        percentile = std::clamp(percentile, 0.0, 100.0);
+        uint64_t target = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(percentile / 100 * total_)), 1);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++)
+        {
+            seen += counts_[i];
+            if (seen >= target)
+                return std::min(HighestEquivalentValue(i), max_);
+        }
+        return max_;
+    }
+}
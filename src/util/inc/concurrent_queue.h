@@ -65,8 +65,8 @@ namespace netstack
         }
 
         std::atomic<size_t> turn_ = { 0 };
-        //typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
-        T storage_;
+        // 只有 turn_ 为奇数时槽中才有对象,由 Construct/Destroy 管理生命周期
+        alignas(T) unsigned char storage_[sizeof(T)];
     };
 
 
@@ -119,7 +119,7 @@ namespace netstack
             while (true)
             {
                 auto& slot = slots_[Index(head)];
-                if (Turn(slot.turn_) * 2 == slot.turn_.load(std::memory_order_acquire))
+                if (Turn(head) * 2 == slot.turn_.load(std::memory_order_acquire))
                 {
                     if (head_.compare_exchange_strong(head, head + 1))
                     {
@@ -0,0 +1,64 @@
+#pragma once
+/*
+    HDR直方图: 在 [1, highest] 的范围内以固定的有效数字精度记录数值(比如纳秒级的延迟),
+    内存大小只和范围、精度有关,记录是O(1)的.
+
+    数值按2的幂分成若干个桶,每个桶再线性地分成 sub_bucket_count 个子桶,
+    所以相对误差不超过 10^-significant_digits. 第一个桶以外每个桶只用后一半子桶
+    (前一半和上一个桶重叠),计数数组的长度是 (bucket_count + 1) * sub_bucket_count / 2.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace netstack
+{
+    class HdrHistogram
+    {
+    public:
+        /**
+         * @brief 构造函数
+         *
+         * @param highest 能记录的最大值,超过的按最大值记录
+         * @param significant_digits 有效数字的位数(1 ~ 5)
+         */
+        explicit HdrHistogram(uint64_t highest = 3600ULL * 1000000000ULL, int significant_digits = 3);
+    public:
+        void Record(uint64_t value, uint64_t count = 1);
+        void Reset();
+
+        /**
+         * @brief 百分位数,返回和结果处在同一个子桶中的最大值
+         *
+         * @param percentile 0 ~ 100
+         * @return uint64_t 没有记录时返回0
+         */
+        uint64_t ValueAtPercentile(double percentile) const;
+
+        uint64_t Count() const
+        { return total_; }
+
+        uint64_t Min() const
+        { return total_ ? min_ : 0; }
+
+        uint64_t Max() const
+        { return max_; }
+
+        double Mean() const
+        { return total_ ? static_cast<double>(sum_) / total_ : 0; }
+    private:
+        size_t CountsIndex(uint64_t value) const;
+        uint64_t HighestEquivalentValue(size_t index) const;
+    private:
+        uint64_t highest_;
+        int sub_bucket_half_count_magnitude_;
+        uint64_t sub_bucket_count_;
+        uint64_t sub_bucket_half_count_;
+        uint64_t sub_bucket_mask_;
+        std::vector<uint64_t> counts_;
+        uint64_t total_ = 0;
+        uint64_t min_ = UINT64_MAX;
+        uint64_t max_ = 0;
+        uint64_t sum_ = 0;
+    };
+}
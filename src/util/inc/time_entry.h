@@ -57,8 +57,8 @@ namespace netstack
         friend TimeEntry operator-(const TimeEntry& lhs, const TimeEntry& rhs)
         {
             long sum = lhs.value_.tv_sec * TIME_BASE_NS + 
-                lhs.value_.tv_usec + rhs.value_.tv_sec * TIME_BASE_NS +
-                rhs.value_.tv_usec;
+                lhs.value_.tv_usec - (rhs.value_.tv_sec * TIME_BASE_NS +
+                rhs.value_.tv_usec);
             timeval ans = { sum / TIME_BASE_NS, sum % TIME_BASE_NS };
             TimeEntry time_ans(ans);
             return time_ans;
@@ -77,7 +77,7 @@ namespace netstack
 
         friend TimeEntry operator%(const TimeEntry& lhs, const TimeEntry& rhs)
         {
-            long lsum = lhs.value_.tv_sec * TIME_BASE_NS + rhs.value_.tv_usec;
+            long lsum = lhs.value_.tv_sec * TIME_BASE_NS + lhs.value_.tv_usec;
             long rsum = rhs.value_.tv_sec * TIME_BASE_NS + rhs.value_.tv_usec;
             timeval ans = { lsum % rsum / TIME_BASE_NS, lsum % rsum % TIME_BASE_NS };
             TimeEntry time_ans(ans);
@@ -101,7 +101,7 @@ namespace netstack
 
         friend bool operator<(const TimeEntry& lhs, const TimeEntry& rhs)
         {
-            long lsum = lhs.value_.tv_sec * TIME_BASE_NS + rhs.value_.tv_usec;
+            long lsum = lhs.value_.tv_sec * TIME_BASE_NS + lhs.value_.tv_usec;
             long rsum = rhs.value_.tv_sec * TIME_BASE_NS + rhs.value_.tv_usec;
             return lsum < rsum;
         }
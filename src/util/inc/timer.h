@@ -46,6 +46,21 @@ namespace netstack
         */
         void AddTimerTaskEntry(TimerTaskEntry* timer_task_entry);
 
+        /**
+        * @brief 设置(或者重新设置)定时器槽在 delay_time 之后到期,不分配内存
+        * 
+        * @param slot 
+        * @param delay_time 
+        */
+        void Arm(TimerSlot* slot, TimeEntry delay_time);
+
+        /**
+        * @brief 取消定时器槽. 已经提交到线程池的回调仍然会执行,由 TimerSlot::Fired 过滤
+        * 
+        * @param slot 
+        */
+        void Cancel(TimerSlot* slot);
+
         /**
         * @brief 添加延迟任务
         * 
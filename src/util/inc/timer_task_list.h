@@ -15,6 +15,7 @@ namespace netstack
     class TimerTaskEntry;
     class TimerTask;
     class TimerTaskList;
+    class TimerSlot;
     class Timer;
 
     // 定时任务
@@ -53,7 +54,7 @@ namespace netstack
             if (next_ != nullptr)
                 next_ = nullptr;
 
-            if (timer_task_ != nullptr)
+            if (timer_task_ != nullptr && slot_ == nullptr)
             {
                 delete timer_task_;
                 timer_task_ = nullptr;
@@ -94,6 +95,55 @@ namespace netstack
 
         TimerTask* timer_task_ = nullptr;   // 定时任务
         TimeEntry expiration_;              // 超时时间
+        TimerSlot* slot_ = nullptr;         // 嵌入在 TimerSlot 中的条目,到期后不释放
+    };
+
+
+    /*
+        可以重复设置的定时器槽,嵌入在使用者的对象中(比如每个tcp连接的重传定时器).
+        任务和条目只在构造时创建一次,之后 Timer::Arm/Cancel 只是把条目从时间轮的桶中摘下、
+        再挂到新的桶上,都是O(1)而且不分配内存. 
+        到期的回调被提交到线程池后,使用者可能已经重新设置或者取消了定时器,
+        所以回调中要在使用者自己的锁内调用 Fired() 确认这次到期仍然有效.
+     */
+    class TimerSlot
+    {
+        friend class Timer;
+    public:
+        template <typename Func>
+        explicit TimerSlot(Func func)
+            : task_(func), entry_(&task_, TimeEntry())
+        {
+            entry_.slot_ = this;
+        }
+        ~TimerSlot();
+
+        TimerSlot(const TimerSlot&) = delete;
+        TimerSlot& operator=(const TimerSlot&) = delete;
+    public:
+        /**
+        * @brief 已经设置并且还没有被取消或者确认到期
+        * 
+        * @return true 
+        * @return false 
+        */
+        bool Armed() const
+        { return armed_; }
+
+        /**
+        * @brief 在回调中确认这次到期有效,之后 Armed() 返回false
+        * 
+        * @return true 到期之后没有被重新设置或者取消
+        * @return false 
+        */
+        bool Fired();
+    private:
+        TimerTask task_;
+        TimerTaskEntry entry_;
+        Timer* timer_ = nullptr;            // 最近一次设置时使用的定时器
+        bool armed_ = false;
+        std::atomic<uint64_t> gen_ = 0;     // 每次设置、取消时递增
+        std::atomic<uint64_t> fire_gen_ = ~0ULL;    // 到期时的 gen_
     };
 
 
@@ -112,7 +162,8 @@ namespace netstack
             while (itd->next_ != nullptr && itd != root_.get())
             {
                 itn = itd->next_;
-                delete itd;
+                if (itd->slot_ == nullptr)  // 槽中的条目属于使用者
+                    delete itd;
                 itd = itn;
             }
             
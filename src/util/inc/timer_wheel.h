@@ -55,6 +55,6 @@ namespace netstack
         std::shared_ptr<std::atomic<int>> task_counter_;    // 任务计数器
         std::shared_ptr<DelayQueue<TimerTaskList>> queue_;  // 延迟队列,存放即将触发的任务列表
         std::vector<TimerTaskList> buckets_;                // 存放时间轮中的事件槽(桶),每个桶存储一定事件范围内的任务列表
-        static TimerWheel* overflow_wheel_;    // 溢出时间的时间轮,当任务事件超过当前事件的范围时,任务会放到这个溢出时间轮中
+        TimerWheel* overflow_wheel_ = nullptr;  // 溢出时间的时间轮,当任务事件超过当前事件的范围时,任务会放到这个溢出时间轮中
     };
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "threadpool.h"
 #include <memory>
+#include <vector>
 #include <spdlog/spdlog.h>
 
 
@@ -80,16 +81,19 @@ namespace netstack
     {
         running_ = true;
         init_thread_cnt_ = curr_thread_cnt_ = init_thread_cnt;
+        // 线程id是全局递增的,进程中已经有其他线程池(比如定时器的)时不是从0开始
+        std::vector<int> thread_ids;
         for (int i = 0; i < init_thread_cnt_; i++)
         {
             auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::ThreadFunc, this, 
                 std::placeholders::_1));
             int threadId = ptr->GetId();
             threads_.emplace(threadId, std::move(ptr));
+            thread_ids.push_back(threadId);
         }
-        for (int i = 0; i < init_thread_cnt_; i++)
+        for (int threadId : thread_ids)
         {
-            threads_[i]->Start();
+            threads_[threadId]->Start();
             idle_thread_cnt_++;
         }
     }
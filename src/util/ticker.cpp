@@ -35,10 +35,12 @@ namespace netstack
         {
             // 获取滴答的时间
             timeval tick_interval = tick_interval_.GetTimeval();
+            // timeval的单位是微秒,nanosleep需要纳秒
+            struct timespec tick_ts = { tick_interval.tv_sec, tick_interval.tv_usec * 1000 };
 
             // 下面开始定时睡眠, 
             // TODO: 此处需要忽略一些信号,以免打乱定时睡眠
-            nanosleep((const struct timespec*)&tick_interval, nullptr);
+            nanosleep(&tick_ts, nullptr);
 
             // 滴答走完,将时间轮的指针向后走一格
             timer_obj_->AdvanceClock();
@@ -51,6 +51,29 @@ namespace netstack
         AddTimerTaskEntry(new TimerTaskEntry(timer_task, expiration));
     }
 
+    void Timer::Arm(TimerSlot* slot, TimeEntry delay_time)
+    {
+        TimeEntry now;
+        now.GetTimeofday();
+
+        std::shared_lock<std::shared_mutex> lock(rw_mutex_);
+        slot->entry_.Remove();  // 从原来的桶中摘下
+        slot->gen_.fetch_add(1, std::memory_order_release);
+        slot->timer_ = this;
+        slot->armed_ = true;
+        slot->entry_.expiration_ = now + delay_time;
+        AddTimerTaskEntry(&slot->entry_);
+    }
+
+    void Timer::Cancel(TimerSlot* slot)
+    {
+        // 持有读锁,不会和正在推进时间轮的线程同时访问条目
+        std::shared_lock<std::shared_mutex> lock(rw_mutex_);
+        slot->entry_.Remove();
+        slot->gen_.fetch_add(1, std::memory_order_release);
+        slot->armed_ = false;
+    }
+
     /**
     * @brief 添加定时任务到时间轮中
     * 
@@ -67,10 +90,13 @@ namespace netstack
 
                 // 则下面将任务提交到线程池中
                 TimerTask* timer_task = timer_task_entry->GetTimerTask();
-                auto fn = timer_task->GetFunc();
-                fn();
+                TimerSlot* slot = timer_task_entry->slot_;
+                if (slot)   // 记录到期时的编号,回调中用来判断是否已经被重新设置
+                    slot->fire_gen_.store(slot->gen_.load(std::memory_order_relaxed),
+                        std::memory_order_release);
                 threadpool_->SubmitTask(timer_task->GetFunc());
-                delete timer_task_entry;
+                if (slot == nullptr)
+                    delete timer_task_entry;
             }
         }
     }
@@ -91,6 +91,23 @@ namespace netstack
 
 
 
+    ////////////////////////////////////////////////// TimerSlot
+    TimerSlot::~TimerSlot()
+    {
+        if (timer_)
+            timer_->Cancel(this);
+    }
+
+    bool TimerSlot::Fired()
+    {
+        if (!armed_ || fire_gen_.load(std::memory_order_acquire) != gen_.load(std::memory_order_relaxed))
+            return false;
+        armed_ = false;
+        return true;
+    }
+
+
+
     ////////////////////////////////////////////////// TimerTaskList
     TimerTaskList::TimerTaskList() {}
 
@@ -5,16 +5,16 @@
 
 namespace netstack 
 {
-    TimerWheel* TimerWheel::overflow_wheel_ = nullptr;
-
     TimerWheel::TimerWheel(TimeEntry tick_ms, int wheel_size, TimeEntry start_ms,
             std::shared_ptr<std::atomic<int>> task_counter,
             std::shared_ptr<DelayQueue<TimerTaskList>> queue)
         : tick_ms_(tick_ms), wheel_size_(wheel_size),
         task_counter_(task_counter), queue_(queue)
     {
-        // 初始化用于时间轮的桶
-        buckets_.resize(wheel_size, TimerTaskList(task_counter));
+        // 初始化用于时间轮的桶. 每个桶单独构造(拷贝构造会共享同一个链表)
+        buckets_.reserve(wheel_size);
+        for (int i = 0; i < wheel_size; i++)
+            buckets_.emplace_back(task_counter);
 
         // 时间轮转一圈的时间
         interval_ = tick_ms * wheel_size;
@@ -37,12 +37,11 @@ namespace netstack
     */
     void TimerWheel::AdvanceClock(TimeEntry time_ms)
     {
-        TimerWheel* curr_wheel = this;
-        while (time_ms >= (curr_time_ms_ + tick_ms_))
+        if (time_ms >= (curr_time_ms_ + tick_ms_))
         {
             curr_time_ms_ = time_ms - (time_ms % tick_ms_);
-            if (overflow_wheel_ == nullptr)
-                break;
+            if (overflow_wheel_ != nullptr)
+                overflow_wheel_->AdvanceClock(curr_time_ms_);
         }
     }
 
@@ -58,42 +57,25 @@ namespace netstack
     bool TimerWheel::Add(TimerTaskEntry* timer_task_entry)
     {
         TimeEntry expiration = timer_task_entry->GetExpiration();
-        // 如果当前定时任务被取消或者该任务已经超时了,那么返回false
+        // 如果当前定时任务被取消或者该任务已经到期了,那么返回false,由调用者执行
         if (timer_task_entry->Cancelled() || expiration < (curr_time_ms_ + tick_ms_))
-        {
-            printf("添加任务到时间轮失败\n");
             return false;
-        }
 
-        while (true)
+        if (expiration < (curr_time_ms_ + interval_))
         {
-            if (expiration < (curr_time_ms_ + interval_))
-            {
-                long virtual_id = expiration / tick_ms_;
-                TimerTaskList& bucket = buckets_.at(virtual_id % wheel_size_);
-                bucket.Add(timer_task_entry);
+            long virtual_id = expiration / tick_ms_;
+            TimerTaskList& bucket = buckets_.at(virtual_id % wheel_size_);
+            bucket.Add(timer_task_entry);
 
-                if (bucket.SetExpiration(tick_ms_ * virtual_id))
-                    queue_->Offer(&bucket, expiration);
+            if (bucket.SetExpiration(tick_ms_ * virtual_id))
+                queue_->Offer(&bucket, expiration);
 
-                return true;
-            }
-            else 
-            {
-                std::unique_lock<std::mutex> lock(mutex_);
-                if (overflow_wheel_ == nullptr)
-                {
-                    overflow_wheel_ = new TimerWheel(
-                        interval_,
-                        wheel_size_,
-                        curr_time_ms_,
-                        task_counter_,
-                        queue_
-                    );
-                }
-            }
+            return true;
         }
-        return true;
+
+        // 超出当前时间轮的范围,交给溢出时间轮
+        AddOverflowWheel();
+        return overflow_wheel_->Add(timer_task_entry);
     }
 
 
@@ -45,8 +45,9 @@ namespace netstack
 
     uint16_t GetRandomNum()
     {
-        std::random_device device;
-        std::mt19937 generator(device());
+        // 每次构造 random_device 和重新播种要二十多微秒,每个ipv4数据报都会调用,
+        // 所以每个线程只播种一次
+        thread_local std::mt19937 generator(std::random_device{}());
         uint16_t max_num = std::numeric_limits<uint16_t>::max();
         std::uniform_int_distribution<uint16_t> distribution(0, max_num);
         return distribution(generator);